@@ -0,0 +1,214 @@
+/*
+ * Batch PMDA for testing the pmdaFetch batch callback
+ *
+ * Copyright (c) 2026 Red Hat.
+ */
+
+#include <pcp/pmapi.h>
+#include <pcp/pmda.h>
+#include "domain.h"
+
+/*
+ * Batch PMDA
+ *
+ * Metrics over a five instance indom, each exercising one path
+ * through pmdaFetch with a pmdaFetchBatchCallBack registered.
+ *
+ *	batch.values		- all instances from the batch callback
+ *	batch.fallback		- batch callback returns PM_ERR_NYI, so
+ *				  values come from the per-instance callback
+ *	batch.partial		- batch callback with an error for one
+ *				  instance and no value for another
+ *	batch.string		- dynamically allocated string values
+ *	batch.single		- singular metric via the batch callback
+ *	batch.fail		- batch callback fails for the whole metric
+ *	batch.calls.batch	- successful batch callback calls so far
+ *	batch.calls.single	- per-instance callback calls so far, not
+ *				  counting the batch.calls metrics
+ */
+
+static pmdaInstid insts[] = {
+    { 0, "zero" }, { 1, "one" }, { 2, "two" }, { 3, "three" }, { 4, "four" }
+};
+
+static pmdaIndom indomtab[] = {
+#define BATCH_INDOM	0
+    { BATCH_INDOM, sizeof(insts)/sizeof(insts[0]), insts }
+};
+
+static pmdaMetric metrictab[] = {
+/* values */
+    { NULL,
+      { PMDA_PMID(0,0), PM_TYPE_U32, BATCH_INDOM, PM_SEM_INSTANT,
+	PMDA_PMUNITS(0,0,0,0,0,0) }, },
+/* fallback */
+    { NULL,
+      { PMDA_PMID(0,1), PM_TYPE_U32, BATCH_INDOM, PM_SEM_INSTANT,
+	PMDA_PMUNITS(0,0,0,0,0,0) }, },
+/* partial */
+    { NULL,
+      { PMDA_PMID(0,2), PM_TYPE_U32, BATCH_INDOM, PM_SEM_INSTANT,
+	PMDA_PMUNITS(0,0,0,0,0,0) }, },
+/* string */
+    { NULL,
+      { PMDA_PMID(0,3), PM_TYPE_STRING, BATCH_INDOM, PM_SEM_DISCRETE,
+	PMDA_PMUNITS(0,0,0,0,0,0) }, },
+/* single */
+    { NULL,
+      { PMDA_PMID(0,4), PM_TYPE_U32, PM_INDOM_NULL, PM_SEM_INSTANT,
+	PMDA_PMUNITS(0,0,0,0,0,0) }, },
+/* fail */
+    { NULL,
+      { PMDA_PMID(0,5), PM_TYPE_U32, BATCH_INDOM, PM_SEM_INSTANT,
+	PMDA_PMUNITS(0,0,0,0,0,0) }, },
+/* calls.batch */
+    { NULL,
+      { PMDA_PMID(1,0), PM_TYPE_U32, PM_INDOM_NULL, PM_SEM_COUNTER,
+	PMDA_PMUNITS(0,0,1,0,0,PM_COUNT_ONE) }, },
+/* calls.single */
+    { NULL,
+      { PMDA_PMID(1,1), PM_TYPE_U32, PM_INDOM_NULL, PM_SEM_COUNTER,
+	PMDA_PMUNITS(0,0,1,0,0,PM_COUNT_ONE) }, },
+};
+
+static unsigned int	batch_calls;
+static unsigned int	single_calls;
+static char		*username;
+
+/*
+ * per-instance callback - values here are distinct from those of the
+ * batch callback, so the output shows which callback supplied them
+ */
+static int
+batch_fetchCallBack(pmdaMetric *mdesc, unsigned int inst, pmAtomValue *atom)
+{
+    unsigned int	cluster = pmID_cluster(mdesc->m_desc.pmid);
+    unsigned int	item = pmID_item(mdesc->m_desc.pmid);
+
+    if (cluster == 1) {
+	if (item == 0)
+	    atom->ul = batch_calls;
+	else if (item == 1)
+	    atom->ul = single_calls;
+	else
+	    return PM_ERR_PMID;
+	return PMDA_FETCH_STATIC;
+    }
+    if (cluster != 0 || item > 5)
+	return PM_ERR_PMID;
+
+    single_calls++;
+    if (item == 3) {
+	atom->cp = "single";
+	return PMDA_FETCH_STATIC;
+    }
+    atom->ul = 900 + inst;
+    return PMDA_FETCH_STATIC;
+}
+
+static int
+batch_fetchBatchCallBack(pmdaMetric *mdesc, int numinst,
+		const unsigned int *instlist, pmAtomValue *avp, int *sts)
+{
+    unsigned int	cluster = pmID_cluster(mdesc->m_desc.pmid);
+    unsigned int	item = pmID_item(mdesc->m_desc.pmid);
+    char		buf[32];
+    int			i;
+
+    if (cluster != 0 || item == 1)
+	return PM_ERR_NYI;
+    if (item == 5)
+	return PM_ERR_PERMISSION;
+
+    for (i = 0; i < numinst; i++) {
+	sts[i] = PMDA_FETCH_STATIC;
+	switch (item) {
+	    case 0:
+		avp[i].ul = 100 + instlist[i];
+		break;
+	    case 2:
+		if (instlist[i] == 1)
+		    sts[i] = PM_ERR_AGAIN;
+		else if (instlist[i] == 3)
+		    sts[i] = PMDA_FETCH_NOVALUES;
+		else
+		    avp[i].ul = 300 + instlist[i];
+		break;
+	    case 3:
+		pmsprintf(buf, sizeof(buf), "batch-%s", insts[instlist[i]].i_name);
+		if ((avp[i].cp = strdup(buf)) == NULL)
+		    sts[i] = -oserror();
+		else
+		    sts[i] = PMDA_FETCH_DYNAMIC;
+		break;
+	    case 4:
+		avp[i].ul = 400;
+		break;
+	    default:
+		return PM_ERR_PMID;
+	}
+    }
+    batch_calls++;
+    return 0;
+}
+
+/*
+ * Initialise the agent.
+ */
+void
+batch_init(pmdaInterface *dp)
+{
+    if (dp->status != 0)
+	return;
+
+    pmdaSetFetchCallBack(dp, batch_fetchCallBack);
+    pmdaSetFetchBatchCallBack(dp, batch_fetchBatchCallBack);
+
+    pmdaInit(dp, indomtab, sizeof(indomtab)/sizeof(indomtab[0]),
+	     metrictab, sizeof(metrictab)/sizeof(metrictab[0]));
+}
+
+static pmdaOptions opts = {
+    .short_options = "D:d:l:U:?",
+    .long_options = (pmLongOptions[]) {
+	PMDA_OPTIONS_HEADER("Options"),
+	PMOPT_DEBUG,
+	PMDAOPT_DOMAIN,
+	PMDAOPT_LOGFILE,
+	PMDAOPT_USERNAME,
+	PMOPT_HELP,
+	PMDA_OPTIONS_END
+    },
+};
+
+int
+main(int argc, char **argv)
+{
+    int			sep = pmPathSeparator();
+    pmdaInterface	dispatch;
+    char		helppath[MAXPATHLEN];
+
+    pmSetProgname(argv[0]);
+    pmGetUsername(&username);
+    pmsprintf(helppath, sizeof(helppath),
+		"%s%c" "testsuite" "%c" "pmdas" "%c" "batch" "%c" "help",
+		pmGetConfig("PCP_VAR_DIR"), sep, sep, sep, sep);
+    pmdaDaemon(&dispatch, PMDA_INTERFACE_7, pmGetProgname(), BATCH,
+		"batch.log", helppath);
+
+    pmdaGetOptions(argc, argv, &opts, &dispatch);
+    if (opts.errors) {
+	pmdaUsageMessage(&opts);
+	exit(1);
+    }
+    if (opts.username)
+	username = opts.username;
+
+    pmdaOpenLog(&dispatch);
+    pmSetProcessIdentity(username);
+    batch_init(&dispatch);
+    pmdaConnect(&dispatch);
+    pmdaMain(&dispatch);
+
+    exit(0);
+}
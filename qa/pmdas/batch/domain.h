@@ -0,0 +1 @@
+#define BATCH 252
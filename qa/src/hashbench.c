@@ -0,0 +1,201 @@
+/*
+ * Copyright (c) 2026 Red Hat.
+ *
+ * Microbenchmark for the libpcp __pmHash* routines, using key
+ * distributions like those seen in archive metadata: PMIDs (domain,
+ * cluster and item bit fields) and instance identifiers (small dense
+ * integers, or sparse ones like PIDs).
+ *
+ * Without -v only the (deterministic) verification results are
+ * reported, so this doubles as a functional test.
+ */
+
+#include <pcp/pmapi.h>
+#include "libpcp.h"
+
+static double
+tv_sub(struct timeval *a, struct timeval *b)
+{
+    return (double)(a->tv_sec - b->tv_sec) +
+	   (double)(a->tv_usec - b->tv_usec) / 1000000.0;
+}
+
+static int	vflag;
+
+static void
+report(const char *what, int ops, struct timeval *start)
+{
+    struct timeval	end;
+    double		secs;
+
+    gettimeofday(&end, NULL);
+    secs = tv_sub(&end, start);
+    if (vflag)
+	printf("%-10s %9d ops %8.3f msec %7.1f nsec/op\n", what, ops,
+		secs * 1000.0, ops ? secs * 1000000000.0 / ops : 0.0);
+    gettimeofday(start, NULL);
+}
+
+static __pmHashWalkState
+counter(const __pmHashNode *hp, void *arg)
+{
+    (*(int *)arg)++;
+    (void)hp;
+    return PM_HASH_WALK_NEXT;
+}
+
+static unsigned int
+makekey(char type, int i)
+{
+    switch (type) {
+    case 'p':	/* PMIDs ... 60 domains, 16 clusters, up to 1024 items */
+	return pmID_build(1 + i % 60, (i / 60) % 16, i / (60 * 16));
+    case 's':	/* sparse instances, like PIDs */
+	return (unsigned int)i * 7919 + 300;
+    case 'i':	/* dense instances */
+    default:
+	return (unsigned int)i;
+    }
+}
+
+int
+main(int argc, char **argv)
+{
+    int		c;
+    int		i, r, n = 100000;
+    int		rounds = 1;
+    int		errflag = 0;
+    int		found, missed, walked;
+    char	type = 'p';
+    char	*endnum;
+    unsigned int	*keys;
+    __pmHashCtl	hc;
+    __pmHashNode	*hp;
+    struct timeval	start;
+    static char	*usage = "[-k p|i|s] [-n nkeys] [-r rounds] [-v]";
+
+    pmSetProgname(argv[0]);
+
+    while ((c = getopt(argc, argv, "k:n:r:v")) != EOF) {
+	switch (c) {
+
+	case 'k':	/* key type: PMIDs, dense or sparse instances */
+	    type = optarg[0];
+	    if (strchr("pis", type) == NULL || optarg[1] != '\0') {
+		fprintf(stderr, "%s: -k requires p, i or s\n", pmGetProgname());
+		errflag++;
+	    }
+	    break;
+
+	case 'n':	/* number of keys */
+	    n = (int)strtol(optarg, &endnum, 10);
+	    if (*endnum != '\0' || n <= 0) {
+		fprintf(stderr, "%s: -n requires a positive numeric argument\n", pmGetProgname());
+		errflag++;
+	    }
+	    break;
+
+	case 'r':	/* lookup rounds */
+	    rounds = (int)strtol(optarg, &endnum, 10);
+	    if (*endnum != '\0' || rounds <= 0) {
+		fprintf(stderr, "%s: -r requires a positive numeric argument\n", pmGetProgname());
+		errflag++;
+	    }
+	    break;
+
+	case 'v':	/* verbose, report timings */
+	    vflag++;
+	    break;
+
+	case '?':
+	default:
+	    errflag++;
+	    break;
+	}
+    }
+
+    if (errflag || optind != argc) {
+	fprintf(stderr, "Usage: %s %s\n", pmGetProgname(), usage);
+	exit(1);
+    }
+
+    if ((keys = (unsigned int *)malloc(n * sizeof(unsigned int))) == NULL) {
+	perror("malloc");
+	exit(1);
+    }
+    for (i = 0; i < n; i++)
+	keys[i] = makekey(type, i);
+    /* shuffle (deterministically), so lookups are not in insert order */
+    srandom(42);
+    for (i = n - 1; i > 0; i--) {
+	unsigned int	tmp;
+
+	r = random() % (i + 1);
+	tmp = keys[i];
+	keys[i] = keys[r];
+	keys[r] = tmp;
+    }
+
+    __pmHashInit(&hc);
+    gettimeofday(&start, NULL);
+    for (i = 0; i < n; i++) {
+	if (__pmHashAdd(keys[i], (void *)&keys[i], &hc) < 0) {
+	    fprintf(stderr, "__pmHashAdd failed at %d\n", i);
+	    exit(1);
+	}
+    }
+    report("insert", n, &start);
+
+    found = 0;
+    for (r = 0; r < rounds; r++) {
+	for (i = n - 1; i >= 0; i--) {
+	    if ((hp = __pmHashSearch(keys[i], &hc)) != NULL &&
+		hp->data == (void *)&keys[i])
+		found++;
+	}
+    }
+    report("lookup", n * rounds, &start);
+
+    missed = 0;
+    for (r = 0; r < rounds; r++) {
+	for (i = 0; i < n; i++) {
+	    /* keys never added: bit 31 is unused by all key types here */
+	    if (__pmHashSearch(keys[i] | 0x80000000, &hc) == NULL)
+		missed++;
+	}
+    }
+    report("miss", n * rounds, &start);
+
+    walked = 0;
+    for (hp = __pmHashWalk(&hc, PM_HASH_WALK_START); hp != NULL;
+	 hp = __pmHashWalk(&hc, PM_HASH_WALK_NEXT))
+	walked++;
+    report("walk", walked, &start);
+
+    i = 0;
+    __pmHashWalkCB(counter, &i, &hc);
+    report("walkcb", i, &start);
+
+    printf("%d keys: inserted %d\n", n, hc.nodes);
+    printf("%d keys: found %d, missed %d\n", n, found / rounds, missed / rounds);
+    printf("%d keys: walked %d and %d\n", n, walked, i);
+
+    /* delete half, then check only the other half remains */
+    for (i = 0; i < n; i += 2) {
+	if (__pmHashDel(keys[i], (void *)&keys[i], &hc) != 1) {
+	    fprintf(stderr, "__pmHashDel failed at %d\n", i);
+	    exit(1);
+	}
+    }
+    report("delete", (n + 1) / 2, &start);
+    for (found = 0, i = 0; i < n; i++) {
+	hp = __pmHashSearch(keys[i], &hc);
+	if ((i % 2 == 0 && hp == NULL) || (i % 2 == 1 && hp != NULL))
+	    found++;
+    }
+    printf("%d keys: %d remain, %d correct after deletes\n", n, hc.nodes, found);
+
+    __pmHashFree(&hc);
+    free(keys);
+    return 0;
+}
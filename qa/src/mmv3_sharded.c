@@ -0,0 +1,170 @@
+/*
+ * Copyright (c) 2026 Red Hat.
+ *
+ * Exercise MMV v3 sharded metrics - several threads update the same
+ * values concurrently, with no locking, and none of the updates may
+ * be lost when the shards are summed (by mmvdump or pmdammv).
+ */
+
+#include <pcp/pmapi.h>
+#include <pcp/mmv_stats.h>
+#include <pthread.h>
+
+static mmv_instances2_t instances[] = {
+    {  0, "down" },
+    {  1, "up" },
+    {  2, "set" },
+};
+
+static pmUnits	countunits = MMV_UNITS(0,0,1,0,0,PM_COUNT_ONE);
+static pmUnits	nounits = MMV_UNITS(0,0,0,0,0,0);
+
+static void	*map;
+static int	iterations = 100000;
+static pmAtomValue	*counter, *down, *up, *set;
+
+static void *
+worker(void *arg)
+{
+    int		i;
+
+    for (i = 0; i < iterations; i++) {
+	mmv_inc(map, counter);
+	mmv_inc_value(map, down, -1);
+	mmv_inc_value(map, up, 2);
+	mmv_inc(map, set);
+    }
+    return arg;
+}
+
+static double
+tv_sub(struct timeval *a, struct timeval *b)
+{
+    return (double)(a->tv_sec - b->tv_sec) +
+	   (double)(a->tv_usec - b->tv_usec) / 1000000.0;
+}
+
+int
+main(int argc, char **argv)
+{
+    int			c, i;
+    int			errflag = 0;
+    int			nthreads = 4;
+    int			vflag = 0;
+    char		*endnum;
+    char		*file;
+    pthread_t		*threads;
+    pmAtomValue		*plain;
+    mmv_registry_t	*registry;
+    struct timeval	start, end;
+    static char		*usage = "[-n iterations] [-t threads] [-v] file";
+
+    pmSetProgname(argv[0]);
+
+    while ((c = getopt(argc, argv, "n:t:v")) != EOF) {
+	switch (c) {
+
+	case 'n':	/* updates per thread */
+	    iterations = (int)strtol(optarg, &endnum, 10);
+	    if (*endnum != '\0' || iterations <= 0) {
+		fprintf(stderr, "%s: -n requires a positive numeric argument\n", pmGetProgname());
+		errflag++;
+	    }
+	    break;
+
+	case 't':	/* number of updating threads */
+	    nthreads = (int)strtol(optarg, &endnum, 10);
+	    if (*endnum != '\0' || nthreads <= 0) {
+		fprintf(stderr, "%s: -t requires a positive numeric argument\n", pmGetProgname());
+		errflag++;
+	    }
+	    break;
+
+	case 'v':	/* verbose, report timings */
+	    vflag++;
+	    break;
+
+	case '?':
+	default:
+	    errflag++;
+	    break;
+	}
+    }
+
+    if (errflag || optind != argc - 1) {
+	fprintf(stderr, "Usage: %s %s\n", pmGetProgname(), usage);
+	exit(1);
+    }
+    file = argv[optind];
+
+    if ((registry = mmv_stats_registry(file, 333, 0)) == NULL) {
+	fprintf(stderr, "mmv_stats_registry: %s - %s\n", file, strerror(errno));
+	exit(1);
+    }
+    mmv_stats_add_indom(registry, 1, "sharded instances", NULL);
+    for (i = 0; i < sizeof(instances) / sizeof(instances[0]); i++)
+	mmv_stats_add_instance(registry, 1,
+			instances[i].internal, instances[i].external);
+
+    if (mmv_stats_add_sharded_metric(registry, "counter", 1,
+			MMV_TYPE_U64, MMV_SEM_COUNTER,
+			countunits, 0,
+			"sharded counter", NULL) < 0 ||
+	mmv_stats_add_sharded_metric(registry, "gauge", 2,
+			MMV_TYPE_I32, MMV_SEM_INSTANT,
+			countunits, 1,
+			"sharded gauge", NULL) < 0 ||
+	mmv_stats_add_metric(registry, "plain", 3,
+			MMV_TYPE_U64, MMV_SEM_COUNTER,
+			countunits, 0,
+			"unsharded counter", NULL) < 0) {
+	fprintf(stderr, "mmv_stats_add_metric: %s - %s\n", file, strerror(errno));
+	exit(1);
+    }
+    /* only integer types can be sharded */
+    if (mmv_stats_add_sharded_metric(registry, "double", 4,
+			MMV_TYPE_DOUBLE, MMV_SEM_INSTANT,
+			nounits, 0, NULL, NULL) == 0)
+	fprintf(stderr, "mmv_stats_add_sharded_metric: double accepted\n");
+
+    if ((map = mmv_stats_start(registry)) == NULL) {
+	fprintf(stderr, "mmv_stats_start: %s - %s\n", file, strerror(errno));
+	exit(1);
+    }
+    counter = mmv_lookup_value_desc(map, "counter", NULL);
+    down = mmv_lookup_value_desc(map, "gauge", "down");
+    up = mmv_lookup_value_desc(map, "gauge", "up");
+    set = mmv_lookup_value_desc(map, "gauge", "set");
+    plain = mmv_lookup_value_desc(map, "plain", NULL);
+    if (!counter || !down || !up || !set || !plain) {
+	fprintf(stderr, "mmv_lookup_value_desc: %s - failed\n", file);
+	exit(1);
+    }
+
+    if ((threads = calloc(nthreads, sizeof(pthread_t))) == NULL) {
+	perror("calloc");
+	exit(1);
+    }
+    gettimeofday(&start, NULL);
+    for (i = 0; i < nthreads; i++) {
+	if (pthread_create(&threads[i], NULL, worker, NULL) != 0) {
+	    fprintf(stderr, "pthread_create: %s\n", strerror(errno));
+	    exit(1);
+	}
+    }
+    for (i = 0; i < nthreads; i++)
+	pthread_join(threads[i], NULL);
+    gettimeofday(&end, NULL);
+    if (vflag)
+	printf("%d threads: %.1f nsec/update\n", nthreads,
+		tv_sub(&end, &start) * 1000000000.0 / ((double)iterations * 4));
+
+    /* expected results, in the unsharded metric */
+    mmv_set_value(map, plain, (double)nthreads * iterations);
+    /* overwrite all shards of one sharded value */
+    mmv_set_value(map, set, 42);
+
+    free(threads);
+    mmv_stats_free(registry);
+    return 0;
+}
@@ -0,0 +1,220 @@
+/*
+ * Copyright (c) 2026 Red Hat.
+ *
+ * Scaling exerciser for pmdammv value lookups - create an MMV file with
+ * many metrics over one large instance domain, then (optionally) fetch
+ * every value of every metric via pmcd, checking each value and timing
+ * the fetches as the number of values in the mapping grows.
+ */
+
+#include <pcp/pmapi.h>
+#include <pcp/mmv_stats.h>
+
+static pmUnits	countunits = MMV_UNITS(0,0,1,0,0,PM_COUNT_ONE);
+
+static double
+tv_sub(struct timeval *a, struct timeval *b)
+{
+    return (double)(a->tv_sec - b->tv_sec) +
+	   (double)(a->tv_usec - b->tv_usec) / 1000000.0;
+}
+
+/* expected value for (metric, instance) */
+#define EXPECT(m,i)	((__uint64_t)(m) * 100000 + (i))
+
+/*
+ * Fetch all values of all metrics via pmcd (and pmdammv), checking
+ * each value, and report the average time per fetch if asked.
+ */
+static void
+fetch(const char *file, char *host, int nmetrics, int iterations, int vflag)
+{
+    int			c, i, m, sts;
+    int			nvalues, bad;
+    char		name[64];
+    char		**names;
+    pmID		*pmids;
+    pmResult		*rp;
+    struct timeval	start, end;
+
+    if ((sts = pmNewContext(PM_CONTEXT_HOST, host)) < 0) {
+	fprintf(stderr, "pmNewContext(%s): %s\n", host, pmErrStr(sts));
+	exit(1);
+    }
+    names = (char **)calloc(nmetrics, sizeof(char *));
+    pmids = (pmID *)calloc(nmetrics, sizeof(pmID));
+    if (names == NULL || pmids == NULL) {
+	perror("calloc");
+	exit(1);
+    }
+    for (m = 0; m < nmetrics; m++) {
+	pmsprintf(name, sizeof(name), "mmv.%s.m%d", file, m);
+	names[m] = strdup(name);
+    }
+    if ((sts = pmLookupName(nmetrics, (const char **)names, pmids)) != nmetrics) {
+	fprintf(stderr, "pmLookupName: %s\n",
+		sts < 0 ? pmErrStr(sts) : "some metric names not found");
+	exit(1);
+    }
+
+    nvalues = bad = 0;
+    gettimeofday(&start, NULL);
+    for (c = 0; c < iterations; c++) {
+	if ((sts = pmFetch(nmetrics, pmids, &rp)) < 0) {
+	    fprintf(stderr, "pmFetch: %s\n", pmErrStr(sts));
+	    exit(1);
+	}
+	for (m = 0; m < rp->numpmid; m++) {
+	    pmValueSet	*vsp = rp->vset[m];
+
+	    for (i = 0; i < vsp->numval; i++) {
+		pmAtomValue	atom;
+
+		nvalues++;
+		if (pmExtractValue(vsp->valfmt, &vsp->vlist[i], PM_TYPE_U64,
+				&atom, PM_TYPE_U64) < 0 ||
+		    atom.ull != EXPECT(m, vsp->vlist[i].inst))
+		    bad++;
+	    }
+	}
+	pmFreeResult(rp);
+    }
+    gettimeofday(&end, NULL);
+
+    printf("%d metrics: %d values fetched, %d bad\n",
+		nmetrics, nvalues / iterations, bad);
+    if (vflag)
+	printf("%d metrics: %.3f msec/fetch\n",
+		nmetrics, tv_sub(&end, &start) * 1000.0 / iterations);
+
+    for (m = 0; m < nmetrics; m++)
+	free(names[m]);
+    free(names);
+    free(pmids);
+    pmDestroyContext(pmWhichContext());
+}
+
+int
+main(int argc, char **argv)
+{
+    int			c, i, m;
+    int			errflag = 0;
+    int			nmetrics = 100;
+    int			ninsts = 100;
+    int			iterations = 0;
+    int			vflag = 0;
+    char		*host = "local:";
+    char		*endnum;
+    char		*file;
+    char		name[64];
+    char		**mnames, **inames;
+    void		*map;
+    pmAtomValue		*ap;
+    mmv_registry_t	*registry;
+    static char		*usage = "[-h host] [-I instances] [-i iterations] [-m metrics] [-v] file";
+
+    pmSetProgname(argv[0]);
+
+    while ((c = getopt(argc, argv, "h:I:i:m:v")) != EOF) {
+	switch (c) {
+
+	case 'h':	/* host running pmcd and pmdammv */
+	    host = optarg;
+	    break;
+
+	case 'I':	/* number of instances per metric */
+	    ninsts = (int)strtol(optarg, &endnum, 10);
+	    if (*endnum != '\0' || ninsts <= 0) {
+		fprintf(stderr, "%s: -I requires a positive numeric argument\n", pmGetProgname());
+		errflag++;
+	    }
+	    break;
+
+	case 'i':	/* timed fetches of all metrics */
+	    iterations = (int)strtol(optarg, &endnum, 10);
+	    if (*endnum != '\0' || iterations < 0) {
+		fprintf(stderr, "%s: -i requires a non-negative numeric argument\n", pmGetProgname());
+		errflag++;
+	    }
+	    break;
+
+	case 'm':	/* number of metrics, all with instances */
+	    nmetrics = (int)strtol(optarg, &endnum, 10);
+	    if (*endnum != '\0' || nmetrics <= 0 || nmetrics > 1000) {
+		fprintf(stderr, "%s: -m requires a numeric argument (1 to 1000)\n", pmGetProgname());
+		errflag++;
+	    }
+	    break;
+
+	case 'v':	/* verbose, report timings */
+	    vflag++;
+	    break;
+
+	case '?':
+	default:
+	    errflag++;
+	    break;
+	}
+    }
+
+    if (errflag || optind != argc - 1) {
+	fprintf(stderr, "Usage: %s %s\n", pmGetProgname(), usage);
+	exit(1);
+    }
+    file = argv[optind];
+
+    if ((registry = mmv_stats_registry(file, 0, 0)) == NULL) {
+	fprintf(stderr, "mmv_stats_registry: %s - %s\n", file, strerror(errno));
+	exit(1);
+    }
+    /* the registry keeps references to (not copies of) these names */
+    mnames = (char **)calloc(nmetrics, sizeof(char *));
+    inames = (char **)calloc(ninsts, sizeof(char *));
+    if (mnames == NULL || inames == NULL) {
+	perror("calloc");
+	exit(1);
+    }
+    mmv_stats_add_indom(registry, 1, "scaling instances", NULL);
+    for (i = 0; i < ninsts; i++) {
+	pmsprintf(name, sizeof(name), "i%d", i);
+	inames[i] = strdup(name);
+	mmv_stats_add_instance(registry, 1, i, inames[i]);
+    }
+    for (m = 0; m < nmetrics; m++) {
+	pmsprintf(name, sizeof(name), "m%d", m);
+	mnames[m] = strdup(name);
+	if (mmv_stats_add_metric(registry, mnames[m], m + 1,
+			MMV_TYPE_U64, MMV_SEM_COUNTER, countunits, 1,
+			"scaling metric", NULL) < 0) {
+	    fprintf(stderr, "mmv_stats_add_metric: %s - %s\n", name, strerror(errno));
+	    exit(1);
+	}
+    }
+    if ((map = mmv_stats_start(registry)) == NULL) {
+	fprintf(stderr, "mmv_stats_start: %s - %s\n", file, strerror(errno));
+	exit(1);
+    }
+    for (m = 0; m < nmetrics; m++) {
+	for (i = 0; i < ninsts; i++) {
+	    if ((ap = mmv_lookup_value_desc(map, mnames[m], inames[i])) == NULL) {
+		fprintf(stderr, "mmv_lookup_value_desc: %s[%s] - failed\n",
+				mnames[m], inames[i]);
+		exit(1);
+	    }
+	    mmv_set_value(map, ap, (double)EXPECT(m, i));
+	}
+    }
+    printf("%d metrics x %d instances: created\n", nmetrics, ninsts);
+
+    if (iterations > 0)
+	fetch(file, host, nmetrics, iterations, vflag);
+
+    mmv_stats_free(registry);
+    for (m = 0; m < nmetrics; m++)
+	free(mnames[m]);
+    for (i = 0; i < ninsts; i++)
+	free(inames[i]);
+    free(mnames);
+    free(inames);
+    return 0;
+}
@@ -0,0 +1,203 @@
+/*
+ * Copyright (c) 2026 Red Hat.
+ *
+ * Connection scaling exerciser for pmcd ... hold open many idle client
+ * connections to one pmcd (spread across child processes, to stay clear
+ * of per-process descriptor limits), then time a series of fetches on
+ * one more context as the number of connected clients grows.
+ */
+
+#include <pcp/pmapi.h>
+#include "libpcp.h"
+#include <sys/wait.h>
+
+#define PERCHILD	500	/* idle contexts held open per child process */
+
+static char	*host = "local:";
+
+static double
+tv_sub(struct timeval *a, struct timeval *b)
+{
+    return (double)(a->tv_sec - b->tv_sec) +
+	   (double)(a->tv_usec - b->tv_usec) / 1000000.0;
+}
+
+/*
+ * Open n contexts, report success (one byte) through the pipe, then
+ * hold the connections open until the parent closes its end.
+ */
+static void
+holder(int n, int rfd, int wfd)
+{
+    int		i, sts;
+    char	c = 'y';
+
+    for (i = 0; i < n; i++) {
+	if ((sts = pmNewContext(PM_CONTEXT_HOST, host)) < 0) {
+	    fprintf(stderr, "holder pmNewContext(%s) #%d: %s\n", host, i, pmErrStr(sts));
+	    c = 'n';
+	    break;
+	}
+    }
+    if (write(wfd, &c, 1) != 1)
+	exit(1);
+    close(wfd);
+    while (read(rfd, &c, 1) > 0)
+	;
+    exit(0);
+}
+
+int
+main(int argc, char **argv)
+{
+    int		c;
+    int		i, n, sts;
+    int		errflag = 0;
+    int		nconns = 1000;
+    int		iterations = 1000;
+    int		step = 0;
+    int		vflag = 0;
+    int		nchild = 0;
+    int		held = 0;
+    int		ctl[2];			/* parent -> holders, closed at end */
+    int		ack[2];			/* holders -> parent */
+    char	*metric = "pmcd.numclients";
+    char	*endnum;
+    char	ok;
+    pmID	pmid;
+    pmResult	*rp;
+    struct timeval	start, end;
+    static char	*usage = "[-D debug] [-h host] [-i iterations] [-m metric] [-n nconns] [-s step] [-v]";
+
+    pmSetProgname(argv[0]);
+    setlinebuf(stdout);
+
+    while ((c = getopt(argc, argv, "D:h:i:m:n:s:v")) != EOF) {
+	switch (c) {
+
+	case 'D':	/* debug options */
+	    sts = pmSetDebug(optarg);
+	    if (sts < 0) {
+		fprintf(stderr, "%s: unrecognized debug options specification (%s)\n",
+		    pmGetProgname(), optarg);
+		errflag++;
+	    }
+	    break;
+
+	case 'h':	/* host */
+	    host = optarg;
+	    break;
+
+	case 'i':	/* timed fetches at each step */
+	    iterations = (int)strtol(optarg, &endnum, 10);
+	    if (*endnum != '\0' || iterations <= 0) {
+		fprintf(stderr, "%s: -i requires a positive numeric argument\n", pmGetProgname());
+		errflag++;
+	    }
+	    break;
+
+	case 'm':	/* metric to fetch */
+	    metric = optarg;
+	    break;
+
+	case 'n':	/* total number of idle client connections */
+	    nconns = (int)strtol(optarg, &endnum, 10);
+	    if (*endnum != '\0' || nconns < 0) {
+		fprintf(stderr, "%s: -n requires a non-negative numeric argument\n", pmGetProgname());
+		errflag++;
+	    }
+	    break;
+
+	case 's':	/* measure after every step connections */
+	    step = (int)strtol(optarg, &endnum, 10);
+	    if (*endnum != '\0' || step < 0) {
+		fprintf(stderr, "%s: -s requires a non-negative numeric argument\n", pmGetProgname());
+		errflag++;
+	    }
+	    break;
+
+	case 'v':	/* verbose, report timings */
+	    vflag++;
+	    break;
+
+	case '?':
+	default:
+	    errflag++;
+	    break;
+	}
+    }
+
+    if (errflag || optind != argc) {
+	fprintf(stderr, "Usage: %s %s\n", pmGetProgname(), usage);
+	exit(1);
+    }
+    if (step == 0 || step > nconns)
+	step = nconns ? nconns : 1;
+
+    if (pipe(ctl) < 0 || pipe(ack) < 0) {
+	perror("pipe");
+	exit(1);
+    }
+
+    if ((sts = pmNewContext(PM_CONTEXT_HOST, host)) < 0) {
+	fprintf(stderr, "pmNewContext(%s): %s\n", host, pmErrStr(sts));
+	exit(1);
+    }
+    if ((sts = pmLookupName(1, (const char **)&metric, &pmid)) < 0) {
+	fprintf(stderr, "pmLookupName(%s): %s\n", metric, pmErrStr(sts));
+	exit(1);
+    }
+
+    for (;;) {
+	gettimeofday(&start, NULL);
+	for (i = 0; i < iterations; i++) {
+	    if ((sts = pmFetch(1, &pmid, &rp)) < 0) {
+		fprintf(stderr, "pmFetch: %d idle clients: %s\n", held, pmErrStr(sts));
+		exit(1);
+	    }
+	    pmFreeResult(rp);
+	}
+	gettimeofday(&end, NULL);
+
+	printf("%d idle clients: %d fetches OK\n", held, iterations);
+	if (vflag)
+	    printf("%d idle clients: %.3f usec/fetch\n", held,
+		    tv_sub(&end, &start) * 1000000.0 / iterations);
+
+	if (held >= nconns)
+	    break;
+
+	/* connect the next step's worth of idle clients */
+	for (n = 0; n < step && held < nconns; n += i, held += i) {
+	    i = PERCHILD;
+	    if (i > step - n)
+		i = step - n;
+	    if (i > nconns - held)
+		i = nconns - held;
+	    fflush(stdout);
+	    if ((sts = fork()) == 0) {
+		close(ctl[1]);
+		close(ack[0]);
+		holder(i, ctl[0], ack[1]);
+		/* NOTREACHED */
+	    }
+	    else if (sts < 0) {
+		perror("fork");
+		exit(1);
+	    }
+	    nchild++;
+	    if (read(ack[0], &ok, 1) != 1 || ok != 'y') {
+		fprintf(stderr, "holder failed after %d idle clients\n", held);
+		exit(1);
+	    }
+	}
+    }
+
+    /* release the holders, and wait for them to disconnect */
+    close(ctl[0]);
+    close(ctl[1]);
+    while (nchild > 0 && wait(&sts) > 0)
+	nchild--;
+    pmDestroyContext(pmWhichContext());
+    return 0;
+}
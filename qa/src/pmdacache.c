@@ -11,7 +11,7 @@ main(int argc, char **argv)
 
     pmSetProgname(argv[0]);
 
-    while ((c = getopt(argc, argv, "Cc:D:dh:LSs:")) != EOF) {
+    while ((c = getopt(argc, argv, "Cc:D:dh:LSs:y")) != EOF) {
 	switch (c) {
 
 	case 'C':
@@ -73,6 +73,13 @@ main(int argc, char **argv)
 	    fputc('\n', stderr);
 	    break;
 
+	case 'y':
+	    sts = pmdaCacheOp(indom, PMDA_CACHE_SYNC);
+	    fprintf(stderr, "sync() -> %d", sts);
+	    if (sts < 0) fprintf(stderr, " %s", pmErrStr(sts));
+	    fputc('\n', stderr);
+	    break;
+
 	case '?':
 	default:
 	    errflag++;
@@ -91,6 +98,7 @@ main(int argc, char **argv)
 	fprintf(stderr, "-L             load\n");
 	fprintf(stderr, "-S             store\n");
 	fprintf(stderr, "-s inst        save\n");
+	fprintf(stderr, "-y             sync\n");
 	exit(1);
     }
 
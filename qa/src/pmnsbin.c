@@ -0,0 +1,108 @@
+/*
+ * Copyright (c) 2026 Red Hat.
+ *
+ * Exercise a PMNS loaded with pmLoadNameSpace, as used to compare
+ * the ASCII and compiled (pmnscomp) forms of the same PMNS.
+ */
+
+#include <pcp/pmapi.h>
+#include "libpcp.h"
+
+static void
+dometric(const char *name)
+{
+    pmID	pmid;
+    char	*back;
+    char	**nameset;
+    int		i;
+    int		n;
+
+    if ((n = pmLookupName(1, &name, &pmid)) < 0) {
+	printf("pmLookupName(%s): %s\n", name, pmErrStr(n));
+	return;
+    }
+    if ((n = pmNameID(pmid, &back)) < 0) {
+	printf("pmNameID(%s): %s\n", pmIDStr(pmid), pmErrStr(n));
+	return;
+    }
+    printf("%s %s %s", name, pmIDStr(pmid), back);
+    free(back);
+    if ((n = pmNameAll(pmid, &nameset)) < 0) {
+	printf(" pmNameAll: %s\n", pmErrStr(n));
+	return;
+    }
+    for (i = 0; i < n; i++) {
+	if (strcmp(name, nameset[i]) != 0)
+	    printf(" alias %s", nameset[i]);
+    }
+    putchar('\n');
+    free(nameset);
+}
+
+int
+main(int argc, char **argv)
+{
+    int		c;
+    int		i;
+    int		n;
+    int		sts;
+    int		errflag = 0;
+    int		*status;
+    char	**offspring;
+    static char	*usage = "[-D debugspec] namespace [metricpath ...]";
+
+    pmSetProgname(argv[0]);
+
+    while ((c = getopt(argc, argv, "D:")) != EOF) {
+	switch (c) {
+
+	case 'D':	/* debug options */
+	    sts = pmSetDebug(optarg);
+	    if (sts < 0) {
+		fprintf(stderr, "%s: unrecognized debug options specification (%s)\n",
+		    pmGetProgname(), optarg);
+		errflag++;
+	    }
+	    break;
+
+	case '?':
+	default:
+	    errflag++;
+	    break;
+	}
+    }
+
+    if (errflag || optind >= argc) {
+	printf("Usage: %s %s\n", pmGetProgname(), usage);
+	exit(1);
+    }
+
+    if ((sts = pmLoadNameSpace(argv[optind])) < 0) {
+	printf("pmLoadNameSpace(%s): %s\n", argv[optind], pmErrStr(sts));
+	exit(1);
+    }
+    optind++;
+
+    if ((n = pmGetChildrenStatus("", &offspring, &status)) < 0)
+	printf("pmGetChildrenStatus(\"\"): %s\n", pmErrStr(n));
+    else {
+	printf("root:");
+	for (i = 0; i < n; i++)
+	    printf(" %s%s", offspring[i], status[i] == PMNS_LEAF_STATUS ? "" : ".");
+	putchar('\n');
+	free(offspring);
+	free(status);
+    }
+
+    if (optind >= argc)
+	pmTraversePMNS("", dometric);
+    else {
+	for ( ; optind < argc; optind++) {
+	    if ((sts = pmTraversePMNS(argv[optind], dometric)) < 0)
+		printf("pmTraversePMNS(%s): %s\n", argv[optind], pmErrStr(sts));
+	}
+    }
+
+    pmUnloadNameSpace();
+    exit(0);
+}
@@ -0,0 +1,316 @@
+/*
+ * Copyright (c) 2026 Red Hat.
+ *
+ * Benchmark for pmdaproc refresh and fetch, using a synthetic /proc
+ * tree (for PROC_STATSPATH) that is modified between samples: some
+ * processes change state or accumulate CPU time, some exit and some
+ * new ones are started.
+ *
+ * Each sample reports the number of values and a checksum for each
+ * metric, which only depends on the synthetic tree - so this doubles
+ * as a functional test.  With -v, timings are reported as well.
+ */
+
+#include <pcp/pmapi.h>
+#include <sys/stat.h>
+#include <sys/time.h>
+
+static const char *metrics[] = {
+    "proc.nprocs",
+    "proc.psinfo.pid",
+    "proc.psinfo.cmd",
+    "proc.psinfo.sname",
+    "proc.psinfo.utime",
+    "proc.psinfo.stime",
+    "proc.psinfo.vctxsw",
+    "proc.id.uid",
+    "proc.memory.size",
+    "proc.memory.rss",
+    "proc.schedstat.cpu_time",
+    "proc.runq.runnable",
+    "proc.runq.sleeping",
+};
+#define NMETRICS (sizeof(metrics) / sizeof(metrics[0]))
+
+static const char	*root;
+static int		vflag;
+
+static double
+tv_sub(struct timeval *a, struct timeval *b)
+{
+    return (double)(a->tv_sec - b->tv_sec) +
+	   (double)(a->tv_usec - b->tv_usec) / 1000000.0;
+}
+
+static void
+put_file(int pid, const char *name, const char *contents, size_t length)
+{
+    char	path[MAXPATHLEN];
+    FILE	*fp;
+
+    pmsprintf(path, sizeof(path), "%s/proc/%d/%s", root, pid, name);
+    /* rewrite in place, like procfs content changing under an open fd */
+    if ((fp = fopen(path, "w")) == NULL ||
+	fwrite(contents, 1, length, fp) != length || fclose(fp) != 0) {
+	fprintf(stderr, "%s: cannot write %s: %s\n",
+		pmGetProgname(), path, strerror(errno));
+	exit(1);
+    }
+}
+
+static void
+put_stat(int pid, int tick)
+{
+    char	buf[512];
+    int		len;
+
+    len = pmsprintf(buf, sizeof(buf),
+	"%d (cmd%d) %c 1 %d %d 0 -1 4194560 %d 0 %d 0 %d %d 0 0 20 0 1 0 "
+	"%d %d %d 18446744073709551615 1 1 0 0 0 0 0 4096 0 0 0 0 17 %d "
+	"0 0 0 0 0 1 1 1 1 1 1 1 0\n",
+	pid, pid % 97, (pid + tick) % 5 ? 'S' : 'R', pid, pid,
+	pid % 1000, pid % 10, (pid % 100) + tick * 3, (pid % 50) + tick,
+	pid % 10000, (pid % 4096 + 1) * 4096, pid % 4096, pid % 8);
+    put_file(pid, "stat", buf, len);
+}
+
+static void
+put_schedstat(int pid, int tick)
+{
+    char	buf[128];
+    int		len;
+
+    len = pmsprintf(buf, sizeof(buf), "%llu %llu %d\n",
+	(unsigned long long)pid * 1000 + tick * 7,
+	(unsigned long long)pid * 10, pid % 100 + tick);
+    put_file(pid, "schedstat", buf, len);
+}
+
+static void
+make_process(int pid)
+{
+    char	path[MAXPATHLEN];
+    char	buf[1024];
+    int		len;
+
+    pmsprintf(path, sizeof(path), "%s/proc/%d", root, pid);
+    if (mkdir(path, 0755) < 0) {
+	fprintf(stderr, "%s: cannot create %s: %s\n",
+		pmGetProgname(), path, strerror(errno));
+	exit(1);
+    }
+    len = pmsprintf(buf, sizeof(buf), "/usr/bin/cmd%d%c-x%c", pid % 97, '\0', '\0');
+    put_file(pid, "cmdline", buf, len);
+    put_stat(pid, 0);
+    len = pmsprintf(buf, sizeof(buf), "%d %d %d 1 0 %d 0\n",
+	pid % 4096 + 1, pid % 1024, pid % 512, pid % 2048);
+    put_file(pid, "statm", buf, len);
+    len = pmsprintf(buf, sizeof(buf),
+	"Name:\tcmd%d\nUmask:\t0022\nState:\tS (sleeping)\nTgid:\t%d\n"
+	"Ngid:\t0\nPid:\t%d\nPPid:\t1\nTracerPid:\t0\n"
+	"Uid:\t%d\t%d\t%d\t%d\nGid:\t%d\t%d\t%d\t%d\n"
+	"VmPeak:\t   %d kB\nVmSize:\t   %d kB\nVmRSS:\t    %d kB\n"
+	"Threads:\t1\nSigPnd:\t0000000000000000\nSigBlk:\t0000000000000000\n"
+	"SigIgn:\t0000000000001000\nSigCgt:\t0000000180000000\n"
+	"Cpus_allowed_list:\t0-7\n"
+	"voluntary_ctxt_switches:\t%d\nnonvoluntary_ctxt_switches:\t%d\n",
+	pid % 97, pid, pid,
+	pid % 3 * 500, pid % 3 * 500, pid % 3 * 500, pid % 3 * 500,
+	pid % 5 * 100, pid % 5 * 100, pid % 5 * 100, pid % 5 * 100,
+	(pid % 4096 + 1) * 4, (pid % 4096 + 1) * 4, (pid % 1024) * 4,
+	pid % 1000, pid % 100);
+    put_file(pid, "status", buf, len);
+    put_schedstat(pid, 0);
+}
+
+static void
+remove_process(int pid)
+{
+    static const char *files[] = {
+	"cmdline", "stat", "statm", "status", "schedstat"
+    };
+    char	path[MAXPATHLEN];
+    int		i;
+
+    for (i = 0; i < sizeof(files) / sizeof(files[0]); i++) {
+	pmsprintf(path, sizeof(path), "%s/proc/%d/%s", root, pid, files[i]);
+	unlink(path);
+    }
+    pmsprintf(path, sizeof(path), "%s/proc/%d", root, pid);
+    rmdir(path);
+}
+
+/*
+ * Changes made before sample (tick) - one in four processes run,
+ * one in fifty exits, and nprocs/100 new processes are started.
+ * Pids are never reused within the life of the benchmark.
+ */
+static void
+update_processes(int nprocs, int tick)
+{
+    int		i, pid;
+
+    for (i = 0; i < nprocs; i++) {
+	pid = 1000 + i * 7;
+	if (i % 50 == tick - 1) {
+	    remove_process(pid);
+	    continue;
+	}
+	if (i % 50 < tick)
+	    continue;	/* exited earlier */
+	if (i % 4 == tick % 4) {
+	    put_stat(pid, tick);
+	    put_schedstat(pid, tick);
+	}
+    }
+    for (i = 0; i < nprocs / 100; i++)
+	make_process(1000000 + tick * 10000 + i);
+}
+
+static void
+report(pmResult *rp, pmDesc *descs)
+{
+    pmValueSet		*vsp;
+    pmAtomValue		atom;
+    unsigned long long	sum;
+    int			i, j, sts;
+
+    for (i = 0; i < rp->numpmid; i++) {
+	vsp = rp->vset[i];
+	sum = 0;
+	for (j = 0; j < vsp->numval; j++) {
+	    if (descs[i].type == PM_TYPE_STRING) {
+		sts = pmExtractValue(vsp->valfmt, &vsp->vlist[j],
+				PM_TYPE_STRING, &atom, PM_TYPE_STRING);
+		if (sts >= 0) {
+		    sum += strlen(atom.cp) + vsp->vlist[j].inst;
+		    free(atom.cp);
+		}
+	    } else {
+		sts = pmExtractValue(vsp->valfmt, &vsp->vlist[j],
+				descs[i].type, &atom, PM_TYPE_U64);
+		if (sts >= 0)
+		    sum += atom.ull + vsp->vlist[j].inst;
+	    }
+	}
+	printf("  %-24s numval %5d sum %llu\n", metrics[i], vsp->numval, sum);
+    }
+}
+
+int
+main(int argc, char **argv)
+{
+    int			c, i, sts;
+    int			errflag = 0;
+    int			nprocs = 1000;
+    int			samples = 5;
+    char		*endnum;
+    char		path[MAXPATHLEN];
+    int			pmda = 0;
+    pmID		pmids[NMETRICS];
+    pmDesc		descs[NMETRICS];
+    pmResult		*rp;
+    struct timeval	start, end;
+    double		update = 0, fetch = 0;
+    static char		*usage = "[-n nprocs] [-s samples] [-v] -K spec ... dir";
+
+    pmSetProgname(argv[0]);
+
+    while ((c = getopt(argc, argv, "K:n:s:v")) != EOF) {
+	switch (c) {
+
+	case 'K':	/* local proc PMDA spec */
+	    if ((endnum = pmSpecLocalPMDA(optarg)) != NULL) {
+		fprintf(stderr, "%s: -K %s: %s\n", pmGetProgname(), optarg, endnum);
+		errflag++;
+	    }
+	    pmda++;
+	    break;
+
+	case 'n':	/* number of processes */
+	    nprocs = (int)strtol(optarg, &endnum, 10);
+	    if (*endnum != '\0' || nprocs < 1) {
+		fprintf(stderr, "%s: -n requires numeric argument\n", pmGetProgname());
+		errflag++;
+	    }
+	    break;
+
+	case 's':	/* number of samples */
+	    samples = (int)strtol(optarg, &endnum, 10);
+	    if (*endnum != '\0' || samples < 1 || samples > 50) {
+		fprintf(stderr, "%s: -s requires numeric argument (1 to 50)\n", pmGetProgname());
+		errflag++;
+	    }
+	    break;
+
+	case 'v':	/* verbose, report timings */
+	    vflag = 1;
+	    break;
+
+	case '?':
+	default:
+	    errflag++;
+	    break;
+	}
+    }
+
+    if (errflag || pmda == 0 || optind != argc - 1) {
+	fprintf(stderr, "Usage: %s %s\n", pmGetProgname(), usage);
+	exit(1);
+    }
+    root = argv[optind];
+
+    pmsprintf(path, sizeof(path), "%s/proc", root);
+    if (mkdir(root, 0755) < 0 || mkdir(path, 0755) < 0) {
+	fprintf(stderr, "%s: cannot create %s: %s\n",
+		pmGetProgname(), path, strerror(errno));
+	exit(1);
+    }
+    gettimeofday(&start, NULL);
+    for (i = 0; i < nprocs; i++)
+	make_process(1000 + i * 7);
+    gettimeofday(&end, NULL);
+    if (vflag)
+	printf("created %d processes: %.3f msec\n", nprocs,
+		tv_sub(&end, &start) * 1000.0);
+
+    setenv("PROC_STATSPATH", root, 1);
+    if ((sts = pmNewContext(PM_CONTEXT_LOCAL, NULL)) < 0) {
+	fprintf(stderr, "%s: pmNewContext: %s\n", pmGetProgname(), pmErrStr(sts));
+	exit(1);
+    }
+    if ((sts = pmLookupName(NMETRICS, metrics, pmids)) < 0) {
+	fprintf(stderr, "%s: pmLookupName: %s\n", pmGetProgname(), pmErrStr(sts));
+	exit(1);
+    }
+    for (i = 0; i < NMETRICS; i++) {
+	if ((sts = pmLookupDesc(pmids[i], &descs[i])) < 0) {
+	    fprintf(stderr, "%s: pmLookupDesc(%s): %s\n",
+		    pmGetProgname(), metrics[i], pmErrStr(sts));
+	    exit(1);
+	}
+    }
+
+    for (i = 0; i < samples; i++) {
+	gettimeofday(&start, NULL);
+	if (i > 0)
+	    update_processes(nprocs, i);
+	gettimeofday(&end, NULL);
+	update += tv_sub(&end, &start);
+	start = end;
+	if ((sts = pmFetch(NMETRICS, pmids, &rp)) < 0) {
+	    fprintf(stderr, "%s: pmFetch: %s\n", pmGetProgname(), pmErrStr(sts));
+	    exit(1);
+	}
+	gettimeofday(&end, NULL);
+	fetch += tv_sub(&end, &start);
+	printf("sample %d\n", i);
+	report(rp, descs);
+	pmFreeResult(rp);
+    }
+    if (vflag)
+	printf("%d samples: update %.3f msec, fetch %.3f msec per sample\n",
+		samples, update * 1000.0 / samples, fetch * 1000.0 / samples);
+
+    exit(0);
+}
@@ -0,0 +1,187 @@
+/*
+ * Copyright (c) 2026 Red Hat.
+ *
+ * Fetch metrics from a local context PMDA once per snapshot file,
+ * copying each snapshot over the target file (e.g. a file below a
+ * PMDA statspath) before the fetch - so a single PMDA instance sees
+ * the file content change between refreshes.
+ */
+
+#include <pcp/pmapi.h>
+
+static void
+put_file(const char *snapshot, const char *target)
+{
+    char	buf[BUFSIZ];
+    FILE	*in, *out;
+    size_t	bytes;
+
+    if ((in = fopen(snapshot, "r")) == NULL) {
+	fprintf(stderr, "%s: cannot open %s: %s\n",
+		pmGetProgname(), snapshot, strerror(errno));
+	exit(1);
+    }
+    /* rewrite in place, like procfs content changing under an open fd */
+    if ((out = fopen(target, "w")) == NULL) {
+	fprintf(stderr, "%s: cannot write %s: %s\n",
+		pmGetProgname(), target, strerror(errno));
+	exit(1);
+    }
+    while ((bytes = fread(buf, 1, sizeof(buf), in)) > 0) {
+	if (fwrite(buf, 1, bytes, out) != bytes) {
+	    fprintf(stderr, "%s: cannot write %s: %s\n",
+		    pmGetProgname(), target, strerror(errno));
+	    exit(1);
+	}
+    }
+    fclose(in);
+    if (fclose(out) != 0) {
+	fprintf(stderr, "%s: cannot write %s: %s\n",
+		pmGetProgname(), target, strerror(errno));
+	exit(1);
+    }
+}
+
+static void
+report(pmResult *rp, const char **names, pmDesc *descs)
+{
+    pmValueSet	*vsp;
+    char	*iname;
+    int		i, j, sts;
+
+    for (i = 0; i < rp->numpmid; i++) {
+	vsp = rp->vset[i];
+	printf("  %s", names[i]);
+	if (vsp->numval < 0) {
+	    printf(": %s\n", pmErrStr(vsp->numval));
+	    continue;
+	}
+	if (vsp->numval == 0) {
+	    printf(": no values\n");
+	    continue;
+	}
+	putchar('\n');
+	for (j = 0; j < vsp->numval; j++) {
+	    if (descs[i].indom == PM_INDOM_NULL)
+		printf("    ");
+	    else if ((sts = pmNameInDom(descs[i].indom,
+					vsp->vlist[j].inst, &iname)) < 0)
+		printf("    [%d] ", vsp->vlist[j].inst);
+	    else {
+		printf("    [%s] ", iname);
+		free(iname);
+	    }
+	    pmPrintValue(stdout, vsp->valfmt, descs[i].type, &vsp->vlist[j], 1);
+	    putchar('\n');
+	}
+    }
+}
+
+int
+main(int argc, char **argv)
+{
+    int		c, i, sts;
+    int		errflag = 0;
+    int		pmda = 0;
+    int		nsnaps = 0;
+    int		numpmid;
+    char	*errmsg;
+    char	*target = NULL;
+    char	**snaps = NULL;
+    const char	**names;
+    pmID	*pmids;
+    pmDesc	*descs;
+    pmResult	*rp;
+    static char	*usage = "[-D debug] -K spec ... -f target -s snapshot ... metric ...";
+
+    pmSetProgname(argv[0]);
+
+    while ((c = getopt(argc, argv, "D:f:K:s:")) != EOF) {
+	switch (c) {
+
+	case 'D':	/* debug options */
+	    if ((sts = pmSetDebug(optarg)) < 0) {
+		fprintf(stderr, "%s: unrecognized debug options specification (%s)\n",
+		    pmGetProgname(), optarg);
+		errflag++;
+	    }
+	    break;
+
+	case 'f':	/* file each snapshot is copied over */
+	    target = optarg;
+	    break;
+
+	case 'K':	/* local PMDA spec */
+	    if ((errmsg = pmSpecLocalPMDA(optarg)) != NULL) {
+		fprintf(stderr, "%s: -K %s: %s\n", pmGetProgname(), optarg, errmsg);
+		errflag++;
+	    }
+	    pmda++;
+	    break;
+
+	case 's':	/* snapshot, one fetch each, in order */
+	    if ((snaps = realloc(snaps, (nsnaps + 1) * sizeof(char *))) == NULL) {
+		fprintf(stderr, "%s: out of memory\n", pmGetProgname());
+		exit(1);
+	    }
+	    snaps[nsnaps++] = optarg;
+	    break;
+
+	case '?':
+	default:
+	    errflag++;
+	    break;
+	}
+    }
+
+    if (errflag || pmda == 0 || target == NULL || nsnaps == 0 || optind == argc) {
+	fprintf(stderr, "Usage: %s %s\n", pmGetProgname(), usage);
+	exit(1);
+    }
+
+    numpmid = argc - optind;
+    names = (const char **)&argv[optind];
+    if ((pmids = calloc(numpmid, sizeof(pmID))) == NULL ||
+	(descs = calloc(numpmid, sizeof(pmDesc))) == NULL) {
+	fprintf(stderr, "%s: out of memory\n", pmGetProgname());
+	exit(1);
+    }
+
+    /* the PMDA may refresh at context creation, so start with the first */
+    put_file(snaps[0], target);
+    if ((sts = pmNewContext(PM_CONTEXT_LOCAL, NULL)) < 0) {
+	fprintf(stderr, "%s: pmNewContext: %s\n", pmGetProgname(), pmErrStr(sts));
+	exit(1);
+    }
+    if ((sts = pmLookupName(numpmid, names, pmids)) < 0) {
+	fprintf(stderr, "%s: pmLookupName: %s\n", pmGetProgname(), pmErrStr(sts));
+	exit(1);
+    }
+    for (i = 0; i < numpmid; i++) {
+	if ((sts = pmLookupDesc(pmids[i], &descs[i])) < 0) {
+	    fprintf(stderr, "%s: pmLookupDesc(%s): %s\n",
+		    pmGetProgname(), names[i], pmErrStr(sts));
+	    exit(1);
+	}
+    }
+
+    for (i = 0; i < nsnaps; i++) {
+	if (i > 0)
+	    put_file(snaps[i], target);
+	printf("snapshot %d\n", i);
+	fflush(stdout);
+	if ((sts = pmFetch(numpmid, pmids, &rp)) < 0) {
+	    fprintf(stderr, "%s: pmFetch: %s\n", pmGetProgname(), pmErrStr(sts));
+	    exit(1);
+	}
+	report(rp, names, descs);
+	fflush(stdout);
+	pmFreeResult(rp);
+    }
+
+    pmDestroyContext(pmWhichContext());
+    free(snaps);
+    free(pmids);
+    free(descs);
+    exit(0);
+}
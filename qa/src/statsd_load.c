@@ -0,0 +1,181 @@
+/*
+ * Copyright (c) 2026 Red Hat.
+ *
+ * Load generator for pmdastatsd - several threads each send counter
+ * updates ("<prefix><metric>:1|c") round-robin over a set of metric
+ * names, optionally several updates per datagram, reporting the rate
+ * at which datagrams were sent.
+ */
+
+#include <pcp/pmapi.h>
+#include <pthread.h>
+#include <sys/socket.h>
+#include <netdb.h>
+
+static char	*host = "localhost";
+static char	*port = "8125";
+static char	*prefix = "load_m";
+static int	npackets = 10000;
+static int	nmetrics = 100;
+static int	nbatch = 1;
+static int	pause_usec;
+
+static double
+tv_sub(struct timeval *a, struct timeval *b)
+{
+    return (double)(a->tv_sec - b->tv_sec) +
+	   (double)(a->tv_usec - b->tv_usec) / 1000000.0;
+}
+
+static void *
+sender(void *arg)
+{
+    int			fd, i, j, sts;
+    int			metric = (int)(long)arg;
+    size_t		len;
+    char		buf[8192];
+    struct addrinfo	hints, *res;
+
+    memset(&hints, 0, sizeof(hints));
+    hints.ai_family = AF_UNSPEC;
+    hints.ai_socktype = SOCK_DGRAM;
+    if ((sts = getaddrinfo(host, port, &hints, &res)) != 0) {
+	fprintf(stderr, "getaddrinfo(%s, %s): %s\n", host, port, gai_strerror(sts));
+	exit(1);
+    }
+    if ((fd = socket(res->ai_family, res->ai_socktype, res->ai_protocol)) < 0) {
+	perror("socket");
+	exit(1);
+    }
+    for (i = 0; i < npackets; i++) {
+	for (len = 0, j = 0; j < nbatch; j++) {
+	    len += pmsprintf(buf + len, sizeof(buf) - len, "%s%s%d:1|c",
+			j ? "\n" : "", prefix, metric);
+	    metric = (metric + 1) % nmetrics;
+	}
+	if (sendto(fd, buf, len, 0, res->ai_addr, res->ai_addrlen) < 0) {
+	    perror("sendto");
+	    exit(1);
+	}
+	if (pause_usec)
+	    usleep(pause_usec);
+    }
+    close(fd);
+    freeaddrinfo(res);
+    return NULL;
+}
+
+int
+main(int argc, char **argv)
+{
+    int			c, i;
+    int			errflag = 0;
+    int			nthreads = 1;
+    int			vflag = 0;
+    char		*endnum;
+    pthread_t		*threads;
+    struct timeval	start, end;
+    double		secs;
+    static char		*usage = "[-b batch] [-h host] [-m metrics] [-n packets] [-P prefix] [-p port] [-t threads] [-v] [-w usec]";
+
+    pmSetProgname(argv[0]);
+
+    while ((c = getopt(argc, argv, "b:h:m:n:P:p:t:vw:")) != EOF) {
+	switch (c) {
+
+	case 'b':	/* updates per datagram */
+	    nbatch = (int)strtol(optarg, &endnum, 10);
+	    if (*endnum != '\0' || nbatch <= 0 || nbatch > 256) {
+		fprintf(stderr, "%s: -b requires a numeric argument (1 to 256)\n", pmGetProgname());
+		errflag++;
+	    }
+	    break;
+
+	case 'h':	/* host running pmdastatsd */
+	    host = optarg;
+	    break;
+
+	case 'm':	/* number of metric names */
+	    nmetrics = (int)strtol(optarg, &endnum, 10);
+	    if (*endnum != '\0' || nmetrics <= 0) {
+		fprintf(stderr, "%s: -m requires a positive numeric argument\n", pmGetProgname());
+		errflag++;
+	    }
+	    break;
+
+	case 'n':	/* datagrams per thread */
+	    npackets = (int)strtol(optarg, &endnum, 10);
+	    if (*endnum != '\0' || npackets <= 0) {
+		fprintf(stderr, "%s: -n requires a positive numeric argument\n", pmGetProgname());
+		errflag++;
+	    }
+	    break;
+
+	case 'P':	/* metric name prefix */
+	    prefix = optarg;
+	    break;
+
+	case 'p':	/* pmdastatsd port */
+	    port = optarg;
+	    break;
+
+	case 't':	/* number of sending threads */
+	    nthreads = (int)strtol(optarg, &endnum, 10);
+	    if (*endnum != '\0' || nthreads <= 0) {
+		fprintf(stderr, "%s: -t requires a positive numeric argument\n", pmGetProgname());
+		errflag++;
+	    }
+	    break;
+
+	case 'v':	/* verbose, report timings */
+	    vflag++;
+	    break;
+
+	case 'w':	/* pause between datagrams */
+	    pause_usec = (int)strtol(optarg, &endnum, 10);
+	    if (*endnum != '\0' || pause_usec < 0) {
+		fprintf(stderr, "%s: -w requires a non-negative numeric argument\n", pmGetProgname());
+		errflag++;
+	    }
+	    break;
+
+	case '?':
+	default:
+	    errflag++;
+	    break;
+	}
+    }
+
+    if (errflag || optind != argc) {
+	fprintf(stderr, "Usage: %s %s\n", pmGetProgname(), usage);
+	exit(1);
+    }
+
+    if ((threads = calloc(nthreads, sizeof(pthread_t))) == NULL) {
+	perror("calloc");
+	exit(1);
+    }
+    gettimeofday(&start, NULL);
+    for (i = 0; i < nthreads; i++) {
+	/* threads start on different metrics, so all are kept busy */
+	if (pthread_create(&threads[i], NULL, sender,
+			(void *)(long)((i * nmetrics) / nthreads)) != 0) {
+	    fprintf(stderr, "pthread_create: %s\n", strerror(errno));
+	    exit(1);
+	}
+    }
+    for (i = 0; i < nthreads; i++)
+	pthread_join(threads[i], NULL);
+    gettimeofday(&end, NULL);
+
+    printf("sent %d datagrams, %d updates\n",
+		nthreads * npackets, nthreads * npackets * nbatch);
+    if (vflag) {
+	secs = tv_sub(&end, &start);
+	printf("%d threads: %.0f datagrams/sec\n", nthreads,
+		secs > 0 ? (double)nthreads * npackets / secs : 0.0);
+    }
+
+    free(threads);
+    return 0;
+}
@@ -0,0 +1,97 @@
+#!/usr/bin/env pmpython
+# -*- coding: utf-8 -*-
+
+# Exercises agent with multiple listener, parser and aggregator threads:
+# - same results as with single threads, for a mix of valid and invalid payloads
+# - no updates lost under load, counter values sum to statsd.pmda.aggregated
+
+import sys
+import socket
+import os
+import time
+import subprocess
+
+utils_path = os.path.abspath(os.path.join("utils"))
+sys.path.append(utils_path)
+
+import pmdastatsd_test_utils as utils
+
+utils.print_test_file_separator()
+print(os.path.basename(__file__))
+
+ip = "0.0.0.0"
+port = 8125
+sock = socket.socket(socket.AF_INET, socket.SOCK_DGRAM)
+statsd_load = sys.argv[1]
+load_metrics = 50
+
+payloads = [
+    # These are parsed and aggregated
+    "stat_login:1|c",
+    "stat_login:5|c",
+    "stat_logout:2|c",
+    "stat_tagged_counter_a,tagX=X:1|c",
+    "stat_tagged_counter_a,tagY=Y:2|c",
+    "stat_success:0|g",
+    "stat_success:+5|g",
+    "stat_success:-12|g",
+    "stat_cpu_wait:200|ms",
+    "stat_cpu_wait:100|ms",
+    # These are parsed, not aggregated and then dropped
+    "stat_login:1|g",
+    "stat_logout:0.128|g",
+    "cache_cleared:-4|c",
+    # These are not parsed and then dropped
+    "session_started:1wq|c",
+    "cache_cleared:4|gw",
+    ":20|ms"
+]
+
+testconfigs = utils.configs["threads"]
+
+def extract_value(str):
+    return int(str.split("\n")[1].split()[-1])
+
+def wait_for_received():
+    # wait until the agent has caught up with everything sent
+    last = -1
+    received = extract_value(utils.request_metric('statsd.pmda.received'))
+    while received != last:
+        time.sleep(1)
+        last = received
+        received = extract_value(utils.request_metric('statsd.pmda.received'))
+
+def run_test():
+    for testconfig in testconfigs:
+        utils.print_test_section_separator()
+        utils.pmdastatsd_install(testconfig)
+        for payload in payloads:
+            sock.sendto(payload.encode("utf-8"), (ip, port))
+        wait_for_received()
+        utils.print_metric('statsd.pmda.received')
+        utils.print_metric('statsd.pmda.parsed')
+        utils.print_metric('statsd.pmda.aggregated')
+        utils.print_metric('statsd.pmda.dropped')
+        utils.print_metric('statsd.stat_login')
+        utils.print_metric('statsd.stat_success')
+        aggregated = extract_value(utils.request_metric('statsd.pmda.aggregated'))
+        dropped = extract_value(utils.request_metric('statsd.pmda.dropped'))
+        # UDP may drop some datagrams under load, so only totals are checked
+        command = '{} -h 127.0.0.1 -p {} -n 2000 -t 4 -m {} -b 8 -w 50'
+        subprocess.check_output(command.format(statsd_load, port, load_metrics), shell=True)
+        wait_for_received()
+        total = 0
+        for i in range(load_metrics):
+            total += extract_value(utils.request_metric('statsd.load_m{}'.format(i)))
+        load_aggregated = extract_value(utils.request_metric('statsd.pmda.aggregated')) - aggregated
+        if total == load_aggregated:
+            print("load counters sum to aggregated")
+        else:
+            print("load counters sum to {}, aggregated {}".format(total, load_aggregated))
+        print("load dropped {}".format(extract_value(utils.request_metric('statsd.pmda.dropped')) - dropped))
+        tracked = utils.get_instances(utils.request_metric('statsd.pmda.metrics_tracked'))
+        print("metrics tracked: counter {}".format(tracked["counter"]))
+        utils.pmdastatsd_remove()
+        utils.restore_config()
+
+run_test()
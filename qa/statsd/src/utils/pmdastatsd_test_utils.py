@@ -106,6 +106,19 @@ verbose = 1
 """
 [global]
 verbose = 2
+"""],
+	"threads": [
+"""
+[global]
+listener_threads = 1
+parser_threads = 1
+aggregator_threads = 1
+""",
+"""
+[global]
+listener_threads = 2
+parser_threads = 4
+aggregator_threads = 4
 """]
 }
 
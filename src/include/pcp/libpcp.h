@@ -170,6 +170,8 @@ typedef struct __pmnsTree {
 
 /* used by pmnsmerge/pmnsdel */
 PCP_CALL extern __pmnsTree *__pmExportPMNS(void); 
+/* used by pmnscomp */
+PCP_CALL extern int __pmCompilePMNS(const __pmnsTree *, const char *, const char *);
 
 /* for PMNS in archives and PMDA use */
 PCP_CALL extern int __pmNewPMNS(__pmnsTree **);
@@ -432,6 +434,14 @@ PCP_CALL extern __pmPDU *__pmFindPDUBuf(int);
 PCP_CALL extern void __pmPinPDUBuf(void *);
 PCP_CALL extern int __pmUnpinPDUBuf(void *);
 PCP_CALL extern void __pmCountPDUBuf(int, int *, int *);
+typedef struct {
+    __uint64_t	requests;	/* __pmFindPDUBuf calls */
+    __uint64_t	hits;		/* served from an existing slab */
+    __uint64_t	large;		/* malloc'd, too large for a slab (or */
+				/* no new slab could be allocated) */
+    __uint32_t	slabs;		/* slabs currently allocated */
+} __pmPDUBufStats;
+PCP_CALL extern void __pmGetPDUBufStats(__pmPDUBufStats *);
 
 /* PDU counting services */
 PCP_DATA extern unsigned int *__pmPDUCntIn;
@@ -506,7 +516,12 @@ PCP_CALL extern __pmHostEnt * __pmGetAddrInfo(const char *);
 PCP_CALL extern void	     __pmHostEntFree(__pmHostEnt *);
 PCP_CALL extern char *	     __pmHostEntGetName(__pmHostEnt *);
 
-/* Hashed Data Structures for the Processing of Logs and Archives */
+/*
+ * Hashed Data Structures for the Processing of Logs and Archives
+ * - the buckets may be walked directly, but nodes must only be linked
+ *   and unlinked via __pmHashAdd, __pmHashDel and __pmHashWalkCB, as
+ *   larger tables also maintain a private lookup index
+ */
 typedef struct __pmHashNode {
     struct __pmHashNode	*next;
     unsigned int	key;
@@ -518,6 +533,7 @@ typedef struct __pmHashCtl {
     __pmHashNode	**hash;
     __pmHashNode	*next;
     unsigned int	index;
+    struct __pmHashIndex *lookup;	/* private to hash.c */
 } __pmHashCtl;
 typedef enum {
     PM_HASH_WALK_START = 0,
@@ -813,6 +829,8 @@ typedef struct {
     __pmTimestamp endtime;	/* (when reading) timestamp at logical EOF */
     int		numti;		/* (when reading) no. temporal index entries */
     __pmLogTI	*ti;		/* (when reading) temporal index */
+    int		tiorder;	/* (when reading) ti[] in volume, offset */
+				/*                and time order */
     struct __pmnsTree *pmns;	/* namespace from meta data */
     int		multi;		/* part of a multi-archive context */
 } __pmLogCtl;
@@ -927,6 +945,7 @@ PCP_CALL extern size_t __pmLogLabelSize(const __pmLogCtl *);
 PCP_CALL extern int __pmLogChkLabel(__pmArchCtl *, __pmFILE *, __pmLogLabel *, int);
 PCP_CALL extern int __pmLogCreate(const char *, const char *, int, __pmArchCtl *);
 PCP_CALL extern __pmFILE *__pmLogNewFile(const char *, int);
+PCP_CALL extern int __pmLogSetCompression(const char *);
 PCP_CALL extern void __pmLogClose(__pmArchCtl *);
 PCP_CALL extern int __pmLogPutDesc(__pmArchCtl *, const pmDesc *, int, char **);
 PCP_CALL extern int __pmLogPutInDom(__pmArchCtl *, int, const __pmLogInDom * const);
@@ -1447,6 +1466,26 @@ __pmOffsetHighResResult(const __pmResult *rp)
    return (pmHighResResult *)(&((char *)rp)[offsetof(__pmResult,numpmid) - offsetof(pmHighResResult,numpmid)]);
 }
 
+/*
+ * Build the pmValueSets for a result in reusable scratch space, then
+ * move them all into a single pdubuf ... released in one step by
+ * __pmFreeResultValues() and friends
+ */
+typedef struct {
+    char	*buf;		/* scratch space */
+    size_t	size;		/* bytes allocated at buf */
+    size_t	used;		/* bytes in use at buf */
+    size_t	*voff;		/* pmValueSet offset in buf for each slot */
+    int		nslot;		/* slots (pmValueSets) in this result */
+    int		maxslot;	/* slots allocated at voff */
+} __pmResultArena;
+PCP_CALL extern int __pmResultArenaStart(__pmResultArena *, int);
+PCP_CALL extern int __pmResultArenaAddValueSet(__pmResultArena *, int, pmID, int);
+PCP_CALL extern pmValueSet *__pmResultArenaValueSet(__pmResultArena *, int);
+PCP_CALL extern int __pmResultArenaStuffValue(__pmResultArena *, int, int, const pmAtomValue *, int);
+PCP_CALL extern int __pmResultArenaCopyValueSet(__pmResultArena *, int, const pmValueSet *);
+PCP_CALL extern int __pmResultArenaFinish(__pmResultArena *, pmValueSet **);
+
 /* free malloc'd data structures */
 PCP_CALL extern void __pmFreeAttrsSpec(__pmHashCtl *);
 PCP_CALL extern void __pmFreeHostAttrsSpec(__pmHostSpec *, int, __pmHashCtl *);
@@ -18,7 +18,7 @@
 
 #define MMV_VERSION1	1	/* original on-disk format */
 #define MMV_VERSION2	2	/* + mmv_disk_{metric2,instance2}_t */
-#define MMV_VERSION3	3	/* + labels support */
+#define MMV_VERSION3	3	/* + labels support, sharded values */
 #define MMV_VERSION     1	/* default, upgrading to v3 only if needed */
 
 typedef enum mmv_toc_type {
@@ -28,8 +28,15 @@ typedef enum mmv_toc_type {
     MMV_TOC_VALUES	= 4,	/* mmv_disk_value_t */
     MMV_TOC_STRINGS	= 5,	/* mmv_disk_string_t */
     MMV_TOC_LABELS	= 6,	/* mmv_disk_label_t */
+    MMV_TOC_SHARDS	= 7,	/* mmv_disk_shards_t */
 } mmv_toc_type_t;
 
+/* Per-metric flags, in the v3 mmv_disk_metric2_t flags field */
+#define MMV_METRIC_SHARDED	0x1	/* values summed over shard slots */
+
+#define MMV_SHARDMAX	4096	/* upper bound on the number of shards */
+#define MMV_SHARDALIGN	64	/* shard block alignment (cache line) */
+
 /* The way the Table Of Contents is written into the file */
 typedef struct mmv_disk_toc {
     mmv_toc_type_t	type;		/* What is it? */
@@ -89,18 +96,31 @@ typedef struct mmv_disk_metric2 {
     mmv_metric_sem_t	semantics;
     pmUnits		dimension;
     __int32_t		indom;		/* Instance domain number */
-    __uint32_t		padding;	/* zero filled, alignment bits */
+    __uint32_t		flags;		/* MMV_METRIC_* (v3), else zero */
     __uint64_t		shorttext;	/* Offset of short help text string */
     __uint64_t		helptext;	/* Offset of long help text string */
 } mmv_disk_metric2_t;
 
 typedef struct mmv_disk_value {
     pmAtomValue		value;		/* Union of all possible value types */
-    __int64_t		extra;		/* INTEGRAL(starttime)/STRING(offset) */
+    __int64_t		extra;		/* INTEGRAL(starttime)/STRING(offset)/
+					   SHARDED(offset in shard block) */
     __uint64_t		metric;		/* Offset into the metric section */
     __uint64_t		instance;	/* Offset into the instance section */
 } mmv_disk_value_t;
 
+/*
+ * Sharded values have one 64-bit slot in each of count per-shard blocks
+ * (one block per CPU, each starting on a cache line boundary), so that
+ * concurrent updates from different CPUs do not contend.  The value is
+ * the sum of its slots, in two's complement for the signed types.
+ */
+typedef struct mmv_disk_shards {
+    __uint32_t		count;		/* Number of shard blocks */
+    __uint32_t		stride;		/* Size of each shard block */
+    __uint64_t		offset;		/* Offset of first shard block */
+} mmv_disk_shards_t;
+
 typedef struct mmv_disk_header {
     char		magic[4];	/* MMV\0 */
     __int32_t		version;	/* version */
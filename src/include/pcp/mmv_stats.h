@@ -133,6 +133,9 @@ extern int mmv_stats_add_metric(mmv_registry_t *, const char *, int,
 		mmv_metric_type_t, mmv_metric_sem_t, pmUnits,
 		int, const char *, const char *);
 extern int mmv_stats_add_instance(mmv_registry_t *, int, int, const char *);
+extern int mmv_stats_add_sharded_metric(mmv_registry_t *, const char *, int,
+		mmv_metric_type_t, mmv_metric_sem_t, pmUnits,
+		int, const char *, const char *);
 
 extern int mmv_stats_add_registry_label(mmv_registry_t *,
 		const char *, const char *, mmv_value_type_t, int);
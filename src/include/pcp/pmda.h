@@ -83,6 +83,14 @@ typedef int (*pmdaFetchCallBack)(pmdaMetric *, unsigned int, pmAtomValue *);
 #define PMDA_FETCH_STATIC	1
 #define PMDA_FETCH_DYNAMIC	2	/* free avp->vp after __pmStuffValue */
 
+/*
+ * Type of optional function call back used by pmdaFetch to assign the
+ * values for all requested instances of one metric in a single call.
+ * The per-instance status codes are the pmdaFetchCallBack return values;
+ * returning PM_ERR_NYI falls back to the pmdaFetchCallBack for the metric.
+ */
+typedef int (*pmdaFetchBatchCallBack)(pmdaMetric *, int, const unsigned int *, pmAtomValue *, int *);
+
 /*
  * Type of function call back used by pmdaMain to clean up a pmResult structure
  * after a fetch.
@@ -456,6 +464,12 @@ typedef struct pmdaOptions {
  *      pmAtom structure with a metrics value. This must be set if pmdaFetch is
  *      used as the fetch callback.
  *
+ * pmdaSetFetchBatchCallBack
+ *      Optionally specify a routine that assigns values for every requested
+ *      instance of a metric at once, avoiding per-value callback overhead for
+ *      large instance domains.  Metrics for which it returns PM_ERR_NYI are
+ *      completed using the pmdaSetFetchCallBack routine instead.
+ *
  * pmdaSetCheckCallBack
  *      Allows an application specific routine to be called upon receipt of any
  *      PDU. For all PDUs except PDU_PROFILE, a result less than zero
@@ -499,6 +513,7 @@ PMDA_CALL extern void pmdaSendError(pmdaInterface *, int);
 
 PMDA_CALL extern void pmdaSetResultCallBack(pmdaInterface *, pmdaResultCallBack);
 PMDA_CALL extern void pmdaSetFetchCallBack(pmdaInterface *, pmdaFetchCallBack);
+PMDA_CALL extern void pmdaSetFetchBatchCallBack(pmdaInterface *, pmdaFetchBatchCallBack);
 PMDA_CALL extern void pmdaSetCheckCallBack(pmdaInterface *, pmdaCheckCallBack);
 PMDA_CALL extern void pmdaSetDoneCallBack(pmdaInterface *, pmdaDoneCallBack);
 PMDA_CALL extern void pmdaSetEndContextCallBack(pmdaInterface *, pmdaEndContextCallBack);
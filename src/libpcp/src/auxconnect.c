@@ -24,6 +24,9 @@
 #ifdef HAVE_NETIOAPI_H
 #include <netioapi.h>
 #endif
+#ifdef HAVE_POLL_H
+#include <poll.h>
+#endif
 #define SOCKET_INTERNAL
 #include "internal.h"
 
@@ -1629,14 +1632,31 @@ __pmRecv(int socket, void *buffer, size_t length, int flags)
 int
 __pmSocketReady(int fd, struct timeval *timeout)
 {
-    __pmFdSet	onefd;
+#ifdef HAVE_POLL_H
+    struct pollfd	pollfd;
+    int			msec;
+#else
+    __pmFdSet		onefd;
+#endif
 
     if (fd < 0)
 	return -EBADF;
 
+#ifdef HAVE_POLL_H
+    /* poll(2) has no FD_SETSIZE limit on the descriptor number */
+    pollfd.fd = fd;
+    pollfd.events = POLLIN;
+    pollfd.revents = 0;
+    if (timeout == NULL)
+	msec = -1;
+    else	/* round up, so a short timeout does not become a busy wait */
+	msec = timeout->tv_sec * 1000 + (timeout->tv_usec + 999) / 1000;
+    return poll(&pollfd, 1, msec);
+#else
     FD_ZERO(&onefd);
     FD_SET(fd, &onefd);
     return select(fd+1, &onefd, NULL, NULL, timeout);
+#endif
 }
 
 #endif /* !HAVE_SECURE_SOCKETS */
@@ -562,6 +562,11 @@ extern const char *compress_suffix_list(void);
 #else
 #define TRANSPARENT_DECOMPRESS	disabled
 #endif
+#if defined(HAVE_TRANSPARENT_DECOMPRESSION) && defined(HAVE_ZSTD_DECOMPRESSION)
+#define ZSTD_COMPRESS		enabled
+#else
+#define ZSTD_COMPRESS		disabled
+#endif
 
 typedef const char *(*feature_detector)(void);
 static struct {
@@ -590,6 +595,7 @@ static struct {
 	{ "compress_suffixes",	compress_suffix_list },		/* from pcp-4.0.1 */
 	{ "v3_archives",	enabled },			/* from pcp-6.0.0 */
 	{ "archive_features",	myfeatures },			/* from pcp-6.0.0 */
+	{ "zstd_compress",	ZSTD_COMPRESS },		/* from pcp-6.0.3 */
 };
 
 void
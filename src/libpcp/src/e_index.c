@@ -229,6 +229,7 @@ __pmLogLoadIndex(__pmLogCtl *lcp)
 
     lcp->numti = 0;
     lcp->ti = NULL;
+    lcp->tiorder = 1;
 
     if (__pmLogVersion(lcp) == PM_LOG_VERS03)
 	record_size = sizeof(__pmTI_v3);
@@ -296,6 +297,23 @@ __pmLogLoadIndex(__pmLogCtl *lcp)
 		tip->off_data = ntohl(tip_v2->off_data);
 	    }
 
+	    /*
+	     * __pmLogSetTime can only binary search an index that is in
+	     * order, so note any entry that goes backwards
+	     */
+	    if (lcp->numti > 0 && lcp->tiorder) {
+		__pmLogTI	*prev = tip - 1;
+
+		if (tip->vol < prev->vol ||
+		    (tip->vol == prev->vol && tip->off_data < prev->off_data) ||
+		    __pmTimestampSub(&tip->stamp, &prev->stamp) < 0) {
+		    if (pmDebugOptions.log)
+			fprintf(stderr, "%s: TI entry %d out of order\n",
+				"__pmLogLoadIndex", lcp->numti);
+		    lcp->tiorder = 0;
+		}
+	    }
+
 	    lcp->numti++;
 	}
     }
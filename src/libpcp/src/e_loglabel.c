@@ -171,7 +171,13 @@ __pmLogWriteLabel(__pmFILE *f, const __pmLogLabel *lp)
 	pmflush();
 	return -oserror();
     }
-    
+
+    /*
+     * for a compressed data volume, make the label visible to readers
+     * now, rather than at the next sync point
+     */
+    __pmFflush(f);
+
     return 0;
 }
 
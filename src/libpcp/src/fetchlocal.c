@@ -23,6 +23,13 @@
 static pmID *splitlist;
 static int splitmax;
 
+/*
+ * The answer is assembled here, copying each DSO's pmValueSets as
+ * they arrive, so the caller gets a result that (like one decoded
+ * from a PDU) lives in a single pdubuf.
+ */
+static __pmResultArena arena;
+
 static int
 resize_splitlist(int numpmid)
 {
@@ -42,21 +49,21 @@ resize_splitlist(int numpmid)
 
 static int
 copyvset(const char *caller, pmID pmid, int sts,
-		pmValueSet **tmpvset, int n, pmValueSet **ansvset, int k)
+		pmValueSet **tmpvset, int n, int k)
 {
+    pmValueSet	*vsp;
+    int		lsts;
+
     if (sts < 0) {
-	ansvset[k] = (pmValueSet *)malloc(sizeof(pmValueSet));
-	if (ansvset[k] == NULL) {
-	    /* cleanup all partial allocations for ansvset[] */
-	    for (k--; k >=0; k--)
-		free(ansvset[k]);
-	    return -oserror();
-	}
-	ansvset[k]->numval = sts;
-	ansvset[k]->pmid = pmid;
+	if ((lsts = __pmResultArenaAddValueSet(&arena, k, pmid, 0)) < 0)
+	    return lsts;
+	vsp = __pmResultArenaValueSet(&arena, k);
+	vsp->numval = sts;
     }
     else {
-	ansvset[k] = tmpvset[n];
+	if ((lsts = __pmResultArenaCopyValueSet(&arena, k, tmpvset[n])) < 0)
+	    return lsts;
+	vsp = __pmResultArenaValueSet(&arena, k);
     }
 
     if (pmDebugOptions.fetch) {
@@ -65,11 +72,11 @@ copyvset(const char *caller, pmID pmid, int sts,
 
 	fprintf(stderr, "%s: [%d] PMID=%s nval=",
 		caller, k, pmIDStr_r(pmid, strbuf, sizeof(strbuf)));
-	if (ansvset[k]->numval < 0)
+	if (vsp->numval < 0)
 	    fprintf(stderr, "%s\n",
-		    pmErrStr_r(ansvset[k]->numval, errmsg, sizeof(errmsg)));
+		    pmErrStr_r(vsp->numval, errmsg, sizeof(errmsg)));
 	else
-	    fprintf(stderr, "%d\n", ansvset[k]->numval);
+	    fprintf(stderr, "%d\n", vsp->numval);
     }
 
     return 0;
@@ -173,20 +180,18 @@ __pmFetchLocal(__pmContext *ctxp, int numpmid, pmID pmidlist[], __pmResult **res
      * 
      * So we make a __pmResult, selectively copy and return it.
      */
+    if ((sts = __pmResultArenaStart(&arena, numpmid)) < 0)
+	return sts;
     if ((ans = __pmAllocResult(numpmid)) == NULL)
 	return -oserror();
 
-    /* mark all metrics as not picked, yet */
-    for (j = 0; j < numpmid; j++)
-	ans->vset[j] = NULL;
-
     ans->numpmid = numpmid;
     __pmGetTimestamp(&ans->timestamp);
 
     for (j = 0; j < numpmid; j++) {
 	int cnt, res;
 
-	if (ans->vset[j] != NULL)
+	if (__pmResultArenaValueSet(&arena, j) != NULL)
 	    /* picked up in a previous fetch */
 	    continue;
 
@@ -196,20 +201,30 @@ __pmFetchLocal(__pmContext *ctxp, int numpmid, pmID pmidlist[], __pmResult **res
 	/* Copy results back
 	 *
 	 * Note: We DO NOT have to free tmp_ans since DSO PMDA would
-	 *		ALWAYS return a pointer to the static area.
+	 *		ALWAYS return a pointer to the static area, but
+	 *		the values are ours to release once copied.
 	 */
-	for (n = 0, k = j; k < numpmid && n < cnt; k++) {
+	for (sts = 0, n = 0, k = j; k < numpmid && n < cnt; k++) {
 	    if (pmidlist[k] == splitlist[n]) {
 		sts = copyvset("__pmFetchLocal", splitlist[n], res,
-				tmp_ans->vset, n, ans->vset, k);
-		if (sts < 0) {
-		    free(ans);
-		    return sts;
-		}
+				tmp_ans->vset, n, k);
+		if (sts < 0)
+		    break;
 		n++;
 	    }
 	}
+	if (res >= 0)
+	    __pmFreeResultValues(tmp_ans);
+	if (sts < 0)
+	    goto fail;
     }
+    if ((sts = __pmResultArenaFinish(&arena, ans->vset)) < 0)
+	goto fail;
     *result = ans;
     return 0;
+
+fail:
+    ans->numpmid = 0;
+    __pmFreeResult(ans);
+    return sts;
 }
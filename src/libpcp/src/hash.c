@@ -17,6 +17,177 @@
 #include "libpcp.h"
 #include <stddef.h>
 
+/*
+ * The bucket array and chains of __pmHashNode are visible to callers,
+ * some of which walk hash[0 .. hsize-1] directly, and the order of such
+ * walks is reflected in (for example) archive metadata dumps, so bucket
+ * selection and table growth are unchanged here.
+ *
+ * Once a table holding more than INDEX_MIN nodes is searched, lookups
+ * are instead served from an open-addressing index of (key, node) slots,
+ * using linear probing on a multiplicative hash of the key.  This avoids
+ * chasing chains of nodes scattered across the heap - and keys that
+ * are not uniformly distributed modulo hsize (such as PMIDs, with
+ * their domain and cluster bit fields) no longer produce long chains
+ * for __pmHashSearch.  For duplicate keys the index refers to the node
+ * a chain search would find, i.e. the first one on the key's chain.
+ *
+ * The index is built by __pmHashAdd once a table holds more than
+ * INDEX_MIN nodes, and rebuilt (larger) when it fills or the bucket
+ * array is resized, so __pmHashSearch never modifies the table.  The
+ * index hangs off hcp->lookup, and is released by __pmHashClear and
+ * __pmHashFree.
+ */
+#define INDEX_MIN	64
+
+typedef struct {
+    unsigned int	key;
+    __pmHashNode	*node;		/* NULL for an empty slot */
+} hashslot_t;
+
+typedef struct __pmHashIndex {
+    unsigned int	mask;		/* number of slots - 1 */
+    unsigned int	used;
+    hashslot_t		slot[1];
+} hashindex_t;
+
+static inline unsigned int
+index_hash(unsigned int key, unsigned int mask)
+{
+    /* MurmurHash3 finalizer, every key bit affects every index bit */
+    key ^= key >> 16;
+    key *= 0x85ebca6bU;
+    key ^= key >> 13;
+    key *= 0xc2b2ae35U;
+    key ^= key >> 16;
+    return key & mask;
+}
+
+static hashslot_t *
+index_find(const hashindex_t *ip, unsigned int key)
+{
+    unsigned int	i;
+
+    for (i = index_hash(key, ip->mask); ip->slot[i].node != NULL; i = (i + 1) & ip->mask) {
+	if (ip->slot[i].key == key)
+	    return (hashslot_t *)&ip->slot[i];
+    }
+    return NULL;
+}
+
+/*
+ * Point the index entry for key at node, unless replace is zero and
+ * the key is already present.  There is always at least one empty
+ * slot, as __pmHashAdd rebuilds the index once it is 3/4 full.
+ */
+static void
+index_put(hashindex_t *ip, unsigned int key, __pmHashNode *node, int replace)
+{
+    unsigned int	i;
+
+    for (i = index_hash(key, ip->mask); ip->slot[i].node != NULL; i = (i + 1) & ip->mask) {
+	if (ip->slot[i].key == key) {
+	    if (replace)
+		ip->slot[i].node = node;
+	    return;
+	}
+    }
+    ip->slot[i].key = key;
+    ip->slot[i].node = node;
+    ip->used++;
+}
+
+/*
+ * Remove a slot, shifting later entries of the probe sequence back
+ * into the hole (so no tombstones are needed).
+ */
+static void
+index_remove(hashindex_t *ip, hashslot_t *sp)
+{
+    unsigned int	i = sp - ip->slot;
+    unsigned int	j, k;
+
+    for (j = (i + 1) & ip->mask; ip->slot[j].node != NULL; j = (j + 1) & ip->mask) {
+	k = index_hash(ip->slot[j].key, ip->mask);
+	/* can slot j move back to i, i.e. is k cyclically outside (i, j] */
+	if ((i <= j) ? (i < k && k <= j) : (i < k || k <= j))
+	    continue;
+	ip->slot[i] = ip->slot[j];
+	i = j;
+    }
+    ip->slot[i].node = NULL;
+    ip->used--;
+}
+
+/*
+ * Build the index from the bucket chains, indexing only the first
+ * node seen for any key.  On failure the table is simply
+ * left without an index, and lookups fall back to the chains.
+ */
+static void
+index_build(__pmHashCtl *hcp, unsigned int nslots)
+{
+    hashindex_t		*ip;
+    __pmHashNode	*hp;
+    int			n;
+
+    free(hcp->lookup);
+    hcp->lookup = NULL;
+    ip = (hashindex_t *)calloc(1, sizeof(hashindex_t) + (nslots - 1) * sizeof(hashslot_t));
+    if (ip == NULL)
+	return;
+    ip->mask = nslots - 1;
+    for (n = 0; n < hcp->hsize; n++) {
+	for (hp = hcp->hash[n]; hp != NULL; hp = hp->next)
+	    index_put(ip, hp->key, hp, 0);
+    }
+    hcp->lookup = ip;
+}
+
+/*
+ * (Re)build the index for a table large enough to benefit, at most
+ * half full so the table can grow by half again before it is rebuilt.
+ */
+static void
+index_create(__pmHashCtl *hcp)
+{
+    unsigned int	nslots = 4 * INDEX_MIN;
+
+    if (hcp->nodes <= INDEX_MIN) {
+	free(hcp->lookup);	/* chains are short enough */
+	hcp->lookup = NULL;
+	return;
+    }
+    while (nslots < (unsigned int)hcp->nodes * 2)
+	nslots *= 2;
+    index_build(hcp, nslots);
+}
+
+/*
+ * Node hp has been unlinked from its chain - if the index refers to
+ * it, refer instead to the next node on the chain with the same key,
+ * else drop the key from the index.  Nodes with that key ahead of hp
+ * would have been indexed instead of hp, so the search starts from
+ * hp->next.
+ */
+static void
+index_unlink(__pmHashCtl *hcp, const __pmHashNode *hp)
+{
+    hashindex_t		*ip = hcp->lookup;
+    hashslot_t		*sp;
+    __pmHashNode	*tp;
+
+    if (ip == NULL || (sp = index_find(ip, hp->key)) == NULL || sp->node != hp)
+	return;
+    for (tp = hp->next; tp != NULL; tp = tp->next) {
+	if (tp->key == hp->key) {
+	    sp->node = tp;
+	    return;
+	}
+    }
+    index_remove(ip, sp);
+}
+
 void
 __pmHashInit(__pmHashCtl *hcp)
 {
@@ -43,10 +214,14 @@ __pmHashNode *
 __pmHashSearch(unsigned int key, __pmHashCtl *hcp)
 {
     __pmHashNode	*hp;
+    hashslot_t		*sp;
 
     if (hcp->hsize == 0)
 	return NULL;
 
+    if (hcp->lookup != NULL)
+	return (sp = index_find(hcp->lookup, key)) != NULL ? sp->node : NULL;
+
     for (hp = hcp->hash[key % hcp->hsize]; hp != NULL; hp = hp->next) {
 	if (hp->key == key)
 	    return hp;
@@ -58,7 +233,9 @@ int
 __pmHashAdd(unsigned int key, void *data, __pmHashCtl *hcp)
 {
     __pmHashNode    *hp;
+    hashindex_t	    *ip;
     int		k;
+    int		relinked = 0;
 
     hcp->nodes++;
 
@@ -96,6 +273,7 @@ __pmHashAdd(unsigned int key, void *data, __pmHashCtl *hcp)
 	    }
 	}
 	free(old);
+	relinked = 1;
     }
 
     if ((hp = (__pmHashNode *)malloc(sizeof(__pmHashNode))) == NULL)
@@ -107,6 +285,16 @@ __pmHashAdd(unsigned int key, void *data, __pmHashCtl *hcp)
     hp->next = hcp->hash[k];
     hcp->hash[k] = hp;
 
+    /*
+     * re-linking reverses the chain order of duplicate keys, so the
+     * index is rebuilt from the chains then, as well as when it fills
+     */
+    if ((ip = hcp->lookup) != NULL && !relinked &&
+	(ip->used + 1) * 4 <= (ip->mask + 1) * 3)
+	index_put(ip, key, hp, 1);
+    else
+	index_create(hcp);
+
     return 1;
 }
 
@@ -118,6 +306,8 @@ __pmHashDel(unsigned int key, void *data, __pmHashCtl *hcp)
 
     if (hcp->hsize == 0)
 	return 0;
+    if (hcp->lookup != NULL && index_find(hcp->lookup, key) == NULL)
+	return 0;
 
     for (hp = hcp->hash[key % hcp->hsize]; hp != NULL; hp = hp->next) {
 	if (hp->key == key && hp->data == data) {
@@ -125,6 +315,7 @@ __pmHashDel(unsigned int key, void *data, __pmHashCtl *hcp)
 		hcp->hash[key % hcp->hsize] = hp->next;
 	    else
 		lhp->next = hp->next;
+	    index_unlink(hcp, hp);
 	    free(hp);
 	    hcp->nodes--;
 	    return 1;
@@ -138,6 +329,8 @@ __pmHashDel(unsigned int key, void *data, __pmHashCtl *hcp)
 void
 __pmHashClear(__pmHashCtl *hcp)
 {
+    free(hcp->lookup);
+    hcp->lookup = NULL;
     if (hcp->hsize != 0) {
 	free(hcp->hash);
 	hcp->hash = NULL;
@@ -166,6 +359,7 @@ __pmHashWalkCB(__pmHashWalkCallback cb, void *cdata, const __pmHashCtl *hcp)
             switch (state) {
             case PM_HASH_WALK_DELETE_STOP:
                 *tpp = tp->next;  /* unlink */
+                index_unlink((__pmHashCtl *)hcp, tp);
                 free(tp);         /* delete */
                 return;           /* & stop */
 
@@ -179,6 +373,7 @@ __pmHashWalkCB(__pmHashWalkCallback cb, void *cdata, const __pmHashCtl *hcp)
                 /* NB: do not change tpp.  It will still point at the previous
                  * node's "next" pointer.  Consider consecutive CONTINUE_DELETEs.
                  */
+                index_unlink((__pmHashCtl *)hcp, tp);
                 free(tp);         /* delete */
                 tp = *tpp; /* == tp->next, except that tp is already freed. */
                 break;            /* & next */
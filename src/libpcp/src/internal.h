@@ -340,6 +340,9 @@ extern int __pmGetArchiveEnd_ctx(__pmContext *, __pmTimestamp *) _PCP_HIDDEN;
 extern int __pmLogGenerateMark_ctx(__pmContext *, int, __pmResult **) _PCP_HIDDEN;
 extern int __pmLogCheckForNextArchive(__pmLogCtl *, int, __pmResult **) _PCP_HIDDEN;
 
+/* building pmValueSets in a __pmResultArena */
+extern int __pmStuffValueBody(const pmAtomValue *, pmValue *, int, const void **, size_t *) _PCP_HIDDEN;
+
 #ifdef BUILD_WITH_LOCK_ASSERTS
 #include <assert.h>
 #define PM_ASSERT_IS_LOCKED(lock) assert(__pmIsLocked(&(lock)))
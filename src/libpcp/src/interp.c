@@ -18,9 +18,9 @@
  * non-atomic updates ... we've decided that it is acceptable for their
  * values to be subject to possible (but unlikely) missed updates
  *
- * the one-trip initialization of ignore_mark_records and ignore_mark_gap
- * is not guarded as the same value would result from concurrent repeated
- * execution
+ * the one-trip initialization of ignore_mark_records, ignore_mark_gap
+ * and cache_maxbytes is not guarded as the same value would result from
+ * concurrent repeated execution
  */
 
 /*
@@ -108,18 +108,49 @@ typedef struct pmidcntl {		/* metric control */
     __pmHashCtl		hc;		/* metric-instances */
 } pmidcntl_t;
 
-typedef struct {
+/*
+ * Read cache of decoded pmResults from __pmLogRead, so that repeated
+ * scans backwards and forwards over the same region of an archive (as
+ * happens for every interpolated fetch) do not re-read and re-decode
+ * the same records.  Entries are found by the (archive, volume, file
+ * offset) of either end of the record, depending on the direction of
+ * the read, and replaced in LRU order once the cache size bound (in
+ * archive record bytes, $PCP_INTERP_CACHE_SIZE) is reached.
+ */
+typedef struct cache {
     __pmResult	*rp;		/* cached pmResult from __pmLogRead */
     int		sts;		/* from __pmLogRead */
-    char	*c_name;	/* log name */
+    int		log;		/* archive index (ac_cur_log), -1 if unused */
     int		vol;		/* log volume */
     long	head_posn;	/* posn in file before forwards __pmLogRead */
     long	tail_posn;	/* posn in file after forwards __pmLogRead */
     int		mode;		/* PM_MODE_FORW or PM_MODE_BACK */
-    int		used;		/* used count for LFU replacement */
+    size_t	size;		/* accounted size of this entry (bytes) */
+    struct cache *prev;		/* LRU list, more recently used */
+    struct cache *next;		/* LRU list, less recently used */
+    struct cache *head_chain;	/* hash chain, by head_posn */
+    struct cache *tail_chain;	/* hash chain, by tail_posn */
 } cache_t;
 
-#define NUMCACHE 4
+typedef struct {
+    cache_t	*first;		/* most recently used entry */
+    cache_t	*last;		/* least recently used entry */
+    cache_t	**head_hash;	/* entries hashed by head_posn */
+    cache_t	**tail_hash;	/* entries hashed by tail_posn */
+    unsigned int hsize;		/* number of hash buckets (power of 2) */
+    unsigned int count;		/* number of entries */
+    size_t	bytes;		/* sum of entry sizes */
+    size_t	maxbytes;	/* size bound, see $PCP_INTERP_CACHE_SIZE */
+    unsigned long hits;		/* lookups satisfied from the cache */
+    unsigned long misses;	/* lookups needing a __pmLogRead */
+    unsigned long evictions;	/* entries replaced (LRU) */
+} cachectl_t;
+
+#define NUMCACHE 4		/* always keep this many, whatever the size */
+#define CACHE_HASH_INIT 64	/* initial number of hash buckets */
+#define CACHE_SIZE_DEFAULT (16*1024*1024)
+
+static size_t	cache_maxbytes = (size_t)-1;	/* not yet initialized */
 
 /*
  * diagnostic counters ... indexed by PM_MODE_FORW (2) and
@@ -128,6 +159,203 @@ typedef struct {
 static long	nr_cache[PM_MODE_BACK+1];
 static long	nr[PM_MODE_BACK+1];
 
+static size_t
+cache_size_config(void)
+{
+    size_t	size = CACHE_SIZE_DEFAULT;
+    char	*str, *endnum;
+    long long	val;
+
+    PM_LOCK(__pmLock_extcall);
+    if ((str = getenv("PCP_INTERP_CACHE_SIZE")) != NULL) {	/* THREADSAFE */
+	val = strtoll(str, &endnum, 10);
+	if (*endnum == 'k' || *endnum == 'K')
+	    val *= 1024, endnum++;
+	else if (*endnum == 'm' || *endnum == 'M')
+	    val *= 1024 * 1024, endnum++;
+	else if (*endnum == 'g' || *endnum == 'G')
+	    val *= 1024 * 1024 * 1024, endnum++;
+	if (*endnum != '\0' || val < 0)
+	    fprintf(stderr, "%s: Warning: bad $PCP_INTERP_CACHE_SIZE: \"%s\" ignored\n",
+		    pmGetProgname(), str);
+	else
+	    size = (size_t)val;
+    }
+    PM_UNLOCK(__pmLock_extcall);
+    return size;
+}
+
+/*
+ * size of a decoded pmResult, for entries that have no archive record
+ * extent to account them by
+ */
+static size_t
+cache_result_size(__pmResult *rp)
+{
+    pmValueSet	*vsp;
+    size_t	size;
+    int		i, j;
+
+    size = sizeof(__pmResult) + rp->numpmid * sizeof(pmValueSet *);
+    for (i = 0; i < rp->numpmid; i++) {
+	if ((vsp = rp->vset[i]) == NULL)
+	    continue;
+	size += sizeof(pmValueSet);
+	if (vsp->numval > 1)
+	    size += (vsp->numval - 1) * sizeof(pmValue);
+	if (vsp->numval > 0 && vsp->valfmt != PM_VAL_INSITU) {
+	    for (j = 0; j < vsp->numval; j++)
+		size += vsp->vlist[j].value.pval->vlen;
+	}
+    }
+    return size;
+}
+
+static inline unsigned int
+cache_hash(cachectl_t *ccp, int vol, long posn)
+{
+    return ((unsigned long)posn * 2654435761UL + vol) & (ccp->hsize - 1);
+}
+
+static void
+cache_hash_insert(cachectl_t *ccp, cache_t *cp)
+{
+    unsigned int	k;
+
+    k = cache_hash(ccp, cp->vol, cp->head_posn);
+    cp->head_chain = ccp->head_hash[k];
+    ccp->head_hash[k] = cp;
+    k = cache_hash(ccp, cp->vol, cp->tail_posn);
+    cp->tail_chain = ccp->tail_hash[k];
+    ccp->tail_hash[k] = cp;
+}
+
+static void
+cache_hash_remove(cachectl_t *ccp, cache_t *cp)
+{
+    cache_t		**cpp;
+
+    if (cp->log < 0)	/* never hashed */
+	return;
+    for (cpp = &ccp->head_hash[cache_hash(ccp, cp->vol, cp->head_posn)];
+	 *cpp != NULL; cpp = &(*cpp)->head_chain) {
+	if (*cpp == cp) {
+	    *cpp = cp->head_chain;
+	    break;
+	}
+    }
+    for (cpp = &ccp->tail_hash[cache_hash(ccp, cp->vol, cp->tail_posn)];
+	 *cpp != NULL; cpp = &(*cpp)->tail_chain) {
+	if (*cpp == cp) {
+	    *cpp = cp->tail_chain;
+	    break;
+	}
+    }
+}
+
+/*
+ * double the number of hash buckets, keeping average chain length low
+ */
+static int
+cache_hash_grow(cachectl_t *ccp)
+{
+    cache_t		**head_hash, **tail_hash;
+    cache_t		*cp;
+    unsigned int	hsize = ccp->hsize ? ccp->hsize * 2 : CACHE_HASH_INIT;
+
+    if ((head_hash = (cache_t **)calloc(hsize, sizeof(cache_t *))) == NULL)
+	return -ENOMEM;
+    if ((tail_hash = (cache_t **)calloc(hsize, sizeof(cache_t *))) == NULL) {
+	free(head_hash);
+	return -ENOMEM;
+    }
+    free(ccp->head_hash);
+    free(ccp->tail_hash);
+    ccp->head_hash = head_hash;
+    ccp->tail_hash = tail_hash;
+    ccp->hsize = hsize;
+    for (cp = ccp->first; cp != NULL; cp = cp->next) {
+	if (cp->log >= 0)
+	    cache_hash_insert(ccp, cp);
+    }
+    return 0;
+}
+
+static void
+cache_unlink(cachectl_t *ccp, cache_t *cp)
+{
+    if (cp->prev)
+	cp->prev->next = cp->next;
+    else
+	ccp->first = cp->next;
+    if (cp->next)
+	cp->next->prev = cp->prev;
+    else
+	ccp->last = cp->prev;
+    cp->prev = cp->next = NULL;
+}
+
+static void
+cache_push(cachectl_t *ccp, cache_t *cp)
+{
+    cp->prev = NULL;
+    cp->next = ccp->first;
+    if (ccp->first)
+	ccp->first->prev = cp;
+    else
+	ccp->last = cp;
+    ccp->first = cp;
+}
+
+static void
+cache_free_entry(cachectl_t *ccp, cache_t *cp)
+{
+    cache_hash_remove(ccp, cp);
+    cache_unlink(ccp, cp);
+    ccp->count--;
+    ccp->bytes -= cp->size;
+    if (cp->rp != NULL)
+	__pmFreeResult(cp->rp);
+    free(cp);
+}
+
+/*
+ * release least recently used entries until within the size bound,
+ * always keeping the most recent few (callers may still be using them)
+ */
+static void
+cache_trim(cachectl_t *ccp)
+{
+    while (ccp->count > NUMCACHE && ccp->bytes > ccp->maxbytes) {
+	cache_free_entry(ccp, ccp->last);
+	ccp->evictions++;
+    }
+}
+
+static cache_t *
+cache_lookup(cachectl_t *ccp, int log, int vol, long posn, int mode)
+{
+    cache_t		*cp;
+    unsigned int	k;
+
+    if (ccp->hsize == 0)
+	return NULL;
+    k = cache_hash(ccp, vol, posn);
+    if (mode == PM_MODE_FORW) {
+	for (cp = ccp->head_hash[k]; cp != NULL; cp = cp->head_chain) {
+	    if (cp->head_posn == posn && cp->vol == vol && cp->log == log)
+		return cp;
+	}
+    }
+    else {
+	for (cp = ccp->tail_hash[k]; cp != NULL; cp = cp->tail_chain) {
+	    if (cp->tail_posn == posn && cp->vol == vol && cp->log == log)
+		return cp;
+	}
+    }
+    return NULL;
+}
+
 /*
  * called with the context lock held
  */
@@ -137,10 +365,8 @@ cache_read(__pmContext *ctxp, int mode, __pmResult **rp)
     __pmArchCtl	*acp = ctxp->c_archctl;
     long	posn;
     cache_t	*cp;
-    cache_t	*lfup;
-    cache_t	*cache;
-    char	*save_curlog_name;
-    int		sts;
+    cachectl_t	*ccp;
+    int		save_curlog;
     int		save_curvol;
     int		archive_changed;
 
@@ -149,7 +375,7 @@ cache_read(__pmContext *ctxp, int mode, __pmResult **rp)
      * changed direction, then we need to generate that record again.
      */
     if (acp->ac_mark_done != 0 && acp->ac_mark_done != mode) {
-	sts = __pmLogGenerateMark_ctx(ctxp, acp->ac_mark_done, rp);
+	int	sts = __pmLogGenerateMark_ctx(ctxp, acp->ac_mark_done, rp);
 	acp->ac_mark_done = 0;
 	return sts;
     }
@@ -164,13 +390,15 @@ cache_read(__pmContext *ctxp, int mode, __pmResult **rp)
 
     if (acp->ac_cache == NULL) {
 	/* cache initialization */
-	acp->ac_cache = cache = (cache_t *)calloc(NUMCACHE, sizeof(cache_t));
-	if (!cache)
+	if (cache_maxbytes == (size_t)-1)
+	    cache_maxbytes = cache_size_config();
+	acp->ac_cache = ccp = (cachectl_t *)calloc(1, sizeof(cachectl_t));
+	if (!ccp)
 	    return -ENOMEM;
-	acp->ac_cache_idx = 0;
+	ccp->maxbytes = cache_maxbytes;
     }
     else
-	cache = acp->ac_cache;
+	ccp = (cachectl_t *)acp->ac_cache;
 
     if (pmDebugOptions.log && pmDebugOptions.desperate) {
 	fprintf(stderr, "cache_read: fd=%d mode=%s vol=%d (curvol=%d) %s_posn=%ld ",
@@ -181,116 +409,113 @@ cache_read(__pmContext *ctxp, int mode, __pmResult **rp)
 	    (long)posn);
     }
 
-    acp->ac_cache_idx = (acp->ac_cache_idx + 1) % NUMCACHE;
-    lfup = &cache[acp->ac_cache_idx];
-    for (cp = cache; cp < &cache[NUMCACHE]; cp++) {
-	if (cp->c_name != NULL && strcmp(cp->c_name, acp->ac_log->name) == 0 &&
-	    cp->vol == acp->ac_vol &&
-	    ((mode == PM_MODE_FORW && cp->head_posn == posn) ||
-	     (mode == PM_MODE_BACK && cp->tail_posn == posn)) &&
-	    cp->rp != NULL) {
-	    *rp = cp->rp;
-	    cp->used++;
-	    if (mode == PM_MODE_FORW)
-		__pmFseek(acp->ac_mfp, cp->tail_posn, SEEK_SET);
-	    else
-		__pmFseek(acp->ac_mfp, cp->head_posn, SEEK_SET);
-	    if (pmDebugOptions.log && pmDebugOptions.desperate) {
-		__pmTimestamp	tmp;
-		double		t_this;
-		tmp = cp->rp->timestamp;	/* struct assignment */
-		t_this = __pmTimestampSub(&tmp, __pmLogStartTime(acp));
-		fprintf(stderr, "hit cache[%d] t=%.6f\n",
-			(int)(cp - cache), t_this);
-		nr_cache[mode]++;
-	    }
-	    acp->ac_mark_done = 0;
-	    sts = cp->sts;
-	    return sts;
+    if (posn != 0 &&
+	(cp = cache_lookup(ccp, acp->ac_cur_log, acp->ac_vol, posn, mode)) != NULL) {
+	*rp = cp->rp;
+	if (cp != ccp->first) {
+	    cache_unlink(ccp, cp);
+	    cache_push(ccp, cp);
+	}
+	if (mode == PM_MODE_FORW)
+	    __pmFseek(acp->ac_mfp, cp->tail_posn, SEEK_SET);
+	else
+	    __pmFseek(acp->ac_mfp, cp->head_posn, SEEK_SET);
+	if (pmDebugOptions.log && pmDebugOptions.desperate) {
+	    __pmTimestamp	tmp;
+	    double		t_this;
+	    tmp = cp->rp->timestamp;	/* struct assignment */
+	    t_this = __pmTimestampSub(&tmp, __pmLogStartTime(acp));
+	    fprintf(stderr, "hit cache[%u] t=%.6f\n", ccp->count, t_this);
 	}
+	nr_cache[mode]++;
+	ccp->hits++;
+	acp->ac_mark_done = 0;
+	return cp->sts;
     }
 
     if (pmDebugOptions.log && pmDebugOptions.desperate)
 	fprintf(stderr, "miss\n");
     nr[mode]++;
+    ccp->misses++;
 
-    if (lfup->rp != NULL)
-	__pmFreeResult(lfup->rp);
+    if ((cp = (cache_t *)calloc(1, sizeof(cache_t))) == NULL)
+	return -ENOMEM;
+    cp->log = -1;
+    cp->size = sizeof(cache_t);
+    cache_push(ccp, cp);
+    ccp->count++;
+    ccp->bytes += cp->size;
 
     /*
      * We need to know when we cross archive or volume boundaries.
-     * The only way to know if the archive has changed is to check whether the
-     * archive name has changed.
+     * The archive index changes when we cross archive boundaries in
+     * a multi-archive context.
      */
-    if ((save_curlog_name = strdup(acp->ac_log->name)) == NULL) {
-	pmNoMem("__pmLogFetchInterp.save_curlog_name",
-		  strlen(acp->ac_log->name) + 1, PM_FATAL_ERR);
-    }
+    save_curlog = acp->ac_cur_log;
     save_curvol = acp->ac_curvol;
 
-    lfup->sts = __pmLogRead_ctx(ctxp, mode, NULL, &lfup->rp, PMLOGREAD_NEXT);
-    if (lfup->sts < 0)
-	lfup->rp = NULL;
-    *rp = lfup->rp;
+    cp->sts = __pmLogRead_ctx(ctxp, mode, NULL, &cp->rp, PMLOGREAD_NEXT);
+    if (cp->sts < 0)
+	cp->rp = NULL;
+    *rp = cp->rp;
 
-    archive_changed = strcmp(save_curlog_name, acp->ac_log->name) != 0;
-    free(save_curlog_name);
+    archive_changed = save_curlog != acp->ac_cur_log;
 
     /*
      * vol/arch switch since last time, or vol/arch switch or virtual mark
      * record generated in __pmLogRead_ctx() ...
      * new vol/arch, stdio stream and we don't know where we started from
-     * ... don't cache
+     * ... don't cache (the entry is kept only until replaced, but
+     * the decoded result still counts towards the size bound)
      */
     if (posn == 0 || save_curvol != acp->ac_curvol || archive_changed ||
-	acp->ac_mark_done) {
-	if (lfup->c_name) {
-	    free(lfup->c_name);
-	    lfup->c_name = NULL;
+	acp->ac_mark_done || cp->rp == NULL) {
+	if (cp->rp != NULL) {
+	    size_t	size = cache_result_size(cp->rp);
+	    ccp->bytes += size;
+	    cp->size += size;
 	}
 	if (pmDebugOptions.log && pmDebugOptions.desperate)
-	    fprintf(stderr, "cache_read: reload vol switch, mark cache[%d] unused\n",
-		(int)(lfup - cache));
+	    fprintf(stderr, "cache_read: reload vol switch, mark cache entry unused\n");
     }
     else {
-	lfup->mode = mode;
-	lfup->vol = acp->ac_vol;
-	lfup->used = 1;
-	/* Try to avoid excessive copying/freeing of the archive name. */
-	if (lfup->c_name != NULL && strcmp(lfup->c_name, acp->ac_log->name) != 0) {
-	    free(lfup->c_name);
-	    lfup->c_name = NULL;
-	}
-	if (lfup->c_name == NULL) {
-	    if ((lfup->c_name = strdup(acp->ac_log->name)) == NULL) {
-		pmNoMem("__pmLogFetchInterp.name",
-			  strlen(acp->ac_log->name) + 1, PM_FATAL_ERR);
-	    }
-	}
+	cp->mode = mode;
+	cp->vol = acp->ac_vol;
 	if (mode == PM_MODE_FORW) {
-	    lfup->head_posn = posn;
-	    lfup->tail_posn = __pmFtell(acp->ac_mfp);
-	    assert(lfup->tail_posn >= 0);
+	    cp->head_posn = posn;
+	    cp->tail_posn = __pmFtell(acp->ac_mfp);
+	    assert(cp->tail_posn >= 0);
 	}
 	else {
-	    lfup->tail_posn = posn;
-	    lfup->head_posn = __pmFtell(acp->ac_mfp);
-	    assert(lfup->head_posn >= 0);
+	    cp->tail_posn = posn;
+	    cp->head_posn = __pmFtell(acp->ac_mfp);
+	    assert(cp->head_posn >= 0);
 	}
+	/* account for the decoded record by its size in the archive */
+	ccp->bytes += cp->tail_posn - cp->head_posn;
+	cp->size += cp->tail_posn - cp->head_posn;
+	if (ccp->count <= ccp->hsize || cache_hash_grow(ccp) == 0) {
+	    cp->log = acp->ac_cur_log;
+	    cache_hash_insert(ccp, cp);
+	}
+	/* else no memory to index this entry, so it cannot be found */
 	if (pmDebugOptions.log && pmDebugOptions.desperate) {
-	    fprintf(stderr, "cache_read: reload cache[%d] vol=%d (curvol=%d) head=%ld tail=%ld ",
-		(int)(lfup - cache), lfup->vol, acp->ac_curvol,
-		(long)lfup->head_posn, (long)lfup->tail_posn);
-	    if (lfup->sts == 0)
-		fprintf(stderr, "sts=%d\n", lfup->sts);
+	    fprintf(stderr, "cache_read: reload cache[%u] vol=%d (curvol=%d) head=%ld tail=%ld ",
+		ccp->count, cp->vol, acp->ac_curvol,
+		(long)cp->head_posn, (long)cp->tail_posn);
+	    if (cp->sts == 0)
+		fprintf(stderr, "sts=%d\n", cp->sts);
 	    else {
 		char	errmsg[PM_MAXERRMSGLEN];
-		fprintf(stderr, "sts=%s\n", pmErrStr_r(lfup->sts, errmsg, sizeof(errmsg)));
+		fprintf(stderr, "sts=%s\n", pmErrStr_r(cp->sts, errmsg, sizeof(errmsg)));
 	    }
 	}
     }
 
-    return lfup->sts;
+    /* entries used by our caller (this one, at least) are never trimmed */
+    cache_trim(ccp);
+
+    return cp->sts;
 }
 
 /*
@@ -924,7 +1149,7 @@ time_caliper(__pmContext *ctxp, instcntl_t *icp)
 	    pmNoMem("time_caliper.__pmLogTrimInDom", sizeof(__pmLogTrimInDom), PM_FATAL_ERR);
 	    /*NOTREACHED*/
 	}
-	indomp->hashinst.nodes = indomp->hashinst.hsize = 0;
+	__pmHashInit(&indomp->hashinst);
 	sts = __pmHashAdd((unsigned int)icp->metric->desc.indom, (void *)indomp, &lcp->trimindom);
 	if (sts < 0) {
 	    char	strbuf[20];
@@ -2255,12 +2480,7 @@ __pmFreeInterpData(__pmContext *ctxp)
 			free(last_ihp);
 		    }
 		}
-		if (pcp->hc.hash) {
-		    free(pcp->hc.hash);
-		    /* just being paranoid here */
-		    pcp->hc.hash = NULL;
-		}
-		pcp->hc.hsize = 0;
+		__pmHashClear(&pcp->hc);
 		if (last_hp != NULL) {
 		    if (last_hp->data != NULL)
 			free(last_hp->data);
@@ -2274,36 +2494,25 @@ __pmFreeInterpData(__pmContext *ctxp)
 		free(last_hp);
 	    }
 	}
-	if (hcp->hash) {
-	    free(hcp->hash);
-	    /* just being paranoid here */
-	    hcp->hash = NULL;
-	}
-	hcp->hsize = 0;
+	__pmHashClear(hcp);
     }
 
     if (ctxp->c_archctl->ac_cache != NULL) {
 	/* read cache allocated, work to be done */
-	cache_t		*cache = (cache_t *)ctxp->c_archctl->ac_cache;
-	cache_t		*cp;
-
-	for (cp = cache; cp < &cache[NUMCACHE]; cp++) {
-	    if (pmDebugOptions.log && pmDebugOptions.interp) {
-		fprintf(stderr, "read cache entry "
-			PRINTF_P_PFX "%p: c_name=%s rp="
-			PRINTF_P_PFX "%p\n",
-			cp, cp->c_name ? cp->c_name : "(none)",
-			cp->rp);
-	    }
-	    if (cp->c_name != NULL) {
-		free(cp->c_name);
-		cp->c_name = NULL;
-	    }
-	    if (cp->rp != NULL) {
-		__pmFreeResult(cp->rp);
-		cp->rp = NULL;
-	    }
-	    cp->used = 0;
+	cachectl_t	*ccp = (cachectl_t *)ctxp->c_archctl->ac_cache;
+
+	if (pmDebugOptions.log && pmDebugOptions.interp) {
+	    fprintf(stderr, "read cache: %lu hits, %lu misses, %lu evictions, "
+			"%u entries, %lu bytes (max %lu)\n",
+			ccp->hits, ccp->misses, ccp->evictions, ccp->count,
+			(unsigned long)ccp->bytes, (unsigned long)ccp->maxbytes);
 	}
+	while (ccp->first != NULL)
+	    cache_free_entry(ccp, ccp->first);
+	free(ccp->head_hash);
+	free(ccp->tail_hash);
+	ccp->head_hash = ccp->tail_hash = NULL;
+	ccp->hsize = 0;
+	/* control structure itself is released with the __pmArchCtl */
     }
 }
@@ -28,6 +28,9 @@ extern __pm_fops __pm_stdio;
 #if HAVE_TRANSPARENT_DECOMPRESSION && HAVE_LZMA_DECOMPRESSION
 extern __pm_fops __pm_xz;
 #endif
+#if HAVE_TRANSPARENT_DECOMPRESSION && HAVE_ZSTD_DECOMPRESSION
+extern __pm_fops __pm_zstd;
+#endif
 
 /*
  * Suffixes and associated compresssion application for compressed filenames.
@@ -39,12 +42,18 @@ extern __pm_fops __pm_xz;
 #define	USE_BZIP2	1
 #define USE_GZIP	2
 #define USE_XZ		3
+#define USE_ZSTD	4
 
 #if HAVE_TRANSPARENT_DECOMPRESSION && HAVE_LZMA_DECOMPRESSION
 #define TRANSPARENT_XZ (&__pm_xz)
 #else
 #define TRANSPARENT_XZ NULL
 #endif
+#if HAVE_TRANSPARENT_DECOMPRESSION && HAVE_ZSTD_DECOMPRESSION
+#define TRANSPARENT_ZSTD (&__pm_zstd)
+#else
+#define TRANSPARENT_ZSTD NULL
+#endif
 
 static const struct {
     const char	*suffix;
@@ -52,6 +61,7 @@ static const struct {
     __pm_fops   *handler;
 } compress_ctl[] = {
     { ".xz",	USE_XZ,	 	TRANSPARENT_XZ },
+    { ".zst",	USE_ZSTD,	TRANSPARENT_ZSTD },
     { ".lzma",	USE_XZ,		NULL },
     { ".bz2",	USE_BZIP2,	NULL },
     { ".bz",	USE_BZIP2,	NULL },
@@ -260,6 +270,10 @@ fopen_compress(const char *fname, int compress_ix)
 	cmd = "gzip";
 	arg = "-dc";
     }
+    else if (compress_ctl[compress_ix].appl == USE_ZSTD) {
+	cmd = "zstd";
+	arg = "-dc";
+    }
     else {
 	/* botch in compress_ctl[] ... should not happen */
 	if (pmDebugOptions.log) {
@@ -409,6 +423,7 @@ __pmAccess(const char *path, int amode)
 	    if (compress_ctl[compress_ix].appl == USE_BZIP2) use = "bzip2";
 	    else if (compress_ctl[compress_ix].appl == USE_GZIP) use = "gzip";
 	    else if (compress_ctl[compress_ix].appl == USE_XZ) use = "xz";
+	    else if (compress_ctl[compress_ix].appl == USE_ZSTD) use = "zstd";
 	    else use = "???";
 	    fprintf(stderr, "__pmAccess(\"%s\", \"%d\"): decompress: %s", path, amode, use);
 	    if (compress_ctl[compress_ix].handler != NULL)
@@ -429,7 +444,8 @@ __pmAccess(const char *path, int amode)
  * Open a PCP file with given mode and return a __pmFILE. An i/o
  * handler is automatically chosen based on filename suffix, e.g. .xz, .gz,
  * etc. The stdio pass-thru handler will be chosen for other files.
- * The stdio handler is the only handler currently supporting write operations.
+ * The stdio handler and the zstd handler (mode "w" only, writes appended
+ * at the end of the file) are the only handlers supporting write operations.
  * Return a valid __pmFILE pointer on success or NULL on failure.
  */
 __pmFILE *
@@ -458,6 +474,7 @@ __pmFopen(const char *path, const char *mode)
 	    if (compress_ctl[compress_ix].appl == USE_BZIP2) use = "bzip2";
 	    else if (compress_ctl[compress_ix].appl == USE_GZIP) use = "gzip";
 	    else if (compress_ctl[compress_ix].appl == USE_XZ) use = "xz";
+	    else if (compress_ctl[compress_ix].appl == USE_ZSTD) use = "zstd";
 	    else use = "???";
 	    fprintf(stderr, "__pmFopen(\"%s\", \"%s\"): decompress: %s", path, mode, use);
 	    if (compress_ctl[compress_ix].handler != NULL)
@@ -467,8 +484,14 @@ __pmFopen(const char *path, const char *mode)
     }
     if (compress_ix >= 0) {
 	if (mode[0] != 'r' || mode[1] != '\0') {
-	    /* We don't (yet) support opening compressed files for writing. */
-	    return NULL;
+	    /*
+	     * Only zstd compressed files can be opened for writing, and
+	     * only for on-the-fly compression, see __pmLogSetCompression().
+	     */
+	    if (compress_ctl[compress_ix].appl != USE_ZSTD ||
+		compress_ctl[compress_ix].handler == NULL ||
+		mode[0] != 'w' || mode[1] != '\0')
+		return NULL;
 	}
 
 	/* Use the compressed file name and select a handler. */
@@ -638,6 +661,7 @@ __pmStat(const char *path, struct stat *buf)
 	    if (compress_ctl[compress_ix].appl == USE_BZIP2) use = "bzip2";
 	    else if (compress_ctl[compress_ix].appl == USE_GZIP) use = "gzip";
 	    else if (compress_ctl[compress_ix].appl == USE_XZ) use = "xz";
+	    else if (compress_ctl[compress_ix].appl == USE_ZSTD) use = "zstd";
 	    else use = "???";
 	    fprintf(stderr, "__pmStat(\"%s\"): decompress: %s", path, use);
 	    if (compress_ctl[compress_ix].handler != NULL)
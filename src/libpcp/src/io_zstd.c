@@ -0,0 +1,1013 @@
+/*
+ * Copyright (c) 2026 Red Hat.
+ *
+ * This library is free software; you can redistribute it and/or modify it
+ * under the terms of the GNU Lesser General Public License as published
+ * by the Free Software Foundation; either version 2.1 of the License, or
+ * (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of MERCHANTABILITY
+ * or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU Lesser General Public
+ * License for more details.
+ */
+
+/*
+ * Transparent decompression of zstd compressed files, with random
+ * access by frame.
+ *
+ * Files in the zstd "seekable format" (as written by pmlogcompress(1))
+ * end with a skippable frame holding a seek table - the compressed and
+ * uncompressed size of every frame - so the frame containing any given
+ * uncompressed offset can be found without decompressing anything else.
+ * For other zstd files the frame table is built when the file is opened,
+ * by walking the frame and block headers; a file compressed as a single
+ * frame (the zstd(1) default) then works, but any access means
+ * decompressing the whole file.
+ *
+ * Decompressed frames are kept in a small LRU cache.
+ *
+ * Files may also be opened for writing (see __pmLogSetCompression()),
+ * in which case data is accumulated and written as an independent
+ * frame each time the file is flushed, or when a frame's worth of data
+ * is pending, and the seek table is appended when the file is closed.
+ * Until then, a reader sees a file that is still growing and with no
+ * seek table, so frames written since the last walk are found again
+ * by walking forward from the last complete frame, and a partly written
+ * frame at the end of the file is treated as not yet written.
+ */
+
+#include "config.h"
+#if HAVE_ZSTD_DECOMPRESSION
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdarg.h>
+#include <errno.h>
+#include <sys/types.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <zstd.h>
+#include "pmapi.h"
+#include "libpcp.h"
+
+#ifndef PCP_ZSTD_CACHE_FRAMES
+#define PCP_ZSTD_CACHE_FRAMES 8	/* decompressed frames in the cache */
+#endif
+#ifndef PCP_ZSTD_FRAME_SIZE
+#define PCP_ZSTD_FRAME_SIZE (1024*1024) /* most uncompressed bytes per frame */
+#endif
+
+/* Frame and seek table format, see RFC 8878 and the zstd seekable format */
+#define ZSTD_FRAME_MAGIC	0xFD2FB528U
+#define SKIPPABLE_MAGIC_MIN	0x184D2A50U
+#define SKIPPABLE_MAGIC_MAX	0x184D2A5FU
+#define SEEKTABLE_SKIPPABLE_MAGIC 0x184D2A5EU
+#define SEEKTABLE_MAGIC		0x8F92EAB1U	/* end of the seek table footer */
+#define SEEKTABLE_FOOTER_SIZE	9
+#define SEEKTABLE_CHECKSUM	0x80		/* descriptor, entries have checksum */
+#define SEEKTABLE_ENTRY_SIZE	8		/* entries written, no checksum */
+#define SKIPPABLE_HEADER_SIZE	8
+#define FRAME_HEADER_MAX	18
+#define BLOCK_HEADER_SIZE	3
+
+/* one zstd frame */
+typedef struct {
+    __uint64_t		coffset;	/* compressed (file) offset */
+    __uint64_t		csize;		/* compressed size */
+    __uint64_t		ustart;		/* first uncompressed offset */
+    __uint64_t		usize;		/* uncompressed size */
+} zframe_t;
+
+/* a decompressed frame in the cache */
+typedef struct {
+    __uint64_t		ustart;
+    __uint64_t		usize;
+    char		*data;
+} zcache_t;
+
+/* the file handle */
+typedef struct {
+    FILE		*f;
+    int			fd;
+    int			nframes;
+    int			maxframes;
+    zframe_t		*frames;
+    __uint64_t		walked;		/* end of the last complete frame */
+    zcache_t		cache[PCP_ZSTD_CACHE_FRAMES];	/* MRU first */
+    ZSTD_DCtx		*dctx;
+    off_t		uncompressed_offset;
+    __uint64_t		uncompressed_size;
+    size_t		hits;
+    size_t		misses;
+    /* only used for writing */
+    ZSTD_CCtx		*cctx;
+    char		*pending;	/* data for the next frame */
+    size_t		npending;
+    char		*cbuf;		/* compressed frame */
+    size_t		cbufsize;
+    int			error;
+    double		ctime;		/* seconds spent compressing */
+} zstdfile_t;
+
+static void
+zstd_debug(const char *fmt, ...)
+{
+    va_list	ap;
+
+    if (pmDebugOptions.compress) {
+	va_start(ap, fmt);
+	vfprintf(stderr, fmt, ap);
+	fputc('\n', stderr);
+	va_end(ap);
+    }
+}
+
+static __uint32_t
+get_le32(const unsigned char *p)
+{
+    return (__uint32_t)p[0] | ((__uint32_t)p[1] << 8) |
+	   ((__uint32_t)p[2] << 16) | ((__uint32_t)p[3] << 24);
+}
+
+static int
+read_at(int fd, void *buf, size_t len, __uint64_t offset)
+{
+    ssize_t	n;
+    size_t	done = 0;
+
+    while (done < len) {
+	n = pread(fd, (char *)buf + done, len - done, (off_t)(offset + done));
+	if (n <= 0) {
+	    if (n < 0)
+		zstd_debug("%s(%d, ...): pread: %s", "read_at", fd, strerror(errno));
+	    return -1;
+	}
+	done += n;
+    }
+    return 0;
+}
+
+static int
+add_frame(zstdfile_t *zf, __uint64_t coffset, __uint64_t csize,
+		__uint64_t usize)
+{
+    zframe_t	*fp;
+
+    if (zf->nframes == zf->maxframes) {
+	int	newmax = zf->maxframes ? zf->maxframes * 2 : 64;
+
+	if ((fp = realloc(zf->frames, newmax * sizeof(zframe_t))) == NULL) {
+	    pmNoMem("zstd frames", newmax * sizeof(zframe_t), PM_RECOV_ERR);
+	    return -1;
+	}
+	zf->frames = fp;
+	zf->maxframes = newmax;
+    }
+    fp = &zf->frames[zf->nframes];
+    fp->coffset = coffset;
+    fp->csize = csize;
+    fp->ustart = zf->nframes ? fp[-1].ustart + fp[-1].usize : 0;
+    fp->usize = usize;
+    zf->nframes++;
+    zf->walked = coffset + csize;
+    /* when writing, the size already includes this (and pending) data */
+    if (zf->uncompressed_size < fp->ustart + usize)
+	zf->uncompressed_size = fp->ustart + usize;
+    return 0;
+}
+
+/*
+ * Build the frame table from a seek table at the end of the file,
+ * returns 0 if there is no seek table, 1 if found, -1 on error.
+ */
+static int
+parse_seektable(zstdfile_t *zf, __uint64_t filesize)
+{
+    unsigned char	footer[SEEKTABLE_FOOTER_SIZE];
+    unsigned char	header[SKIPPABLE_HEADER_SIZE];
+    unsigned char	*table, *p;
+    __uint64_t		tablesize, coffset;
+    __uint32_t		count;
+    size_t		entrysize;
+    int			i;
+
+    if (filesize < SKIPPABLE_HEADER_SIZE + SEEKTABLE_FOOTER_SIZE)
+	return 0;
+    if (read_at(zf->fd, footer, sizeof(footer), filesize - sizeof(footer)) < 0)
+	return -1;
+    if (get_le32(&footer[5]) != SEEKTABLE_MAGIC)
+	return 0;
+
+    count = get_le32(&footer[0]);
+    entrysize = (footer[4] & SEEKTABLE_CHECKSUM) ? 12 : 8;
+    tablesize = (__uint64_t)count * entrysize + SEEKTABLE_FOOTER_SIZE;
+    if (tablesize + SKIPPABLE_HEADER_SIZE > filesize) {
+	zstd_debug("%s(%d, ...): seek table size %llu too big",
+		"parse_seektable", zf->fd, (unsigned long long)tablesize);
+	return -1;
+    }
+    if (read_at(zf->fd, header, sizeof(header),
+		filesize - tablesize - SKIPPABLE_HEADER_SIZE) < 0)
+	return -1;
+    if (get_le32(&header[0]) < SKIPPABLE_MAGIC_MIN ||
+	get_le32(&header[0]) > SKIPPABLE_MAGIC_MAX ||
+	get_le32(&header[4]) != tablesize) {
+	zstd_debug("%s(%d, ...): bad seek table frame header",
+		"parse_seektable", zf->fd);
+	return -1;
+    }
+    if ((table = malloc(tablesize)) == NULL) {
+	pmNoMem("zstd seek table", tablesize, PM_RECOV_ERR);
+	return -1;
+    }
+    if (read_at(zf->fd, table, tablesize, filesize - tablesize) < 0) {
+	free(table);
+	return -1;
+    }
+    coffset = 0;
+    for (i = 0, p = table; i < count; i++, p += entrysize) {
+	if (add_frame(zf, coffset, get_le32(p), get_le32(p+4)) < 0) {
+	    free(table);
+	    return -1;
+	}
+	coffset += get_le32(p);
+    }
+    free(table);
+
+    if (coffset + tablesize + SKIPPABLE_HEADER_SIZE != filesize) {
+	zstd_debug("%s(%d, ...): seek table frames (%llu bytes) do not match file",
+		"parse_seektable", zf->fd, (unsigned long long)coffset);
+	return -1;
+    }
+    zf->walked = filesize;
+    zstd_debug("%s(%d, ...): %u frames, %llu bytes uncompressed",
+		"parse_seektable", zf->fd, count,
+		(unsigned long long)zf->uncompressed_size);
+    return 1;
+}
+
+/*
+ * Uncompressed size of a frame that does not record it in its header -
+ * all we can do is decompress it.
+ */
+static __uint64_t
+frame_content_size(zstdfile_t *zf, __uint64_t coffset, __uint64_t csize)
+{
+    ZSTD_inBuffer	in;
+    ZSTD_outBuffer	out;
+    __uint64_t		total = 0;
+    size_t		sts;
+    char		*src, *dst;
+    size_t		dstsize = ZSTD_DStreamOutSize();
+
+    if ((src = malloc(csize)) == NULL) {
+	pmNoMem("zstd frame", csize, PM_RECOV_ERR);
+	return ZSTD_CONTENTSIZE_ERROR;
+    }
+    if ((dst = malloc(dstsize)) == NULL) {
+	pmNoMem("zstd frame", dstsize, PM_RECOV_ERR);
+	free(src);
+	return ZSTD_CONTENTSIZE_ERROR;
+    }
+    if (read_at(zf->fd, src, csize, coffset) < 0) {
+	free(src);
+	free(dst);
+	return ZSTD_CONTENTSIZE_ERROR;
+    }
+    ZSTD_DCtx_reset(zf->dctx, ZSTD_reset_session_only);
+    in.src = src;
+    in.size = csize;
+    in.pos = 0;
+    for (;;) {
+	out.dst = dst;
+	out.size = dstsize;
+	out.pos = 0;
+	sts = ZSTD_decompressStream(zf->dctx, &out, &in);
+	if (ZSTD_isError(sts)) {
+	    zstd_debug("%s(%d, ...): %s", "frame_content_size", zf->fd,
+			ZSTD_getErrorName(sts));
+	    total = ZSTD_CONTENTSIZE_ERROR;
+	    break;
+	}
+	total += out.pos;
+	if (sts == 0)
+	    break;		/* end of frame */
+	if (in.pos == in.size && out.pos < out.size) {
+	    zstd_debug("%s(%d, ...): truncated frame", "frame_content_size", zf->fd);
+	    total = ZSTD_CONTENTSIZE_ERROR;
+	    break;
+	}
+    }
+    free(src);
+    free(dst);
+    return total;
+}
+
+/*
+ * Extend the frame table by walking the frame and block headers from
+ * the end of the last complete frame, skipping any skippable frames.
+ * Stops quietly at a frame that is not (yet) completely in the file.
+ */
+static int
+walk_frames(zstdfile_t *zf, __uint64_t filesize)
+{
+    unsigned char	hdr[FRAME_HEADER_MAX];
+    unsigned char	blk[BLOCK_HEADER_SIZE];
+    __uint64_t		pos = zf->walked, start, usize;
+    __uint32_t		magic, bhdr, bsize;
+    size_t		hsize, n;
+    int			fhd, last;
+
+    while (pos < filesize) {
+	start = pos;
+	n = filesize - pos < sizeof(hdr) ? filesize - pos : sizeof(hdr);
+	if (n < SKIPPABLE_HEADER_SIZE)
+	    break;			/* partial header */
+	if (read_at(zf->fd, hdr, n, pos) < 0)
+	    goto bad;
+	magic = get_le32(hdr);
+	if (magic >= SKIPPABLE_MAGIC_MIN && magic <= SKIPPABLE_MAGIC_MAX) {
+	    pos += SKIPPABLE_HEADER_SIZE + get_le32(&hdr[4]);
+	    if (pos > filesize)
+		break;			/* partial skippable frame */
+	    zf->walked = pos;
+	    continue;
+	}
+	if (magic != ZSTD_FRAME_MAGIC)
+	    goto bad;
+
+	/* frame header size, from the frame header descriptor */
+	fhd = hdr[4];
+	hsize = 5;
+	if ((fhd & 0x20) == 0)
+	    hsize++;				/* window descriptor */
+	hsize += (size_t[]){ 0, 1, 2, 4 }[fhd & 0x3];	/* dictionary ID */
+	hsize += (size_t[]){ 0, 2, 4, 8 }[fhd >> 6];	/* content size */
+	if ((fhd >> 6) == 0 && (fhd & 0x20))
+	    hsize++;				/* single segment, 1 byte size */
+	if (hsize > n)
+	    break;			/* partial frame header */
+	usize = ZSTD_getFrameContentSize(hdr, hsize);
+	if (usize == ZSTD_CONTENTSIZE_ERROR)
+	    goto bad;
+
+	/* walk the blocks to find the compressed frame size */
+	pos += hsize;
+	last = 0;
+	do {
+	    if (pos + BLOCK_HEADER_SIZE > filesize)
+		break;
+	    if (read_at(zf->fd, blk, sizeof(blk), pos) < 0)
+		goto bad;
+	    bhdr = blk[0] | (blk[1] << 8) | (blk[2] << 16);
+	    last = bhdr & 0x1;
+	    bsize = bhdr >> 3;
+	    if (((bhdr >> 1) & 0x3) == 1)	/* RLE block, one byte */
+		bsize = 1;
+	    pos += BLOCK_HEADER_SIZE + bsize;
+	} while (!last && pos < filesize);
+	if (fhd & 0x4)
+	    pos += 4;				/* content checksum */
+	if (!last || pos > filesize)
+	    break;			/* partial frame */
+
+	if (usize == ZSTD_CONTENTSIZE_UNKNOWN) {
+	    usize = frame_content_size(zf, start, pos - start);
+	    if (usize == ZSTD_CONTENTSIZE_ERROR)
+		goto bad;
+	}
+	if (add_frame(zf, start, pos - start, usize) < 0)
+	    return -1;
+    }
+    zstd_debug("%s(%d, ...): %d frames, %llu bytes uncompressed%s",
+		"walk_frames", zf->fd, zf->nframes,
+		(unsigned long long)zf->uncompressed_size,
+		zf->walked < filesize ? ", partial frame at end" : "");
+    return 0;
+
+bad:
+    zstd_debug("%s(%d, ...): bad frame at offset %llu",
+		"walk_frames", zf->fd, (unsigned long long)pos);
+    setoserror(-PM_ERR_LOGREC);
+    return -1;
+}
+
+/*
+ * The file may still be being written, so pick up any frames added
+ * since the frame table was last extended.
+ */
+static void
+refresh(zstdfile_t *zf)
+{
+    struct stat		sbuf;
+
+    if (zf->cctx != NULL)
+	return;			/* we are the writer */
+    if (fstat(zf->fd, &sbuf) < 0 || sbuf.st_size <= zf->walked)
+	return;
+    walk_frames(zf, sbuf.st_size);
+}
+
+static int
+init(zstdfile_t *zf)
+{
+    unsigned char	magic[4];
+    struct stat		sbuf;
+    int			sts;
+
+    if (fstat(zf->fd, &sbuf) < 0)
+	return -1;
+    /* an empty file may be one that is still being written */
+    if (sbuf.st_size >= sizeof(magic) &&
+	(read_at(zf->fd, magic, sizeof(magic), 0) < 0 ||
+	 get_le32(magic) != ZSTD_FRAME_MAGIC)) {
+	setoserror(-PM_ERR_LOGREC);
+	return -1;
+    }
+    if ((zf->dctx = ZSTD_createDCtx()) == NULL) {
+	pmNoMem("zstd context", sizeof(void *), PM_RECOV_ERR);
+	return -1;
+    }
+    if ((sts = parse_seektable(zf, sbuf.st_size)) <= 0) {
+	/* no seek table, or (in a growing file) something that looks like one */
+	zf->nframes = 0;
+	zf->walked = zf->uncompressed_size = 0;
+	sts = walk_frames(zf, sbuf.st_size);
+    }
+    if (sts < 0) {
+	setoserror(-PM_ERR_LOGREC);
+	return -1;
+    }
+    zf->uncompressed_offset = 0;
+    return 0;
+}
+
+static int
+init_write(zstdfile_t *zf)
+{
+    if ((zf->cctx = ZSTD_createCCtx()) == NULL) {
+	pmNoMem("zstd context", sizeof(void *), PM_RECOV_ERR);
+	return -1;
+    }
+    ZSTD_CCtx_setParameter(zf->cctx, ZSTD_c_compressionLevel, ZSTD_CLEVEL_DEFAULT);
+    ZSTD_CCtx_setParameter(zf->cctx, ZSTD_c_checksumFlag, 1);
+    ZSTD_CCtx_setParameter(zf->cctx, ZSTD_c_contentSizeFlag, 1);
+    zf->cbufsize = ZSTD_compressBound(PCP_ZSTD_FRAME_SIZE);
+    if ((zf->pending = malloc(PCP_ZSTD_FRAME_SIZE)) == NULL) {
+	pmNoMem("zstd frame", PCP_ZSTD_FRAME_SIZE, PM_RECOV_ERR);
+	return -1;
+    }
+    if ((zf->cbuf = malloc(zf->cbufsize)) == NULL) {
+	pmNoMem("zstd frame", zf->cbufsize, PM_RECOV_ERR);
+	return -1;
+    }
+    return 0;
+}
+
+static int
+write_all(zstdfile_t *zf, const void *buf, size_t len)
+{
+    ssize_t	n;
+    size_t	done = 0;
+
+    while (done < len) {
+	if ((n = write(zf->fd, (const char *)buf + done, len - done)) < 0) {
+	    if (errno == EINTR)
+		continue;
+	    zstd_debug("%s(%d, ...): write: %s", "write_all", zf->fd, strerror(errno));
+	    zf->error = errno;
+	    return -1;
+	}
+	done += n;
+    }
+    return 0;
+}
+
+/*
+ * Compress the pending data and append it to the file as one frame,
+ * with a single write(2) so a concurrent reader sees either none or
+ * all of the frame once the write completes.
+ */
+static int
+emit_frame(zstdfile_t *zf)
+{
+    struct timespec	start, end;
+    size_t		csize;
+
+    if (zf->npending == 0)
+	return 0;
+    if (zf->error)
+	return -1;
+    pmtimespecNow(&start);
+    csize = ZSTD_compress2(zf->cctx, zf->cbuf, zf->cbufsize,
+			   zf->pending, zf->npending);
+    pmtimespecNow(&end);
+    zf->ctime += pmtimespecSub(&end, &start);
+    if (ZSTD_isError(csize)) {
+	zstd_debug("%s(%d, ...): %s", "emit_frame", zf->fd, ZSTD_getErrorName(csize));
+	zf->error = EIO;
+	return -1;
+    }
+    if (write_all(zf, zf->cbuf, csize) < 0)
+	return -1;
+    if (add_frame(zf, zf->walked, csize, zf->npending) < 0) {
+	zf->error = ENOMEM;
+	return -1;
+    }
+    zf->npending = 0;
+    return 0;
+}
+
+static void
+put_le32(unsigned char *p, __uint32_t v)
+{
+    p[0] = v & 0xff;
+    p[1] = (v >> 8) & 0xff;
+    p[2] = (v >> 16) & 0xff;
+    p[3] = (v >> 24) & 0xff;
+}
+
+/* write the seek table, as a skippable frame at the end of the file */
+static int
+write_seektable(zstdfile_t *zf)
+{
+    unsigned char	*table, *p;
+    size_t		tablesize;
+    int			i, sts;
+
+    tablesize = SKIPPABLE_HEADER_SIZE + SEEKTABLE_FOOTER_SIZE +
+		zf->nframes * SEEKTABLE_ENTRY_SIZE;
+    if ((table = malloc(tablesize)) == NULL) {
+	pmNoMem("zstd seek table", tablesize, PM_RECOV_ERR);
+	return -1;
+    }
+    put_le32(table, SEEKTABLE_SKIPPABLE_MAGIC);
+    put_le32(table + 4, tablesize - SKIPPABLE_HEADER_SIZE);
+    for (i = 0, p = table + SKIPPABLE_HEADER_SIZE; i < zf->nframes; i++) {
+	put_le32(p, zf->frames[i].csize);
+	put_le32(p + 4, zf->frames[i].usize);
+	p += SEEKTABLE_ENTRY_SIZE;
+    }
+    put_le32(p, zf->nframes);
+    p[4] = 0;		/* descriptor: no checksums */
+    put_le32(p + 5, SEEKTABLE_MAGIC);
+    sts = write_all(zf, table, tablesize);
+    free(table);
+    return sts;
+}
+
+static void
+cleanup(zstdfile_t *zf)
+{
+    int		i;
+
+    if (zf->hits + zf->misses)
+	zstd_debug("%s(%d, ...): frame cache %lu hits, %lu misses",
+		"zstd_close", zf->fd, (unsigned long)zf->hits,
+		(unsigned long)zf->misses);
+    if (zf->cctx != NULL && zf->uncompressed_size > 0)
+	zstd_debug("%s(%d, ...): %llu bytes written as %llu compressed "
+		"(%.1f%%) in %d frames, %.3f msec compressing",
+		"zstd_close", zf->fd, (unsigned long long)zf->uncompressed_size,
+		(unsigned long long)zf->walked,
+		100.0 * zf->walked / zf->uncompressed_size, zf->nframes,
+		zf->ctime * 1000);
+    for (i = 0; i < PCP_ZSTD_CACHE_FRAMES; i++)
+	free(zf->cache[i].data);
+    free(zf->frames);
+    if (zf->dctx)
+	ZSTD_freeDCtx(zf->dctx);
+    if (zf->cctx)
+	ZSTD_freeCCtx(zf->cctx);
+    free(zf->pending);
+    free(zf->cbuf);
+}
+
+static void *
+zstd_open(__pmFILE *f, const char *path, const char *mode)
+{
+    zstdfile_t	*zf;
+
+    if ((zf = calloc(1, sizeof(*zf))) == NULL) {
+	pmNoMem("zstd_open", sizeof(*zf), PM_FATAL_ERR);
+	return NULL;
+    }
+    if ((zf->f = fopen(path, mode)) == NULL) {
+	zstd_debug("%s(..., %s, ...): fopen: %s", "zstd_open", path, strerror(errno));
+	free(zf);
+	return NULL;
+    }
+    zf->fd = fileno(zf->f);
+    zstd_debug("%s(..., %s, ...): fd=%d", "zstd_open", path, zf->fd);
+
+    if ((mode[0] == 'w' ? init_write(zf) : init(zf)) == 0) {
+	f->priv = zf;
+	return zf;
+    }
+    cleanup(zf);
+    fclose(zf->f);
+    free(zf);
+    return NULL;
+}
+
+static void *
+zstd_fdopen(__pmFILE *f, int fd, const char *mode)
+{
+    zstdfile_t	*zf;
+
+    if ((zf = calloc(1, sizeof(*zf))) == NULL) {
+	pmNoMem("zstd_fdopen", sizeof(*zf), PM_FATAL_ERR);
+	return NULL;
+    }
+    if ((zf->f = fdopen(fd, mode)) == NULL) {
+	free(zf);
+	return NULL;
+    }
+    zf->fd = fd;
+
+    if (init(zf) == 0) {
+	f->priv = zf;
+	return zf;
+    }
+    cleanup(zf);
+    fclose(zf->f);
+    free(zf);
+    return NULL;
+}
+
+static int
+zstd_seek(__pmFILE *f, off_t offset, int whence)
+{
+    zstdfile_t	*zf = (zstdfile_t *)f->priv;
+    __int64_t	new_offset;
+
+    switch (whence) {
+    case SEEK_SET:
+	new_offset = offset;
+	break;
+    case SEEK_CUR:
+	new_offset = zf->uncompressed_offset + offset;
+	break;
+    case SEEK_END:
+	refresh(zf);
+	new_offset = zf->uncompressed_size + offset;
+	break;
+    default:
+	errno = EINVAL;
+	return -1;
+    }
+    if (new_offset < 0) {
+	errno = EINVAL;
+	return -1;
+    }
+
+    /*
+     * No decompression needed until the next read.  When writing, the
+     * offset only matters to __pmFtell() (e.g. for the temporal index),
+     * writes are only allowed at the end of the file.
+     */
+    zf->uncompressed_offset = new_offset;
+    return 0;
+}
+
+static off_t
+zstd_lseek(__pmFILE *f, off_t offset, int whence)
+{
+    zstdfile_t	*zf = (zstdfile_t *)f->priv;
+
+    if (zstd_seek(f, offset, whence) < 0)
+	return -1;
+    return zf->uncompressed_offset;
+}
+
+static void
+zstd_rewind(__pmFILE *f)
+{
+    zstdfile_t	*zf = (zstdfile_t *)f->priv;
+
+    zf->uncompressed_offset = 0;
+}
+
+static off_t
+zstd_tell(__pmFILE *f)
+{
+    zstdfile_t	*zf = (zstdfile_t *)f->priv;
+
+    return zf->uncompressed_offset;
+}
+
+/* binary search for the frame containing uncompressed offset */
+static zframe_t *
+find_frame(zstdfile_t *zf, __uint64_t offset)
+{
+    int		lo = 0, hi = zf->nframes - 1, mid;
+
+    while (lo <= hi) {
+	mid = lo + (hi - lo) / 2;
+	if (offset < zf->frames[mid].ustart)
+	    hi = mid - 1;
+	else if (offset >= zf->frames[mid].ustart + zf->frames[mid].usize)
+	    lo = mid + 1;
+	else
+	    return &zf->frames[mid];
+    }
+    return NULL;
+}
+
+static char *
+decompress_frame(zstdfile_t *zf, zframe_t *fp)
+{
+    char	*src, *dst;
+    size_t	sts;
+
+    if ((src = malloc(fp->csize)) == NULL) {
+	pmNoMem("zstd frame", fp->csize, PM_RECOV_ERR);
+	return NULL;
+    }
+    if ((dst = malloc(fp->usize)) == NULL) {
+	pmNoMem("zstd frame", fp->usize, PM_RECOV_ERR);
+	free(src);
+	return NULL;
+    }
+    if (read_at(zf->fd, src, fp->csize, fp->coffset) < 0)
+	goto fail;
+    sts = ZSTD_decompressDCtx(zf->dctx, dst, fp->usize, src, fp->csize);
+    if (ZSTD_isError(sts)) {
+	zstd_debug("%s(%d, ...): frame at %llu: %s", "decompress_frame",
+		zf->fd, (unsigned long long)fp->coffset, ZSTD_getErrorName(sts));
+	goto fail;
+    }
+    if (sts != fp->usize) {
+	zstd_debug("%s(%d, ...): frame at %llu: %lu bytes, expected %llu",
+		"decompress_frame", zf->fd, (unsigned long long)fp->coffset,
+		(unsigned long)sts, (unsigned long long)fp->usize);
+	goto fail;
+    }
+    free(src);
+    return dst;
+
+fail:
+    free(src);
+    free(dst);
+    return NULL;
+}
+
+/*
+ * Return the cached (decompressed) frame containing the current
+ * uncompressed offset, decompressing it into the least recently
+ * used cache slot if need be.
+ */
+static zcache_t *
+reposition(zstdfile_t *zf)
+{
+    __uint64_t	offset = zf->uncompressed_offset;
+    zframe_t	*fp;
+    zcache_t	found;
+    char	*data;
+    int		slot;
+
+    if (zf->dctx == NULL)
+	return NULL;	/* open for writing */
+    for (slot = 0; slot < PCP_ZSTD_CACHE_FRAMES; slot++) {
+	if (zf->cache[slot].data == NULL)
+	    break;
+	if (offset >= zf->cache[slot].ustart &&
+	    offset < zf->cache[slot].ustart + zf->cache[slot].usize) {
+	    zf->hits++;
+	    goto used;
+	}
+    }
+
+    if ((fp = find_frame(zf, offset)) == NULL) {
+	/* end of file ... unless more has been written since */
+	refresh(zf);
+	if ((fp = find_frame(zf, offset)) == NULL)
+	    return NULL;
+    }
+    if ((data = decompress_frame(zf, fp)) == NULL)
+	return NULL;
+    zf->misses++;
+    if (slot == PCP_ZSTD_CACHE_FRAMES)
+	slot--;
+    free(zf->cache[slot].data);
+    zf->cache[slot].data = data;
+    zf->cache[slot].ustart = fp->ustart;
+    zf->cache[slot].usize = fp->usize;
+
+used:
+    /* move to the front, as most recently used */
+    if (slot != 0) {
+	found = zf->cache[slot];
+	memmove(&zf->cache[1], &zf->cache[0], slot * sizeof(zcache_t));
+	zf->cache[0] = found;
+    }
+    return &zf->cache[0];
+}
+
+static int
+zstd_getc(__pmFILE *f)
+{
+    zstdfile_t	*zf = (zstdfile_t *)f->priv;
+    zcache_t	*cp;
+    int		c;
+
+    if ((cp = reposition(zf)) == NULL)
+	return EOF;
+    c = *(unsigned char *)(cp->data + (zf->uncompressed_offset - cp->ustart));
+    zf->uncompressed_offset++;
+    return c;
+}
+
+static size_t
+zstd_read(void *ptr, size_t size, size_t nmemb, __pmFILE *f)
+{
+    zstdfile_t	*zf = (zstdfile_t *)f->priv;
+    zcache_t	*cp;
+    __uint64_t	skip;
+    size_t	itemsize = size;
+    size_t	n;
+    size_t	copied = 0;
+
+    if (itemsize == 0)
+	return 0;
+    size *= nmemb;
+    while (size > 0) {
+	if ((cp = reposition(zf)) == NULL)
+	    break;
+	skip = zf->uncompressed_offset - cp->ustart;
+	n = size;
+	if (n > cp->usize - skip)
+	    n = cp->usize - skip;
+	memcpy(ptr, cp->data + skip, n);
+	copied += n;
+	zf->uncompressed_offset += n;
+	ptr = (char *)ptr + n;
+	size -= n;
+    }
+    /* like fread(3), the number of complete items */
+    return copied / itemsize;
+}
+
+static size_t
+zstd_write(void *ptr, size_t size, size_t nmemb, __pmFILE *f)
+{
+    zstdfile_t	*zf = (zstdfile_t *)f->priv;
+    size_t	itemsize = size;
+    size_t	n;
+    size_t	copied = 0;
+
+    if (zf->cctx == NULL) {
+	zstd_debug("libpcp internal error: %s not open for writing", "zstd_write");
+	return 0;
+    }
+    if (zf->uncompressed_offset != zf->uncompressed_size) {
+	/* compressed data cannot be overwritten */
+	zstd_debug("libpcp internal error: %s at %lld, not at end (%llu)",
+		"zstd_write", (long long)zf->uncompressed_offset,
+		(unsigned long long)zf->uncompressed_size);
+	zf->error = ESPIPE;
+	return 0;
+    }
+    if (itemsize == 0 || zf->error)
+	return 0;
+    size *= nmemb;
+    while (size > 0) {
+	n = PCP_ZSTD_FRAME_SIZE - zf->npending;
+	if (n > size)
+	    n = size;
+	memcpy(zf->pending + zf->npending, ptr, n);
+	zf->npending += n;
+	copied += n;
+	zf->uncompressed_offset += n;
+	zf->uncompressed_size += n;
+	ptr = (char *)ptr + n;
+	size -= n;
+	if (zf->npending == PCP_ZSTD_FRAME_SIZE && emit_frame(zf) < 0)
+	    break;
+    }
+    return copied / itemsize;
+}
+
+/*
+ * Flushing is the sync point for writers - all data written so far
+ * becomes visible to readers as a new frame.
+ */
+static int
+zstd_flush(__pmFILE *f)
+{
+    zstdfile_t	*zf = (zstdfile_t *)f->priv;
+
+    if (zf->cctx == NULL)
+	return 0;
+    if (emit_frame(zf) < 0) {
+	errno = zf->error;
+	return EOF;
+    }
+    return 0;
+}
+
+static int
+zstd_fsync(__pmFILE *f)
+{
+    zstdfile_t	*zf = (zstdfile_t *)f->priv;
+
+    return fsync(zf->fd);
+}
+
+static int
+zstd_fileno(__pmFILE *f)
+{
+    zstdfile_t	*zf = (zstdfile_t *)f->priv;
+
+    return zf->fd;
+}
+
+static int
+zstd_fstat(__pmFILE *f, struct stat *buf)
+{
+    zstdfile_t	*zf = (zstdfile_t *)f->priv;
+    int		rc;
+
+    refresh(zf);
+    rc = fstat(zf->fd, buf);
+
+    /* what the caller really wants for st_size is the uncompressed size */
+    if (rc != -1)
+	buf->st_size = zf->uncompressed_size;
+    return rc;
+}
+
+static int
+zstd_feof(__pmFILE *f)
+{
+    zstdfile_t	*zf = (zstdfile_t *)f->priv;
+
+    return zf->uncompressed_offset >= zf->uncompressed_size;
+}
+
+static int
+zstd_ferror(__pmFILE *f)
+{
+    zstdfile_t	*zf = (zstdfile_t *)f->priv;
+
+    return zf->error != 0;
+}
+
+static void
+zstd_clearerr(__pmFILE *f)
+{
+}
+
+static int
+zstd_setvbuf(__pmFILE *f, char *buf, int mode, size_t size)
+{
+    zstdfile_t	*zf = (zstdfile_t *)f->priv;
+
+    if (zf->cctx != NULL)
+	return 0;	/* writes are buffered a frame at a time regardless */
+    zstd_debug("libpcp internal error: %s not implemented", "zstd_setvbuf");
+    return -1;
+}
+
+static int
+zstd_close(__pmFILE *f)
+{
+    zstdfile_t	*zf = (zstdfile_t *)f->priv;
+    int		sts = 0;
+
+    if (zf->cctx != NULL) {
+	if (emit_frame(zf) < 0 || write_seektable(zf) < 0)
+	    sts = EOF;
+    }
+    cleanup(zf);
+    if (fclose(zf->f) != 0)
+	sts = EOF;
+    free(zf);
+    return sts;
+}
+
+__pm_fops __pm_zstd = {
+    /*
+     * zstd decompression, and compression when writing
+     */
+    .__pmopen = zstd_open,
+    .__pmfdopen = zstd_fdopen,
+    .__pmseek = zstd_seek,
+    .__pmrewind = zstd_rewind,
+    .__pmtell = zstd_tell,
+    .__pmfgetc = zstd_getc,
+    .__pmread = zstd_read,
+    .__pmwrite = zstd_write,
+    .__pmflush = zstd_flush,
+    .__pmfsync = zstd_fsync,
+    .__pmfileno = zstd_fileno,
+    .__pmlseek = zstd_lseek,
+    .__pmfstat = zstd_fstat,
+    .__pmfeof = zstd_feof,
+    .__pmferror = zstd_ferror,
+    .__pmclearerr = zstd_clearerr,
+    .__pmsetvbuf = zstd_setvbuf,
+    .__pmclose = zstd_close
+};
+#endif /* HAVE_ZSTD_DECOMPRESSION */
@@ -48,6 +48,14 @@ typedef struct {
  */
 static __pmHashCtl	pc_hc;
 
+/*
+ * Suffix (".zst") when data volumes created by __pmLogNewFile() are
+ * to be compressed as they are written, else NULL.
+ *
+ * Note, this is also global across all archives being written.
+ */
+static const char	*volume_suffix;
+
 static int LogCheckForNextArchive(__pmContext *, int, __pmResult **);
 static int LogChangeToNextArchive(__pmContext *);
 static int LogChangeToPreviousArchive(__pmContext *);
@@ -241,16 +249,53 @@ __pmLogName(const char *base, int vol)
     return __pmLogName_r(base, vol, tbuf, sizeof(tbuf));
 }
 
+/*
+ * Select on-the-fly compression for data volumes subsequently created
+ * by __pmLogNewFile(), method is "zstd", or NULL or "none" to turn
+ * compression off.  The data volume is written as a sequence of
+ * independent zstd frames, a new frame at every __pmFflush() (e.g. for
+ * each temporal index entry), so archives being written can be read
+ * as they grow.
+ */
+int
+__pmLogSetCompression(const char *method)
+{
+    const char	*suffix;
+
+    if (method == NULL || strcmp(method, "none") == 0)
+	suffix = NULL;
+#if HAVE_TRANSPARENT_DECOMPRESSION && HAVE_ZSTD_DECOMPRESSION
+    else if (strcmp(method, "zstd") == 0)
+	suffix = ".zst";
+#endif
+    else
+	return -EOPNOTSUPP;
+
+    PM_LOCK(logutil_lock);
+    volume_suffix = suffix;
+    PM_UNLOCK(logutil_lock);
+    return 0;
+}
+
 __pmFILE *
 __pmLogNewFile(const char *base, int vol)
 {
     char	fname[MAXPATHLEN];
+    char	plain[MAXPATHLEN];
+    const char	*suffix = NULL;
     __pmFILE	*f;
     int		save_error;
 
-    __pmLogName_r(base, vol, fname, sizeof(fname));
+    __pmLogName_r(base, vol, plain, sizeof(plain));
+    if (vol >= 0) {
+	PM_LOCK(logutil_lock);
+	suffix = volume_suffix;
+	PM_UNLOCK(logutil_lock);
+    }
+    pmsprintf(fname, sizeof(fname), "%s%s", plain, suffix ? suffix : "");
 
-    if (access(fname, R_OK) != -1) {
+    if (access(fname, R_OK) != -1 ||
+	(suffix != NULL && access(plain, R_OK) != -1)) {
 	/* exists and readable ... */
 	pmprintf("__pmLogNewFile: \"%s\" already exists, not over-written\n", fname);
 	pmflush();
@@ -295,11 +340,11 @@ __pmLogCreate(const char *host, const char *base, int log_version,
     char	fname[MAXPATHLEN];
 
     lcp->minvol = lcp->maxvol = acp->ac_curvol = 0;
-    lcp->hashpmid.nodes = lcp->hashpmid.hsize = 0;
-    lcp->hashindom.nodes = lcp->hashindom.hsize = 0;
-    lcp->trimindom.nodes = lcp->trimindom.hsize = 0;
-    lcp->hashlabels.nodes = lcp->hashlabels.hsize = 0;
-    lcp->hashtext.nodes = lcp->hashtext.hsize = 0;
+    __pmHashInit(&lcp->hashpmid);
+    __pmHashInit(&lcp->hashindom);
+    __pmHashInit(&lcp->trimindom);
+    __pmHashInit(&lcp->hashlabels);
+    __pmHashInit(&lcp->hashtext);
     lcp->tifp = lcp->mdfp = acp->ac_mfp = NULL;
 
     if ((lcp->tifp = __pmLogNewFile(base, PM_LOG_VOL_TI)) != NULL) {
@@ -361,7 +406,7 @@ logFreeHashPMID(__pmHashCtl *hcp)
 	if (prior_hp != NULL)
 	    free(prior_hp);
     }
-    free(hcp->hash);
+    __pmHashClear(hcp);
 }
 
 static void
@@ -412,7 +457,7 @@ logFreeHashInDom(__pmHashCtl *hcp)
 	if (prior_hp != NULL)
 	    free(prior_hp);
     }
-    free(hcp->hash);
+    __pmHashClear(hcp);
 }
 
 static void
@@ -443,8 +488,7 @@ logFreeTrimInDom(__pmHashCtl *hcp)
 		if (prior_ip != NULL)
 		    free(prior_ip);
 	    }
-	    if (icp->hsize > 0)
-		free(icp->hash);
+	    __pmHashClear(icp);
 	    free(indomp);
 	    if (prior_hp != NULL)
 		free(prior_hp);
@@ -453,7 +497,7 @@ logFreeTrimInDom(__pmHashCtl *hcp)
 	if (prior_hp != NULL)
 	    free(prior_hp);
     }
-    free(hcp->hash);
+    __pmHashClear(hcp);
 }
 
 static void
@@ -496,12 +540,12 @@ logFreeHashLabels(__pmHashCtl *type_ctl)
 
 	    curr_type_node = type_node;
 	    type_node = type_node->next;
-	    free(ident_ctl->hash);
+	    __pmHashClear(ident_ctl);
 	    free(ident_ctl);
 	    free(curr_type_node);
 	}
     }
-    free(type_ctl->hash);
+    __pmHashClear(type_ctl);
 }
 
 static void
@@ -532,12 +576,12 @@ logFreeHashText(__pmHashCtl *type_ctl)
 
 	    curr_type_node = type_node;
 	    type_node = type_node->next;
-	    free(ident_ctl->hash);
+	    __pmHashClear(ident_ctl);
 	    free(ident_ctl);
 	    free(curr_type_node);
 	}
     }
-    free(type_ctl->hash);
+    __pmHashClear(type_ctl);
 }
 
 static void
@@ -1241,7 +1285,7 @@ __pmLogGenerateMark_ctx(__pmContext *ctxp, int mode, __pmResult **result)
     pr->numpmid = 0;
     if (mode == PM_MODE_FORW) {
 	if ((sts = __pmGetArchiveEnd_ctx(ctxp, &end)) < 0) {
-	    free(pr);
+	    __pmFreeResult(pr);
 	    return sts;
 	}
 	pr->timestamp = lcp->endtime;
@@ -2121,6 +2165,81 @@ VolSkip(__pmArchCtl *acp, int mode, int j)
     return PM_ERR_EOL;
 }
 
+/*
+ * Binary searches of the temporal index ti[lo..hi-1], each returning
+ * the index of the first matching entry, else hi if none match.
+ */
+
+/* first entry for volume vol or later */
+static int
+ti_search_vol(const __pmLogTI *ti, int lo, int hi, int vol)
+{
+    int		mid;
+
+    while (lo < hi) {
+	mid = lo + (hi - lo) / 2;
+	if (ti[mid].vol < vol)
+	    lo = mid + 1;
+	else
+	    hi = mid;
+    }
+    return lo;
+}
+
+/* first entry at or after time *tsp */
+static int
+ti_search_time(const __pmLogTI *ti, int lo, int hi, const __pmTimestamp *tsp)
+{
+    int		mid;
+
+    while (lo < hi) {
+	mid = lo + (hi - lo) / 2;
+	if (__pmTimestampSub(&ti[mid].stamp, tsp) < 0)
+	    lo = mid + 1;
+	else
+	    hi = mid;
+    }
+    return lo;
+}
+
+/* first entry beyond data volume offset off (all in the same volume) */
+static int
+ti_search_offset(const __pmLogTI *ti, int lo, int hi, off_t off)
+{
+    int		mid;
+
+    while (lo < hi) {
+	mid = lo + (hi - lo) / 2;
+	if (ti[mid].off_data <= off)
+	    lo = mid + 1;
+	else
+	    hi = mid;
+    }
+    return lo;
+}
+
+/*
+ * size of the last data volume, beyond which its temporal index
+ * entries are not (yet) valid
+ */
+static off_t
+ti_lastsize(__pmArchCtl *acp)
+{
+    __pmLogCtl	*lcp = acp->ac_log;
+    __pmFILE	*f;
+    struct stat	sbuf;
+    int		vol = lcp->maxvol;
+
+    sbuf.st_size = 0;
+    if (vol >= 0 && vol < lcp->numseen && lcp->seen[vol])
+	__pmFstat(acp->ac_mfp, &sbuf);
+    else if ((f = _logpeek(acp, vol)) != NULL) {
+	__pmFstat(f, &sbuf);
+	__pmFclose(f);
+    }
+    return sbuf.st_size;
+}
+
 int
 __pmLogSetTime(__pmContext *ctxp)
 {
@@ -2178,58 +2297,68 @@ __pmLogSetTime(__pmContext *ctxp)
 
     if (lcp->numti) {
 	/* we have a temporal index, use it! */
-	int		j = -1;
+	int		j;
 	int		try;
 	int		toobig = 0;
 	int		match = 0;
-	int		tivol;
-	int		vol;
 	int		numti = lcp->numti;
 	off_t		tilog;
-	__pmFILE	*f;
-	__pmLogTI	*tip = lcp->ti;
+	off_t		size;
 	double		t_lo;
-	struct stat	sbuf;
 
-	sbuf.st_size = -1;
+	if (lcp->tiorder) {
+	    /*
+	     * The temporal index is in time order (and volume order), so
+	     * binary search for the first entry at or after the origin,
+	     * ignoring entries for missing preliminary volumes ... this
+	     * keeps seeks cheap even for a dense index on a large archive.
+	     */
+	    i = ti_search_vol(lcp->ti, 0, numti, lcp->minvol);
+	    j = ti_search_time(lcp->ti, i, numti, &ctxp->c_origin);
 
-	for (i = 0; i < numti; i++, tip++) {
-	    tivol = tip->vol;
-	    tilog = tip->off_data;
-	    if (tivol < lcp->minvol)
-		/* skip missing preliminary volumes */
-		continue;
-	    if (tivol == lcp->maxvol) {
-		/* truncated check for last volume */
-		if (sbuf.st_size < 0) {
-		    sbuf.st_size = 0;
-		    vol = lcp->maxvol;
-		    if (vol >= 0 && vol < lcp->numseen && lcp->seen[vol])
-			__pmFstat(acp->ac_mfp, &sbuf);
-		    else if ((f = _logpeek(acp, lcp->maxvol)) != NULL) {
-			__pmFstat(f, &sbuf);
-			__pmFclose(f);
-		    }
-		}
-		if (tilog > sbuf.st_size) {
-		    j = i;
+	    /*
+	     * The last volume may be truncated (or still being written),
+	     * so its index entries beyond the end of the file are not
+	     * valid ... use the first of those instead if it comes
+	     * before the entry found above.
+	     */
+	    try = j < numti ? j : numti-1;
+	    if (try >= i && lcp->ti[try].vol == lcp->maxvol) {
+		size = ti_lastsize(acp);
+		if (lcp->ti[try].off_data > size) {
+		    i = ti_search_vol(lcp->ti, i, try, lcp->maxvol);
+		    j = ti_search_offset(lcp->ti, i, try, size);
 		    toobig++;
-		    break;
 		}
 	    }
-	    t_hi = __pmTimestampSub(&tip->stamp, &ctxp->c_origin);
-	    if (t_hi > 0) {
-		j = i;
-		break;
-	    }
-	    else if (t_hi == 0) {
-		j = i;
-		match = 1;
-		break;
+	}
+	else {
+	    /*
+	     * Entries out of order (index written by some other tool, or
+	     * damaged), so the binary searches cannot be trusted ... scan
+	     * the whole index for the first entry at or after the origin.
+	     */
+	    size = -1;
+	    for (j = 0; j < numti; j++) {
+		if (lcp->ti[j].vol < lcp->minvol)
+		    /* skip missing preliminary volumes */
+		    continue;
+		if (lcp->ti[j].vol == lcp->maxvol) {
+		    /* truncated check for last volume */
+		    if (size < 0)
+			size = ti_lastsize(acp);
+		    if (lcp->ti[j].off_data > size) {
+			toobig++;
+			break;
+		    }
+		}
+		if (__pmTimestampSub(&lcp->ti[j].stamp, &ctxp->c_origin) >= 0)
+		    break;
 	    }
 	}
-	if (i == numti)
-	    j = numti;
+	if (!toobig && j < numti &&
+	    __pmTimestampSub(&lcp->ti[j].stamp, &ctxp->c_origin) == 0)
+	    match = 1;
 
 	acp->ac_serial = 1;
 
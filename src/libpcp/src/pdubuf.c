@@ -1,6 +1,6 @@
 /*
  * Copyright (c) 1995 Silicon Graphics, Inc.  All Rights Reserved.
- * Copyright (c) 2015 Red Hat, Inc.
+ * Copyright (c) 2015,2026 Red Hat, Inc.
  * 
  * This library is free software; you can redistribute it and/or modify it
  * under the terms of the GNU Lesser General Public License as published
@@ -17,6 +17,12 @@
  * To avoid buffer trampling, on success __pmFindPDUBuf() now returns
  * a pinned PDU buffer.  It is the caller's responsibility to unpin the
  * PDU buffer when safe to do so.
+ *
+ * Buffers are pinned and unpinned from different threads (e.g. a PDU
+ * received in one thread is decoded and released in another), so the
+ * pin counts and free lists are all guarded by the one pdubuf_lock; the
+ * work done while holding it is constant time for all but the largest
+ * buffers.
  */
 
 #include "pmapi.h"
@@ -30,12 +36,65 @@ typedef struct bufctl
 {
     int		bc_pincnt;
     int		bc_size;
+    int		bc_slab;	/* carved from a slab, else malloc'd */
     char	*bc_buf;
     /* The actual buffer happens to follow this struct. */
 } bufctl_t;
 
+/*
+ * PDU buffers up to the largest size class are carved from slabs of
+ * SLAB_SIZE bytes, allocated on a SLAB_SIZE boundary.  Masking any
+ * pointer into a buffer (handles may point anywhere in a buffer, not
+ * just at the start) yields the slab header, and the bufctl_t header
+ * is found by simple arithmetic from there - no searching required.
+ *
+ * Larger buffers are individually malloc'd and kept in buf_tree, as
+ * they always have been - as are smaller ones if a new slab cannot be
+ * allocated.  Since a slab spans its whole aligned range,
+ * no malloc'd buffer can ever lie within it, so the slab registry
+ * lookup alone decides which of the two schemes owns a handle.
+ */
+#ifdef HAVE_POSIX_MEMALIGN
+#define SLAB_SHIFT	16
+#define SLAB_SIZE	(1 << SLAB_SHIFT)
+#define SLAB_MASK	(~((uintptr_t)SLAB_SIZE - 1))
+#define SLAB_ALIGN(x)	(((x) + 15) & ~15)
+#define NCLASS		6		/* 256, 512, ... 8192 bytes */
+#define CLASS_MIN_SHIFT	8
+#define SLAB_MAXBUF	(1 << (CLASS_MIN_SHIFT + NCLASS - 1))
+#define NREGISTRY	256		/* slab registry hash buckets */
+
+typedef struct slab
+{
+    struct slab	*sl_next;	/* partial slabs in this size class */
+    struct slab	*sl_prev;
+    struct slab	*sl_hnext;	/* registry hash chain */
+    bufctl_t	*sl_free;	/* free buffers, linked via bc_buf[] */
+    int		sl_class;
+    int		sl_nfree;
+    int		sl_nobj;
+    int		sl_stride;	/* bufctl_t plus buffer, 16-byte aligned */
+    char	*sl_data;	/* first bufctl_t */
+} slab_t;
+
+typedef struct {
+    slab_t	*sc_partial;	/* slabs with at least one free buffer */
+    int		sc_size;	/* buffer size for this class */
+    int		sc_slabs;	/* number of slabs allocated */
+    int		sc_empty;	/* number of these that are entirely free */
+} sizeclass_t;
+
+/* Protected by the pdubuf_lock mutex. */
+static sizeclass_t	sizeclass[NCLASS] = {
+    { NULL, 256 }, { NULL, 512 }, { NULL, 1024 },
+    { NULL, 2048 }, { NULL, 4096 }, { NULL, 8192 },
+};
+static slab_t		*registry[NREGISTRY];
+#endif
+
 /* Protected by the pdubuf_lock mutex. */
 static void *buf_tree;
+static __pmPDUBufStats	bufstats;
 
 #ifdef PM_MULTI_THREAD
 static pthread_mutex_t	pdubuf_lock = PTHREAD_MUTEX_INITIALIZER;
@@ -54,6 +113,203 @@ __pmIsPdubufLock(void *lock)
 }
 #endif
 
+#ifdef HAVE_POSIX_MEMALIGN
+static inline unsigned int
+slab_hash(const void *base)
+{
+    return ((uintptr_t)base >> SLAB_SHIFT) & (NREGISTRY - 1);
+}
+
+/*
+ * Registered slab containing addr, else NULL.
+ * Called with pdubuf_lock held.
+ */
+static slab_t *
+slab_find(const void *addr)
+{
+    slab_t	*sp;
+    uintptr_t	base = (uintptr_t)addr & SLAB_MASK;
+
+    for (sp = registry[slab_hash((void *)base)]; sp != NULL; sp = sp->sl_hnext) {
+	if ((uintptr_t)sp == base)
+	    break;
+    }
+    return sp;
+}
+
+/*
+ * Map a (possibly interior) buffer pointer within slab sp to its
+ * bufctl_t, or NULL if it does not fall within a pinned buffer.
+ * Called with pdubuf_lock held.
+ */
+static bufctl_t *
+slab_lookup(slab_t *sp, const void *handle)
+{
+    bufctl_t	*pcp;
+    uintptr_t	offset;
+
+    if ((uintptr_t)handle < (uintptr_t)sp->sl_data)
+	return NULL;
+    offset = (uintptr_t)handle - (uintptr_t)sp->sl_data;
+    if (offset >= (uintptr_t)sp->sl_nobj * sp->sl_stride)
+	return NULL;
+    pcp = (bufctl_t *)(sp->sl_data + (offset / sp->sl_stride) * sp->sl_stride);
+    if (pcp->bc_pincnt <= 0 || (char *)handle < pcp->bc_buf ||
+	(char *)handle >= &pcp->bc_buf[pcp->bc_size])
+	return NULL;
+    return pcp;
+}
+
+/*
+ * Allocate and register a new slab for size class c.
+ * Called with pdubuf_lock held.
+ */
+static slab_t *
+slab_create(int c)
+{
+    sizeclass_t	*scp = &sizeclass[c];
+    slab_t	*sp;
+    bufctl_t	*pcp;
+    void	*mem;
+    unsigned int	h;
+    int		i;
+
+    if (posix_memalign(&mem, SLAB_SIZE, SLAB_SIZE) != 0)
+	return NULL;
+    sp = (slab_t *)mem;
+    sp->sl_class = c;
+    sp->sl_stride = SLAB_ALIGN(sizeof(bufctl_t) + scp->sc_size);
+    sp->sl_data = (char *)sp + SLAB_ALIGN(sizeof(slab_t));
+    sp->sl_nobj = (SLAB_SIZE - SLAB_ALIGN(sizeof(slab_t))) / sp->sl_stride;
+    sp->sl_nfree = sp->sl_nobj;
+    sp->sl_free = NULL;
+    for (i = sp->sl_nobj - 1; i >= 0; i--) {
+	pcp = (bufctl_t *)(sp->sl_data + i * sp->sl_stride);
+	pcp->bc_pincnt = 0;
+	pcp->bc_size = 0;
+	pcp->bc_slab = 1;
+	pcp->bc_buf = (char *)pcp + sizeof(*pcp);
+	*(bufctl_t **)pcp->bc_buf = sp->sl_free;
+	sp->sl_free = pcp;
+    }
+
+    h = slab_hash(sp);
+    sp->sl_hnext = registry[h];
+    registry[h] = sp;
+
+    sp->sl_prev = NULL;
+    sp->sl_next = scp->sc_partial;
+    if (scp->sc_partial != NULL)
+	scp->sc_partial->sl_prev = sp;
+    scp->sc_partial = sp;
+    scp->sc_slabs++;
+    scp->sc_empty++;
+    bufstats.slabs++;
+    return sp;
+}
+
+/*
+ * Unlink from the partial list and registry, then release a slab.
+ * Called with pdubuf_lock held.
+ */
+static void
+slab_destroy(slab_t *sp)
+{
+    sizeclass_t	*scp = &sizeclass[sp->sl_class];
+    slab_t	**spp;
+
+    if (sp->sl_prev != NULL)
+	sp->sl_prev->sl_next = sp->sl_next;
+    else
+	scp->sc_partial = sp->sl_next;
+    if (sp->sl_next != NULL)
+	sp->sl_next->sl_prev = sp->sl_prev;
+    for (spp = &registry[slab_hash(sp)]; *spp != NULL; spp = &(*spp)->sl_hnext) {
+	if (*spp == sp) {
+	    *spp = sp->sl_hnext;
+	    break;
+	}
+    }
+    scp->sc_slabs--;
+    scp->sc_empty--;
+    bufstats.slabs--;
+    free(sp);
+}
+
+/*
+ * Take a buffer from size class c, growing the class by a slab when
+ * there are no free buffers.  Called with pdubuf_lock held.
+ */
+static bufctl_t *
+slab_alloc(int c)
+{
+    sizeclass_t	*scp = &sizeclass[c];
+    slab_t	*sp;
+    bufctl_t	*pcp;
+
+    if ((sp = scp->sc_partial) != NULL)
+	bufstats.hits++;
+    else if ((sp = slab_create(c)) == NULL)
+	return NULL;
+
+    pcp = sp->sl_free;
+    sp->sl_free = *(bufctl_t **)pcp->bc_buf;
+    if (sp->sl_nfree-- == sp->sl_nobj)
+	scp->sc_empty--;
+    if (sp->sl_nfree == 0) {
+	/* now full, off the partial list */
+	scp->sc_partial = sp->sl_next;
+	if (sp->sl_next != NULL)
+	    sp->sl_next->sl_prev = NULL;
+	sp->sl_next = sp->sl_prev = NULL;
+    }
+    pcp->bc_pincnt = 1;
+    return pcp;
+}
+
+/*
+ * Return a buffer to its slab.  One entirely free slab is retained
+ * per size class to absorb allocate/free cycles, any more are freed.
+ * Called with pdubuf_lock held.
+ */
+static void
+slab_free(bufctl_t *pcp)
+{
+    slab_t	*sp = (slab_t *)((uintptr_t)pcp & SLAB_MASK);
+    sizeclass_t	*scp = &sizeclass[sp->sl_class];
+
+    *(bufctl_t **)pcp->bc_buf = sp->sl_free;
+    sp->sl_free = pcp;
+    if (sp->sl_nfree++ == 0) {
+	/* was full, back onto the partial list */
+	sp->sl_prev = NULL;
+	sp->sl_next = scp->sc_partial;
+	if (scp->sc_partial != NULL)
+	    scp->sc_partial->sl_prev = sp;
+	scp->sc_partial = sp;
+    }
+    if (sp->sl_nfree == sp->sl_nobj) {
+	if (++scp->sc_empty > 1)
+	    slab_destroy(sp);
+    }
+}
+
+/*
+ * Size class for a buffer of need bytes, else -1 if too large.
+ */
+static int
+slab_class(int need)
+{
+    int		c;
+
+    if (need > SLAB_MAXBUF)
+	return -1;
+    for (c = 0; need > sizeclass[c].sc_size; c++)
+	;
+    return c;
+}
+#endif /* HAVE_POSIX_MEMALIGN */
+
 static void
 pdubufdump1(const void *nodep, const VISIT which, const int depth)
 {
@@ -68,13 +324,42 @@ pdubufdump1(const void *nodep, const VISIT which, const int depth)
 static void
 pdubufdump(void)
 {
+    int		pinned;
+#ifdef HAVE_POSIX_MEMALIGN
+    slab_t	*sp;
+    bufctl_t	*pcp;
+    int		h, i;
+#endif
+
     /*
-     * There is no longer a pdubuf free list, ergo no
+     * Free slab buffers are not individually reported, ergo no
      * fprintf(stderr, "   free pdubuf[size]:\n");
      */
     PM_LOCK(pdubuf_lock);
-    if (buf_tree != NULL) {
+    pinned = (buf_tree != NULL);
+#ifdef HAVE_POSIX_MEMALIGN
+    for (h = 0; h < NREGISTRY && !pinned; h++) {
+	for (sp = registry[h]; sp != NULL; sp = sp->sl_hnext) {
+	    if (sp->sl_nfree < sp->sl_nobj) {
+		pinned = 1;
+		break;
+	    }
+	}
+    }
+#endif
+    if (pinned) {
 	fprintf(stderr, "   pinned pdubuf[size](pincnt):");
+#ifdef HAVE_POSIX_MEMALIGN
+	for (h = 0; h < NREGISTRY; h++) {
+	    for (sp = registry[h]; sp != NULL; sp = sp->sl_hnext) {
+		for (i = 0; i < sp->sl_nobj && sp->sl_nfree < sp->sl_nobj; i++) {
+		    pcp = (bufctl_t *)(sp->sl_data + i * sp->sl_stride);
+		    if (pcp->bc_pincnt > 0)
+			pdubufdump1(&pcp, leaf, 0);
+		}
+	    }
+	}
+#endif
 	/* THREADSAFE - no locks acquired in pdubufdump1() */
 	twalk(buf_tree, &pdubufdump1);
 	fprintf(stderr, "\n");
@@ -99,11 +384,44 @@ bufctl_t_compare(const void *a, const void *b)
     return 0;		/* overlap */
 }
 
+/*
+ * Find the bufctl_t for a (possibly interior) handle, or NULL.
+ * Called with pdubuf_lock held.
+ */
+static bufctl_t *
+bufctl_lookup(void *handle)
+{
+    bufctl_t	pcp_search;
+    void	*bcp;
+
+#ifdef HAVE_POSIX_MEMALIGN
+    slab_t	*sp;
+
+    if ((sp = slab_find(handle)) != NULL)
+	return slab_lookup(sp, handle);
+#endif
+
+    /*
+     * Initialize a dummy bufctl_t to use only as search key;
+     * only its bc_buf & bc_size fields need to be set, as that's
+     * all that bufctl_t_compare will look at.
+     */
+    pcp_search.bc_buf = handle;
+    pcp_search.bc_size = 1;
+
+    /* THREADSAFE - no locks acquired in bufctl_t_compare() */
+    bcp = tfind(&pcp_search, &buf_tree, &bufctl_t_compare);
+    return bcp == NULL ? NULL : *(bufctl_t **)bcp;
+}
+
 __pmPDU *
 __pmFindPDUBuf(int need)
 {
     bufctl_t	*pcp;
     void	*bcp;
+#ifdef HAVE_POSIX_MEMALIGN
+    int		c;
+#endif
 
     if (unlikely(need < 0)) {
 	/* special diagnostic case ... dump buffer state */
@@ -112,15 +430,32 @@ __pmFindPDUBuf(int need)
 	return NULL;
     }
 
+#ifdef HAVE_POSIX_MEMALIGN
+    if ((c = slab_class(need)) >= 0) {
+	PM_LOCK(pdubuf_lock);
+	if ((pcp = slab_alloc(c)) != NULL) {
+	    bufstats.requests++;
+	    pcp->bc_size = need;
+	}
+	PM_UNLOCK(pdubuf_lock);
+	if (pcp != NULL)
+	    goto done;
+	/* no new slab, fall back to a malloc'd buffer */
+    }
+#endif
+
     if ((pcp = (bufctl_t *)malloc(sizeof(*pcp) + need)) == NULL) {
 	return NULL;
     }
 
     pcp->bc_pincnt = 1;
     pcp->bc_size = need;
+    pcp->bc_slab = 0;
     pcp->bc_buf = ((char *)pcp) + sizeof(*pcp);
 
     PM_LOCK(pdubuf_lock);
+    bufstats.requests++;
+    bufstats.large++;
     /* Insert the node in the tree. */
     /* THREADSAFE - no locks acquired in bufctl_t_compare() */
     bcp = tsearch((void *)pcp, &buf_tree, &bufctl_t_compare);
@@ -131,6 +466,9 @@ __pmFindPDUBuf(int need)
     }
     PM_UNLOCK(pdubuf_lock);
 
+#ifdef HAVE_POSIX_MEMALIGN
+done:
+#endif
     if (unlikely(pmDebugOptions.pdubuf)) {
 	fprintf(stderr, "__pmFindPDUBuf(%d) -> " PRINTF_P_PFX "%p\n",
 		need, pcp->bc_buf);
@@ -143,27 +481,17 @@ __pmFindPDUBuf(int need)
 void
 __pmPinPDUBuf(void *handle)
 {
-    bufctl_t	*pcp, pcp_search;
-    void	*bcp;
+    bufctl_t	*pcp;
 
     assert(((__psint_t)handle % sizeof(int)) == 0);
-    /*
-     * Initialize a dummy bufctl_t to use only as search key;
-     * only its bc_buf & bc_size fields need to be set, as that's
-     * all that bufctl_t_compare will look at.
-     */
-    pcp_search.bc_buf = handle;
-    pcp_search.bc_size = 1;
 
     PM_LOCK(pdubuf_lock);
-    /* THREADSAFE - no locks acquired in bufctl_t_compare() */
-    bcp = tfind(&pcp_search, &buf_tree, &bufctl_t_compare);
+    pcp = bufctl_lookup(handle);
     /*
      * NB: don't release the lock until final disposition of this object;
      * we don't want to play TOCTOU.
      */
-    if (likely(bcp != NULL)) {
-	pcp = *(bufctl_t **)bcp;
+    if (likely(pcp != NULL)) {
 	assert((&pcp->bc_buf[0] <= (char *)handle) &&
 	       ((char *)handle < &pcp->bc_buf[pcp->bc_size]));
 	pcp->bc_pincnt++;
@@ -186,29 +514,17 @@ __pmPinPDUBuf(void *handle)
 int
 __pmUnpinPDUBuf(void *handle)
 {
-    bufctl_t	*pcp, pcp_search;
-    void	*bcp;
+    bufctl_t	*pcp;
 
     assert(((__psint_t)handle % sizeof(int)) == 0);
     PM_LOCK(pdubuf_lock);
 
-    /*
-     * Initialize a dummy bufctl_t to use only as search key;
-     * only its bc_buf & bc_size fields need to be set, as that's
-     * all that bufctl_t_compare will look at.
-     */
-    pcp_search.bc_buf = handle;
-    pcp_search.bc_size = 1;
-
-    /* THREADSAFE - no locks acquired in bufctl_t_compare() */
-    bcp = tfind(&pcp_search, &buf_tree, &bufctl_t_compare);
+    pcp = bufctl_lookup(handle);
     /*
      * NB: don't release the lock until final disposition of this object;
      * we don't want to play TOCTOU.
      */
-    if (likely(bcp != NULL)) {
-	pcp = *(bufctl_t **)bcp;
-    } else {
+    if (unlikely(pcp == NULL)) {
 	PM_UNLOCK(pdubuf_lock);
 	if (pmDebugOptions.pdubuf) {
 	    fprintf(stderr, "__pmUnpinPDUBuf(" PRINTF_P_PFX "%p) -> fails\n",
@@ -227,6 +543,13 @@ __pmUnpinPDUBuf(void *handle)
 	   ((char*)handle < &pcp->bc_buf[pcp->bc_size]));
 
     if (likely(--pcp->bc_pincnt == 0)) {
+#ifdef HAVE_POSIX_MEMALIGN
+	if (pcp->bc_slab) {
+	    slab_free(pcp);
+	    PM_UNLOCK(pdubuf_lock);
+	    return 1;
+	}
+#endif
 	/* THREADSAFE - no locks acquired in bufctl_t_compare() */
 	tdelete(pcp, &buf_tree, &bufctl_t_compare);
 	PM_UNLOCK(pdubuf_lock);
@@ -259,6 +582,12 @@ pdubufcount(const void *nodep, const VISIT which, const int depth)
 void
 __pmCountPDUBuf(int need, int *alloc, int *free)
 {
+#ifdef HAVE_POSIX_MEMALIGN
+    slab_t	*sp;
+    bufctl_t	*pcp;
+    int		h, i;
+#endif
+
     PM_LOCK(pdubuf_lock);
 
     pdu_bufcnt_need = need;
@@ -267,7 +596,34 @@ __pmCountPDUBuf(int need, int *alloc, int *free)
     twalk(buf_tree, &pdubufcount);
     *alloc = pdu_bufcnt;
 
-    *free = 0;			/* We don't retain freed nodes. */
+    *free = 0;			/* We don't retain freed large nodes. */
+
+#ifdef HAVE_POSIX_MEMALIGN
+    /*
+     * Allocated slab buffers are counted by the size requested, free
+     * ones by the size of their class.
+     */
+    for (h = 0; h < NREGISTRY; h++) {
+	for (sp = registry[h]; sp != NULL; sp = sp->sl_hnext) {
+	    if (sizeclass[sp->sl_class].sc_size < need)
+		continue;
+	    *free += sp->sl_nfree;
+	    for (i = 0; i < sp->sl_nobj && sp->sl_nfree < sp->sl_nobj; i++) {
+		pcp = (bufctl_t *)(sp->sl_data + i * sp->sl_stride);
+		if (pcp->bc_pincnt > 0 && pcp->bc_size >= need)
+		    (*alloc)++;
+	    }
+	}
+    }
+#endif
+
+    PM_UNLOCK(pdubuf_lock);
+}
 
+void
+__pmGetPDUBufStats(__pmPDUBufStats *sp)
+{
+    PM_LOCK(pdubuf_lock);
+    *sp = bufstats;
     PM_UNLOCK(pdubuf_lock);
 }
@@ -108,6 +108,17 @@ static int export;
 
 static int havePmLoadCall;
 
+/*
+ * Compiled PMNS, see __pmCompilePMNS() ... mapped read-only and
+ * shared, with the node table and pmid hash table built from it
+ */
+static struct {
+    void	*base;
+    size_t	size;
+    __pmnsTree	*tree;		/* main_pmns when loaded from here */
+    __pmnsNode	*nodes;
+} binpmns;
+
 static int load(const char *, int, int);
 static __pmnsNode *locate(const char *, __pmnsNode *);
 
@@ -1346,6 +1357,373 @@ loadascii(int dupok, int use_cpp)
     return type;
 }
 
+/*
+ * Compiled PMNS file format - everything in host byte order, so a file
+ * from a host of the other endianness is (safely) rejected by the magic
+ * number check:
+ *
+ *	header
+ *	node table, numnodes entries, root first
+ *	pmid hash table, htabsize entries, node index of each chain head
+ *	string table, strsize bytes of '\0' terminated node names
+ *
+ * Node links are indices into the node table, or PMNS_BIN_NIL.  The size
+ * and modification time of the ASCII PMNS it was compiled from are kept
+ * in the header, and the compiled PMNS is only used if they still match.
+ */
+#define PMNS_BIN_MAGIC		0x504d4e43	/* PMNC */
+#define PMNS_BIN_VERSION	1
+#define PMNS_BIN_NIL		0xffffffff
+#define PMNS_BIN_DUPS		0x1		/* has duplicate PMIDs */
+#define PMNS_BIN_SUFFIX		".bin"
+
+typedef struct {
+    __uint32_t	magic;
+    __uint32_t	version;
+    __uint32_t	flags;
+    __uint32_t	numnodes;
+    __uint32_t	htabsize;
+    __uint32_t	strsize;
+    __int64_t	src_size;	/* ASCII PMNS size ... */
+    __int64_t	src_sec;	/* ... and modification time */
+    __int64_t	src_nsec;
+} pmns_bin_hdr;
+
+typedef struct {
+    __uint32_t	parent;
+    __uint32_t	next;
+    __uint32_t	first;
+    __uint32_t	hash;
+    __uint32_t	name;		/* offset into string table */
+    __uint32_t	pmid;
+} pmns_bin_node;
+
+static void
+pmns_mtime(const struct stat *sbuf, __int64_t *sec, __int64_t *nsec)
+{
+#if defined(HAVE_ST_MTIME_WITH_E)
+    *sec = sbuf->st_mtime;
+    *nsec = 0;
+#elif defined(HAVE_ST_MTIME_WITH_SPEC)
+    *sec = sbuf->st_mtimespec.tv_sec;
+    *nsec = sbuf->st_mtimespec.tv_nsec;
+#else
+    *sec = sbuf->st_mtim.tv_sec;
+    *nsec = sbuf->st_mtim.tv_nsec;
+#endif
+}
+
+static void
+unloadbinary(void)
+{
+    if (binpmns.tree != NULL) {
+	free(binpmns.tree->htab);
+	free(binpmns.tree);
+	binpmns.tree = NULL;
+    }
+    free(binpmns.nodes);
+    binpmns.nodes = NULL;
+    if (binpmns.base != NULL) {
+	__pmMemoryUnmap(binpmns.base, binpmns.size);
+	binpmns.base = NULL;
+    }
+}
+
+/*
+ * Load the compiled PMNS for fname, if there is one and it is up
+ * to date.  Returns 0 on success, else the caller should fall back
+ * to the ASCII PMNS.
+ */
+static int
+loadbinary(int dupok)
+{
+    char		binname[MAXPATHLEN];
+    struct stat		sbuf;
+    pmns_bin_hdr	*hp;
+    pmns_bin_node	*bp;
+    __uint32_t		*hashp;
+    char		*strings;
+    __pmnsNode		*np;
+    __int64_t		sec, nsec;
+    size_t		need;
+    int			fd;
+    int			i;
+
+    PM_ASSERT_IS_LOCKED(pmns_lock);
+
+    if (stat(fname, &sbuf) < 0)
+	return -oserror();
+    pmns_mtime(&sbuf, &sec, &nsec);
+
+    pmsprintf(binname, sizeof(binname), "%s" PMNS_BIN_SUFFIX, fname);
+    if ((fd = open(binname, O_RDONLY)) < 0)
+	return -oserror();
+    if (fstat(fd, &sbuf) < 0 || sbuf.st_size < sizeof(pmns_bin_hdr)) {
+	if (pmDebugOptions.pmns)
+	    fprintf(stderr, "loadbinary: %s: truncated\n", binname);
+	close(fd);
+	return PM_ERR_PMNS;
+    }
+    binpmns.size = sbuf.st_size;
+    binpmns.base = __pmMemoryMap(fd, binpmns.size, 0);
+    close(fd);
+    if (binpmns.base == NULL)
+	return -oserror();
+
+    hp = (pmns_bin_hdr *)binpmns.base;
+    if (hp->magic != PMNS_BIN_MAGIC || hp->version != PMNS_BIN_VERSION) {
+	if (pmDebugOptions.pmns)
+	    fprintf(stderr, "loadbinary: %s: bad magic or version\n", binname);
+	goto fail;
+    }
+    if (hp->src_size != (__int64_t)last_size ||
+	hp->src_sec != sec || hp->src_nsec != nsec) {
+	if (pmDebugOptions.pmns)
+	    fprintf(stderr, "loadbinary: %s: out of date for %s\n", binname, fname);
+	goto fail;
+    }
+    if ((hp->flags & PMNS_BIN_DUPS) && dupok == NO_DUPS) {
+	if (pmDebugOptions.pmns)
+	    fprintf(stderr, "loadbinary: %s: duplicate PMIDs\n", binname);
+	goto fail;
+    }
+    need = sizeof(*hp) + (size_t)hp->numnodes * sizeof(*bp) +
+	   (size_t)hp->htabsize * sizeof(*hashp) + hp->strsize;
+    if (hp->numnodes == 0 || hp->htabsize == 0 || hp->strsize == 0 ||
+	need != binpmns.size) {
+	if (pmDebugOptions.pmns)
+	    fprintf(stderr, "loadbinary: %s: size %zu, expected %zu\n",
+		    binname, binpmns.size, need);
+	goto fail;
+    }
+    bp = (pmns_bin_node *)&hp[1];
+    hashp = (__uint32_t *)&bp[hp->numnodes];
+    strings = (char *)&hashp[hp->htabsize];
+    if (strings[hp->strsize-1] != '\0')
+	goto corrupt;
+
+    binpmns.tree = (__pmnsTree *)malloc(sizeof(__pmnsTree));
+    binpmns.nodes = (__pmnsNode *)malloc(hp->numnodes * sizeof(__pmnsNode));
+    if (binpmns.tree == NULL || binpmns.nodes == NULL)
+	goto fail;
+    binpmns.tree->htabsize = hp->htabsize;
+    binpmns.tree->htab = (__pmnsNode **)malloc(hp->htabsize * sizeof(__pmnsNode *));
+    if (binpmns.tree->htab == NULL)
+	goto fail;
+
+#define NODE(x) ((x) == PMNS_BIN_NIL ? NULL : &binpmns.nodes[x])
+#define BADNODE(x) ((x) != PMNS_BIN_NIL && (x) >= hp->numnodes)
+    for (i = 0; i < hp->numnodes; i++, bp++) {
+	if (BADNODE(bp->parent) || BADNODE(bp->next) || BADNODE(bp->first) ||
+	    BADNODE(bp->hash) || bp->name >= hp->strsize)
+	    goto corrupt;
+	np = &binpmns.nodes[i];
+	np->parent = NODE(bp->parent);
+	np->next = NODE(bp->next);
+	np->first = NODE(bp->first);
+	np->hash = NODE(bp->hash);
+	np->name = &strings[bp->name];
+	np->pmid = bp->pmid;
+    }
+    for (i = 0; i < hp->htabsize; i++) {
+	if (BADNODE(hashp[i]))
+	    goto corrupt;
+	binpmns.tree->htab[i] = NODE(hashp[i]);
+    }
+#undef NODE
+#undef BADNODE
+    if (binpmns.nodes[0].parent != NULL)
+	goto corrupt;
+    binpmns.tree->root = &binpmns.nodes[0];
+    binpmns.tree->mark_state = 0;
+    main_pmns = binpmns.tree;
+
+    if (pmDebugOptions.pmns)
+	fprintf(stderr, "Loaded compiled PMNS %s: %u nodes\n",
+		binname, hp->numnodes);
+    return 0;
+
+corrupt:
+    if (pmDebugOptions.pmns)
+	fprintf(stderr, "loadbinary: %s: corrupted\n", binname);
+fail:
+    unloadbinary();
+    return PM_ERR_PMNS;
+}
+
+/* helpers for __pmCompilePMNS(), node pointer to position in sorted[] */
+typedef struct {
+    const __pmnsNode	**nodes;	/* in depth-first order */
+    const __pmnsNode	**sorted;	/* by address */
+    int			numnodes;
+    size_t		strsize;
+} pmns_bin_ctl;
+
+static void
+count_nodes(const __pmnsNode *np, pmns_bin_ctl *ctl)
+{
+    for (; np != NULL; np = np->next) {
+	if (ctl->nodes != NULL)
+	    ctl->nodes[ctl->numnodes] = np;
+	ctl->numnodes++;
+	ctl->strsize += strlen(np->name) + 1;
+	count_nodes(np->first, ctl);
+    }
+}
+
+static int
+compare_nodes(const void *a, const void *b)
+{
+    const __pmnsNode	*x = *(const __pmnsNode **)a;
+    const __pmnsNode	*y = *(const __pmnsNode **)b;
+
+    return x < y ? -1 : (x > y ? 1 : 0);
+}
+
+static __uint32_t
+node_index(const pmns_bin_ctl *ctl, const __pmnsNode *np)
+{
+    const __pmnsNode	**found;
+
+    if (np == NULL)
+	return PMNS_BIN_NIL;
+    found = bsearch(&np, ctl->sorted, ctl->numnodes, sizeof(np), compare_nodes);
+    assert(found != NULL);
+    return (__uint32_t)(found - ctl->sorted);
+}
+
+/*
+ * Write a compiled version of the PMNS tree (loaded from the ASCII
+ * PMNS file srcname) to binname, to be loaded in preference to the
+ * ASCII PMNS while the latter is unchanged.
+ */
+int
+__pmCompilePMNS(const __pmnsTree *tree, const char *srcname, const char *binname)
+{
+    pmns_bin_ctl	ctl = { NULL, NULL, 0, 0 };
+    pmns_bin_hdr	hdr;
+    pmns_bin_node	*bnodes = NULL;
+    __uint32_t		*hashtab = NULL;
+    __uint32_t		*order = NULL;
+    char		*strings = NULL;
+    char		tmpname[MAXPATHLEN];
+    struct stat		sbuf;
+    const __pmnsNode	*np, *xp;
+    size_t		off;
+    FILE		*f = NULL;
+    int			sts;
+    int			i;
+
+    if (tree == NULL || tree->root == NULL || tree->htabsize == 0)
+	return PM_ERR_NOPMNS;
+    if (stat(srcname, &sbuf) < 0)
+	return -oserror();
+
+    memset(&hdr, 0, sizeof(hdr));
+    hdr.magic = PMNS_BIN_MAGIC;
+    hdr.version = PMNS_BIN_VERSION;
+    hdr.src_size = sbuf.st_size;
+    pmns_mtime(&sbuf, &hdr.src_sec, &hdr.src_nsec);
+
+    /* number the nodes, root first then depth-first */
+    ctl.numnodes = 1;
+    ctl.strsize = strlen(tree->root->name) + 1;
+    count_nodes(tree->root->first, &ctl);
+    ctl.nodes = calloc(ctl.numnodes, sizeof(__pmnsNode *));
+    ctl.sorted = calloc(ctl.numnodes, sizeof(__pmnsNode *));
+    order = calloc(ctl.numnodes, sizeof(__uint32_t));
+    bnodes = calloc(ctl.numnodes, sizeof(pmns_bin_node));
+    hashtab = calloc(tree->htabsize, sizeof(__uint32_t));
+    strings = calloc(1, ctl.strsize);
+    if (ctl.nodes == NULL || ctl.sorted == NULL || order == NULL ||
+	bnodes == NULL || hashtab == NULL || strings == NULL) {
+	sts = -ENOMEM;
+	goto done;
+    }
+    ctl.nodes[0] = tree->root;
+    ctl.numnodes = 1;
+    ctl.strsize = 0;
+    count_nodes(tree->root->first, &ctl);
+
+    /*
+     * sort by address for lookups, remembering the depth-first index
+     * of each, then map sorted positions back to depth-first indices
+     */
+    memcpy(ctl.sorted, ctl.nodes, ctl.numnodes * sizeof(__pmnsNode *));
+    qsort(ctl.sorted, ctl.numnodes, sizeof(__pmnsNode *), compare_nodes);
+    for (i = 0; i < ctl.numnodes; i++)
+	order[node_index(&ctl, ctl.nodes[i])] = i;
+#define INDEX(p) ((p) == NULL ? PMNS_BIN_NIL : order[node_index(&ctl, (p))])
+
+    for (i = 0, off = 0; i < ctl.numnodes; i++) {
+	np = ctl.nodes[i];
+	bnodes[i].parent = INDEX(np->parent);
+	bnodes[i].next = INDEX(np->next);
+	bnodes[i].first = INDEX(np->first);
+	bnodes[i].hash = INDEX(np->hash);
+	bnodes[i].pmid = np->pmid & PMID_MASK;
+	if (np->pmid == PM_ID_NULL)
+	    bnodes[i].pmid = PM_ID_NULL;
+	bnodes[i].name = (__uint32_t)off;
+	strcpy(&strings[off], np->name);
+	off += strlen(np->name) + 1;
+    }
+    bnodes[0].parent = PMNS_BIN_NIL;	/* root, even within a subtree */
+    hdr.numnodes = ctl.numnodes;
+    hdr.strsize = (__uint32_t)off;
+
+    hdr.htabsize = tree->htabsize;
+    for (i = 0; i < tree->htabsize; i++) {
+	hashtab[i] = INDEX(tree->htab[i]);
+	for (np = tree->htab[i]; np != NULL; np = np->hash) {
+	    if (IS_DYNAMIC_ROOT(np->pmid & PMID_MASK))
+		continue;
+	    for (xp = np->hash; xp != NULL; xp = xp->hash) {
+		if ((xp->pmid & PMID_MASK) == (np->pmid & PMID_MASK))
+		    hdr.flags |= PMNS_BIN_DUPS;
+	    }
+	}
+    }
+#undef INDEX
+
+    /* write to a temporary file, then rename into place */
+    pmsprintf(tmpname, sizeof(tmpname), "%s.new", binname);
+    if ((f = fopen(tmpname, "w")) == NULL) {
+	sts = -oserror();
+	goto done;
+    }
+    if (fwrite(&hdr, sizeof(hdr), 1, f) != 1 ||
+	fwrite(bnodes, sizeof(pmns_bin_node), hdr.numnodes, f) != hdr.numnodes ||
+	fwrite(hashtab, sizeof(__uint32_t), hdr.htabsize, f) != hdr.htabsize ||
+	fwrite(strings, 1, hdr.strsize, f) != hdr.strsize) {
+	sts = -oserror();
+	fclose(f);
+	unlink(tmpname);
+	goto done;
+    }
+    if (fclose(f) != 0) {
+	sts = -oserror();
+	unlink(tmpname);
+	goto done;
+    }
+    chmod(tmpname, sbuf.st_mode & 0666);
+    if (rename(tmpname, binname) < 0) {
+	sts = -oserror();
+	unlink(tmpname);
+	goto done;
+    }
+    sts = 0;
+
+done:
+    free(ctl.nodes);
+    free(ctl.sorted);
+    free(order);
+    free(bnodes);
+    free(hashtab);
+    free(strings);
+    return sts;
+}
+
 static const char * 
 getfname(const char *filename)
 {
@@ -1523,8 +1901,12 @@ load(const char *filename, int dupok, int use_cpp)
 	use_cpp = NO_CPP;
 
     /*
-     * load ASCII PMNS
+     * load the compiled PMNS if there is an up to date one, else
+     * the ASCII PMNS ... cpp controls and macros are only expanded
+     * for the latter
      */
+    if (use_cpp == NO_CPP && loadbinary(dupok) == 0)
+	return 0;
     return loadascii(dupok, use_cpp);
 }
 
@@ -1670,7 +2052,10 @@ pmUnloadNameSpace(void)
     PM_INIT_LOCKS();
 
     havePmLoadCall = 0;
-    __pmFreePMNS(main_pmns);
+    if (main_pmns != NULL && main_pmns == binpmns.tree)
+	unloadbinary();
+    else
+	__pmFreePMNS(main_pmns);
     if (PM_TPD(curr_pmns) == main_pmns) {
 	PM_TPD(curr_pmns) = NULL;
 	PM_TPD(useExtPMNS) = 0;
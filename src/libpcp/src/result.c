@@ -16,8 +16,9 @@
  *
  * Threadsafe notes.
  *
- * - result_pool (head of list => all of the list) is guarded by the
- *   result_lock mutex
+ * - result_pool (the hash table and all of the entries) is guarded by
+ *   the result_lock mutex
+ * - a __pmResultArena belongs to its caller, who must serialize its use
  */
 
 #include "pmapi.h"
@@ -26,15 +27,23 @@
 #include "fault.h"
 
 /*
- * Linked list of allocations made by __pmAllocResult(), but not
- * yet released by pmFreeResult().
+ * Allocations made by __pmAllocResult(), but not yet released by
+ * pmFreeResult().  Each pool entry and its __pmResult come from one
+ * malloc(), and entries are hashed on the __pmResult address so the
+ * free routines decide "ours or not" without searching the whole pool.
  */
 typedef struct result_pool_t {
-    struct result_pool_t	*next;
-    __pmResult			*rp;
+    struct result_pool_t	*next;		/* hash chain */
+    __pmResult			rp;		/* must be last, vset[] grows */
 } result_pool_t;
 
-result_pool_t	*result_pool;
+#define POOL_MINBUCKET	64
+
+static struct {
+    result_pool_t	**bucket;
+    unsigned int	nbucket;	/* always a power of 2 */
+    size_t		count;
+} result_pool;
 
 #ifdef PM_MULTI_THREAD
 static pthread_mutex_t	result_lock;
@@ -61,6 +70,63 @@ init_result_lock(void)
 #endif
 }
 
+static unsigned int
+pool_hash(const __pmResult *rp, unsigned int nbucket)
+{
+    uintptr_t	key = (uintptr_t)rp;
+
+    return (unsigned int)((key >> 4) ^ (key >> 16)) & (nbucket - 1);
+}
+
+/*
+ * Double the hash table once the chains average more than two entries.
+ * Called with result_lock held.
+ */
+static int
+pool_grow(void)
+{
+    result_pool_t	**bucket;
+    result_pool_t	*pool, *next;
+    unsigned int	nbucket, h, i;
+
+    if (result_pool.count < 2 * (size_t)result_pool.nbucket)
+	return 0;
+    nbucket = result_pool.nbucket ? 2 * result_pool.nbucket : POOL_MINBUCKET;
+    if ((bucket = (result_pool_t **)calloc(nbucket, sizeof(*bucket))) == NULL)
+	return -oserror();
+    for (i = 0; i < result_pool.nbucket; i++) {
+	for (pool = result_pool.bucket[i]; pool != NULL; pool = next) {
+	    next = pool->next;
+	    h = pool_hash(&pool->rp, nbucket);
+	    pool->next = bucket[h];
+	    bucket[h] = pool;
+	}
+    }
+    free(result_pool.bucket);
+    result_pool.bucket = bucket;
+    result_pool.nbucket = nbucket;
+    return 0;
+}
+
+/*
+ * Find the link to the pool entry for rp, else NULL if rp was not
+ * allocated by __pmAllocResult().  Called with result_lock held.
+ */
+static result_pool_t **
+pool_lookup(const __pmResult *rp)
+{
+    result_pool_t	**poolp;
+
+    if (result_pool.nbucket == 0)
+	return NULL;
+    for (poolp = &result_pool.bucket[pool_hash(rp, result_pool.nbucket)];
+	 *poolp != NULL; poolp = &(*poolp)->next) {
+	if (&(*poolp)->rp == rp)
+	    return poolp;
+    }
+    return NULL;
+}
+
 /*
  * Allocate a __pmResult with enough space for numpmid metrics
  * ... return NULL on failure, and let caller decide what to do next
@@ -69,6 +135,7 @@ __pmResult *
 __pmAllocResult(int numpmid)
 {
     size_t		need;
+    unsigned int	h;
     result_pool_t	*new;
 
     /*
@@ -81,39 +148,36 @@ PM_FAULT_RETURN(NULL);
 
     PM_INIT_LOCKS();
 
-    new = (result_pool_t *)malloc(sizeof(*new));
+    if (numpmid < 1)
+	numpmid = 1;
+    need = sizeof(result_pool_t) + (numpmid - 1) * sizeof(pmValueSet *);
+    new = (result_pool_t *)malloc(need);
     if (new == NULL) {
 	if (pmDebugOptions.alloc)
-	    fprintf(stderr, "__pmAllocResult: new alloc failed\n");
+	    fprintf(stderr, "__pmAllocResult: __pmResult %zu failed\n", need);
 	return NULL;
     }
 
-    if (numpmid < 1)
-	numpmid = 1;
-    need = sizeof(__pmResult) + (numpmid - 1) * sizeof(pmValueSet *);
-    new->rp = (__pmResult *)malloc(need);
-    if (new->rp == NULL) {
+    PM_LOCK(result_lock);
+    if (pool_grow() < 0) {
+	PM_UNLOCK(result_lock);
 	if (pmDebugOptions.alloc)
-	    fprintf(stderr, "__pmAllocResult: __pmResult %zu failed\n", need);
+	    fprintf(stderr, "__pmAllocResult: pool grow failed\n");
 	free(new);
 	return NULL;
     }
+    h = pool_hash(&new->rp, result_pool.nbucket);
+    new->next = result_pool.bucket[h];
+    result_pool.bucket[h] = new;
+    result_pool.count++;
 
-    PM_LOCK(result_lock);
-    new->next = result_pool;
-    result_pool = new;
-
-    if (pmDebugOptions.alloc) {
-	int		n = 0;
-	result_pool_t	*pool;
-	for (pool = result_pool; pool != NULL; pool = pool->next)
-	    n++;
-	fprintf(stderr, "__pmAllocResult ->" PRINTF_P_PFX "%p (%d in pool)\n", new->rp, n);
-    }
+    if (pmDebugOptions.alloc)
+	fprintf(stderr, "__pmAllocResult ->" PRINTF_P_PFX "%p (%zu in pool)\n",
+		&new->rp, result_pool.count);
 
     PM_UNLOCK(result_lock);
 
-    return new->rp;
+    return &new->rp;
 }
 
 /*
@@ -124,36 +188,27 @@ __pmDumpResultPool(void)
 {
     if (pmDebugOptions.alloc) {
 	result_pool_t	*pool;
+	unsigned int	i;
 	size_t		n = 0;
 
-	for (pool = result_pool; pool != NULL; pool = pool->next) {
-	    fprintf(stderr, "__pmResult [%zu] %p -> rp %p\n", n, pool, pool->rp);
-	    n++;
+	for (i = 0; i < result_pool.nbucket; i++) {
+	    for (pool = result_pool.bucket[i]; pool != NULL; pool = pool->next) {
+		fprintf(stderr, "__pmResult [%zu] %p -> rp %p\n", n, pool, &pool->rp);
+		n++;
+	    }
 	}
 	if (n == 0)
 	    fprintf(stderr, "__pmResult pool is empty\n");
     }
 }
 
-static size_t
-__pmSizeResultPool(void)
-{
-    result_pool_t	*pool;
-    size_t		size = 0;
-
-    for (pool = result_pool; pool != NULL; pool = pool->next)
-	size++;
-    return size;
-}
-
 static void
-__pmFreeResultFromPool(result_pool_t *pool, result_pool_t *prior)
+__pmFreeResultFromPool(result_pool_t **poolp)
 {
-    if (prior == NULL)
-	result_pool = pool->next;
-    else
-	prior->next = pool->next;
-    free(pool->rp);
+    result_pool_t	*pool = *poolp;
+
+    *poolp = pool->next;
+    result_pool.count--;
     free(pool);
 }
 
@@ -196,7 +251,7 @@ __pmFreeResultValueSets(pmValueSet **ppvstart, pmValueSet **ppvsend)
 void
 __pmFreeResult(__pmResult *result)
 {
-    result_pool_t	*pool, *prior = NULL;
+    result_pool_t	**poolp;
 
     PM_INIT_LOCKS();
     PM_LOCK(result_lock);
@@ -209,22 +264,18 @@ __pmFreeResult(__pmResult *result)
 
     if (pmDebugOptions.alloc)
 	fprintf(stderr, "%s(" PRINTF_P_PFX "%p) (%zu in pool)",
-			"__pmFreeResult", result, __pmSizeResultPool());
+			"__pmFreeResult", result, result_pool.count);
 
-    for (pool = result_pool; pool != NULL; pool = pool->next) {
-	if (result == pool->rp) {
-	    if (pmDebugOptions.alloc)
-		fprintf(stderr, " [in " PRINTF_P_PFX "%p]", pool->rp);
-	    break;
-	}
-	prior = pool;
-    }
-    if (pmDebugOptions.alloc)
+    poolp = pool_lookup(result);
+    if (pmDebugOptions.alloc) {
+	if (poolp != NULL)
+	    fprintf(stderr, " [in " PRINTF_P_PFX "%p]", *poolp);
 	fputc('\n', stderr);
+    }
     if (result->numpmid > 0)
 	__pmFreeResultValueSets(result->vset, &result->vset[result->numpmid]);
-    if (pool != NULL)
-	__pmFreeResultFromPool(pool, prior);
+    if (poolp != NULL)
+	__pmFreeResultFromPool(poolp);
     /* else on-stack */
     PM_UNLOCK(result_lock);
 }
@@ -252,7 +303,7 @@ __pmFreeHighResResultValues(pmHighResResult *result)
 void
 pmFreeResult(pmResult *result)
 {
-    result_pool_t	*pool, *prior = NULL;
+    result_pool_t	**poolp;
 
     PM_INIT_LOCKS();
     PM_LOCK(result_lock);
@@ -265,21 +316,19 @@ pmFreeResult(pmResult *result)
 
     if (pmDebugOptions.alloc)
 	fprintf(stderr, "%s(" PRINTF_P_PFX "%p) (%zu in pool)",
-			"pmFreeResult", result, __pmSizeResultPool());
+			"pmFreeResult", result, result_pool.count);
 
-    for (pool = result_pool; pool != NULL; pool = pool->next) {
-	if (result == __pmOffsetResult(pool->rp)) {
-	    if (pmDebugOptions.alloc)
-		fprintf(stderr, " [in " PRINTF_P_PFX "%p]", pool->rp);
-	    break;
-	}
-	prior = pool;
-    }
-    if (pmDebugOptions.alloc)
+    /* the __pmResult (if any) that result was exported from */
+    poolp = pool_lookup((__pmResult *)((char *)result -
+		(offsetof(__pmResult, numpmid) - offsetof(pmResult, numpmid))));
+    if (pmDebugOptions.alloc) {
+	if (poolp != NULL)
+	    fprintf(stderr, " [in " PRINTF_P_PFX "%p]", *poolp);
 	fputc('\n', stderr);
+    }
     __pmFreeResultValues(result);
-    if (pool != NULL)
-	__pmFreeResultFromPool(pool, prior);
+    if (poolp != NULL)
+	__pmFreeResultFromPool(poolp);
     else
 	free(result);	/* not allocated by __pmAllocResult */
     PM_UNLOCK(result_lock);
@@ -288,7 +337,7 @@ pmFreeResult(pmResult *result)
 void
 __pmFreeHighResResult(pmHighResResult *result)
 {
-    result_pool_t	*pool, *prior = NULL;
+    result_pool_t	**poolp;
 
     PM_INIT_LOCKS();
     PM_LOCK(result_lock);
@@ -301,21 +350,19 @@ __pmFreeHighResResult(pmHighResResult *result)
 
     if (pmDebugOptions.alloc)
 	fprintf(stderr, "%s(" PRINTF_P_PFX "%p) (%zu in pool)",
-			"pmFreeHighResResult", result, __pmSizeResultPool());
+			"pmFreeHighResResult", result, result_pool.count);
 
-    for (pool = result_pool; pool != NULL; pool = pool->next) {
-	if (result == __pmOffsetHighResResult(pool->rp)) {
-	    if (pmDebugOptions.alloc)
-		fprintf(stderr, " [in " PRINTF_P_PFX "%p]", pool->rp);
-	    break;
-	}
-	prior = pool;
-    }
-    if (pmDebugOptions.alloc)
+    /* the __pmResult (if any) that result was exported from */
+    poolp = pool_lookup((__pmResult *)((char *)result -
+		(offsetof(__pmResult, numpmid) - offsetof(pmHighResResult, numpmid))));
+    if (pmDebugOptions.alloc) {
+	if (poolp != NULL)
+	    fprintf(stderr, " [in " PRINTF_P_PFX "%p]", *poolp);
 	fputc('\n', stderr);
+    }
     __pmFreeHighResResultValues(result);
-    if (pool != NULL)
-	__pmFreeResultFromPool(pool, prior);
+    if (poolp != NULL)
+	__pmFreeResultFromPool(poolp);
     else
 	free(result);	/* not allocated by __pmAllocResult */
     PM_UNLOCK(result_lock);
@@ -326,3 +373,203 @@ pmFreeHighResResult(pmHighResResult *result)
 {
     return __pmFreeHighResResult(result);
 }
+
+/*
+ * Result arenas ... the pmValueSets and pmValueBlocks for a whole
+ * result are built in scratch space that is reused from one result
+ * to the next, then copied into a single pinned pdubuf, so the
+ * result costs one allocation and __pmFreeResultValueSets() releases
+ * it with one __pmUnpinPDUBuf() instead of a free() per pmValueSet
+ * and per pmValueBlock.
+ *
+ * The scratch space may move as it grows, so until
+ * __pmResultArenaFinish() the slot offsets (and the pval of each
+ * PM_VAL_DPTR value) are offsets from the start of the scratch space.
+ */
+#define ARENA_ALIGN(x)	(((x) + sizeof(__int64_t) - 1) & ~(sizeof(__int64_t) - 1))
+#define ARENA_EMPTY	((size_t)-1)
+
+static int
+arena_reserve(__pmResultArena *ap, size_t need, size_t *offp)
+{
+    size_t	size;
+    char	*buf;
+
+    need = ARENA_ALIGN(need);
+    if (ap->used + need > ap->size) {
+	size = ap->size ? ap->size : 4096;
+	while (size < ap->used + need)
+	    size *= 2;
+	if ((buf = (char *)realloc(ap->buf, size)) == NULL)
+	    return -oserror();
+	ap->buf = buf;
+	ap->size = size;
+    }
+    *offp = ap->used;
+    ap->used += need;
+    return 0;
+}
+
+/*
+ * Start building a result of numpmid pmValueSets, discarding
+ * anything left from a previous (failed) build.
+ */
+int
+__pmResultArenaStart(__pmResultArena *ap, int numpmid)
+{
+    size_t	*voff;
+    int		i;
+
+    if (numpmid > ap->maxslot) {
+	if ((voff = (size_t *)realloc(ap->voff, numpmid * sizeof(size_t))) == NULL)
+	    return -oserror();
+	ap->voff = voff;
+	ap->maxslot = numpmid;
+    }
+    for (i = 0; i < numpmid; i++)
+	ap->voff[i] = ARENA_EMPTY;
+    ap->nslot = numpmid;
+    ap->used = 0;
+    return 0;
+}
+
+/*
+ * Add an empty pmValueSet with room for maxval values at slot.
+ */
+int
+__pmResultArenaAddValueSet(__pmResultArena *ap, int slot, pmID pmid, int maxval)
+{
+    pmValueSet	*vsp;
+    size_t	need;
+    size_t	off;
+    int		sts;
+
+    if (maxval >= 1)
+	need = sizeof(pmValueSet) + (maxval - 1) * sizeof(pmValue);
+    else
+	need = sizeof(pmValueSet) - sizeof(pmValue);
+    if ((sts = arena_reserve(ap, need, &off)) < 0)
+	return sts;
+    ap->voff[slot] = off;
+    vsp = (pmValueSet *)&ap->buf[off];
+    vsp->pmid = pmid;
+    vsp->numval = 0;
+    vsp->valfmt = PM_VAL_INSITU;
+    return 0;
+}
+
+/*
+ * The pmValueSet at slot, else NULL if none has been added yet ...
+ * only valid until the next call that may add to the arena.
+ */
+pmValueSet *
+__pmResultArenaValueSet(__pmResultArena *ap, int slot)
+{
+    if (ap->voff[slot] == ARENA_EMPTY)
+	return NULL;
+    return (pmValueSet *)&ap->buf[ap->voff[slot]];
+}
+
+/*
+ * Arena equivalent of __pmStuffValue(), appending the value for
+ * inst to the pmValueSet at slot.  Returns the value format, else
+ * an error and the pmValueSet is unchanged.
+ */
+int
+__pmResultArenaStuffValue(__pmResultArena *ap, int slot, int inst,
+			const pmAtomValue *avp, int type)
+{
+    pmValueSet		*vsp = (pmValueSet *)&ap->buf[ap->voff[slot]];
+    pmValueBlock	*vbp;
+    const void		*src;
+    size_t		body, need;
+    size_t		off;
+    int			valfmt;
+    int			sts;
+
+    valfmt = __pmStuffValueBody(avp, &vsp->vlist[vsp->numval], type, &src, &body);
+    if (valfmt == PM_VAL_DPTR) {
+	need = body + PM_VAL_HDR_SIZE;
+	if ((sts = arena_reserve(ap, need < sizeof(pmValueBlock) ?
+				sizeof(pmValueBlock) : need, &off)) < 0)
+	    return sts;
+	vbp = (pmValueBlock *)&ap->buf[off];
+	vbp->vlen = (int)need;
+	vbp->vtype = type;
+	memcpy((void *)vbp->vbuf, src, body);
+	vsp = (pmValueSet *)&ap->buf[ap->voff[slot]];
+	vsp->vlist[vsp->numval].value.pval = (pmValueBlock *)off;
+    }
+    else if (valfmt < 0)
+	return valfmt;
+    vsp->vlist[vsp->numval].inst = inst;
+    vsp->valfmt = valfmt;
+    vsp->numval++;
+    return valfmt;
+}
+
+/*
+ * Deep copy the pmValueSet vsp (from anywhere) into slot ... values
+ * held by PM_VAL_SPTR are not copied, just as for __pmStuffValue().
+ */
+int
+__pmResultArenaCopyValueSet(__pmResultArena *ap, int slot, const pmValueSet *vsp)
+{
+    pmValueSet		*nvsp;
+    pmValueBlock	*vbp;
+    size_t		need;
+    size_t		off;
+    int			sts;
+    int			j;
+
+    if ((sts = __pmResultArenaAddValueSet(ap, slot, vsp->pmid, vsp->numval)) < 0)
+	return sts;
+    nvsp = (pmValueSet *)&ap->buf[ap->voff[slot]];
+    nvsp->numval = vsp->numval;
+    nvsp->valfmt = vsp->valfmt;
+    for (j = 0; j < vsp->numval; j++) {
+	nvsp->vlist[j] = vsp->vlist[j];
+	if (vsp->valfmt != PM_VAL_DPTR)
+	    continue;
+	vbp = vsp->vlist[j].value.pval;
+	need = vbp->vlen < sizeof(pmValueBlock) ? sizeof(pmValueBlock) : vbp->vlen;
+	if ((sts = arena_reserve(ap, need, &off)) < 0)
+	    return sts;
+	memcpy(&ap->buf[off], (void *)vbp, vbp->vlen);
+	nvsp = (pmValueSet *)&ap->buf[ap->voff[slot]];
+	nvsp->vlist[j].value.pval = (pmValueBlock *)off;
+    }
+    return 0;
+}
+
+/*
+ * Move the finished pmValueSets into one pinned pdubuf and return
+ * them via vset[], in slot order.  Every slot must have been added.
+ */
+int
+__pmResultArenaFinish(__pmResultArena *ap, pmValueSet **vset)
+{
+    pmValueSet	*vsp;
+    char	*base;
+    int		i;
+    int		j;
+
+    if (ap->nslot == 0)
+	return 0;
+    if (ap->used > INT_MAX)
+	return PM_ERR_TOOBIG;
+    if ((base = (char *)__pmFindPDUBuf((int)ap->used)) == NULL)
+	return -oserror();
+    memcpy(base, ap->buf, ap->used);
+    for (i = 0; i < ap->nslot; i++) {
+	vset[i] = vsp = (pmValueSet *)&base[ap->voff[i]];
+	if (vsp->numval <= 0 || vsp->valfmt != PM_VAL_DPTR)
+	    continue;
+	for (j = 0; j < vsp->numval; j++)
+	    vsp->vlist[j].value.pval = (pmValueBlock *)
+			&base[(size_t)vsp->vlist[j].value.pval];
+    }
+    ap->nslot = 0;
+    ap->used = 0;
+    return 0;
+}
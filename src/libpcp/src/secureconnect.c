@@ -23,6 +23,9 @@
 #include <openssl/ssl.h>
 #include <openssl/err.h>
 #include <sys/stat.h>
+#ifdef HAVE_POLL_H
+#include <poll.h>
+#endif
 #ifdef HAVE_SYS_TERMIOS_H
 #include <sys/termios.h>
 #endif
@@ -1410,7 +1413,12 @@ int
 __pmSocketReady(int fd, struct timeval *timeout)
 {
     __pmSecureSocket ss;
+#ifdef HAVE_POLL_H
+    struct pollfd pollfd;
+    int msec;
+#else
     __pmFdSet onefd;
+#endif
 
     if (fd < 0)
 	return -EBADF;
@@ -1419,7 +1427,19 @@ __pmSocketReady(int fd, struct timeval *timeout)
 	if (SSL_pending(ss.ssl) > 0)
 	    return 1;	/* proceed without blocking */
 
+#ifdef HAVE_POLL_H
+    /* poll(2) has no FD_SETSIZE limit on the descriptor number */
+    pollfd.fd = fd;
+    pollfd.events = POLLIN;
+    pollfd.revents = 0;
+    if (timeout == NULL)
+	msec = -1;
+    else	/* round up, so a short timeout does not become a busy wait */
+	msec = timeout->tv_sec * 1000 + (timeout->tv_usec + 999) / 1000;
+    return poll(&pollfd, 1, msec);
+#else
     FD_ZERO(&onefd);
     FD_SET(fd, &onefd);
     return select(fd+1, &onefd, NULL, NULL, timeout);
+#endif
 }
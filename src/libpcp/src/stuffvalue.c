@@ -14,6 +14,7 @@
 
 #include "pmapi.h"
 #include "libpcp.h"
+#include "internal.h"
 #include <ctype.h>
 #include <limits.h>
 #ifdef HAVE_VALUES_H
@@ -184,12 +185,16 @@ __pmStringValue(const char *buf, pmAtomValue *avp, int type)
     return 0;
 }
 
+/*
+ * Common to __pmStuffValue() and the result arenas ... values that fit
+ * in vp are stored there and the value format returned, otherwise for
+ * PM_VAL_DPTR the caller must allocate a pmValueBlock and copy body
+ * bytes from *srcp into it.
+ */
 int
-__pmStuffValue(const pmAtomValue *avp, pmValue *vp, int type)
+__pmStuffValueBody(const pmAtomValue *avp, pmValue *vp, int type,
+		const void **srcp, size_t *bodyp)
 {
-    void	*src;
-    size_t	need, body;
-
     switch (type) {
 	case PM_TYPE_32:
 	case PM_TYPE_U32:
@@ -197,15 +202,15 @@ __pmStuffValue(const pmAtomValue *avp, pmValue *vp, int type)
 	    return PM_VAL_INSITU;
 
 	case PM_TYPE_FLOAT:
-	    body = sizeof(float);
-	    src  = (void *)&avp->f;
+	    *bodyp = sizeof(float);
+	    *srcp  = (void *)&avp->f;
 	    break;
 
 	case PM_TYPE_64:
 	case PM_TYPE_U64:
 	case PM_TYPE_DOUBLE:
-	    body = sizeof(__int64_t);
-	    src  = (void *)&avp->ull;
+	    *bodyp = sizeof(__int64_t);
+	    *srcp  = (void *)&avp->ull;
 	    break;
 
 	case PM_TYPE_AGGREGATE:
@@ -213,16 +218,17 @@ __pmStuffValue(const pmAtomValue *avp, pmValue *vp, int type)
 	     * vbp field of pmAtomValue points to a dynamically allocated
 	     * pmValueBlock ... the vlen and vtype fields MUST have been
 	     * already set up.
-	     * A new pmValueBlock header will be allocated below, so adjust
-	     * the length here (PM_VAL_HDR_SIZE will be added back later).
+	     * A new pmValueBlock header will be allocated by the caller,
+	     * so adjust the length here (PM_VAL_HDR_SIZE will be added
+	     * back later).
 	     */
-	    body = avp->vbp->vlen - PM_VAL_HDR_SIZE;
-	    src  = avp->vbp->vbuf;
+	    *bodyp = avp->vbp->vlen - PM_VAL_HDR_SIZE;
+	    *srcp  = avp->vbp->vbuf;
 	    break;
 	    
 	case PM_TYPE_STRING:
-	    body = strlen(avp->cp) + 1;
-	    src  = (void *)avp->cp;
+	    *bodyp = strlen(avp->cp) + 1;
+	    *srcp  = (void *)avp->cp;
 	    break;
 
 	case PM_TYPE_AGGREGATE_STATIC:
@@ -241,6 +247,19 @@ __pmStuffValue(const pmAtomValue *avp, pmValue *vp, int type)
 	default:
 	    return PM_ERR_TYPE;
     }
+    return PM_VAL_DPTR;
+}
+
+int
+__pmStuffValue(const pmAtomValue *avp, pmValue *vp, int type)
+{
+    const void	*src;
+    size_t	need, body;
+    int		valfmt;
+
+    valfmt = __pmStuffValueBody(avp, vp, type, &src, &body);
+    if (valfmt != PM_VAL_DPTR)
+	return valfmt;
     need = body + PM_VAL_HDR_SIZE;
     vp->value.pval = (pmValueBlock *)malloc( 
 	    (need < sizeof(pmValueBlock)) ? sizeof(pmValueBlock) : need);
@@ -248,6 +267,6 @@ __pmStuffValue(const pmAtomValue *avp, pmValue *vp, int type)
 	return -oserror();
     vp->value.pval->vlen = (int)need;
     vp->value.pval->vtype = type;
-    memcpy((void *)vp->value.pval->vbuf, (void *)src, body);
+    memcpy((void *)vp->value.pval->vbuf, src, body);
     return PM_VAL_DPTR;
 }
@@ -18,6 +18,9 @@
 #include "pmapi.h"
 #include <ctype.h>
 #include <sys/stat.h>
+#ifdef HAVE_SCHED_GETCPU
+#include <sched.h>
+#endif
 #include "mmv_stats.h"
 #include "mmv_dev.h"
 #include "libpcp.h"
@@ -26,6 +29,7 @@ struct mmv_registry {
     mmv_indom2_t *	indoms;
     __uint32_t		nindoms;
     mmv_metric2_t *	metrics;
+    __uint32_t *	mflags;		/* MMV_METRIC_* flags, per metric */
     __uint32_t		nmetrics;
     mmv_instances2_t *	instances;
     __uint32_t		ninstances;
@@ -128,12 +132,32 @@ mmv_generation(void)
     return (((__uint64_t)gen1 << 32) | (__uint64_t)gen2);
 }
 
+/*
+ * Number of shard blocks for sharded values - one per configured CPU,
+ * so that updates from each CPU land in a separate cache line.
+ */
+static int
+mmv_shard_count(void)
+{
+    long ncpus = 1;
+
+#ifdef _SC_NPROCESSORS_CONF
+    ncpus = sysconf(_SC_NPROCESSORS_CONF);
+#endif
+    if (ncpus < 1)
+	ncpus = 1;
+    if (ncpus > MMV_SHARDMAX)
+	ncpus = MMV_SHARDMAX;
+    return (int)ncpus;
+}
+
 static void * 
 mmv_init(const char *fname, int version,
 		int cluster, mmv_stats_flags_t fl,
 		const mmv_metric_t *st1, int nmetric1,
 		const mmv_indom_t *in1, int nindom1,
 		const mmv_metric2_t *st2, int nmetric2,
+		const __uint32_t *fl2,
 		const mmv_indom2_t *in2, int nindom2,
 		const mmv_label_t *lb, int nlabels)
 {
@@ -145,6 +169,7 @@ mmv_init(const char *fname, int version,
     mmv_disk_indom_t *domlist;
     mmv_disk_value_t *vlist;
     mmv_disk_label_t *lblist;
+    mmv_disk_shards_t *shards;
     mmv_disk_header_t *hdr;
     mmv_disk_toc_t *toc;
     const mmv_indom_t *mi1;
@@ -155,6 +180,9 @@ mmv_init(const char *fname, int version,
     __uint64_t values_offset;		/* anchor start of values section */
     __uint64_t strings_offset;		/* anchor start of any/all strings */
     __uint64_t labels_offset;		/* anchor start of any/all labels */
+    __uint64_t shards_offset;		/* anchor start of shard descriptor */
+    __uint64_t blocks_offset;		/* anchor start of shard blocks */
+    __uint32_t stride = 0;
     void *addr;
     size_t size;
     __uint64_t offset;
@@ -162,6 +190,9 @@ mmv_init(const char *fname, int version,
     int ninstances = 0;
     int nstrings = 0;
     int nvalues = 0;
+    int nsharded = 0;
+    int nshards = 0;
+    int slot;
 
     for (i = 0; i < nindom1; i++) {
 	ninstances += in1[i].count;
@@ -210,15 +241,24 @@ mmv_init(const char *fname, int version,
 	    if (st2[i].type == MMV_TYPE_STRING)
 		nstrings += mi2->count;
 	    nvalues += mi2->count;
+	    if (fl2 && (fl2[i] & MMV_METRIC_SHARDED))
+		nsharded += mi2->count;
 	} else {
 	    if (st2[i].type == MMV_TYPE_STRING)
 		nstrings++;
 	    nvalues++;
+	    if (fl2 && (fl2[i] & MMV_METRIC_SHARDED))
+		nsharded++;
 	}
     }
-    
+    if (nsharded) {
+	nshards = mmv_shard_count();
+	stride = nsharded * sizeof(__uint64_t);
+	stride = (stride + MMV_SHARDALIGN - 1) & ~(MMV_SHARDALIGN - 1);
+    }
+
     /* TOC follows header, with enough entries to hold */
-    /* indoms, instances, metrics, values, strings, and labels */
+    /* indoms, instances, metrics, values, strings, labels and shards */
     size = sizeof(mmv_disk_toc_t) * 2;
     if (nindom1 || nindom2)
 	size += sizeof(mmv_disk_toc_t) * 2;
@@ -227,6 +267,8 @@ mmv_init(const char *fname, int version,
     if (nlabels) {
 	size += sizeof(mmv_disk_toc_t) * 1;
     }
+    if (nsharded)
+	size += sizeof(mmv_disk_toc_t) * 1;
     indoms_offset = sizeof(mmv_disk_header_t) + size;
 
     /* Following the indom definitions are the actual instances */
@@ -271,8 +313,17 @@ mmv_init(const char *fname, int version,
     size = nstrings * sizeof(mmv_disk_string_t);
     labels_offset = strings_offset + size;
 
-    /* End of file follows all of the actual strings */
-    size = labels_offset + nlabels * sizeof(mmv_disk_label_t);
+    /* Following the labels are the (cache line aligned) shard blocks */
+    shards_offset = labels_offset + nlabels * sizeof(mmv_disk_label_t);
+    blocks_offset = shards_offset;
+    if (nsharded) {
+	blocks_offset += sizeof(mmv_disk_shards_t);
+	blocks_offset = (blocks_offset + MMV_SHARDALIGN - 1) &
+			~((__uint64_t)MMV_SHARDALIGN - 1);
+    }
+
+    /* End of file follows all of the actual strings and shards */
+    size = blocks_offset + (__uint64_t)nshards * stride;
 
     if ((addr = mmv_mapping_init(fname, size)) == NULL)
 	return NULL;
@@ -300,6 +351,8 @@ mmv_init(const char *fname, int version,
 	hdr->tocs += 1;
     if (nlabels)
 	hdr->tocs += 1;    
+    if (nsharded)
+	hdr->tocs += 1;
     hdr->flags = fl;
     hdr->cluster = cluster;
     hdr->process = (__int32_t)getpid();
@@ -337,6 +390,12 @@ mmv_init(const char *fname, int version,
 	toc[tocidx].offset = labels_offset;
 	tocidx++;
     }
+    if (nsharded) {
+	toc[tocidx].type = MMV_TOC_SHARDS;
+	toc[tocidx].count = 1;
+	toc[tocidx].offset = shards_offset;
+	tocidx++;
+    }
 
     /* Indom section */
     domlist = (mmv_disk_indom_t *)((char *)addr + indoms_offset);
@@ -430,7 +489,7 @@ mmv_init(const char *fname, int version,
 	    mlist2[i].semantics = st2[i].semantics;
 	    mlist2[i].shorttext = 0;	/* filled in later */
 	    mlist2[i].helptext = 0;	/* filled in later */
-	    mlist2[i].padding = 0;
+	    mlist2[i].flags = fl2 ? fl2[i] : 0;
 	}
     }
 
@@ -457,7 +516,9 @@ mmv_init(const char *fname, int version,
 	    }
 	}
     }
-    for (i = j = 0; i < nmetric2; i++) {
+    for (i = j = slot = 0; i < nmetric2; i++) {
+	int sharded = (fl2 && (fl2[i] & MMV_METRIC_SHARDED));
+
 	if (version == MMV_VERSION1)
 	    offset = metrics_offset + i * sizeof(mmv_disk_metric_t);
 	else
@@ -466,6 +527,8 @@ mmv_init(const char *fname, int version,
 	if (mmv_singular(st2[i].indom)) {
 	    memset(&vlist[j], 0, sizeof(mmv_disk_value_t));
 	    vlist[j].metric = offset;
+	    if (sharded)	/* offset of this values slot in each block */
+		vlist[j].extra = slot++ * sizeof(__uint64_t);
 	    j++;
 	} else {
 	    __uint64_t ioff;
@@ -480,6 +543,8 @@ mmv_init(const char *fname, int version,
 		memset(&vlist[j], 0, sizeof(mmv_disk_value_t));
 		vlist[j].metric = offset;
 		vlist[j].instance = ioff;
+		if (sharded)
+		    vlist[j].extra = slot++ * sizeof(__uint64_t);
 		j++;
 	    }
 	}
@@ -617,6 +682,14 @@ mmv_init(const char *fname, int version,
 	memcpy(lblist[i].payload, lb[i].payload, MMV_LABELMAX);
     }
 
+    /* Shards section - the (zero-filled) blocks need no initialisation */
+    if (nsharded) {
+	shards = (mmv_disk_shards_t *)((char *)addr + shards_offset);
+	shards->count = nshards;
+	shards->stride = stride;
+	shards->offset = blocks_offset;
+    }
+
     /* Complete - unlock the header, PMDA can read now */
     hdr->g2 = hdr->g1;
 
@@ -688,7 +761,7 @@ mmv_stats_init(const char *fname,
 
     return mmv_init(fname, version, cluster, flags,
 		    st, nmetrics, in, nindoms, 
-		    NULL, 0, NULL, 0, NULL, 0);
+		    NULL, 0, NULL, NULL, 0, NULL, 0);
 }
 
 static int
@@ -772,7 +845,7 @@ mmv_stats2_init(const char *fname,
 	return NULL;
 
     return mmv_init(fname, version, cluster, flags,
-		    NULL, 0, NULL, 0, st, nmetrics, in, nindoms, NULL, 0);
+		    NULL, 0, NULL, 0, st, nmetrics, NULL, in, nindoms, NULL, 0);
 }
 
 mmv_registry_t *
@@ -791,8 +864,8 @@ mmv_stats_registry(const char *file,
 	return NULL;
     }
     /*
-     * Initial version is 1, this increases to 2 if adding
-     * long strings, and to 3 if adding any metric labels.
+     * Initial version is 1, this increases to 2 if adding long
+     * strings, and to 3 if adding any labels or sharded metrics.
      */
     mr->version = MMV_VERSION1;
     mr->file = file;
@@ -807,6 +880,7 @@ mmv_stats_add_metric(mmv_registry_t *registry, const char *name, int item,
 		     int serial, const char *shorthelp, const char *longhelp)
 {
     mmv_metric2_t * metric;
+    __uint32_t * mflags;
     size_t bytes;
 
     if (registry == NULL) {
@@ -814,6 +888,15 @@ mmv_stats_add_metric(mmv_registry_t *registry, const char *name, int item,
 	return -1;
     }
 
+    bytes = (registry->nmetrics + 1) * sizeof(__uint32_t);
+    mflags = (__uint32_t *) realloc(registry->mflags, bytes);
+    if (mflags == NULL) {
+	setoserror(ENOMEM);
+	return -1;
+    }
+    registry->mflags = mflags;
+    mflags[registry->nmetrics] = 0;
+
     bytes = (registry->nmetrics + 1) * sizeof(mmv_metric2_t);
     metric = (mmv_metric2_t *) realloc(registry->metrics, bytes);
     if (metric == NULL) {
@@ -838,6 +921,43 @@ mmv_stats_add_metric(mmv_registry_t *registry, const char *name, int item,
     return 0;
 }
 
+/*
+ * Add a metric with per-CPU sharded values - updates from different
+ * CPUs (or threads) are made to separate cache lines using relaxed
+ * atomic operations, and the PMDA sums the shards when fetching.
+ * Only integer types are supported, and the v3 format is required.
+ */
+int 
+mmv_stats_add_sharded_metric(mmv_registry_t *registry, const char *name,
+		     int item, mmv_metric_type_t type, mmv_metric_sem_t sem,
+		     pmUnits units, int serial,
+		     const char *shorthelp, const char *longhelp)
+{
+    if (registry == NULL) {
+	setoserror(EFAULT);
+	return -1;
+    }
+
+    switch (type) {
+    case MMV_TYPE_I32:
+    case MMV_TYPE_U32:
+    case MMV_TYPE_I64:
+    case MMV_TYPE_U64:
+	break;
+    default:
+	setoserror(EINVAL);
+	return -1;
+    }
+
+    if (mmv_stats_add_metric(registry, name, item, type, sem, units,
+			serial, shorthelp, longhelp) < 0)
+	return -1;
+
+    registry->version = MMV_VERSION3;
+    registry->mflags[registry->nmetrics - 1] |= MMV_METRIC_SHARDED;
+    return 0;
+}
+
 int
 mmv_stats_add_indom(mmv_registry_t *registry, int serial, 
 		    const char *shorthelp, const char *longhelp) 
@@ -1205,6 +1325,7 @@ mmv_stats_start(mmv_registry_t *registry)
 				registry->version, registry->cluster,
 				registry->flags, NULL, 0, NULL, 0, 
 				registry->metrics, registry->nmetrics, 
+				registry->mflags,
 				registry->indoms, registry->nindoms,
 				registry->labels, registry->nlabels);
     return registry->addr;
@@ -1249,6 +1370,8 @@ mmv_stats_free(mmv_registry_t *registry)
 	free(registry->instances);
     if (registry->metrics)
 	free(registry->metrics);
+    if (registry->mflags)
+	free(registry->mflags);
     if (registry->labels)
 	free(registry->labels);
 
@@ -1345,13 +1468,129 @@ mmv_lookup_value_desc(void *addr, const char *metric, const char *inst)
     return NULL;
 }
 
+/*
+ * Sharded values - each CPU updates its own slot (in its own cache
+ * line) with relaxed atomics, which is safe for concurrent updaters
+ * and cheap because the cache line is very rarely shared.
+ */
+static mmv_disk_shards_t *
+mmv_lookup_shards(void *addr)
+{
+    mmv_disk_header_t *hdr = (mmv_disk_header_t *)addr;
+    mmv_disk_toc_t *toc = (mmv_disk_toc_t *)
+			((char *)addr + sizeof(mmv_disk_header_t));
+    int i;
+
+    /* mmv_init always places the shards entry last in the TOC */
+    for (i = hdr->tocs - 1; i >= 0; i--)
+	if (toc[i].type == MMV_TOC_SHARDS)
+	    return (mmv_disk_shards_t *)((char *)addr + toc[i].offset);
+    return NULL;
+}
+
+static unsigned int
+mmv_shard_self(void)
+{
+#ifdef HAVE_SCHED_GETCPU
+    int cpu;
+
+    if ((cpu = sched_getcpu()) >= 0)
+	return cpu;
+#endif
+#if defined(PM_MULTI_THREAD) && defined(HAVE___THREAD)
+    {
+	/* no CPU number available, so spread threads across the slots */
+	static unsigned int nextslot;
+	static __thread int slot = -1;
+
+	if (slot < 0)
+	    slot = __atomic_fetch_add(&nextslot, 1, __ATOMIC_RELAXED) & INT_MAX;
+	return slot;
+    }
+#else
+    return 0;
+#endif
+}
+
+static __uint64_t *
+mmv_shard_slot(void *addr, mmv_disk_shards_t *sp, mmv_disk_value_t *v,
+		unsigned int shard)
+{
+    return (__uint64_t *)((char *)addr + sp->offset +
+		(__uint64_t)shard * sp->stride + v->extra);
+}
+
+static void
+mmv_shard_add(void *addr, mmv_disk_value_t *v, __uint64_t inc)
+{
+    mmv_disk_shards_t *sp;
+    unsigned int shard;
+
+    if ((sp = mmv_lookup_shards(addr)) == NULL || sp->count == 0)
+	return;
+    if ((shard = mmv_shard_self()) >= sp->count)
+	shard %= sp->count;
+    __atomic_fetch_add(mmv_shard_slot(addr, sp, v, shard), inc,
+			__ATOMIC_RELAXED);
+}
+
+/*
+ * Setting a sharded value is not atomic with respect to concurrent
+ * updates of that value (the slots are written one by one).
+ */
+static void
+mmv_shard_set(void *addr, mmv_disk_value_t *v, __uint64_t value)
+{
+    mmv_disk_shards_t *sp;
+    unsigned int shard;
+
+    if ((sp = mmv_lookup_shards(addr)) == NULL)
+	return;
+    for (shard = 0; shard < sp->count; shard++)
+	__atomic_store_n(mmv_shard_slot(addr, sp, v, shard),
+			shard ? 0 : value, __ATOMIC_RELAXED);
+}
+
+/* sign-extend signed values, slots are summed in two's complement */
+static __uint64_t
+mmv_shard_value(int type, double value)
+{
+    switch (type) {
+    case MMV_TYPE_I32:
+	return (__uint64_t)(__int64_t)(__int32_t)value;
+    case MMV_TYPE_U32:
+	return (__uint32_t)value;
+    case MMV_TYPE_I64:
+	return (__uint64_t)(__int64_t)value;
+    default:
+	break;
+    }
+    return (__uint64_t)value;
+}
+
+static __uint64_t
+mmv_shard_atomvalue(int type, pmAtomValue *value)
+{
+    switch (type) {
+    case MMV_TYPE_I32:
+	return (__uint64_t)(__int64_t)value->l;
+    case MMV_TYPE_U32:
+	return value->ul;
+    case MMV_TYPE_I64:
+	return (__uint64_t)value->ll;
+    default:
+	break;
+    }
+    return value->ull;
+}
+
 void
 mmv_inc_value(void *addr, pmAtomValue *av, double inc)
 {
     if (av != NULL && addr != NULL) {
 	mmv_disk_header_t *hdr = (mmv_disk_header_t *)addr;
 	mmv_disk_value_t *v = (mmv_disk_value_t *)av;
-	int type;
+	int type, sharded = 0;
 
 	if (hdr->version == MMV_VERSION1) {
 	    mmv_disk_metric_t *m = (mmv_disk_metric_t *)
@@ -1361,6 +1600,12 @@ mmv_inc_value(void *addr, pmAtomValue *av, double inc)
 	    mmv_disk_metric2_t *m = (mmv_disk_metric2_t *)
 					((char *)addr + v->metric);
 	    type = m->type;
+	    sharded = (hdr->version == MMV_VERSION3 &&
+			(m->flags & MMV_METRIC_SHARDED));
+	}
+	if (sharded) {
+	    mmv_shard_add(addr, v, mmv_shard_value(type, inc));
+	    return;
 	}
 	switch (type) {
 	case MMV_TYPE_I32:
@@ -1401,7 +1646,7 @@ mmv_inc_atomvalue(void *addr, pmAtomValue *av, pmAtomValue *value)
     if (av != NULL && addr != NULL) {
 	mmv_disk_header_t *hdr = (mmv_disk_header_t *)addr;
 	mmv_disk_value_t *v = (mmv_disk_value_t *)av;
-	int type;
+	int type, sharded = 0;
 
 	if (hdr->version == MMV_VERSION1) {
 	    mmv_disk_metric_t *m = (mmv_disk_metric_t *)
@@ -1411,6 +1656,12 @@ mmv_inc_atomvalue(void *addr, pmAtomValue *av, pmAtomValue *value)
 	    mmv_disk_metric2_t *m = (mmv_disk_metric2_t *)
 					((char *)addr + v->metric);
 	    type = m->type;
+	    sharded = (hdr->version == MMV_VERSION3 &&
+			(m->flags & MMV_METRIC_SHARDED));
+	}
+	if (sharded) {
+	    mmv_shard_add(addr, v, mmv_shard_atomvalue(type, value));
+	    return;
 	}
 	switch (type) {
 	case MMV_TYPE_I32:
@@ -1457,7 +1708,7 @@ mmv_inc(void *addr, pmAtomValue *av)
     if (av != NULL && addr != NULL) {
 	mmv_disk_header_t *hdr = (mmv_disk_header_t *)addr;
 	mmv_disk_value_t *v = (mmv_disk_value_t *)av;
-	int type;
+	int type, sharded = 0;
 
 	if (hdr->version == MMV_VERSION1) {
 	    mmv_disk_metric_t *m = (mmv_disk_metric_t *)
@@ -1467,6 +1718,12 @@ mmv_inc(void *addr, pmAtomValue *av)
 	    mmv_disk_metric2_t *m = (mmv_disk_metric2_t *)
 					((char *)addr + v->metric);
 	    type = m->type;
+	    sharded = (hdr->version == MMV_VERSION3 &&
+			(m->flags & MMV_METRIC_SHARDED));
+	}
+	if (sharded) {
+	    mmv_shard_add(addr, v, 1);
+	    return;
 	}
 	switch (type) {
 	case MMV_TYPE_I32:
@@ -1507,7 +1764,7 @@ mmv_set_value(void *addr, pmAtomValue *av, double val)
     if (av != NULL && addr != NULL) {
 	mmv_disk_header_t *hdr = (mmv_disk_header_t *)addr;
 	mmv_disk_value_t *v = (mmv_disk_value_t *)av;
-	int type;
+	int type, sharded = 0;
 
 	if (hdr->version == MMV_VERSION1) {
 	    mmv_disk_metric_t *m = (mmv_disk_metric_t *)
@@ -1517,6 +1774,12 @@ mmv_set_value(void *addr, pmAtomValue *av, double val)
 	    mmv_disk_metric2_t *m = (mmv_disk_metric2_t *)
 					((char *)addr + v->metric);
 	    type = m->type;
+	    sharded = (hdr->version == MMV_VERSION3 &&
+			(m->flags & MMV_METRIC_SHARDED));
+	}
+	if (sharded) {
+	    mmv_shard_set(addr, v, mmv_shard_value(type, val));
+	    return;
 	}
 	switch (type) {
 	case MMV_TYPE_I32:
@@ -1587,7 +1850,7 @@ mmv_set_atomvalue(void *addr, pmAtomValue *av, pmAtomValue *value)
     if (av != NULL && addr != NULL) {
 	mmv_disk_header_t *hdr = (mmv_disk_header_t *)addr;
 	mmv_disk_value_t *v = (mmv_disk_value_t *)av;
-	int type;
+	int type, sharded = 0;
 
 	if (hdr->version == MMV_VERSION1) {
 	    mmv_disk_metric_t *m = (mmv_disk_metric_t *)
@@ -1597,6 +1860,12 @@ mmv_set_atomvalue(void *addr, pmAtomValue *av, pmAtomValue *value)
 	    mmv_disk_metric2_t *m = (mmv_disk_metric2_t *)
 					((char *)addr + v->metric);
 	    type = m->type;
+	    sharded = (hdr->version == MMV_VERSION3 &&
+			(m->flags & MMV_METRIC_SHARDED));
+	}
+	if (sharded) {
+	    mmv_shard_set(addr, v, mmv_shard_atomvalue(type, value));
+	    return;
 	}
 	if (type == MMV_TYPE_ELAPSED)
 	    v->extra = 0;
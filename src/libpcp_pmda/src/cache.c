@@ -36,12 +36,15 @@ typedef struct entry {
     int			state;
     void		*private;
     time_t		stamp;
+    int			jstate;		/* journal state, see save_cache() */
 } entry_t;
 
 #define CACHE_VERSION1	1
 #define CACHE_VERSION2	2
-#define CACHE_VERSION	CACHE_VERSION2	/* version of external file format */
+#define CACHE_VERSION3	3	/* as for 2, with journal records appended */
+#define CACHE_VERSION	CACHE_VERSION2	/* version of compacted external file */
 #define MAX_HASH_TRY	10
+#define JOURNAL_SLACK	64	/* journal records allowed before compaction */
 
 /*
  * linked list of cache headers
@@ -61,6 +64,14 @@ typedef struct hdr {
     int			hstate;		/* dirty/clean/string state */
     int			keyhash_cnt[MAX_HASH_TRY];
     int			maxinst;	/* maximum inst */
+    int			*jpend;		/* insts changed since last save */
+    int			njpend;
+    int			maxjpend;
+    int			jrecs;		/* records in external file, -1 if unknown */
+    off_t		jsize;		/* size of external file */
+    int			jversion;	/* header fields of external file */
+    int			j_ins_mode;
+    int			j_maxinst;
 } hdr_t;
 
 #define DEFAULT_MAXINST 0x7fffffff
@@ -70,6 +81,10 @@ typedef struct hdr {
 #define DIRTY_STAMP	0x2
 #define CACHE_STRINGS	0x4
 
+/* bitfields for jstate */
+#define JOURNAL_SAVED	0x1	/* external file has this name and key */
+#define JOURNAL_PENDING	0x2	/* inst is on the jpend list */
+
 static hdr_t	*base;		/* start of cache headers */
 static char 	filename[MAXPATHLEN];
 				/* for load/save ops */
@@ -194,6 +209,11 @@ find_cache(pmInDom indom, int *sts)
     for (i = 0; i < MAX_HASH_TRY; i++)
 	h->keyhash_cnt[i] = 0;
     h->maxinst = DEFAULT_MAXINST;
+    h->jpend = NULL;
+    h->njpend = h->maxjpend = 0;
+    h->jrecs = -1;
+    h->jsize = 0;
+    h->jversion = 0;
     return h;
 }
 
@@ -536,7 +556,7 @@ reorder:
 	else
 	    last_e = t;
     }
-
+    h->last = last_e;
 }
 
 /*
@@ -710,10 +730,12 @@ retry:
     e->inst = inst;
     e->name = dup;
     e->hashlen = get_hashlen(h, dup);
+    e->keylen = 0;
     e->key = NULL;
     e->state = PMDA_CACHE_INACTIVE;
     e->private = NULL;
     e->stamp = 0;
+    e->jstate = 0;
     if (h->last == NULL || h->last->inst < inst)
 	h->last = e;
     h->nentry++;
@@ -746,20 +768,47 @@ retry:
     return e;
 }
 
+/*
+ * Note a change to entry e that the external file does not have yet,
+ * for the next save_cache() to append to the journal.
+ */
+static void
+journal_mark(hdr_t *h, entry_t *e)
+{
+    int		*jpend;
+    int		want;
+
+    if (h->jrecs < 0 || (e->jstate & JOURNAL_PENDING))
+	/* not journalling, or already noted */
+	return;
+    if (h->njpend >= 2 * h->nentry + JOURNAL_SLACK) {
+	/* too many changes, give up and rewrite at the next save */
+	h->jrecs = -1;
+	h->njpend = 0;
+	return;
+    }
+    if (h->njpend == h->maxjpend) {
+	want = h->maxjpend == 0 ? 16 : 2 * h->maxjpend;
+	if ((jpend = (int *)realloc(h->jpend, want * sizeof(int))) == NULL) {
+	    /* cannot track the change, so rewrite at the next save */
+	    h->jrecs = -1;
+	    h->njpend = 0;
+	    return;
+	}
+	h->jpend = jpend;
+	h->maxjpend = want;
+    }
+    h->jpend[h->njpend++] = e->inst;
+    e->jstate |= JOURNAL_PENDING;
+}
+
+/*
+ * Set filename[] to the external file for this cache, making the
+ * directory on the first trip through here.
+ */
 static int
-load_cache(hdr_t *h)
+cache_path(hdr_t *h)
 {
-    FILE	*fp;
-    entry_t	*e;
-    int		cnt;
-    int		x;
-    int		inst;
-    int		keylen = 0;
-    void	*key = NULL;
-    int		s;
-    char	buf[1024];	/* input line buffer, is this big enough? */
-    char	*p;
-    int		sts;
     int		sep = pmPathSeparator();
     char	strbuf[20];
 
@@ -777,26 +826,123 @@ load_cache(hdr_t *h)
     pmsprintf(filename, sizeof(filename), "%s%cconfig%cpmda%c%s",
 		vdp, sep, sep, sep,
 		pmInDomStr_r(h->indom, strbuf, sizeof(strbuf)));
-    if ((fp = fopen(filename, "r")) == NULL)
+    return 0;
+}
+
+/*
+ * Copy the next line (including any newline) from the mapped file
+ * at *pp into buf, growing buf as needed, and advance *pp.
+ */
+static int
+get_line(char **buf, size_t *buflen, const char **pp, const char *end)
+{
+    const char	*p = *pp;
+    const char	*q;
+    size_t	len;
+    char	*tmp;
+
+    if (p >= end)
+	return 0;
+    if ((q = memchr(p, '\n', end - p)) != NULL)
+	q++;
+    else
+	q = end;
+    len = q - p;
+    if (len + 1 > *buflen) {
+	if ((tmp = (char *)realloc(*buf, len + 1)) == NULL)
+	    return -ENOMEM;
+	*buf = tmp;
+	*buflen = len + 1;
+    }
+    memcpy(*buf, p, len);
+    (*buf)[len] = '\0';
+    *pp = q;
+    return 1;
+}
+
+static int
+hexval(int c)
+{
+    if (c >= '0' && c <= '9')
+	return c - '0';
+    if (c >= 'a' && c <= 'f')
+	return c - 'a' + 10;
+    if (c >= 'A' && c <= 'F')
+	return c - 'A' + 10;
+    return 0;
+}
+
+/*
+ * The external file is a header line, then one record per line,
+ * either "inst stamp [key] name" for an entry, or (version 3, see
+ * save_cache()) "-inst" when a previously saved entry was culled.
+ * In version 3 files a later record for the same inst or name
+ * replaces any earlier one.
+ */
+static int
+load_cache(hdr_t *h)
+{
+    int		fd;
+    struct stat	sbuf;
+    char	*map;
+    const char	*mp;
+    const char	*mend;
+    entry_t	*e;
+    int		cnt;		/* entry records */
+    int		nrec;		/* journal removal records */
+    int		reap = 0;
+    int		version;
+    int		hdrok;
+    int		x;
+    int		inst;
+    int		keylen = 0;
+    void	*key = NULL;
+    int		s;
+    char	*buf = NULL;	/* current line, grown as needed */
+    size_t	buflen = 0;
+    char	*p;
+    int		sts;
+    char	strbuf[20];
+
+    if ((sts = cache_path(h)) < 0)
+	return sts;
+    h->jrecs = -1;
+
+    if ((fd = open(filename, O_RDONLY)) < 0)
 	return -oserror();
-    if (fgets(buf, sizeof(buf), fp) == NULL) {
+    if (fstat(fd, &sbuf) < 0) {
+	sts = -oserror();
+	close(fd);
+	return sts;
+    }
+    if (sbuf.st_size == 0) {
 	pmNotifyErr(LOG_ERR, 
 	     "pmdaCacheOp: %s: empty file?", filename);
-	fclose(fp);
+	close(fd);
 	return 0;
     }
+    map = (char *)__pmMemoryMap(fd, sbuf.st_size, 0);
+    sts = -oserror();
+    close(fd);
+    if (map == NULL)
+	return sts;
+    mp = map;
+    mend = map + sbuf.st_size;
+
+    if ((sts = get_line(&buf, &buflen, &mp, mend)) < 0)
+	goto done;
     /* First grab the file version. */
-    s = sscanf(buf, "%d ", &x);
-    if (s != 1 || x <= 0 || x > CACHE_VERSION) {
+    s = sscanf(buf, "%d ", &version);
+    if (s != 1 || version <= 0 || version > CACHE_VERSION3) {
 	pmNotifyErr(LOG_ERR, 
 	     "pmdaCacheOp: %s: illegal cache header record: %s",
 	     filename, buf);
-	fclose(fp);
-	return PM_ERR_GENERIC;
+	sts = PM_ERR_GENERIC;
+	goto done;
     }	
 
     /* Based on the file version, grab the entire line. */
-    switch (x) {
+    switch (version) {
 	case CACHE_VERSION1:
 	    h->maxinst = DEFAULT_MAXINST;
 	    s = sscanf(buf, "%d %d", &x, &h->ins_mode);
@@ -813,12 +959,15 @@ load_cache(hdr_t *h)
 	pmNotifyErr(LOG_ERR, 
 	     "pmdaCacheOp: %s: illegal cache header record: %s",
 	     filename, buf);
-	fclose(fp);
-	return PM_ERR_GENERIC;
+	sts = PM_ERR_GENERIC;
+	goto done;
     }
+    /* version can be changed in place if the header starts with it */
+    hdrok = (buf[0] == '0' + version && buf[1] == ' ');
 
-    for (cnt = 0; ; cnt++) {
-	if (fgets(buf, sizeof(buf), fp) == NULL)
+    cnt = nrec = 0;
+    for ( ; ; ) {
+	if ((sts = get_line(&buf, &buflen, &mp, mend)) <= 0)
 	    break;
 	if ((p = strchr(buf, '\n')) != NULL)
 	    *p = '\0';
@@ -826,6 +975,23 @@ load_cache(hdr_t *h)
 	while (*p && isascii((int)*p) && isspace((int)*p))
 	    p++;
 	if (*p == '\0') goto bad;
+	if (*p == '-' && version >= CACHE_VERSION3) {
+	    /* journal record, saved entry has since been culled */
+	    p++;
+	    inst = 0;
+	    while (*p && isascii((int)*p) && isdigit((int)*p)) {
+		inst = inst*10 + (*p-'0');
+		p++;
+	    }
+	    if (*p != '\0') goto bad;
+	    e = find_entry(h, NULL, inst, &sts);
+	    if (e != NULL && (e->jstate & JOURNAL_SAVED)) {
+		e->state = PMDA_CACHE_EMPTY;
+		reap++;
+	    }
+	    nrec++;
+	    continue;
+	}
 	inst = 0;
 	while (*p && isascii((int)*p) && isdigit((int)*p)) {
 	    inst = inst*10 + (*p-'0');
@@ -845,7 +1011,6 @@ load_cache(hdr_t *h)
 	    char	*pend;
 	    char	*q;
 	    int		i;
-	    int		tmp;
 	    p++;
 	    pend = p;
 	    while (*pend && *pend != ']')
@@ -860,13 +1025,12 @@ load_cache(hdr_t *h)
 		pmNotifyErr(LOG_ERR, 
 		     "load_cache: indom %s: unable to allocate memory for keylen=%d",
 		     pmInDomStr_r(h->indom, strbuf, sizeof(strbuf)), keylen);
-		fclose(fp);
-		return PM_ERR_GENERIC;
+		sts = PM_ERR_GENERIC;
+		goto done;
 	    }
 	    q = key;
 	    for (i = 0; i < keylen; i++) {
-		sscanf(p, "%2x", &tmp);
-		*q++ = (tmp & 0xff);
+		*q++ = (hexval(p[0]) << 4) | hexval(p[1]);
 		p += 2;
 	    }
 	    p += 2;
@@ -883,67 +1047,212 @@ bad:
 		 "pmdaCacheOp: %s: illegal record: %s",
 		 filename, buf);
 	    if (key) free(key);
-	    fclose(fp);
-	    return PM_ERR_GENERIC;
+	    sts = PM_ERR_GENERIC;
+	    goto done;
 	}
 	e = insert_cache(h, p, inst, &sts);
+	while (e != NULL && sts != 0 && version >= CACHE_VERSION3 &&
+	       (e->jstate & JOURNAL_SAVED)) {
+	    /* superseded by this later record from the journal */
+	    e->state = PMDA_CACHE_EMPTY;
+	    reap++;
+	    e = insert_cache(h, p, inst, &sts);
+	}
 	if (e == NULL) {
 	    if (key) free(key);
-	    fclose(fp);
-	    return sts;
+	    goto done;
 	}
 	if (sts != 0) {
 	    pmNotifyErr(LOG_WARNING,
 		"pmdaCacheOp: %s: loading instance %d (\"%s\") ignored, already in cache as %d (\"%s\")",
 		filename, inst, p, e->inst, e->name);
 	}
+	else
+	    e->jstate |= JOURNAL_SAVED;
+	if (e->key != NULL)
+	    /* earlier record for this entry, replaced */
+	    free(e->key);
 	e->keylen = keylen;
 	e->key = key;
 	e->stamp = x;
+	key = NULL;
+	cnt++;
+    }
+    if (sts == 0) {
+	/*
+	 * external file is now known, journal from here ... entries
+	 * added before the load are not in the file yet
+	 */
+	h->jrecs = cnt + nrec;
+	h->jsize = sbuf.st_size;
+	h->jversion = hdrok ? version : 0;
+	h->j_ins_mode = h->ins_mode;
+	h->j_maxinst = h->maxinst;
+	h->njpend = 0;
+	for (e = h->first; e != NULL; e = e->next) {
+	    e->jstate &= ~JOURNAL_PENDING;
+	    if (e->state != PMDA_CACHE_EMPTY && (e->jstate & JOURNAL_SAVED) == 0)
+		journal_mark(h, e);
+	}
+	sts = cnt;
     }
-    fclose(fp);
 
-    if (pmDebugOptions.indom) {
+done:
+    if (reap)
+	redo_hash(h, 0);
+    __pmMemoryUnmap(map, sbuf.st_size);
+    if (buf)
+	free(buf);
+
+    if (sts >= 0 && pmDebugOptions.indom) {
 	fprintf(stderr, "After PMDA_CACHE_LOAD\n");
 	dump(stderr, h, 0);
     }
 
+    return sts;
+}
+
+static void
+put_record(FILE *fp, entry_t *e)
+{
+    fprintf(fp, "%d %lld", e->inst, (long long)e->stamp);
+    if (e->keylen > 0) {
+	char	*p = (char *)e->key;
+	int	i;
+	fprintf(fp, " [");
+	for (i = 0; i < e->keylen; i++, p++)
+	    fprintf(fp, "%02x", (*p & 0xff));
+	fputc(']', fp);
+    }
+    fprintf(fp, " %s\n", e->name);
+}
+
+/*
+ * Compaction - rewrite the whole external file from the cache.
+ */
+static int
+write_cache(hdr_t *h)
+{
+    FILE	*fp;
+    entry_t	*e;
+    int		cnt;
+
+    if ((fp = fopen(filename, "w")) == NULL)
+	return -oserror();
+    fprintf(fp, "%d %d %d\n", CACHE_VERSION, h->ins_mode, h->maxinst);
+
+    cnt = 0;
+    for (e = h->first; e != NULL; e = e->next) {
+	if (e->state == PMDA_CACHE_EMPTY)
+	    continue;
+	put_record(fp, e);
+	e->jstate = JOURNAL_SAVED;
+	cnt++;
+    }
+    h->jsize = ftell(fp);
+    if (fclose(fp) != 0 || h->jsize < 0) {
+	h->jrecs = -1;
+	return -oserror();
+    }
+    h->njpend = 0;
+    h->jrecs = cnt;
+    h->jversion = CACHE_VERSION;
+    h->j_ins_mode = h->ins_mode;
+    h->j_maxinst = h->maxinst;
     return cnt;
 }
 
+/*
+ * Append the pending changes to the end of the external file, as
+ * journal records.  Timestamp-only changes (instances re-added) are
+ * written for PMDA_CACHE_SYNC, else they are kept pending.
+ */
 static int
-save_cache(hdr_t *h, int hstate)
+append_cache(hdr_t *h, int hstate)
 {
     FILE	*fp;
+    entry_t	*e;
+    int		nrec = 0;
+    int		cull = 0;
+    int		i, j;
+    int		sts;
+
+    if ((fp = fopen(filename, "r+")) == NULL)
+	return -oserror();
+    /* file must be as we left it, else start over */
+    if (fseek(fp, 0, SEEK_END) < 0 || ftell(fp) != h->jsize) {
+	fclose(fp);
+	return PM_ERR_GENERIC;
+    }
+    /*
+     * Appended entry records replace any earlier record for the same
+     * inst and name, as older loaders do too, so the file stays at
+     * version 2 until the first removal record ... older loaders do
+     * not know these, and must refuse the file from then on.
+     */
+    for (i = 0; i < h->njpend; i++) {
+	if (find_entry(h, NULL, h->jpend[i], &sts) == NULL)
+	    cull++;
+    }
+    if (cull && h->jversion < CACHE_VERSION3) {
+	if (fseek(fp, 0, SEEK_SET) < 0 ||
+	    fputc('0' + CACHE_VERSION3, fp) == EOF ||
+	    fseek(fp, 0, SEEK_END) < 0) {
+	    fclose(fp);
+	    return PM_ERR_GENERIC;
+	}
+    }
+
+    for (i = j = 0; i < h->njpend; i++) {
+	if ((e = find_entry(h, NULL, h->jpend[i], &sts)) == NULL) {
+	    fprintf(fp, "-%d\n", h->jpend[i]);
+	    nrec++;
+	    continue;
+	}
+	if ((e->jstate & JOURNAL_PENDING) == 0)
+	    continue;
+	if ((e->jstate & JOURNAL_SAVED) && (hstate & DIRTY_STAMP) == 0) {
+	    h->jpend[j++] = e->inst;
+	    continue;
+	}
+	put_record(fp, e);
+	e->jstate = JOURNAL_SAVED;
+	nrec++;
+    }
+    h->jsize = ftell(fp);
+    if (fclose(fp) != 0 || h->jsize < 0)
+	return -oserror();
+    h->njpend = j;
+    h->jrecs += nrec;
+    if (cull)
+	h->jversion = CACHE_VERSION3;
+    return nrec;
+}
+
+/*
+ * Rather than rewriting the external file each time, changes since
+ * the last save are appended as journal records, so the cost is in
+ * proportion to the changes, not the size of the cache.  The file
+ * is compacted (rewritten) when its contents are not known to match
+ * the cache (not loaded or saved yet), the header has changed, or
+ * the journal has grown larger than the cache itself.
+ */
+static int
+save_cache(hdr_t *h, int hstate)
+{
     entry_t	*e;
     int		cnt;
+    int		sts;
     time_t	now;
-    int		sep = pmPathSeparator();
     int		state = h->hstate & ~CACHE_STRINGS;
-    char	strbuf[20];
 
     if ((state & hstate) == 0) {
 	/* nothing to be done */
 	return 0;
     }
 
-    if (vdp == NULL) {
-	if ((vdp = pmGetOptionalConfig("PCP_VAR_DIR")) == NULL)
-	    return PM_ERR_GENERIC;
-	pmsprintf(filename, sizeof(filename),
-		"%s%c" "config" "%c" "pmda", vdp, sep, sep);
-	if (mkdir2(filename, 0755) < 0) {
-	    /* failure here is not fatal ... dir may already exist */
-	    ;
-	}
-    }
-
-    pmsprintf(filename, sizeof(filename), "%s%cconfig%cpmda%c%s",
-		vdp, sep, sep, sep,
-		pmInDomStr_r(h->indom, strbuf, sizeof(strbuf)));
-    if ((fp = fopen(filename, "w")) == NULL)
-	return -oserror();
-    fprintf(fp, "%d %d %d\n", CACHE_VERSION, h->ins_mode, h->maxinst);
+    if ((sts = cache_path(h)) < 0)
+	return sts;
 
     now = time(NULL);
     cnt = 0;
@@ -952,19 +1261,16 @@ save_cache(hdr_t *h, int hstate)
 	    continue;
 	if (e->stamp == 0)
 	    e->stamp = now;
-	fprintf(fp, "%d %lld", e->inst, (long long)e->stamp);
-	if (e->keylen > 0) {
-	    char	*p = (char *)e->key;
-	    int		i;
-	    fprintf(fp, " [");
-	    for (i = 0; i < e->keylen; i++, p++)
-		fprintf(fp, "%02x", (*p & 0xff));
-	    fputc(']', fp);
-	}
-	fprintf(fp, " %s\n", e->name);
 	cnt++;
     }
-    fclose(fp);
+
+    if (h->jrecs < 0 || h->jversion < CACHE_VERSION2 ||
+	h->ins_mode != h->j_ins_mode || h->maxinst != h->j_maxinst ||
+	h->jrecs + h->njpend > 2 * cnt + JOURNAL_SLACK ||
+	append_cache(h, hstate) < 0) {
+	if ((sts = write_cache(h)) < 0)
+	    return sts;
+    }
     h->hstate &= ~(DIRTY_INSTANCE | DIRTY_STAMP);
 
     if (pmDebugOptions.indom) {
@@ -1040,6 +1346,8 @@ store(pmInDom indom, int flags, const char *name, pmInDom inst, int keylen, cons
 
     switch (flags) {
 	case PMDA_CACHE_ADD:
+	    if ((e->jstate & JOURNAL_SAVED) && key_eq(e, keylen, key) == 0)
+		e->jstate &= ~JOURNAL_SAVED;	/* key changed, save again */
 	    e->keylen = keylen;
 	    if (keylen > 0) {
 		if ((e->key = malloc(keylen)) == NULL) {
@@ -1057,6 +1365,7 @@ store(pmInDom indom, int flags, const char *name, pmInDom inst, int keylen, cons
 	    e->private = private;
 	    e->stamp = 0;		/* flag, updated at next cache_save() */
 	    h->hstate |= DIRTY_STAMP;	/* timestamp needs updating */
+	    journal_mark(h, e);
 	    break;
 
 	case PMDA_CACHE_HIDE:
@@ -1071,6 +1380,7 @@ store(pmInDom indom, int flags, const char *name, pmInDom inst, int keylen, cons
 	     * the culled entries can be reclaimed
 	     */
 	    h->hstate |= DIRTY_INSTANCE;	/* entry will not be saved */
+	    journal_mark(h, e);
 	    break;
 
 	default:
@@ -1280,6 +1590,7 @@ int pmdaCacheOp(pmInDom indom, int op)
 	    for (e = h->first; e != NULL; e = e->next) {
 		if (e->state != PMDA_CACHE_EMPTY) {
 		    e->state = PMDA_CACHE_EMPTY;
+		    journal_mark(h, e);
 		    sts++;
 		}
 	    }
@@ -1464,6 +1775,7 @@ int pmdaCachePurgeCallback(pmInDom indom, time_t recent, void (*callback)(void *
 	 */
 	if (e->stamp != 0 && e->stamp < epoch) {
 	    e->state = PMDA_CACHE_EMPTY;
+	    journal_mark(h, e);
 	    if (callback && e->private) {
 	    	(*callback)(e->private);
 		e->private = NULL;
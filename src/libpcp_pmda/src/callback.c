@@ -177,25 +177,6 @@ __pmdaNextInst(int *inst, pmdaExt *pmda)
     return 0;
 }
 
-static int
-__pmdaCountInst(pmDesc *dp, pmdaExt *pmda)
-{
-    int		inst, numval = 0;
-
-    if (dp->indom != PM_INDOM_NULL) {
-	/* count instances in indom */
-	__pmdaStartInst(dp->indom, pmda);
-	while (__pmdaNextInst(&inst, pmda))
-	    numval++;
-    }
-    else {
-	/* singular instance domains */
-	numval = 1;
-    }
-    return numval;
-}
-
-
 /*
  * Helper routines for performing metric table searches.
  *
@@ -493,30 +474,164 @@ __pmdaEncodeStatus(pmResult *result, unsigned char byte)
 
 #define PMDA_STATUS_CHANGE (PMDA_EXT_LABEL_CHANGE|PMDA_EXT_NAMES_CHANGE)
 
+/*
+ * Ensure there is space for numinst instances of one metric (and their
+ * values, for the batch fetch callback) in the high-water arrays.
+ */
+static int
+__pmdaFetchGrow(e_ext_t *extp, int numinst)
+{
+    unsigned int	*insts;
+    pmAtomValue		*atoms;
+    int			*atomsts;
+    int			need;
+
+    if (numinst <= extp->maxinsts)
+	return 0;
+    need = extp->maxinsts ? extp->maxinsts : 16;
+    while (need < numinst)
+	need *= 2;
+    if ((insts = (unsigned int *)realloc(extp->insts, need * sizeof(*insts))) == NULL)
+	return -oserror();
+    extp->insts = insts;
+    if ((atoms = (pmAtomValue *)realloc(extp->atoms, need * sizeof(*atoms))) == NULL)
+	return -oserror();
+    extp->atoms = atoms;
+    if ((atomsts = (int *)realloc(extp->atomsts, need * sizeof(*atomsts))) == NULL)
+	return -oserror();
+    extp->atomsts = atomsts;
+    extp->maxinsts = need;
+    return 0;
+}
+
+/*
+ * Walk the profile once, gathering the requested instances of a metric
+ * into extp->insts[] - returns the number found or a negative error.
+ */
+static int
+__pmdaFetchInsts(pmDesc *dp, pmdaExt *pmda, e_ext_t *extp)
+{
+    int		inst, numinst = 0;
+    int		sts;
+
+    if (dp->indom == PM_INDOM_NULL) {
+	if ((sts = __pmdaFetchGrow(extp, 1)) < 0)
+	    return sts;
+	extp->insts[numinst++] = PM_IN_NULL;
+	return numinst;
+    }
+    __pmdaStartInst(dp->indom, pmda);
+    while (__pmdaNextInst(&inst, pmda)) {
+	if (numinst == extp->maxinsts &&
+	    (sts = __pmdaFetchGrow(extp, numinst + 1)) < 0)
+	    return sts;
+	extp->insts[numinst++] = inst;
+    }
+    return numinst;
+}
+
+/*
+ * Handle the result of a fetch callback for one instance, adding the
+ * value (if any) to the pmValueSet at slot i of the result arena and
+ * returning the status.
+ */
+static int
+__pmdaFetchValue(pmDesc *dp, int version, unsigned int inst,
+		int sts, pmAtomValue *atom, __pmResultArena *ap, int i)
+{
+    int			type = dp->type;
+    int			lsts;
+    char		idbuf[20];
+    char		strbuf[20];
+
+    if (sts < 0) {
+	pmIDStr_r(dp->pmid, strbuf, sizeof(strbuf));
+	if (sts == PM_ERR_PMID) {
+	    pmNotifyErr(LOG_ERR, 
+		"pmdaFetch: PMID %s not handled by fetch callback\n",
+			strbuf);
+	}
+	else if (sts == PM_ERR_INST) {
+	    if (pmDebugOptions.libpmda) {
+		pmNotifyErr(LOG_ERR,
+		    "pmdaFetch: Instance %d of PMID %s not handled by fetch callback\n",
+			    inst, strbuf);
+	    }
+	}
+	else if (sts == PM_ERR_VALUE ||
+		 sts == PM_ERR_APPVERSION ||
+		 sts == PM_ERR_PERMISSION ||
+		 sts == PM_ERR_AGAIN ||
+		 sts == PM_ERR_NYI) {
+	    if (pmDebugOptions.libpmda) {
+		pmNotifyErr(LOG_ERR,
+		     "pmdaFetch: Fetch callback error from metric PMID %s[%d]: %s\n",
+			strbuf, inst, pmErrStr(sts));
+	    }
+	}
+	else {
+	    pmNotifyErr(LOG_ERR,
+		"pmdaFetch: Fetch callback error from metric PMID %s[%d]: %s\n",
+			strbuf, inst, pmErrStr(sts));
+	}
+	return sts;
+    }
+
+    /*
+     * PMDA_INTERFACE_2
+     *	>= 0 => OK
+     * PMDA_INTERFACE_3 or PMDA_INTERFACE_4
+     *	== 0 => no values
+     *	> 0  => OK
+     * PMDA_INTERFACE_5 or later
+     *	== 0 (PMDA_FETCH_NOVALUES) => no values
+     *	== 1 (PMDA_FETCH_STATIC) or > 2 => OK
+     *	== 2 (PMDA_FETCH_DYNAMIC) => OK and free(atom.vp)
+     *	     after __pmStuffValue() called
+     */
+    if ((version == PMDA_INTERFACE_2) || (version >= PMDA_INTERFACE_3 && sts > 0)) {
+	if ((lsts = __pmResultArenaStuffValue(ap, i, inst, atom, type)) == PM_ERR_TYPE) {
+	    pmNotifyErr(LOG_ERR, "pmdaFetch: Descriptor type (%s) for metric %s is bad",
+			pmTypeStr_r(type, strbuf, sizeof(strbuf)),
+			pmIDStr_r(dp->pmid, idbuf, sizeof(idbuf)));
+	}
+	if (version >= PMDA_INTERFACE_5 && sts == PMDA_FETCH_DYNAMIC) {
+	    if (type == PM_TYPE_STRING)
+		free(atom->cp);
+	    else if (type == PM_TYPE_AGGREGATE)
+		free(atom->vbp);
+	    else {
+		pmNotifyErr(LOG_WARNING, "pmdaFetch: Attempt to free value for metric %s of wrong type %s\n",
+			    pmIDStr_r(dp->pmid, idbuf, sizeof(idbuf)),
+			    pmTypeStr_r(type, strbuf, sizeof(strbuf)));
+	    }
+	}
+	if (lsts < 0)
+	    sts = lsts;
+    }
+    return sts;
+}
+
 /*
  * Resize the pmResult and call the e_callback for each metric instance
- * required in the profile.
+ * required in the profile, or the batch callback once for all of them.
  */
 
 int
 pmdaFetch(int numpmid, pmID pmidlist[], pmResult **resp, pmdaExt *pmda)
 {
     int			i;		/* over pmidlist[] */
-    int			j;		/* over metatab and vset->vlist[] */
+    int			j;		/* over the requested instances */
     int			sts;
     int			need;
-    int			inst;
     int			numval;
     int			version;
     unsigned char	flags;
     pmValueSet		*vset;
-    pmValueSet		*tmp_vset;
     pmDesc		*dp;
     pmdaMetric          metabuf;
     pmdaMetric		*metap;
     pmAtomValue		atom;
-    int			type;
-    int			lsts;
     char		idbuf[20];
     char		strbuf[20];
     e_ext_t		*extp = (e_ext_t *)pmda->e_ext;
@@ -546,6 +661,8 @@ pmdaFetch(int numpmid, pmID pmidlist[], pmResult **resp, pmdaExt *pmda)
 	extp->maxnpmids = numpmid;
     }
     extp->res->numpmid = numpmid;
+    if ((sts = __pmResultArenaStart(&extp->arena, numpmid)) < 0)
+	return sts;
 
     flags = 0;
     if (version >= PMDA_INTERFACE_7 && (pmda->e_flags & PMDA_STATUS_CHANGE)) {
@@ -569,8 +686,12 @@ pmdaFetch(int numpmid, pmID pmidlist[], pmResult **resp, pmdaExt *pmda)
 	 * will be zero
 	 */
 	dp = &(metap->m_desc);
-	if (dp->pmid != 0)
-	    numval = __pmdaCountInst(dp, pmda);
+	if (dp->pmid != 0) {
+	    if ((numval = __pmdaFetchInsts(dp, pmda, extp)) < 0) {
+		sts = numval;
+		goto error;
+	    }
+	}
 	else {
 	    /* dynamic name metrics may often vanish, avoid log spam */
 	    if (version < PMDA_INTERFACE_4) {
@@ -581,125 +702,49 @@ pmdaFetch(int numpmid, pmID pmidlist[], pmResult **resp, pmdaExt *pmda)
 	    numval = PM_ERR_PMID;
 	}
 
-	/* Must use individual malloc()s because of pmFreeResult() */
-	if (numval >= 1)
-	    extp->res->vset[i] = vset = (pmValueSet *)malloc(sizeof(pmValueSet) +
-					    (numval - 1)*sizeof(pmValue));
-	else
-	    extp->res->vset[i] = vset = (pmValueSet *)malloc(sizeof(pmValueSet) -
-					    sizeof(pmValue));
-	if (vset == NULL) {
-	    sts = -oserror();
+	/*
+	 * pmValueSets (and pmValueBlocks) are built in the arena and
+	 * moved into a single pdubuf at the end, so freeing the
+	 * result values releases them all at once
+	 */
+	if ((sts = __pmResultArenaAddValueSet(&extp->arena, i,
+					pmidlist[i], numval)) < 0)
 	    goto error;
-	}
-	vset->pmid = pmidlist[i];
-	vset->numval = numval;
-	vset->valfmt = PM_VAL_INSITU;
-	if (vset->numval <= 0)
+	if (numval <= 0) {
+	    __pmResultArenaValueSet(&extp->arena, i)->numval = numval;
 	    continue;
-
-	if (dp->indom == PM_INDOM_NULL)
-	    inst = PM_IN_NULL;
-	else {
-	    __pmdaStartInst(dp->indom, pmda);
-	    __pmdaNextInst(&inst, pmda);
 	}
-	type = dp->type;
-	j = 0;
-	do {
-	    if (j == numval) {
-		/* more instances than expected! */
-		numval++;
-		extp->res->vset[i] = tmp_vset = (pmValueSet *)realloc(vset,
-			    sizeof(pmValueSet) + (numval - 1)*sizeof(pmValue));
-		if (tmp_vset == NULL) {
-		    free(vset);
-		    vset = NULL;
-		    sts = -oserror();
-		    goto error;
-		}
-		vset = tmp_vset;
-	    }
-	    vset->vlist[j].inst = inst;
-
-	    if ((sts = (*(pmda->e_fetchCallBack))(metap, inst, &atom)) < 0) {
-		pmIDStr_r(dp->pmid, strbuf, sizeof(strbuf));
-		if (sts == PM_ERR_PMID) {
-		    pmNotifyErr(LOG_ERR, 
-		        "pmdaFetch: PMID %s not handled by fetch callback\n",
-				strbuf);
-		}
-		else if (sts == PM_ERR_INST) {
-		    if (pmDebugOptions.libpmda) {
-			pmNotifyErr(LOG_ERR,
-			    "pmdaFetch: Instance %d of PMID %s not handled by fetch callback\n",
-				    inst, strbuf);
-		    }
-		}
-		else if (sts == PM_ERR_VALUE ||
-			 sts == PM_ERR_APPVERSION ||
-			 sts == PM_ERR_PERMISSION ||
-			 sts == PM_ERR_AGAIN ||
-			 sts == PM_ERR_NYI) {
-		    if (pmDebugOptions.libpmda) {
-			pmNotifyErr(LOG_ERR,
-			     "pmdaFetch: Fetch callback error from metric PMID %s[%d]: %s\n",
-				strbuf, inst, pmErrStr(sts));
-		    }
-		}
-		else {
-		    pmNotifyErr(LOG_ERR,
-			"pmdaFetch: Fetch callback error from metric PMID %s[%d]: %s\n",
-				strbuf, inst, pmErrStr(sts));
-		}
+
+	sts = PM_ERR_NYI;
+	if (extp->batchCallBack != NULL) {
+	    sts = (*(extp->batchCallBack))(metap, numval, extp->insts,
+					extp->atoms, extp->atomsts);
+	    if (sts >= 0) {
+		for (j = 0; j < numval; j++)
+		    sts = __pmdaFetchValue(dp, version, extp->insts[j],
+				extp->atomsts[j], &extp->atoms[j],
+				&extp->arena, i);
 	    }
-	    else {
-		/*
-		 * PMDA_INTERFACE_2
-		 *	>= 0 => OK
-		 * PMDA_INTERFACE_3 or PMDA_INTERFACE_4
-		 *	== 0 => no values
-		 *	> 0  => OK
-		 * PMDA_INTERFACE_5 or later
-		 *	== 0 (PMDA_FETCH_NOVALUES) => no values
-		 *	== 1 (PMDA_FETCH_STATIC) or > 2 => OK
-		 *	== 2 (PMDA_FETCH_DYNAMIC) => OK and free(atom.vp)
-		 *	     after __pmStuffValue() called
-		 */
-		if ((version == PMDA_INTERFACE_2) || (version >= PMDA_INTERFACE_3 && sts > 0)) {
-
-		    if ((lsts = __pmStuffValue(&atom, &vset->vlist[j], type)) == PM_ERR_TYPE) {
-			pmNotifyErr(LOG_ERR, "pmdaFetch: Descriptor type (%s) for metric %s is bad",
-				    pmTypeStr_r(type, strbuf, sizeof(strbuf)),
-				    pmIDStr_r(dp->pmid, idbuf, sizeof(idbuf)));
-		    }
-		    else if (lsts >= 0) {
-			vset->valfmt = lsts;
-			j++;
-		    }
-		    if (version >= PMDA_INTERFACE_5 && sts == PMDA_FETCH_DYNAMIC) {
-			if (type == PM_TYPE_STRING)
-			    free(atom.cp);
-			else if (type == PM_TYPE_AGGREGATE)
-			    free(atom.vbp);
-			else {
-			    pmNotifyErr(LOG_WARNING, "pmdaFetch: Attempt to free value for metric %s of wrong type %s\n",
-					pmIDStr_r(dp->pmid, idbuf, sizeof(idbuf)),
-					pmTypeStr_r(type, strbuf, sizeof(strbuf)));
-			}
-		    }
-		    if (lsts < 0)
-			sts = lsts;
-		}
+	    else if (sts != PM_ERR_NYI)
+		__pmdaFetchValue(dp, version, extp->insts[0], sts, NULL,
+				&extp->arena, i);
+	}
+	if (sts == PM_ERR_NYI) {
+	    for (j = 0; j < numval; j++) {
+		sts = (*(pmda->e_fetchCallBack))(metap, extp->insts[j], &atom);
+		sts = __pmdaFetchValue(dp, version, extp->insts[j], sts, &atom,
+				&extp->arena, i);
 	    }
-	} while (dp->indom != PM_INDOM_NULL && __pmdaNextInst(&inst, pmda));
+	}
 
-	if (j == 0)
+	vset = __pmResultArenaValueSet(&extp->arena, i);
+	if (vset->numval == 0)
 	    vset->numval = sts;
-	else
-	    vset->numval = j;
     }
 
+    if ((sts = __pmResultArenaFinish(&extp->arena, extp->res->vset)) < 0)
+	goto error;
+
     /* success, we will send this PDU - safe to clear flags */
     pmda->e_flags &= ~PMDA_STATUS_CHANGE;
     *resp = extp->res;
@@ -707,10 +752,8 @@ pmdaFetch(int numpmid, pmID pmidlist[], pmResult **resp, pmdaExt *pmda)
 
 error:
 
-    if (i) {
-	extp->res->numpmid = i;
-	__pmFreeResultValues(extp->res);
-    }
+    /* nothing has left the arena, so there is nothing to free */
+    extp->res->numpmid = 0;
     return sts;
 }
 
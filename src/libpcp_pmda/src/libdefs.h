@@ -37,6 +37,12 @@ typedef struct {
     int			ndynamics;	/* number of dynamics entries, below */
     struct dynamic	*dynamics;	/* dynamic metric manipulation table */
     void		*privdata;	/* private (user) data for this PMDA */
+    pmdaFetchBatchCallBack batchCallBack; /* optional per-metric fetch */
+    int			maxinsts;	/* high-water allocation for */
+    unsigned int	*insts;		/* instances of one metric, and */
+    pmAtomValue		*atoms;		/* the values and status codes */
+    int			*atomsts;	/* from the batch fetch callback */
+    __pmResultArena	arena;		/* pmValueSets for the pmResult */
 } e_ext_t;
 
 /*
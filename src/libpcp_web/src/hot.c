@@ -0,0 +1,420 @@
+/*
+ * Copyright (c) 2022 Red Hat.
+ *
+ * This library is free software; you can redistribute it and/or modify it
+ * under the terms of the GNU Lesser General Public License as published
+ * by the Free Software Foundation; either version 2.1 of the License, or
+ * (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of MERCHANTABILITY
+ * or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU Lesser General Public
+ * License for more details.
+ */
+#include "pmapi.h"
+#include "libpcp.h"
+#include "pmwebapi.h"
+#include "util.h"
+#include "hot.h"
+
+/* Redis stream identifier - milliseconds and sequence number */
+typedef struct seriesHotStamp {
+    __uint64_t		ms;
+    __uint64_t		seq;
+} seriesHotStamp;
+
+/*
+ * Ring buffer of the most recent samples of one series, oldest first.
+ * Entries are added only after Redis has accepted them, so the ring
+ * holds every sample Redis has for this series from its oldest entry
+ * onward (assuming this process is the only writer of the series).
+ */
+typedef struct seriesHotRing {
+    unsigned int	head;		/* index of oldest sample */
+    unsigned int	count;		/* number of samples held */
+    unsigned int	size;		/* allocated sample slots */
+    time_t		updated;	/* wallclock time of last insert */
+    seriesHotStamp	*stamps;
+    redisReply		**samples;	/* [stamp, [name, value, ...]] */
+} seriesHotRing;
+
+static dict		*hotseries;	/* series identifier -> hot ring */
+static sds		hotkey;		/* lookup key buffer, avoids allocs */
+static unsigned int	hotsamples;	/* maximum samples per series */
+static unsigned int	hotwindow;	/* maximum seconds per series */
+static unsigned int	hotlimit;	/* maximum number of series */
+static unsigned int	hotexpire;	/* Redis stream expiry seconds */
+static time_t		hotsweep;	/* time of last idle series sweep */
+
+static unsigned int
+hot_config_value(struct dict *config, const char *key, unsigned int value)
+{
+    sds			option;
+
+    if ((option = pmIniFileLookup(config, "pmseries", key)) != NULL)
+	value = (unsigned int)strtoul(option, NULL, 10);
+    return value;
+}
+
+void
+seriesHotInit(struct dict *config, unsigned int maxlen, unsigned int expire)
+{
+    if (hotseries != NULL)
+	return;
+
+    hotsamples = hot_config_value(config, "hot.samples", DEFAULT_HOT_SAMPLES);
+    hotwindow = hot_config_value(config, "hot.window", DEFAULT_HOT_WINDOW);
+    hotlimit = hot_config_value(config, "hot.series", DEFAULT_HOT_SERIES);
+    hotexpire = expire;
+
+    /* never hold samples that Redis may already have trimmed away */
+    if (maxlen && hotsamples > maxlen)
+	hotsamples = maxlen;
+    if (hotsamples == 0 || hotwindow == 0 || hotlimit == 0 || expire == 0)
+	return;	/* hot tier disabled */
+
+    hotseries = dictCreate(&sdsKeyDictCallBacks, NULL);
+    hotkey = sdsempty();
+}
+
+int
+seriesHotEnabled(void)
+{
+    return hotseries != NULL;
+}
+
+static void
+hot_ring_clear(seriesHotRing *ring)
+{
+    unsigned int	i;
+
+    for (i = 0; i < ring->count; i++)
+	freeReplyObject(ring->samples[(ring->head + i) % ring->size]);
+    ring->head = ring->count = 0;
+}
+
+static void
+hot_ring_free(seriesHotRing *ring)
+{
+    hot_ring_clear(ring);
+    free(ring->samples);
+    free(ring->stamps);
+    free(ring);
+}
+
+void
+seriesHotClose(void)
+{
+    dictIterator	*iterator;
+    dictEntry		*entry;
+
+    if (hotseries == NULL)
+	return;
+
+    iterator = dictGetSafeIterator(hotseries);
+    while ((entry = dictNext(iterator)) != NULL)
+	hot_ring_free((seriesHotRing *)dictGetVal(entry));
+    dictReleaseIterator(iterator);
+    dictRelease(hotseries);
+    hotseries = NULL;
+    sdsfree(hotkey);
+    hotkey = NULL;
+}
+
+static int
+hot_stamp_parse(const char *string, seriesHotStamp *stamp)
+{
+    char		*end;
+
+    stamp->ms = strtoull(string, &end, 10);
+    if (end == string)
+	return -EINVAL;
+    if (*end == '-')
+	stamp->seq = strtoull(end + 1, NULL, 10);
+    else
+	stamp->seq = 0;
+    return 0;
+}
+
+static int
+hot_stamp_cmp(seriesHotStamp *a, seriesHotStamp *b)
+{
+    if (a->ms != b->ms)
+	return (a->ms > b->ms) ? 1 : -1;
+    if (a->seq != b->seq)
+	return (a->seq > b->seq) ? 1 : -1;
+    return 0;
+}
+
+static redisReply *
+hot_reply_string(const char *string, size_t length)
+{
+    redisReply		*reply;
+
+    if ((reply = hi_calloc(1, sizeof(redisReply))) == NULL)
+	return NULL;
+    if ((reply->str = hi_malloc(length + 1)) == NULL) {
+	hi_free(reply);
+	return NULL;
+    }
+    memcpy(reply->str, string, length);
+    reply->str[length] = '\0';
+    reply->len = length;
+    reply->type = REDIS_REPLY_STRING;
+    return reply;
+}
+
+static redisReply *
+hot_reply_array(size_t elements)
+{
+    redisReply		*reply;
+
+    if ((reply = hi_calloc(1, sizeof(redisReply))) == NULL)
+	return NULL;
+    if ((reply->element = hi_calloc(elements ? elements : 1,
+				    sizeof(redisReply *))) == NULL) {
+	hi_free(reply);
+	return NULL;
+    }
+    reply->elements = elements;
+    reply->type = REDIS_REPLY_ARRAY;
+    return reply;
+}
+
+/*
+ * Build a sample in XRANGE reply form from a stream timestamp and the
+ * RESP-encoded instance:value pairs that were sent with XADD.
+ */
+redisReply *
+seriesHotSample(sds stamp, sds fields, unsigned int nfields)
+{
+    redisReply		*sample, *values;
+    const char		*p = fields, *end = fields + sdslen(fields);
+    char		*length;
+    size_t		bytes;
+    unsigned int	i;
+
+    if ((sample = hot_reply_array(2)) == NULL)
+	return NULL;
+    if ((sample->element[0] = hot_reply_string(stamp, sdslen(stamp))) == NULL)
+	goto fail;
+    if ((sample->element[1] = values = hot_reply_array(nfields)) == NULL)
+	goto fail;
+
+    for (i = 0; i < nfields; i++) {
+	if (p >= end || *p != '$')
+	    goto fail;
+	bytes = strtoul(p + 1, &length, 10);
+	p = length + 2;		/* skip "\r\n" */
+	if (p + bytes + 2 > end)
+	    goto fail;
+	if ((values->element[i] = hot_reply_string(p, bytes)) == NULL)
+	    goto fail;
+	p += bytes + 2;
+    }
+    return sample;
+
+fail:
+    freeReplyObject(sample);
+    return NULL;
+}
+
+/*
+ * Drop series that have not been updated for a full hot window,
+ * at most once a second - used when the series limit is reached.
+ */
+static void
+hot_sweep(time_t now)
+{
+    dictIterator	*iterator;
+    dictEntry		*entry;
+    seriesHotRing	*ring;
+
+    if (now == hotsweep)
+	return;
+    hotsweep = now;
+
+    iterator = dictGetSafeIterator(hotseries);
+    while ((entry = dictNext(iterator)) != NULL) {
+	ring = (seriesHotRing *)dictGetVal(entry);
+	if (now - ring->updated >= hotwindow) {
+	    hot_ring_free(ring);
+	    dictDelete(hotseries, dictGetKey(entry));
+	}
+    }
+    dictReleaseIterator(iterator);
+}
+
+static int
+hot_ring_grow(seriesHotRing *ring)
+{
+    seriesHotStamp	*stamps;
+    redisReply		**samples;
+    unsigned int	i, j, size;
+
+    size = ring->size ? ring->size * 2 : 4;
+    if (size > hotsamples)
+	size = hotsamples;
+    if ((stamps = calloc(size, sizeof(seriesHotStamp))) == NULL)
+	return -ENOMEM;
+    if ((samples = calloc(size, sizeof(redisReply *))) == NULL) {
+	free(stamps);
+	return -ENOMEM;
+    }
+    for (i = 0; i < ring->count; i++) {
+	j = (ring->head + i) % ring->size;
+	stamps[i] = ring->stamps[j];
+	samples[i] = ring->samples[j];
+    }
+    free(ring->stamps);
+    free(ring->samples);
+    ring->stamps = stamps;
+    ring->samples = samples;
+    ring->size = size;
+    ring->head = 0;
+    return 0;
+}
+
+static void
+hot_ring_evict(seriesHotRing *ring)
+{
+    freeReplyObject(ring->samples[ring->head]);
+    ring->samples[ring->head] = NULL;
+    ring->head = (ring->head + 1) % ring->size;
+    ring->count--;
+}
+
+/*
+ * Insert a sample Redis has accepted for the given series; ownership
+ * of the sample passes to the hot tier.
+ */
+void
+seriesHotAppend(const char *hash, redisReply *sample)
+{
+    seriesHotRing	*ring;
+    seriesHotStamp	stamp, *newest;
+    __uint64_t		window;
+    time_t		now;
+    unsigned int	slot;
+
+    if (hotseries == NULL || sample == NULL ||
+	hot_stamp_parse(sample->element[0]->str, &stamp) < 0)
+	goto discard;
+
+    now = time(NULL);
+    hotkey = sdscpy(hotkey, hash);
+    if ((ring = (seriesHotRing *)dictFetchValue(hotseries, hotkey)) == NULL) {
+	if (dictSize(hotseries) >= hotlimit)
+	    hot_sweep(now);
+	if (dictSize(hotseries) >= hotlimit)
+	    goto discard;
+	if ((ring = calloc(1, sizeof(seriesHotRing))) == NULL)
+	    goto discard;
+	dictAdd(hotseries, hotkey, ring);
+    } else if (ring->count && now - ring->updated >= hotexpire) {
+	/* Redis may have expired the stream, older samples are gone */
+	hot_ring_clear(ring);
+    }
+
+    if (ring->count) {
+	newest = &ring->stamps[(ring->head + ring->count - 1) % ring->size];
+	if (hot_stamp_cmp(&stamp, newest) <= 0)
+	    goto discard;	/* Redis rejects these too */
+    }
+
+    if (ring->count == ring->size) {
+	if (ring->size < hotsamples) {
+	    if (hot_ring_grow(ring) < 0)
+		goto discard;
+	} else {
+	    hot_ring_evict(ring);
+	}
+    }
+    slot = (ring->head + ring->count) % ring->size;
+    ring->stamps[slot] = stamp;
+    ring->samples[slot] = sample;
+    ring->count++;
+    ring->updated = now;
+
+    /* age out samples beyond the time window of the newest sample */
+    window = (__uint64_t)hotwindow * 1000;
+    while (ring->count > 1 &&
+	   stamp.ms - ring->stamps[ring->head].ms > window)
+	hot_ring_evict(ring);
+    return;
+
+discard:
+    freeReplyObject(sample);
+}
+
+/*
+ * Answer an XRANGE (start, end) or XREVRANGE (+, -, COUNT reverse)
+ * request for a series from the hot tier, if it holds every sample
+ * Redis would return.  On success the result is an array reply that
+ * references (does not copy) the hot samples - these remain valid
+ * until control returns to the event loop, and the caller releases
+ * the array only via seriesHotRelease.
+ */
+int
+seriesHotRange(const char *hash, const char *start, const char *end,
+		unsigned int reverse, redisReply *result)
+{
+    seriesHotRing	*ring;
+    seriesHotStamp	first, last;
+    unsigned int	i, j, count, n = 0;
+
+    memset(result, 0, sizeof(*result));
+    if (hotseries == NULL)
+	return 0;
+
+    hotkey = sdscpy(hotkey, hash);
+    if ((ring = (seriesHotRing *)dictFetchValue(hotseries, hotkey)) == NULL ||
+	ring->count == 0)
+	return 0;
+    if (time(NULL) - ring->updated >= hotexpire) {
+	hot_ring_free(ring);
+	dictDelete(hotseries, hotkey);
+	return 0;
+    }
+
+    if (reverse) {
+	if (ring->count < reverse)
+	    return 0;	/* Redis may have older samples */
+	count = reverse;
+    } else {
+	if (hot_stamp_parse(start, &first) < 0 ||
+	    hot_stamp_cmp(&first, &ring->stamps[ring->head]) < 0)
+	    return 0;	/* range begins before the oldest hot sample */
+	if (strcmp(end, "+") == 0)
+	    last.ms = last.seq = ~(__uint64_t)0;
+	else if (hot_stamp_parse(end, &last) < 0)
+	    return 0;
+	count = ring->count;
+    }
+
+    if ((result->element = hi_calloc(count, sizeof(redisReply *))) == NULL)
+	return 0;
+    result->type = REDIS_REPLY_ARRAY;
+
+    for (i = 0; i < count; i++) {
+	if (reverse) {
+	    j = (ring->head + ring->count - 1 - i) % ring->size;
+	} else {
+	    j = (ring->head + i) % ring->size;
+	    if (hot_stamp_cmp(&ring->stamps[j], &first) < 0)
+		continue;
+	    if (hot_stamp_cmp(&ring->stamps[j], &last) > 0)
+		break;
+	}
+	result->element[n++] = ring->samples[j];
+    }
+    result->elements = n;
+    return 1;
+}
+
+void
+seriesHotRelease(redisReply *result)
+{
+    hi_free(result->element);	/* samples are owned by the hot tier */
+    memset(result, 0, sizeof(*result));
+}
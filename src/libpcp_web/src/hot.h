@@ -0,0 +1,43 @@
+/*
+ * Copyright (c) 2022 Red Hat.
+ *
+ * This library is free software; you can redistribute it and/or modify it
+ * under the terms of the GNU Lesser General Public License as published
+ * by the Free Software Foundation; either version 2.1 of the License, or
+ * (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of MERCHANTABILITY
+ * or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU Lesser General Public
+ * License for more details.
+ */
+#ifndef SERIES_HOT_H
+#define SERIES_HOT_H
+
+#include <hiredis/hiredis.h>
+#include "sds.h"
+#include "dict.h"
+
+/*
+ * In-process "hot tier" of the most recent values of each series
+ * streamed into Redis by this process.  Samples are kept in the same
+ * form as XRANGE reply elements - a stream identifier (timestamp) and
+ * an array of instance:value pairs - so that recent-window queries can
+ * be answered using the regular Redis reply handling code.
+ */
+#define DEFAULT_HOT_SAMPLES	64	/* samples per series */
+#define DEFAULT_HOT_WINDOW	600	/* seconds of samples per series */
+#define DEFAULT_HOT_SERIES	4096	/* number of series held */
+
+extern void seriesHotInit(struct dict *, unsigned int, unsigned int);
+extern void seriesHotClose(void);
+extern int seriesHotEnabled(void);
+
+extern redisReply *seriesHotSample(sds, sds, unsigned int);
+extern void seriesHotAppend(const char *, redisReply *);
+
+extern int seriesHotRange(const char *, const char *, const char *,
+		unsigned int, redisReply *);
+extern void seriesHotRelease(redisReply *);
+
+#endif	/* SERIES_HOT_H */
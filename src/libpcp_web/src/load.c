@@ -29,6 +29,7 @@ void initSeriesGetContext(seriesGetContext *, void *);
 void freeSeriesGetContext(seriesGetContext *, int);
 
 static void server_cache_window(void *);
+static void load_read_ahead(seriesLoadBaton *);
 
 /* cache information about this metric source (host/archive) */
 static void
@@ -504,18 +505,19 @@ series_cache_update(seriesLoadBaton *baton, struct dict *exclude)
 
 out:
     sdsfree(timestamp);
-    /* drop reference taken in server_cache_window */
+    /* drop reference taken in server_cache_next */
     doneSeriesGetContext(context, "series_cache_update");
 }
 
 static int
 server_cache_series(seriesLoadBaton *baton)
 {
+    seriesGetContext	*context = &baton->pmapi;
     char		pmmsg[PM_MAXERRMSGLEN];
     sds			msg;
     int			sts;
 
-    if (baton->pmapi.context.type != PM_CONTEXT_ARCHIVE)
+    if (context->context.type != PM_CONTEXT_ARCHIVE)
 	return -ENOTSUP;
 
     if ((sts = pmSetModeHighRes(PM_MODE_FORW, &baton->timing.start, NULL)) < 0) {
@@ -525,6 +527,21 @@ server_cache_series(seriesLoadBaton *baton)
 	return sts;
     }
 
+    /*
+     * Records are read ahead by worker threads using a duplicate
+     * of the archive context, so that metadata lookups from the
+     * main loop (for records already read) never contend with or
+     * disturb the position of the reader.
+     */
+    if ((sts = pmDupContext()) < 0) {
+	infofmt(msg, "pmDupContext failed: %s",
+		pmErrStr_r(sts, pmmsg, sizeof(pmmsg)));
+	batoninfo(baton, PMLOG_ERROR, msg);
+	return sts;
+    }
+    context->fetch = sts;
+    pmUseContext(context->context.context);
+
     seriesBatonReference(baton, "server_cache_series");
     server_cache_window(baton);
     return 0;
@@ -558,61 +575,246 @@ server_cache_update_done(void *arg)
     server_cache_window(baton);
 }
 
+static void
+free_load_batch(seriesLoadBatch *batch)
+{
+    unsigned int	i;
+
+    for (i = batch->index; i < batch->count; i++)
+	pmFreeHighResResult(batch->results[i]);
+    free(batch);
+}
+
+static void
+free_load_batches(seriesGetContext *context)
+{
+    seriesLoadBatch	*batch, *next;
+
+    for (batch = context->head; batch != NULL; batch = next) {
+	next = batch->next;
+	free_load_batch(batch);
+    }
+    context->head = context->tail = NULL;
+    context->queued = 0;
+}
+
+/*
+ * Point the metadata context at the archive and time of a record
+ * read by the worker, so instance domain and label lookups give
+ * the same answers as if that context had fetched the record.
+ */
+static void
+load_metadata_origin(seriesGetContext *context, int log)
+{
+    struct timespec	*stamp = &context->result->timestamp;
+    __pmContext		*ctxp;
+
+    if ((ctxp = __pmHandleToPtr(context->context.context)) == NULL)
+	return;
+    if (ctxp->c_archctl->ac_cur_log == log) {
+	ctxp->c_origin.sec = stamp->tv_sec;
+	ctxp->c_origin.nsec = stamp->tv_nsec;
+	PM_UNLOCK(ctxp->c_lock);
+    } else {	/* crossed into another archive of a multi-archive context */
+	PM_UNLOCK(ctxp->c_lock);
+	pmUseContext(context->context.context);
+	pmSetModeHighRes(PM_MODE_FORW, stamp, NULL);
+    }
+}
+
 #if defined(HAVE_LIBUV)
+static seriesLoadBatch *
+new_load_batch(seriesLoadBaton *baton, unsigned int count)
+{
+    seriesLoadBatch	*batch;
+    size_t		size;
+
+    size = sizeof(seriesLoadBatch) +
+	   count * (sizeof(pmHighResResult *) + sizeof(int));
+    if ((batch = (seriesLoadBatch *)calloc(1, size)) == NULL)
+	return NULL;
+    batch->baton = baton;
+    batch->results = (pmHighResResult **)&batch[1];
+    batch->logs = (int *)&batch->results[count];
+    return batch;
+}
+
 /* this function runs in a worker thread */
 static void
 fetch_archive(uv_work_t *req)
 {
-    seriesLoadBaton	*baton = (seriesLoadBaton *)req->data;
+    seriesLoadBatch	*batch = (seriesLoadBatch *)req->data;
+    seriesLoadBaton	*baton = (seriesLoadBaton *)batch->baton;
     seriesGetContext	*context = &baton->pmapi;
-    context_t		*cp = &context->context;
+    struct timespec	*finish = &baton->timing.end;
     pmHighResResult	*result;
+    __pmContext		*ctxp;
     int			sts;
 
-    assert(context->result == NULL);
-    if ((context->error = sts = pmUseContext(cp->context)) >= 0)
-	if ((context->error = sts = pmFetchHighResArchive(&result)) >= 0)
-	    context->result = result;
+    if ((batch->error = pmUseContext(context->fetch)) < 0)
+	return;
+
+    while (batch->count < context->batchsize) {
+	if ((sts = pmFetchHighResArchive(&result)) < 0) {
+	    batch->error = sts;
+	    break;
+	}
+	if ((ctxp = __pmHandleToPtr(context->fetch)) != NULL) {
+	    batch->logs[batch->count] = ctxp->c_archctl->ac_cur_log;
+	    PM_UNLOCK(ctxp->c_lock);
+	}
+	batch->results[batch->count++] = result;
+
+	/* no need to read beyond the end of the requested time window */
+	if (finish->tv_sec < result->timestamp.tv_sec ||
+	    (finish->tv_sec == result->timestamp.tv_sec &&
+	     finish->tv_nsec < result->timestamp.tv_nsec)) {
+	    batch->error = PM_ERR_EOL;
+	    break;
+	}
+    }
 }
 
 /* this function runs in the main thread */
 static void
 fetch_archive_done(uv_work_t *req, int status)
 {
-    seriesLoadBaton	*baton = (seriesLoadBaton *)req->data;
+    seriesLoadBatch	*batch = (seriesLoadBatch *)req->data;
+    seriesLoadBaton	*baton = (seriesLoadBaton *)batch->baton;
     seriesGetContext	*context = &baton->pmapi;
-    struct timespec	*finish = &baton->timing.end;
-    int 		sts = context->error;
 
+    (void)status;
     free(req);
+    context->reading = 0;
+
     if (context->loaded) {
-	assert(context->result == NULL);
-        doneSeriesGetContext(context, "fetch_archive_done");
-    } else if (sts >= 0) {
+	/* load already ended (time window), discard records read ahead */
+	free_load_batch(batch);
+    } else {
+	if (batch->error < 0)
+	    context->ended = 1;
+	if (context->tail)
+	    context->tail->next = batch;
+	else
+	    context->head = batch;
+	context->tail = batch;
+
+	if (context->waiting) {
+	    context->waiting = 0;
+	    server_cache_window(baton);
+	} else {
+	    load_read_ahead(baton);
+	}
+    }
+
+    /* drop reference taken in load_read_ahead */
+    doneSeriesLoadBaton(baton, "fetch_archive_done");
+}
+#endif
+
+/*
+ * Keep the read-ahead queue full - at most one worker request is
+ * outstanding (it owns the fetch context while queued), with up to
+ * the configured depth of batches read but not yet fully cached.
+ */
+static void
+load_read_ahead(seriesLoadBaton *baton)
+{
+    seriesGetContext	*context = &baton->pmapi;
+#if defined(HAVE_LIBUV)
+    seriesLoadBatch	*batch;
+    uv_work_t		*req;
+
+    if (context->reading || context->ended || context->loaded)
+	return;
+    if (context->queued >= context->depth)
+	return;
+
+    if ((batch = new_load_batch(baton, context->batchsize)) == NULL ||
+	(req = malloc(sizeof(uv_work_t))) == NULL) {
+	free(batch);
+	context->error = -ENOMEM;
+	context->ended = 1;
+	return;
+    }
+    context->reading = 1;
+    context->queued++;
+    seriesBatonReference(baton, "load_read_ahead");
+
+    /*
+     * We must perform pmFetchArchive(3) in a worker thread
+     * because it contains blocking (synchronous) I/O calls
+     */
+    req->data = batch;
+    uv_queue_work(uv_default_loop(), req, fetch_archive, fetch_archive_done);
+#else
+    context->error = -ENOTSUP;
+    context->ended = 1;
+#endif
+}
+
+/*
+ * Start caching the next record read ahead by the worker, returning
+ * zero if there was none available yet or non-zero if the caller is
+ * to proceed immediately with the record after this one.
+ */
+static int
+server_cache_next(seriesLoadBaton *baton)
+{
+    seriesGetContext	*context = &baton->pmapi;
+    struct timespec	*finish = &baton->timing.end;
+    seriesLoadBatch	*batch;
+    int			sts, log;
+
+    /* release batches which have been completely cached */
+    while ((batch = context->head) != NULL &&
+	    batch->index == batch->count && batch->error == 0) {
+	if ((context->head = batch->next) == NULL)
+	    context->tail = NULL;
+	context->queued--;
+	free_load_batch(batch);
+    }
+    load_read_ahead(baton);
+
+    if (batch == NULL) {
+	if (!context->ended || context->reading) {
+	    /* resume from fetch_archive_done once the worker is done */
+	    context->waiting = 1;
+	    return 0;
+	}
+	sts = context->error < 0 ? context->error : -ENOMEM;
+    } else if (batch->index < batch->count) {
+	log = batch->logs[batch->index];
+	context->result = batch->results[batch->index++];
 	if (finish->tv_sec > context->result->timestamp.tv_sec ||
 	    (finish->tv_sec == context->result->timestamp.tv_sec &&
 	     finish->tv_nsec >= context->result->timestamp.tv_nsec)) {
+	    load_metadata_origin(context, log);
+	    seriesBatonReference(context, "server_cache_next");
 	    context->done = server_cache_update_done;
 	    series_cache_update(baton, baton->exclude_pmids);
+	    return 1;
 	}
-	else {
-	    if (pmDebugOptions.series)
-		fprintf(stderr, "%s: time window end\n", "fetch_archive_done");
-	    sts = PM_ERR_EOL;
-	    pmFreeHighResResult(context->result);
-	    context->result = NULL;
-	}
-    }
-
-    if (sts < 0) {
-	if (sts != PM_ERR_EOL)
-	    baton->error = sts;
-	doneSeriesGetContext(context, "fetch_archive_done");
+	if (pmDebugOptions.series)
+	    fprintf(stderr, "%s: time window end\n", "server_cache_next");
+	pmFreeHighResResult(context->result);
+	context->result = NULL;
+	sts = PM_ERR_EOL;
+    } else {
+	sts = batch->error;
     }
 
-    doneSeriesLoadBaton(baton, "fetch_archive_done");
+    /* end of the archive, time window or an error - finish the load */
+    context->error = sts;
+    if (sts != PM_ERR_EOL)
+	baton->error = sts;
+    seriesBatonReference(context, "server_cache_next");
+    context->done = server_cache_series_finished;
+    doneSeriesGetContext(context, "server_cache_next");
+    context->loaded = 1;
+    free_load_batches(context);
+    return 0;
 }
-#endif
 
 void
 server_cache_window(void *arg)
@@ -627,22 +829,23 @@ server_cache_window(void *arg)
     if (pmDebugOptions.series)
 	fprintf(stderr, "%s: fetching next result\n", "server_cache_window");
 
-#if defined(HAVE_LIBUV)
-    seriesBatonReference(baton, "server_cache_window");
-    seriesBatonReference(context, "server_cache_window");
-    context->done = server_cache_series_finished;
-
     /*
-     * We must perform pmFetchArchive(3) in a worker thread
-     * because it contains blocking (synchronous) I/O calls
+     * Caching a record often completes synchronously (e.g. when all
+     * of its metrics are filtered), calling back in here - iterate
+     * rather than recurse through the read-ahead queue in that case.
      */
-    uv_work_t *req = malloc(sizeof(uv_work_t));
-    req->data = baton;
-    uv_queue_work(uv_default_loop(), req, fetch_archive, fetch_archive_done);
-#else
-    baton->error = -ENOTSUP;
-    server_cache_series_finished(arg);
-#endif
+    if (context->active) {
+	context->again = 1;
+	return;
+    }
+    seriesBatonReference(baton, "server_cache_window");
+    context->active = 1;
+    do {
+	context->again = 0;
+	server_cache_next(baton);
+    } while (context->again);
+    context->active = 0;
+    doneSeriesLoadBaton(baton, "server_cache_window");
 }
 
 static void
@@ -802,6 +1005,30 @@ load_prepare_timing(seriesLoadBaton *baton)
     return 0;
 }
 
+/*
+ * Archive records are read in batches by worker threads, ahead of
+ * the main loop caching them - both the number of records per read
+ * and how many batches may be buffered are configurable.
+ */
+static void
+load_prepare_readahead(seriesLoadBaton *baton)
+{
+    pmSeriesModule	*module = (pmSeriesModule *)baton->module;
+    seriesModuleData	*data = getSeriesModuleData(module);
+    seriesGetContext	*context = &baton->pmapi;
+    sds			option;
+    int			value;
+
+    if (data == NULL || data->config == NULL)
+	return;
+    if ((option = pmIniFileLookup(data->config, "pmseries", "load.batch")) &&
+	(value = atoi(option)) > 0)
+	context->batchsize = value;
+    if ((option = pmIniFileLookup(data->config, "pmseries", "load.depth")) &&
+	(value = atoi(option)) > 0)
+	context->depth = value;
+}
+
 static void
 load_prepare_source(seriesLoadBaton *baton, node_t *np, int level)
 {
@@ -909,6 +1136,9 @@ initSeriesGetContext(seriesGetContext *baton, void *arg)
 {
     initSeriesBatonMagic(baton, MAGIC_CONTEXT);
     baton->baton = arg;
+    baton->fetch = -1;
+    baton->batchsize = DEFAULT_LOAD_BATCH;
+    baton->depth = DEFAULT_LOAD_DEPTH;
 }
 
 void
@@ -917,6 +1147,11 @@ freeSeriesGetContext(seriesGetContext *baton, int release)
     context_t		*cp = &baton->context;
 
     seriesBatonCheckMagic(baton, MAGIC_CONTEXT, "freeSeriesGetContext");
+    free_load_batches(baton);
+    if (baton->fetch >= 0) {
+	pmDestroyContext(baton->fetch);
+	baton->fetch = -1;
+    }
     pmwebapi_release_context(cp);
     if (release) {
 	memset(baton, 0, sizeof(*baton));
@@ -1017,6 +1252,7 @@ connect_pmapi_source_service(void *arg)
     } else if (baton->error == 0) {
 	/* setup metric and time-based filtering for source load */
 	load_prepare_timing(baton);
+	load_prepare_readahead(baton);
 	load_prepare_included_metrics(baton);
 	load_prepare_excluded_metrics(baton);
     }
@@ -1221,7 +1457,7 @@ pmSeriesDiscoverSource(pmDiscoverEvent *event, void *arg)
 	return;
     }
 
-    initSeriesLoadBaton(baton, module, 0 /*flags*/,
+    initSeriesLoadBaton(baton, module, PM_SERIES_FLAG_ACTIVE,
 			module->on_info, series_discover_done,
 			data->slots, arg);
     initSeriesGetContext(&baton->pmapi, baton);
@@ -24,6 +24,7 @@
 #include "schema.h"
 #include "slots.h"
 #include "maps.h"
+#include "hot.h"
 #include <math.h>
 #include <fnmatch.h>
 
@@ -72,6 +73,7 @@ static void series_pattern_match(seriesQueryBaton *, node_t *);
 static int series_union(series_set_t *, series_set_t *);
 static int series_intersect(series_set_t *, series_set_t *);
 static int series_calculate(node_t *, int, void *);
+static int series_calculate_node(node_t *, void *);
 static void series_redis_hash_expression(seriesQueryBaton *, char *, int);
 static void series_node_get_metric_name(seriesQueryBaton *, seriesGetSID *, series_sample_set_t *);
 static void series_node_get_desc(seriesQueryBaton *, sds, series_sample_set_t *);
@@ -1604,12 +1606,54 @@ series_value_count_only(timing_t *tp)
     return tp->count;
 }
 
+/*
+ * Answer X[REV]RANGE requests for a set of series from the hot tier
+ * of recently streamed values, instead of Redis.  This is all or
+ * nothing so that replies are processed in the usual request order.
+ */
+static redisReply *
+series_hot_values(seriesQueryBaton *baton, series_set_t *set,
+		sds start, sds end, unsigned int reverse)
+{
+    seriesModuleData	*data = getSeriesModuleData(baton->module);
+    unsigned char	*series = set->series;
+    redisReply		*replies;
+    char		hashbuf[42];
+    int			i, n;
+
+    if (!seriesHotEnabled() || set->nseries <= 0)
+	return NULL;
+    if ((replies = calloc(set->nseries, sizeof(redisReply))) == NULL)
+	return NULL;
+
+    for (i = 0; i < set->nseries; i++, series += SHA1SZ) {
+	pmwebapi_hash_str(series, hashbuf, sizeof(hashbuf));
+	if (!seriesHotRange(hashbuf, start, end, reverse, &replies[i]))
+	    break;
+    }
+    if (i < set->nseries) {
+	for (n = 0; n < i; n++)
+	    seriesHotRelease(&replies[n]);
+	free(replies);
+	replies = NULL;
+    }
+
+    if (data)
+	mmv_inc_value(data->map, data->metrics[replies ?
+			SERIES_HOT_HITS : SERIES_HOT_MISSES], set->nseries);
+    if (pmDebugOptions.series)
+	fprintf(stderr, "HOT: %s for %d series\n",
+			replies ? "hit" : "miss", set->nseries);
+    return replies;
+}
+
 static void
 series_prepare_time(seriesQueryBaton *baton, series_set_t *result)
 {
     timing_t		*tp = &baton->query.timing;
     unsigned char	*series = result->series;
     seriesGetSID	*sid;
+    redisReply		*hot;
     char		buffer[64], revbuf[64];
     sds			start, end, key, cmd;
     unsigned int	i, revlen = 0, reverse = 0;
@@ -1635,6 +1679,9 @@ series_prepare_time(seriesQueryBaton *baton, series_set_t *result)
     if (pmDebugOptions.series)
 	fprintf(stderr, "END: %s\n", end);
 
+    /* recent values may be held in-process, avoiding Redis entirely */
+    hot = series_hot_values(baton, result, start, end, reverse);
+
     /*
      * Query cache for the time series range (groups of instance:value
      * pairs, with an associated timestamp).
@@ -1646,6 +1693,12 @@ series_prepare_time(seriesQueryBaton *baton, series_set_t *result)
 	initSeriesGetSID(sid, buffer, 1, baton);
 	seriesBatonReference(baton, "series_prepare_time");
 
+	if (hot) {
+	    series_prepare_time_reply(NULL, &hot[i], sid);
+	    seriesHotRelease(&hot[i]);
+	    continue;
+	}
+
 	key = sdscatfmt(sdsempty(), "pcp:values:series:%S", sid->name);
 
 	/* X[REV]RANGE key t1 t2 [count N] */
@@ -1668,6 +1721,7 @@ series_prepare_time(seriesQueryBaton *baton, series_set_t *result)
 				series_prepare_time_reply, sid);
 	sdsfree(cmd);
     }
+    free(hot);
     sdsfree(start);
     sdsfree(end);
 }
@@ -1802,6 +1856,163 @@ series_query_expr(void *arg)
     series_query_end_phase(baton);
 }
 
+/*
+ * Allocate space for count instance values of a sample, along with
+ * the decoded value columns - a single block freed via the returned
+ * series_instance pointer.
+ */
+static pmSeriesValue *
+series_instance_alloc(series_instance_set_t *set, int count)
+{
+    size_t		bytes;
+    char		*block;
+
+    bytes = count * (sizeof(pmSeriesValue) + sizeof(double) +
+			sizeof(__int64_t) + sizeof(unsigned char));
+    if ((block = calloc(1, bytes ? bytes : 1)) == NULL)
+	return set->series_instance = NULL;
+    set->series_instance = (pmSeriesValue *)block;
+    block += count * sizeof(pmSeriesValue);
+    set->values = (double *)block;
+    block += count * sizeof(double);
+    set->ints = (__int64_t *)block;
+    block += count * sizeof(__int64_t);
+    set->decoded = (unsigned char *)block;
+    return set->series_instance;
+}
+
+/*
+ * Decode the value string of one instance.  Values are decoded before
+ * the metric type is known, so both a double and an integer form are
+ * kept (as per strtod and strtoll/strtoull), and the typed accessor
+ * below narrows these to the type of the series when needed.
+ */
+static void
+series_instance_decode(series_instance_set_t *set, int k)
+{
+    const char		*s = set->series_instance[k].data;
+    char		*end;
+    double		d;
+
+    d = strtod(s, &end);
+    if (end == s) {
+	set->values[k] = 0.0;
+	set->ints[k] = 0;
+	set->decoded[k] = 0;
+	return;
+    }
+    while (isspace((int)*s))
+	s++;
+    set->values[k] = d;
+    if (*s == '-')
+	set->ints[k] = strtoll(s, NULL, 10);
+    else
+	set->ints[k] = (__int64_t)strtoull(s, NULL, 10);
+    set->decoded[k] = 1;
+}
+
+static int
+series_instance_value(series_instance_set_t *set, int k, int type, pmAtomValue *val)
+{
+    if (set->decoded[k] == 0)
+	return PM_ERR_CONV;
+
+    switch (type) {
+    case PM_TYPE_32:
+	val->l = (__int32_t)set->ints[k];
+	break;
+    case PM_TYPE_U32:
+	val->ul = (__uint32_t)set->ints[k];
+	break;
+    case PM_TYPE_64:
+	val->ll = set->ints[k];
+	break;
+    case PM_TYPE_U64:
+	val->ull = (__uint64_t)set->ints[k];
+	break;
+    case PM_TYPE_FLOAT:
+	val->f = (float)set->values[k];
+	break;
+    case PM_TYPE_DOUBLE:
+	val->d = set->values[k];
+	break;
+    default:
+	return PM_ERR_CONV;
+    }
+    return 0;
+}
+
+/* Record a value calculated in a function alongside its string form */
+static void
+series_instance_set_double(series_instance_set_t *set, int k, double value)
+{
+    set->values[k] = value;
+    set->ints[k] = (__int64_t)value;
+    set->decoded[k] = 1;
+}
+
+static void
+series_instance_set_atom(series_instance_set_t *set, int k, int type, pmAtomValue *val)
+{
+    switch (type) {
+    case PM_TYPE_32:
+	set->ints[k] = val->l;
+	set->values[k] = (double)val->l;
+	break;
+    case PM_TYPE_U32:
+	set->ints[k] = val->ul;
+	set->values[k] = (double)val->ul;
+	break;
+    case PM_TYPE_64:
+	set->ints[k] = val->ll;
+	set->values[k] = (double)val->ll;
+	break;
+    case PM_TYPE_U64:
+	set->ints[k] = (__int64_t)val->ull;
+	set->values[k] = (double)val->ull;
+	break;
+    case PM_TYPE_FLOAT:
+	set->values[k] = val->f;
+	set->ints[k] = (__int64_t)val->f;
+	break;
+    case PM_TYPE_DOUBLE:
+	set->values[k] = val->d;
+	set->ints[k] = (__int64_t)val->d;
+	break;
+    default:
+	set->values[k] = 0.0;
+	set->ints[k] = 0;
+	set->decoded[k] = 0;
+	return;
+    }
+    set->decoded[k] = 1;
+}
+
+static void
+series_instance_set_invalid(series_instance_set_t *set, int k)
+{
+    set->values[k] = 0.0;
+    set->ints[k] = 0;
+    set->decoded[k] = 0;
+}
+
+/* Copy one instance value, string and decoded forms, between samples */
+static void
+series_instance_copy(series_instance_set_t *dst, int j,
+		series_instance_set_t *src, int k)
+{
+    pmSeriesValue	*d = &dst->series_instance[j];
+    pmSeriesValue	*s = &src->series_instance[k];
+
+    d->timestamp = sdsnew(s->timestamp);
+    d->series = sdsnew(s->series);
+    d->data = sdsnew(s->data);
+    d->ts = s->ts;
+    dst->values[j] = src->values[k];
+    dst->ints[j] = src->ints[k];
+    dst->decoded[j] = src->decoded[k];
+}
+
 static int
 series_instance_store_to_node(seriesQueryBaton *baton, sds series,
 	pmSeriesValue *value, int nelements, redisReply **elements, node_t *np, int idx_sample)
@@ -1811,7 +2022,9 @@ series_instance_store_to_node(seriesQueryBaton *baton, sds series,
     int			i, sts = 0;
     int			idx_instance = 0;
     int			idx_series = np->value_set.num_series;
+    series_instance_set_t *set;
 
+    set = &np->value_set.series_values[idx_series].series_sample[idx_sample];
     for (i = 0; i < nelements; i += 2) {
 	inst = value->series;
 	if (extract_string(baton, series, elements[i], &inst, "series") < 0) {
@@ -1833,12 +2046,13 @@ series_instance_store_to_node(seriesQueryBaton *baton, sds series,
 	    sts = -EPROTO;
 	else {
 	    /* update value instance */
-	    pmSeriesValue *valinst = &np->value_set.series_values[idx_series].series_sample[idx_sample].series_instance[idx_instance];
+	    pmSeriesValue *valinst = &set->series_instance[idx_instance];
 
 	    valinst->ts = value->ts; /* struct pmTimespec assign */
 	    valinst->timestamp = sdsnew(value->timestamp);
 	    valinst->series = sdsnew(value->series);
 	    valinst->data = sdsnew(value->data);
+	    series_instance_decode(set, idx_instance);
 	    ++idx_instance;
 	}
     }
@@ -1945,8 +2159,8 @@ series_values_store_to_node(seriesQueryBaton *baton, sds series,
 	
 	idx_sample = i;
 	np->value_set.series_values[idx_series].series_sample[idx_sample].num_instances = reply->elements/2;
-	if ((np->value_set.series_values[idx_series].series_sample[idx_sample].series_instance =
-		(pmSeriesValue *)calloc(reply->elements/2, sizeof(pmSeriesValue))) == NULL) {
+	if (series_instance_alloc(&np->value_set.series_values[idx_series].series_sample[idx_sample],
+		reply->elements/2) == NULL) {
 	    /* TODO: error report here */
 	    baton->error = -ENOMEM;
 	}
@@ -2222,6 +2436,7 @@ series_node_prepare_time(seriesQueryBaton *baton, series_set_t *query_series_set
     timing_t			*tp = &np->time;
     unsigned char		*series = query_series_set->series;
     seriesGetSID		*sid;
+    redisReply			*hot;
     char			buffer[64], revbuf[64];
     sds				start, end, key, cmd;
     unsigned int		i, revlen = 0, reverse = 0;
@@ -2258,6 +2473,9 @@ series_node_prepare_time(seriesQueryBaton *baton, series_set_t *query_series_set
 	return;
     }
 
+    /* recent values may be held in-process, avoiding Redis entirely */
+    hot = series_hot_values(baton, query_series_set, start, end, reverse);
+
     /*
      * Query cache for the time series range (groups of instance:value
      * pairs, with an associated timestamp).
@@ -2269,6 +2487,14 @@ series_node_prepare_time(seriesQueryBaton *baton, series_set_t *query_series_set
 	initSeriesGetSID(sid, buffer, 1, baton);
 	seriesBatonReference(baton, "series_prepare_time");
 
+	if (hot) {
+	    np->value_set.series_values[i].baton = baton;
+	    np->value_set.series_values[i].sid = sid;
+	    series_node_prepare_time_reply(NULL, &hot[i], np);
+	    seriesHotRelease(&hot[i]);
+	    continue;
+	}
+
 	key = sdscatfmt(sdsempty(), "pcp:values:series:%S", sid->name);
 
 	/* X[REV]RANGE key t1 t2 [count N] */
@@ -2295,6 +2521,7 @@ series_node_prepare_time(seriesQueryBaton *baton, series_set_t *query_series_set
 	sdsfree(cmd);
 	
     }
+    free(hot);
     sdsfree(start);
     sdsfree(end);
 }
@@ -2629,7 +2856,7 @@ series_calculate_rate(node_t *np, void *arg)
     seriesQueryBaton	*baton = (seriesQueryBaton *)arg;
     pmSeriesValue	s_pmval, t_pmval;
     unsigned int	n_instances, n_samples, i, j, k;
-    double		s_data, t_data, mult;
+    double		s_data, t_data, rate, mult;
     char		str[256];
     sds			msg, expr;
     int			sts;
@@ -2660,13 +2887,15 @@ series_calculate_rate(node_t *np, void *arg)
 		    }
 
 		    /* compute rate/sec from delta value and delta timestamp */
-		    s_data = strtod(s_pmval.data, NULL);
-		    t_data = strtod(t_pmval.data, NULL);
-		    pmsprintf(str, sizeof(str), "%.6lf", (t_data - s_data) / pmTimespec_delta(&t_pmval.ts, &s_pmval.ts));
+		    s_data = np->value_set.series_values[i].series_sample[j].values[k];
+		    t_data = np->value_set.series_values[i].series_sample[j-1].values[k];
+		    rate = (t_data - s_data) / pmTimespec_delta(&t_pmval.ts, &s_pmval.ts);
+		    pmsprintf(str, sizeof(str), "%.6lf", rate);
 
 		    sdsfree(np->value_set.series_values[i].series_sample[j-1].series_instance[k].data);
 		    sdsfree(np->value_set.series_values[i].series_sample[j-1].series_instance[k].timestamp);
 		    np->value_set.series_values[i].series_sample[j-1].series_instance[k].data = sdsnew(str);
+		    series_instance_set_double(&np->value_set.series_values[i].series_sample[j-1], k, rate);
 		    np->value_set.series_values[i].series_sample[j-1].series_instance[k].timestamp =
 		    	sdsnew(np->value_set.series_values[i].series_sample[j].series_instance[k].timestamp);
 		    np->value_set.series_values[i].series_sample[j-1].series_instance[k].ts =
@@ -2702,7 +2931,8 @@ series_calculate_rate(node_t *np, void *arg)
 	units.scaleTime = PM_TIME_SEC;
 	np->value_set.series_values[i].series_desc.type = sdsnew("double");
 	np->value_set.series_values[i].series_desc.semantics = sdsnew("instant");
-	np->value_set.series_values[i].series_desc.units = sdsnew(pmUnitsStr(&units));
+	np->value_set.series_values[i].series_desc.units = sdsnew(
+		pmUnitsStr_r(&units, str, sizeof(str)));
     }
 }
 
@@ -2717,7 +2947,6 @@ series_calculate_time_domain_max(node_t *np, void *arg)
     double		max_data, data;
     int			max_pointer;
     sds			msg;
-    pmSeriesValue	inst;
 
     n_series = np->left->value_set.num_series;
     np->value_set.num_series = n_series;
@@ -2731,10 +2960,10 @@ series_calculate_time_domain_max(node_t *np, void *arg)
 
 	    for (j = 0; j < n_samples; j++) {
 		np->value_set.series_values[i].series_sample[j].num_instances = 1;
-		np->value_set.series_values[i].series_sample[j].series_instance = (pmSeriesValue *)calloc(1, sizeof(pmSeriesValue));
+		series_instance_alloc(&np->value_set.series_values[i].series_sample[j], 1);
 
 		max_pointer = 0;
-		max_data = atof(np->left->value_set.series_values[i].series_sample[j].series_instance[0].data);
+		max_data = np->left->value_set.series_values[i].series_sample[j].values[0];
 		for (k = 1; k < n_instances; k++) {
 		    if (np->left->value_set.series_values[i].series_sample[j].num_instances != n_instances) {
 			if (pmDebugOptions.query && pmDebugOptions.desperate) {
@@ -2743,18 +2972,14 @@ series_calculate_time_domain_max(node_t *np, void *arg)
 			}
 			continue;
 		    }                
-		    data = atof(np->left->value_set.series_values[i].series_sample[j].series_instance[k].data);
+		    data = np->left->value_set.series_values[i].series_sample[j].values[k];
 		    if (max_data < data) {
 			max_data = data;
 			max_pointer = k;
 		    }
 		}
-		inst = np->left->value_set.series_values[i].series_sample[j].series_instance[max_pointer];
-
-		np->value_set.series_values[i].series_sample[j].series_instance[0].timestamp = sdsnew(inst.timestamp);
-		np->value_set.series_values[i].series_sample[j].series_instance[0].series = sdsnew(inst.series);
-		np->value_set.series_values[i].series_sample[j].series_instance[0].data = sdsnew(inst.data);
-		np->value_set.series_values[i].series_sample[j].series_instance[0].ts = inst.ts;
+		series_instance_copy(&np->value_set.series_values[i].series_sample[j], 0,
+			&np->left->value_set.series_values[i].series_sample[j], max_pointer);
 	    }
         } else {
 	    np->value_set.series_values[i].num_samples = 0;
@@ -2793,10 +3018,10 @@ series_calculate_max(node_t *np, void *arg)
 	    np->value_set.series_values[i].series_sample = (series_instance_set_t *)calloc(1, sizeof(series_instance_set_t));
 	    n_instances = np->left->value_set.series_values[i].series_sample[0].num_instances;
 	    np->value_set.series_values[i].series_sample[0].num_instances = n_instances;
-	    np->value_set.series_values[i].series_sample[0].series_instance = (pmSeriesValue *)calloc(n_instances, sizeof(pmSeriesValue));
+	    series_instance_alloc(&np->value_set.series_values[i].series_sample[0], n_instances);
 	    for (k = 0; k < n_instances; k++) {
 		max_pointer = 0;
-		max_data = atof(np->left->value_set.series_values[i].series_sample[0].series_instance[k].data);
+		max_data = np->left->value_set.series_values[i].series_sample[0].values[k];
 		for (j = 1; j < n_samples; j++) {
 		    if (np->left->value_set.series_values[i].series_sample[j].num_instances != n_instances) {
 			if (pmDebugOptions.query && pmDebugOptions.desperate) {
@@ -2805,20 +3030,14 @@ series_calculate_max(node_t *np, void *arg)
 			}
 			continue;
 		    }
-		    data = atof(np->left->value_set.series_values[i].series_sample[j].series_instance[k].data);
+		    data = np->left->value_set.series_values[i].series_sample[j].values[k];
 		    if (max_data < data) {
 			max_data = data;
 			max_pointer = j;
 		    }
 		}
-		np->value_set.series_values[i].series_sample[0].series_instance[k].timestamp = 
-			sdsnew(np->left->value_set.series_values[i].series_sample[max_pointer].series_instance[k].timestamp);
-		np->value_set.series_values[i].series_sample[0].series_instance[k].series = 
-			sdsnew(np->left->value_set.series_values[i].series_sample[max_pointer].series_instance[k].series);
-		np->value_set.series_values[i].series_sample[0].series_instance[k].data = 
-			sdsnew(np->left->value_set.series_values[i].series_sample[max_pointer].series_instance[k].data);
-		np->value_set.series_values[i].series_sample[0].series_instance[k].ts = 
-			np->left->value_set.series_values[i].series_sample[max_pointer].series_instance[k].ts;
+		series_instance_copy(&np->value_set.series_values[i].series_sample[0], k,
+			&np->left->value_set.series_values[i].series_sample[max_pointer], k);
 	    }
 	} else {
 	    np->value_set.series_values[i].num_samples = 0;
@@ -2846,7 +3065,6 @@ series_calculate_time_domain_min(node_t *np, void *arg)
     double		min_data, data;
     int			min_pointer;
     sds			msg;
-    pmSeriesValue	inst;
 
     n_series = np->left->value_set.num_series;
     np->value_set.num_series = n_series;
@@ -2860,10 +3078,10 @@ series_calculate_time_domain_min(node_t *np, void *arg)
 
 	    for (j = 0; j < n_samples; j++) {
 		np->value_set.series_values[i].series_sample[j].num_instances = 1;
-		np->value_set.series_values[i].series_sample[j].series_instance = (pmSeriesValue *)calloc(1, sizeof(pmSeriesValue));
+		series_instance_alloc(&np->value_set.series_values[i].series_sample[j], 1);
 
 		min_pointer = 0;
-		min_data = atof(np->left->value_set.series_values[i].series_sample[j].series_instance[0].data);
+		min_data = np->left->value_set.series_values[i].series_sample[j].values[0];
 		for (k = 1; k < n_instances; k++) {
 		    if (np->left->value_set.series_values[i].series_sample[j].num_instances != n_instances) {
 			if (pmDebugOptions.query && pmDebugOptions.desperate) {
@@ -2872,18 +3090,14 @@ series_calculate_time_domain_min(node_t *np, void *arg)
 			}
 			continue;
 		    }                
-		    data = atof(np->left->value_set.series_values[i].series_sample[j].series_instance[k].data);
+		    data = np->left->value_set.series_values[i].series_sample[j].values[k];
 		    if (min_data > data) {
 			min_data = data;
 			min_pointer = k;
 		    }
 		}
-		inst = np->left->value_set.series_values[i].series_sample[j].series_instance[min_pointer];
-
-		np->value_set.series_values[i].series_sample[j].series_instance[0].timestamp = sdsnew(inst.timestamp);
-		np->value_set.series_values[i].series_sample[j].series_instance[0].series = sdsnew(inst.series);
-		np->value_set.series_values[i].series_sample[j].series_instance[0].data = sdsnew(inst.data);
-		np->value_set.series_values[i].series_sample[j].series_instance[0].ts = inst.ts;
+		series_instance_copy(&np->value_set.series_values[i].series_sample[j], 0,
+			&np->left->value_set.series_values[i].series_sample[j], min_pointer);
 	    }
         } else {
 	    np->value_set.series_values[i].num_samples = 0;
@@ -2922,10 +3136,10 @@ series_calculate_min(node_t *np, void *arg)
 	    np->value_set.series_values[i].series_sample = (series_instance_set_t *)calloc(1, sizeof(series_instance_set_t));
 	    n_instances = np->left->value_set.series_values[i].series_sample[0].num_instances;
 	    np->value_set.series_values[i].series_sample[0].num_instances = n_instances;
-	    np->value_set.series_values[i].series_sample[0].series_instance = (pmSeriesValue *)calloc(n_instances, sizeof(pmSeriesValue));
+	    series_instance_alloc(&np->value_set.series_values[i].series_sample[0], n_instances);
 	    for (k = 0; k < n_instances; k++) {
 		min_pointer = 0;
-		min_data = atof(np->left->value_set.series_values[i].series_sample[0].series_instance[k].data);
+		min_data = np->left->value_set.series_values[i].series_sample[0].values[k];
 		for (j = 1; j < n_samples; j++) {
 		    if (np->left->value_set.series_values[i].series_sample[j].num_instances != n_instances) {
 			if (pmDebugOptions.query && pmDebugOptions.desperate) {
@@ -2934,20 +3148,14 @@ series_calculate_min(node_t *np, void *arg)
 			}
 			continue;
 		    }
-		    data = atof(np->left->value_set.series_values[i].series_sample[j].series_instance[k].data);
+		    data = np->left->value_set.series_values[i].series_sample[j].values[k];
 		    if (min_data > data) {
 			min_data = data;
 			min_pointer = j;
 		    }
 		}
-		np->value_set.series_values[i].series_sample[0].series_instance[k].timestamp = 
-			sdsnew(np->left->value_set.series_values[i].series_sample[min_pointer].series_instance[k].timestamp);
-		np->value_set.series_values[i].series_sample[0].series_instance[k].series = 
-			sdsnew(np->left->value_set.series_values[i].series_sample[min_pointer].series_instance[k].series);
-		np->value_set.series_values[i].series_sample[0].series_instance[k].data = 
-			sdsnew(np->left->value_set.series_values[i].series_sample[min_pointer].series_instance[k].data);
-		np->value_set.series_values[i].series_sample[0].series_instance[k].ts = 
-			np->left->value_set.series_values[i].series_sample[min_pointer].series_instance[k].ts;
+		series_instance_copy(&np->value_set.series_values[i].series_sample[0], k,
+			&np->left->value_set.series_values[i].series_sample[min_pointer], k);
 	    }
 	} else {
 	    np->value_set.series_values[i].num_samples = 0;
@@ -2994,37 +3202,6 @@ series_extract_type(char *typeStr)
     }
 }
 
-static int
-series_extract_value(int type, sds str, pmAtomValue *oval) 
-{
-    int		sts;
-
-    switch (type) {
-    case PM_TYPE_32:
-	sts = sscanf(str, "%d", &oval->l);
-	break;
-    case PM_TYPE_U32:
-	sts = sscanf(str, "%u", &oval->ul);
-	break;
-    case PM_TYPE_64:
-	sts = sscanf(str, "%" PRId64, &oval->ll);
-	break;
-    case PM_TYPE_U64:
-	sts = sscanf(str, "%" PRIu64, &oval->ull);
-	break;
-    case PM_TYPE_FLOAT:
-	sts = sscanf(str, "%f", &oval->f);
-	break;
-    case PM_TYPE_DOUBLE:
-	sts = sscanf(str, "%lf", &oval->d);
-	break;
-    default:
-	sts = 0;
-	break;
-    }
-    return (sts == 1) ? 0 : PM_ERR_CONV;
-}
-
 static int
 series_pmAtomValue_conv_str(int type, char *str, pmAtomValue *val, int max_len)
 {
@@ -3064,7 +3241,8 @@ static void
 series_calculate_rescale(node_t *np, void *arg)
 {
     seriesQueryBaton	*baton = (seriesQueryBaton *)arg;
-    double		mult;
+    series_instance_set_t *set;
+    double		mult, factor;
     pmUnits		iunit;
     char		*errmsg, str_val[256];
     pmAtomValue		ival, oval;
@@ -3097,27 +3275,41 @@ series_calculate_rescale(node_t *np, void *arg)
 	    return;
 	}
 	type = PM_TYPE_DOUBLE;
+	/*
+	 * Conversion of doubles between scales is a multiplication by
+	 * a constant factor, so find it once for the series and apply
+	 * it over each sample's row of instance values in turn.
+	 */
+	ival.d = 1.0;
+	if ((sts = pmConvScale(type, &ival, &iunit, &oval, &np->right->meta.units)) != 0) {
+	    /* TODO: rescale error report */
+	    fprintf(stderr, "rescale error\n");
+	    return;
+	}
+	factor = oval.d;
 	for (j = 0; j < np->value_set.series_values[i].num_samples; j++) {
-	    for (k = 0; k < np->value_set.series_values[i].series_sample[j].num_instances; k++) {
-		if (series_extract_value(type, 
-			np->value_set.series_values[i].series_sample[j].series_instance[k].data, &ival) != 0 ) {
+	    set = &np->value_set.series_values[i].series_sample[j];
+	    for (k = 0; k < set->num_instances; k++) {
+		if (set->decoded[k] == 0) {
 		    /* TODO: error report for extracting values from string fail */
 		    fprintf(stderr, "Extract values from string fail\n");
 		    return;
 		}
-		if ((sts = pmConvScale(type, &ival, &iunit, &oval, &np->right->meta.units)) != 0) {
-		    /* TODO: rescale error report */
-		    fprintf(stderr, "rescale error\n");
-		    return;
-		}
+	    }
+	    for (k = 0; k < set->num_instances; k++)
+		set->values[k] *= factor;
+	    for (k = 0; k < set->num_instances; k++) {
+		oval.d = set->values[k];
 		if ((str_len = series_pmAtomValue_conv_str(type, str_val, &oval, sizeof(str_val))) == 0)
 		    return;
-		sdsfree(np->value_set.series_values[i].series_sample[j].series_instance[k].data);
-		np->value_set.series_values[i].series_sample[j].series_instance[k].data = sdsnewlen(str_val, str_len);
+		sdsfree(set->series_instance[k].data);
+		set->series_instance[k].data = sdsnewlen(str_val, str_len);
+		set->ints[k] = (__int64_t)set->values[k];
 	    }
 	}
 	sdsfree(np->value_set.series_values[i].series_desc.units);
-	np->value_set.series_values[i].series_desc.units = sdsnew(pmUnitsStr(&np->right->meta.units));
+	np->value_set.series_values[i].series_desc.units = sdsnew(
+		pmUnitsStr_r(&np->right->meta.units, str_val, sizeof(str_val)));
     }
 }
 
@@ -3175,8 +3367,7 @@ series_calculate_abs(node_t *np, void *arg)
 	}	
 	for (j = 0; j < np->value_set.series_values[i].num_samples; j++) {
 	    for (k = 0; k < np->value_set.series_values[i].series_sample[j].num_instances; k++) {
-		if (series_extract_value(type, 
-			np->value_set.series_values[i].series_sample[j].series_instance[k].data, &val) != 0 ) {
+		if (series_instance_value(&np->value_set.series_values[i].series_sample[j], k, type, &val) != 0) {
 		    /* TODO: error report for extracting values from string fail */
 		    fprintf(stderr, "Extract values from string fail\n");
 		    return;
@@ -3190,6 +3381,7 @@ series_calculate_abs(node_t *np, void *arg)
 		    return;
 		sdsfree(np->value_set.series_values[i].series_sample[j].series_instance[k].data);
 		np->value_set.series_values[i].series_sample[j].series_instance[k].data = sdsnewlen(str_val, str_len);
+		series_instance_set_atom(&np->value_set.series_values[i].series_sample[j], k, type, &val);
 	    }
 	}
     }
@@ -3204,7 +3396,6 @@ series_calculate_time_domain_topk(node_t *np, void *arg)
     seriesQueryBaton	*baton = (seriesQueryBaton *)arg;
     unsigned int	n_series, n_samples, n_instances, i, j, k, l;
     sds			msg;
-    pmSeriesValue	inst;
     int			n, ind;
     double		data;
     double		*topk_data;
@@ -3228,7 +3419,7 @@ series_calculate_time_domain_topk(node_t *np, void *arg)
 		topk_data = (double*) calloc(n, sizeof(double));
 		topk_pointer = (int*) calloc(n, sizeof(int));
 		np->value_set.series_values[i].series_sample[j].num_instances = n;
-		np->value_set.series_values[i].series_sample[j].series_instance = (pmSeriesValue *)calloc(n, sizeof(pmSeriesValue));
+		series_instance_alloc(&np->value_set.series_values[i].series_sample[j], n);
 
 		for (k = 0; k < n_instances; k++){
 		    if (np->left->value_set.series_values[i].series_sample[j].num_instances != n_instances) {
@@ -3238,7 +3429,7 @@ series_calculate_time_domain_topk(node_t *np, void *arg)
 			}
 		    continue;
 		    }                
-		    data = strtod(np->left->value_set.series_values[i].series_sample[j].series_instance[k].data, NULL);
+		    data = np->left->value_set.series_values[i].series_sample[j].values[k];
 		    if (data > topk_data[n-1]){
 			for (l = 0; l < n; ++l){
 			    if (data > topk_data[l]){
@@ -3255,13 +3446,9 @@ series_calculate_time_domain_topk(node_t *np, void *arg)
 		    }
 		}
 
-		for (l = 0; l < n; ++l){
-		    inst = np->left->value_set.series_values[i].series_sample[j].series_instance[topk_pointer[l]];
-		    np->value_set.series_values[i].series_sample[j].series_instance[l].timestamp = sdsnew(inst.timestamp);
-		    np->value_set.series_values[i].series_sample[j].series_instance[l].series = sdsnew(inst.series);
-		    np->value_set.series_values[i].series_sample[j].series_instance[l].data = sdsnew(inst.data);
-		    np->value_set.series_values[i].series_sample[j].series_instance[l].ts = inst.ts;       
-		}
+		for (l = 0; l < n; ++l)
+		    series_instance_copy(&np->value_set.series_values[i].series_sample[j], l,
+			    &np->left->value_set.series_values[i].series_sample[j], topk_pointer[l]);
 		free(topk_data);
 		free(topk_pointer);
 	    }
@@ -3294,7 +3481,6 @@ series_calculate_topk(node_t *np, void *arg)
     double		*topk_data;
     int			*topk_pointer;
     sds			msg;
-    pmSeriesValue	inst;
 
     n_series = np->left->value_set.num_series;
     np->value_set.num_series = n_series;
@@ -3313,7 +3499,7 @@ series_calculate_topk(node_t *np, void *arg)
 	    topk_pointer = (int*) calloc(n, sizeof(int));
 	    for (j = 0; j < n_instances; j++){
 		np->value_set.series_values[i].series_sample[j].num_instances = n;
-		np->value_set.series_values[i].series_sample[j].series_instance = (pmSeriesValue *)calloc(n, sizeof(pmSeriesValue));
+		series_instance_alloc(&np->value_set.series_values[i].series_sample[j], n);
 	    }
 	    for (k = 0; k < n_instances; k++) {
 		memset(topk_data, 0, sizeof(*topk_data));
@@ -3325,7 +3511,7 @@ series_calculate_topk(node_t *np, void *arg)
 			}
 			continue;
 		    }
-		    data = atof(np->left->value_set.series_values[i].series_sample[j].series_instance[k].data);
+		    data = np->left->value_set.series_values[i].series_sample[j].values[k];
 		    if (data > topk_data[n-1]){
 			for (l = 0; l < n; ++l){
 			    if (data > topk_data[l]){
@@ -3341,13 +3527,9 @@ series_calculate_topk(node_t *np, void *arg)
 			}
 		    }
 		}		
-		for (l = 0; l < n; ++l){
-		    inst = np->left->value_set.series_values[i].series_sample[topk_pointer[l]].series_instance[k];
-		    np->value_set.series_values[i].series_sample[k].series_instance[l].timestamp = sdsnew(inst.timestamp);
-		    np->value_set.series_values[i].series_sample[k].series_instance[l].series = sdsnew(inst.series);
-		    np->value_set.series_values[i].series_sample[k].series_instance[l].data = sdsnew(inst.data);
-		    np->value_set.series_values[i].series_sample[k].series_instance[l].ts = inst.ts;
-		}
+		for (l = 0; l < n; ++l)
+		    series_instance_copy(&np->value_set.series_values[i].series_sample[k], l,
+			    &np->left->value_set.series_values[i].series_sample[topk_pointer[l]], k);
 	    }
 	    free(topk_data);
 	    free(topk_pointer);
@@ -3376,8 +3558,8 @@ series_calculate_time_domain_standard_deviation(node_t *np, void *arg)
     unsigned int	n_series, n_samples, n_instances, i, j, k;
     double		sum_data, mean, sd, data;
     sds			msg;
-    pmSeriesValue	inst;
     char		stdev[64];
+    pmSeriesValue	inst;
 
     n_series = np->left->value_set.num_series;
     np->value_set.num_series = n_series;
@@ -3391,7 +3573,7 @@ series_calculate_time_domain_standard_deviation(node_t *np, void *arg)
 
 	    for (j = 0; j < n_samples; j++) {
 		np->value_set.series_values[i].series_sample[j].num_instances = 1;
-		np->value_set.series_values[i].series_sample[j].series_instance = (pmSeriesValue *)calloc(1, sizeof(pmSeriesValue));
+		series_instance_alloc(&np->value_set.series_values[i].series_sample[j], 1);
 		sum_data = 0.0;
 		for (k = 0; k < n_instances; k++) {
 		    if (np->left->value_set.series_values[i].series_sample[j].num_instances != n_instances) {
@@ -3401,23 +3583,25 @@ series_calculate_time_domain_standard_deviation(node_t *np, void *arg)
 			}
 		    continue;
 		    }
-		    data = strtod(np->left->value_set.series_values[i].series_sample[j].series_instance[k].data, NULL);
+		    data = np->left->value_set.series_values[i].series_sample[j].values[k];
 		    sum_data += data;
 		}
 
 		mean = sum_data/n_instances;
 		sd = 0.0;
 		for (k = 0; k < n_instances; k++) {
-		    data = strtod(np->left->value_set.series_values[i].series_sample[j].series_instance[k].data, NULL);
+		    data = np->left->value_set.series_values[i].series_sample[j].values[k];
 		    sd += pow(data - mean, 2);
 		}
 
-		pmsprintf(stdev, sizeof(stdev), "%le", sqrt(sd / n_instances));
+		sd = sqrt(sd / n_instances);
+		pmsprintf(stdev, sizeof(stdev), "%le", sd);
 		inst = np->left->value_set.series_values[i].series_sample[j].series_instance[0];
 		np->value_set.series_values[i].series_sample[j].series_instance[0].timestamp = sdsnew(inst.timestamp);
 		np->value_set.series_values[i].series_sample[j].series_instance[0].series = sdsnew(0);
 		np->value_set.series_values[i].series_sample[j].series_instance[0].data = sdsnew(stdev);
 		np->value_set.series_values[i].series_sample[j].series_instance[0].ts = inst.ts;
+		series_instance_set_double(&np->value_set.series_values[i].series_sample[j], 0, sd);
 	    }
 	} else {
 	    np->value_set.series_values[i].num_samples = 0;
@@ -3457,7 +3641,7 @@ series_calculate_standard_deviation(node_t *np, void *arg)
 	    np->value_set.series_values[i].series_sample = (series_instance_set_t *)calloc(1, sizeof(series_instance_set_t));
 	    n_instances = np->left->value_set.series_values[i].series_sample[0].num_instances;
 	    np->value_set.series_values[i].series_sample[0].num_instances = n_instances;
-	    np->value_set.series_values[i].series_sample[0].series_instance = (pmSeriesValue *)calloc(n_instances, sizeof(pmSeriesValue));
+	    series_instance_alloc(&np->value_set.series_values[i].series_sample[0], n_instances);
 	    for (k = 0; k < n_instances; k++) {
 		sum_data = 0.0;
 		for (j = 0; j < n_samples; j++) {
@@ -3468,21 +3652,23 @@ series_calculate_standard_deviation(node_t *np, void *arg)
 			}
 			continue;
 		    }
-		    data = strtod(np->left->value_set.series_values[i].series_sample[j].series_instance[k].data, NULL);
+		    data = np->left->value_set.series_values[i].series_sample[j].values[k];
 		    sum_data += data;
 		}
 		mean = sum_data/n_samples;
 		sd = 0.0;
 		for (j = 0; j < n_samples; j++) {
-		    data = strtod(np->left->value_set.series_values[i].series_sample[j].series_instance[k].data, NULL);
+		    data = np->left->value_set.series_values[i].series_sample[j].values[k];
 		    sd += pow(data - mean, 2);
 		}
-		pmsprintf(stdev, sizeof(stdev), "%le", sqrt(sd / n_samples));
+		sd = sqrt(sd / n_samples);
+		pmsprintf(stdev, sizeof(stdev), "%le", sd);
 		inst = np->left->value_set.series_values[i].series_sample[0].series_instance[k];
 		np->value_set.series_values[i].series_sample[0].series_instance[k].timestamp = sdsnew(inst.timestamp);
 		np->value_set.series_values[i].series_sample[0].series_instance[k].series = sdsnew(inst.series);
 		np->value_set.series_values[i].series_sample[0].series_instance[k].data = sdsnew(stdev);
 		np->value_set.series_values[i].series_sample[0].series_instance[k].ts = inst.ts;
+		series_instance_set_double(&np->value_set.series_values[i].series_sample[0], k, sd);
 	    }
 	} else {
 	    np->value_set.series_values[i].num_samples = 0;
@@ -3510,7 +3696,6 @@ series_calculate_time_domain_nth_percentile(node_t *np, void *arg)
     int			n, instance_idx, rank, *n_pointer;
     double              *n_data, data, rank_d;
     sds			msg;
-    pmSeriesValue       inst;
 
     sscanf(np->right->value, "%d", &n);
     n_series = np->left->value_set.num_series;
@@ -3526,7 +3711,7 @@ series_calculate_time_domain_nth_percentile(node_t *np, void *arg)
 	    rank = (int) rank_d;
 	    for (j = 0; j < n_samples; j++) {
 		np->value_set.series_values[i].series_sample[j].num_instances = 1;
-		np->value_set.series_values[i].series_sample[j].series_instance = (pmSeriesValue *)calloc(1, sizeof(pmSeriesValue));
+		series_instance_alloc(&np->value_set.series_values[i].series_sample[j], 1);
 		n_data = (double*) calloc(n_instances, sizeof(double));
 		n_pointer = (int*) calloc(n_instances, sizeof(int)); 
 
@@ -3538,7 +3723,7 @@ series_calculate_time_domain_nth_percentile(node_t *np, void *arg)
 			}
 			continue;
 		    }
-		    data = strtod(np->left->value_set.series_values[i].series_sample[j].series_instance[k].data, NULL);
+		    data = np->left->value_set.series_values[i].series_sample[j].values[k];
 		    for (l = 0; l < n_instances; ++l){
 			if (data > n_data[l]){
 			    for (m = n_instances - 1; m > l; --m){
@@ -3557,11 +3742,8 @@ series_calculate_time_domain_nth_percentile(node_t *np, void *arg)
 		} else {
 		    instance_idx = n_pointer[n_instances-1-rank];
 		}
-		inst = np->left->value_set.series_values[i].series_sample[j].series_instance[instance_idx];
-		np->value_set.series_values[i].series_sample[j].series_instance[0].timestamp = sdsnew(inst.timestamp);
-		np->value_set.series_values[i].series_sample[j].series_instance[0].series = sdsnew(inst.series);
-		np->value_set.series_values[i].series_sample[j].series_instance[0].data = sdsnew(inst.data);
-		np->value_set.series_values[i].series_sample[j].series_instance[0].ts = inst.ts;
+		series_instance_copy(&np->value_set.series_values[i].series_sample[j], 0,
+			&np->left->value_set.series_values[i].series_sample[j], instance_idx);
 		free(n_data);
 		free(n_pointer);
 	    }
@@ -3591,7 +3773,6 @@ series_calculate_nth_percentile(node_t *np, void *arg)
     int			n, instance_idx, rank, *n_pointer;
     double              *n_data, data, rank_d;
     sds			msg;
-    pmSeriesValue       inst;
 
     sscanf(np->right->value, "%d", &n);
 
@@ -3605,7 +3786,7 @@ series_calculate_nth_percentile(node_t *np, void *arg)
 	    np->value_set.series_values[i].series_sample = (series_instance_set_t *)calloc(1, sizeof(series_instance_set_t));
 	    n_instances = np->left->value_set.series_values[i].series_sample[0].num_instances;
 	    np->value_set.series_values[i].series_sample[0].num_instances = n_instances;
-	    np->value_set.series_values[i].series_sample[0].series_instance = (pmSeriesValue *)calloc(n_instances, sizeof(pmSeriesValue));
+	    series_instance_alloc(&np->value_set.series_values[i].series_sample[0], n_instances);
 	    rank_d = ((double)n/100 * n_samples);
 	    rank = (int) rank_d;
 	    for (k = 0; k < n_instances; k++) {
@@ -3620,7 +3801,7 @@ series_calculate_nth_percentile(node_t *np, void *arg)
 			}
 			continue;
 		    }
-		    data = atof(np->left->value_set.series_values[i].series_sample[j].series_instance[k].data);
+		    data = np->left->value_set.series_values[i].series_sample[j].values[k];
 		    for (l = 0; l < n_samples; ++l){
 			if (data > n_data[l]) {
 			    for (m = n_samples - 1; m > l; --m){
@@ -3638,11 +3819,8 @@ series_calculate_nth_percentile(node_t *np, void *arg)
 		} else {
 		    instance_idx = n_pointer[n_samples-1-rank];
 		}
-		inst = np->left->value_set.series_values[i].series_sample[instance_idx].series_instance[k];
-		np->value_set.series_values[i].series_sample[0].series_instance[k].timestamp = sdsnew(inst.timestamp);
-		np->value_set.series_values[i].series_sample[0].series_instance[k].series = sdsnew(inst.series);
-		np->value_set.series_values[i].series_sample[0].series_instance[k].data = sdsnew(inst.data);
-		np->value_set.series_values[i].series_sample[0].series_instance[k].ts = inst.ts;
+		series_instance_copy(&np->value_set.series_values[i].series_sample[0], k,
+			&np->left->value_set.series_values[i].series_sample[instance_idx], k);
 		free(n_data);
 		free(n_pointer);
 	    }
@@ -3687,7 +3865,7 @@ series_calculate_time_domain_statistical(node_t *np, void *arg)
 	    n_instances = np->left->value_set.series_values[i].series_sample[0].num_instances;
 	    for (j = 0; j < n_samples; j++) {
 		np->value_set.series_values[i].series_sample[j].num_instances = 1;
-		np->value_set.series_values[i].series_sample[j].series_instance = (pmSeriesValue *)calloc(1, sizeof(pmSeriesValue));
+		series_instance_alloc(&np->value_set.series_values[i].series_sample[j], 1);
 		
 		sum_data = 0.0;
 		for (k = 0; k < n_instances; k++) {
@@ -3698,7 +3876,7 @@ series_calculate_time_domain_statistical(node_t *np, void *arg)
 			}
 			continue;
 		    }
-		    data = strtod(np->left->value_set.series_values[i].series_sample[j].series_instance[k].data, NULL);
+		    data = np->left->value_set.series_values[i].series_sample[j].values[k];
 		    sum_data += data;
 		}
 		np->value_set.series_values[i].series_sample[j].series_instance[0].timestamp = 
@@ -3710,7 +3888,8 @@ series_calculate_time_domain_statistical(node_t *np, void *arg)
 		    pmsprintf(sum_data_str, sizeof(sum_data_str), "%le", sum_data);
 		    break;
 		case N_AVG_SAMPLE:
-		    pmsprintf(sum_data_str, sizeof(sum_data_str), "%le", sum_data / n_instances);
+		    sum_data /= n_instances;
+		    pmsprintf(sum_data_str, sizeof(sum_data_str), "%le", sum_data);
 		    break;
 		default:
 		    /* .. TODO: standard deviation, variance, mode, median, etc */
@@ -3720,6 +3899,7 @@ series_calculate_time_domain_statistical(node_t *np, void *arg)
 		}
 
 		np->value_set.series_values[i].series_sample[j].series_instance[0].data = sdsnew(sum_data_str);
+		series_instance_set_double(&np->value_set.series_values[i].series_sample[j], 0, sum_data);
 		np->value_set.series_values[i].series_sample[j].series_instance[0].ts = 
 		np->left->value_set.series_values[i].series_sample[j].series_instance[0].ts;
 	    }
@@ -3768,7 +3948,7 @@ series_calculate_statistical(node_t *np, void *arg)
 	    np->value_set.series_values[i].series_sample = (series_instance_set_t *)calloc(1, sizeof(series_instance_set_t));
 	    n_instances = np->left->value_set.series_values[i].series_sample[0].num_instances;
 	    np->value_set.series_values[i].series_sample[0].num_instances = n_instances;
-	    np->value_set.series_values[i].series_sample[0].series_instance = (pmSeriesValue *)calloc(n_instances, sizeof(pmSeriesValue));
+	    series_instance_alloc(&np->value_set.series_values[i].series_sample[0], n_instances);
 	    for (k = 0; k < n_instances; k++) {
 		sum_data = 0.0;
 		for (j = 0; j < n_samples; j++) {
@@ -3779,7 +3959,7 @@ series_calculate_statistical(node_t *np, void *arg)
 			}
 			continue;
 		    }
-		    data = strtod(np->left->value_set.series_values[i].series_sample[j].series_instance[k].data, NULL);
+		    data = np->left->value_set.series_values[i].series_sample[j].values[k];
 		    sum_data += data;
 		}
 		np->value_set.series_values[i].series_sample[0].series_instance[k].timestamp = 
@@ -3793,7 +3973,8 @@ series_calculate_statistical(node_t *np, void *arg)
 		    break;
 		case N_AVG:
 		case N_AVG_INST:
-		    pmsprintf(sum_data_str, sizeof(sum_data_str), "%le", sum_data / n_samples);
+		    sum_data /= n_samples;
+		    pmsprintf(sum_data_str, sizeof(sum_data_str), "%le", sum_data);
 		    break;
 		default:
 		    /* .. TODO: standard deviation, variance, mode, median, etc */
@@ -3803,6 +3984,7 @@ series_calculate_statistical(node_t *np, void *arg)
 		}
 
 		np->value_set.series_values[i].series_sample[0].series_instance[k].data = sdsnew(sum_data_str);
+		series_instance_set_double(&np->value_set.series_values[i].series_sample[0], k, sum_data);
 		np->value_set.series_values[i].series_sample[0].series_instance[k].ts = 
 			np->left->value_set.series_values[i].series_sample[0].series_instance[k].ts;
 	    }
@@ -3874,8 +4056,7 @@ series_calculate_floor(node_t *np, void *arg)
 	}	
 	for (j = 0; j < np->value_set.series_values[i].num_samples; j++) {
 	    for (k = 0; k < np->value_set.series_values[i].series_sample[j].num_instances; k++) {
-		if (series_extract_value(type, 
-			np->value_set.series_values[i].series_sample[j].series_instance[k].data, &val) != 0 ) {
+		if (series_instance_value(&np->value_set.series_values[i].series_sample[j], k, type, &val) != 0) {
 		    /* TODO: error report for extracting values from string fail */
 		    fprintf(stderr, "Extract values from string fail\n");
 		    return;
@@ -3889,6 +4070,7 @@ series_calculate_floor(node_t *np, void *arg)
 		    return;
 		sdsfree(np->value_set.series_values[i].series_sample[j].series_instance[k].data);
 		np->value_set.series_values[i].series_sample[j].series_instance[k].data = sdsnewlen(str_val, str_len);
+		series_instance_set_atom(&np->value_set.series_values[i].series_sample[j], k, type, &val);
 	    }
 	}
     }
@@ -3968,8 +4150,7 @@ series_calculate_log(node_t *np, void *arg)
 	}
 	for (j = 0; j < np->value_set.series_values[i].num_samples; j++) {
 	    for (k = 0; k < np->value_set.series_values[i].series_sample[j].num_instances; k++) {
-		if (series_extract_value(itype, 
-			np->value_set.series_values[i].series_sample[j].series_instance[k].data, &val) != 0 ) {
+		if (series_instance_value(&np->value_set.series_values[i].series_sample[j], k, itype, &val) != 0) {
 		    /* TODO: error report for extracting values from string fail */
 		    fprintf(stderr, "Extract values from string fail\n");
 		    return;
@@ -3983,6 +4164,7 @@ series_calculate_log(node_t *np, void *arg)
 		    return;
 		sdsfree(np->value_set.series_values[i].series_sample[j].series_instance[k].data);
 		np->value_set.series_values[i].series_sample[j].series_instance[k].data = sdsnewlen(str_val, str_len);
+		series_instance_set_atom(&np->value_set.series_values[i].series_sample[j], k, otype, &val);
 	    }
 	}
 	sdsfree(np->value_set.series_values[i].series_desc.type);
@@ -4054,8 +4236,7 @@ series_calculate_sqrt(node_t *np, void *arg)
 	}	
 	for (j = 0; j < np->value_set.series_values[i].num_samples; j++) {
 	    for (k = 0; k < np->value_set.series_values[i].series_sample[j].num_instances; k++) {
-		if (series_extract_value(itype, 
-			np->value_set.series_values[i].series_sample[j].series_instance[k].data, &val) != 0 ) {
+		if (series_instance_value(&np->value_set.series_values[i].series_sample[j], k, itype, &val) != 0) {
 		    /* TODO: error report for extracting values from string fail */
 		    fprintf(stderr, "Extract values from string fail\n");
 		    return;
@@ -4069,6 +4250,7 @@ series_calculate_sqrt(node_t *np, void *arg)
 		    return;
 		sdsfree(np->value_set.series_values[i].series_sample[j].series_instance[k].data);
 		np->value_set.series_values[i].series_sample[j].series_instance[k].data = sdsnewlen(str_val, str_len);
+		series_instance_set_atom(&np->value_set.series_values[i].series_sample[j], k, otype, &val);
 	    }
 	}
 	sdsfree(np->value_set.series_values[i].series_desc.type);
@@ -4122,8 +4304,7 @@ series_calculate_round(node_t *np, void *arg)
 	}
 	for (j = 0; j < np->value_set.series_values[i].num_samples; j++) {
 	    for (k = 0; k < np->value_set.series_values[i].series_sample[j].num_instances; k++) {
-		if (series_extract_value(type, 
-			np->value_set.series_values[i].series_sample[j].series_instance[k].data, &val) != 0 ) {
+		if (series_instance_value(&np->value_set.series_values[i].series_sample[j], k, type, &val) != 0) {
 		    /* TODO: error report for extracting values from string fail */
 		    fprintf(stderr, "Extract values from string fail\n");
 		    return;
@@ -4137,6 +4318,7 @@ series_calculate_round(node_t *np, void *arg)
 		    return;
 		sdsfree(np->value_set.series_values[i].series_sample[j].series_instance[k].data);
 		np->value_set.series_values[i].series_sample[j].series_instance[k].data = sdsnewlen(str_val, str_len);
+		series_instance_set_atom(&np->value_set.series_values[i].series_sample[j], k, type, &val);
 	    }
 	}
 	
@@ -4359,12 +4541,15 @@ calculate_minus(int *type, pmAtomValue *l_val, pmAtomValue *r_val, pmAtomValue *
 int
 calculate_star(int *type, pmAtomValue *l_val, pmAtomValue *r_val, pmAtomValue *res)
 {
+    __int64_t	ll;
+
     switch (*type) {
     case PM_TYPE_32:
-	if (l_val->l != 0 && res->l / l_val->l != r_val->l) {
+	ll = (__int64_t)l_val->l * r_val->l;
+	if (ll < INT32_MIN || ll > INT32_MAX) {
 	    return -1;
 	}
-	res->l = l_val->l * r_val->l;
+	res->l = (__int32_t)ll;
 	break;
     case PM_TYPE_U32:
 	if (r_val->ul != 0 && l_val->ul > UINT32_MAX / r_val->ul) {
@@ -4373,10 +4558,13 @@ calculate_star(int *type, pmAtomValue *l_val, pmAtomValue *r_val, pmAtomValue *r
 	res->ul = l_val->ul * r_val->ul;
 	break;
     case PM_TYPE_64:
+	if (l_val->ll == -1 && r_val->ll == INT64_MIN) {
+	    return -1;
+	}
+	res->ll = (__uint64_t)l_val->ll * (__uint64_t)r_val->ll;
 	if (l_val->ll != 0 && res->ll / l_val->ll != r_val->ll) {
 	    return -1;
 	}
-	res->ll = l_val->ll * r_val->ll;
 	break;
     case PM_TYPE_U64:
 	if (r_val->ull != 0 && l_val->ull > UINT64_MAX / r_val->ull) {
@@ -4424,36 +4612,57 @@ calculate_slash(int *type, pmAtomValue *l_val, pmAtomValue *r_val, pmAtomValue *
     return 0;
 }
 
+static int
+series_binary_type(int ope_type, int l_type, int r_type)
+{
+    if (l_type == PM_TYPE_DOUBLE || r_type == PM_TYPE_DOUBLE)
+	return PM_TYPE_DOUBLE;
+    if (ope_type == N_SLASH)
+	return PM_TYPE_DOUBLE;
+    if (l_type == PM_TYPE_FLOAT || r_type == PM_TYPE_FLOAT)
+	return PM_TYPE_FLOAT;
+    if (l_type == PM_TYPE_U64 || r_type == PM_TYPE_U64)
+	return PM_TYPE_U64;
+    if (l_type == PM_TYPE_64 || r_type == PM_TYPE_64)
+	return PM_TYPE_64;
+    if (l_type == PM_TYPE_U32 || r_type == PM_TYPE_U32)
+	return PM_TYPE_U32;
+    return PM_TYPE_32;	/* both are PM_TYPE_32 */
+}
+
+static void
+series_binary_result(series_instance_set_t *l_set, int k, int sts, int otype, pmAtomValue *res)
+{
+    pmSeriesValue	*l_data = &l_set->series_instance[k];
+    int			str_len;
+    char		str_val[256];
+
+    sdsfree(l_data->data);
+    if (sts != 0) {
+	l_data->data = sdsnew("no value"); /* TODO - error handling */
+	series_instance_set_invalid(l_set, k);
+    } else {
+	str_len = series_pmAtomValue_conv_str(otype, str_val, res, sizeof(str_val));
+	l_data->data = sdsnewlen(str_val, str_len);
+	series_instance_set_atom(l_set, k, otype, res);
+    }
+}
+
 static void
 series_calculate_order_binary(int ope_type, int l_type, int r_type, int *otype,
 	pmAtomValue *l_val, pmAtomValue *r_val,
-	pmSeriesValue *l_data, pmSeriesValue *r_data,
+	series_instance_set_t *l_set, series_instance_set_t *r_set, int k,
 	pmUnits *l_units, pmUnits *r_units, pmUnits *large_units,
 	int (*operator)(int*, pmAtomValue*, pmAtomValue*, pmAtomValue*))
 {
     pmAtomValue		res;
-    int			str_len;
-    char		str_val[256];
+    int			sts;
 
-    if (l_type == PM_TYPE_DOUBLE || r_type == PM_TYPE_DOUBLE) {
-	*otype = PM_TYPE_DOUBLE;
-    } else if (ope_type == N_SLASH) {
-	*otype = PM_TYPE_DOUBLE;
-    } else if (l_type == PM_TYPE_FLOAT || r_type == PM_TYPE_FLOAT) {
-	*otype = PM_TYPE_FLOAT;
-    } else if (l_type == PM_TYPE_U64 || r_type == PM_TYPE_U64) {
-	*otype = PM_TYPE_U64;
-    } else if (l_type == PM_TYPE_64 || r_type == PM_TYPE_64) {
-	*otype = PM_TYPE_64;
-    } else if (l_type == PM_TYPE_U32 || r_type == PM_TYPE_U32) {
-	*otype = PM_TYPE_U32;
-    } else { /* both are PM_TYPE_32 */
-	*otype = PM_TYPE_32;
-    }
+    *otype = series_binary_type(ope_type, l_type, r_type);
 
     /* Extract series values */
-    series_extract_value(*otype, r_data->data, r_val);
-    series_extract_value(*otype, l_data->data, l_val);
+    series_instance_value(r_set, k, *otype, r_val);
+    series_instance_value(l_set, k, *otype, l_val);
 
     /* Convert scale to larger one */
     if (pmConvScale(*otype, l_val, l_units, l_val, large_units) < 0)
@@ -4461,14 +4670,113 @@ series_calculate_order_binary(int ope_type, int l_type, int r_type, int *otype,
     if (pmConvScale(*otype, r_val, r_units, r_val, large_units) < 0)
     	memset(large_units, 0, sizeof(*large_units));
 
-    if ((*operator)(otype, l_val, r_val, &res) != 0) {
-	sdsfree(l_data->data);
-	l_data->data = sdsnew("no value"); /* TODO - error handling */
+    sts = (*operator)(otype, l_val, r_val, &res);
+    series_binary_result(l_set, k, sts, *otype, &res);
+}
+
+/*
+ * Apply a binary operator to all instances of one sample at once -
+ * fetch both rows of operands, scale them, then run the operator
+ * over the whole row with the result type selected only once (the
+ * floating point operators cannot fail, so these are simple loops)
+ * and finally encode the results back into the left hand operand.
+ */
+static void
+series_calculate_binary_row(int ope_type, int l_type, int r_type, int *otype,
+	unsigned int count, series_instance_set_t *l_set, series_instance_set_t *r_set,
+	pmUnits *l_units, pmUnits *r_units, pmUnits *large_units,
+	int (*operator)(int*, pmAtomValue*, pmAtomValue*, pmAtomValue*))
+{
+    pmAtomValue		*l_val, *r_val, *res, l_one, r_one;
+    unsigned int	k;
+    int			*sts;
+
+    if (count == 0)
+	return;
+
+    l_val = (pmAtomValue *)calloc(3 * count, sizeof(pmAtomValue));
+    sts = (int *)calloc(count, sizeof(int));
+    if (l_val == NULL || sts == NULL) {
+	free(l_val);
+	free(sts);
+	for (k = 0; k < count; k++)
+	    series_calculate_order_binary(ope_type, l_type, r_type, otype,
+			&l_one, &r_one, l_set, r_set, k,
+			l_units, r_units, large_units, operator);
+	return;
+    }
+    r_val = l_val + count;
+    res = r_val + count;
+
+    *otype = series_binary_type(ope_type, l_type, r_type);
+
+    for (k = 0; k < count; k++) {
+	/* an unparsable value retains the preceding operand, as before */
+	if (series_instance_value(r_set, k, *otype, &r_val[k]) != 0 && k > 0)
+	    r_val[k] = r_val[k-1];
+	if (series_instance_value(l_set, k, *otype, &l_val[k]) != 0 && k > 0)
+	    l_val[k] = l_val[k-1];
+
+	/* Convert scale to larger one */
+	if (pmConvScale(*otype, &l_val[k], l_units, &l_val[k], large_units) < 0)
+	    memset(large_units, 0, sizeof(*large_units));
+	if (pmConvScale(*otype, &r_val[k], r_units, &r_val[k], large_units) < 0)
+	    memset(large_units, 0, sizeof(*large_units));
+    }
+
+    if (*otype == PM_TYPE_DOUBLE) {
+	switch (ope_type) {
+	case N_PLUS:
+	    for (k = 0; k < count; k++)
+		res[k].d = l_val[k].d + r_val[k].d;
+	    break;
+	case N_MINUS:
+	    for (k = 0; k < count; k++)
+		res[k].d = l_val[k].d - r_val[k].d;
+	    break;
+	case N_STAR:
+	    for (k = 0; k < count; k++)
+		res[k].d = l_val[k].d * r_val[k].d;
+	    break;
+	case N_SLASH:
+	    for (k = 0; k < count; k++)
+		res[k].d = l_val[k].d / r_val[k].d;
+	    break;
+	default:
+	    for (k = 0; k < count; k++)
+		sts[k] = (*operator)(otype, &l_val[k], &r_val[k], &res[k]);
+	    break;
+	}
+    } else if (*otype == PM_TYPE_FLOAT) {
+	switch (ope_type) {
+	case N_PLUS:
+	    for (k = 0; k < count; k++)
+		res[k].f = l_val[k].f + r_val[k].f;
+	    break;
+	case N_MINUS:
+	    for (k = 0; k < count; k++)
+		res[k].f = l_val[k].f - r_val[k].f;
+	    break;
+	case N_STAR:
+	    for (k = 0; k < count; k++)
+		res[k].f = l_val[k].f * r_val[k].f;
+	    break;
+	default:
+	    for (k = 0; k < count; k++)
+		sts[k] = (*operator)(otype, &l_val[k], &r_val[k], &res[k]);
+	    break;
+	}
     } else {
-	sdsfree(l_data->data);
-	str_len = series_pmAtomValue_conv_str(*otype, str_val, &res, sizeof(str_val));
-	l_data->data = sdsnewlen(str_val, str_len);
+	/* integer arithmetic checks each operation for overflow */
+	for (k = 0; k < count; k++)
+	    sts[k] = (*operator)(otype, &l_val[k], &r_val[k], &res[k]);
     }
+
+    for (k = 0; k < count; k++)
+	series_binary_result(l_set, k, sts[k], *otype, &res[k]);
+
+    free(l_val);
+    free(sts);
 }
 
 static void
@@ -4512,9 +4820,8 @@ series_calculate_plus(node_t *np, void *arg)
     seriesQueryBaton	*baton = (seriesQueryBaton *)arg;
     node_t		*left = np->left, *right = np->right;
     int			l_type, r_type, otype=PM_TYPE_UNKNOWN;
-    int			l_sem, r_sem, j, k;
+    int			l_sem, r_sem, j;
     unsigned int	num_samples, num_instances;
-    pmAtomValue		l_val, r_val;
     pmUnits		l_units = {0}, r_units = {0}, large_units = {0};
     sds			msg;
 
@@ -4538,13 +4845,10 @@ series_calculate_plus(node_t *np, void *arg)
 	    baton->error = -EPROTO;
 	    return;
 	}
-	for (k = 0; k < num_instances; k++) {
-	    series_calculate_order_binary(N_PLUS, l_type, r_type, &otype, 
-		&l_val, &r_val, 
-		left->value_set.series_values[0].series_sample[j].series_instance + k,
-		right->value_set.series_values[0].series_sample[j].series_instance + k,
+	series_calculate_binary_row(N_PLUS, l_type, r_type, &otype, num_instances,
+		&left->value_set.series_values[0].series_sample[j],
+		&right->value_set.series_values[0].series_sample[j],
 		&l_units, &r_units, &large_units, calculate_plus);
-	}
     }
     /*
      * For addition and subtraction all dimensions for
@@ -4563,8 +4867,7 @@ series_calculate_minus(node_t *np, void *arg)
 {
     seriesQueryBaton	*baton = (seriesQueryBaton *)arg;
     node_t		*left = np->left, *right = np->right;
-    unsigned int	num_samples, num_instances, j, k;
-    pmAtomValue		l_val, r_val;
+    unsigned int	num_samples, num_instances, j;
     pmUnits		l_units = {0}, r_units = {0}, large_units = {0};
     int			l_type, r_type, otype=PM_TYPE_UNKNOWN;
     int			l_sem, r_sem;
@@ -4590,13 +4893,10 @@ series_calculate_minus(node_t *np, void *arg)
 	    baton->error = -EPROTO;
 	    return;
 	}
-	for (k = 0; k < num_instances; k++) {
-	    series_calculate_order_binary(N_MINUS, l_type, r_type, &otype, 
-		&l_val, &r_val, 
-		left->value_set.series_values[0].series_sample[j].series_instance + k,
-		right->value_set.series_values[0].series_sample[j].series_instance + k,
+	series_calculate_binary_row(N_MINUS, l_type, r_type, &otype, num_instances,
+		&left->value_set.series_values[0].series_sample[j],
+		&right->value_set.series_values[0].series_sample[j],
 		&l_units, &r_units, &large_units, calculate_minus);
-	}
     }
     /*
      * For addition and subtraction all dimensions for each of
@@ -4613,10 +4913,10 @@ series_calculate_minus(node_t *np, void *arg)
 static void
 series_calculate_star(node_t *np, void *arg)
 {
-    seriesQueryBaton	*baton = (seriesQueryBaton *)np->baton;
+    seriesQueryBaton	*baton = (seriesQueryBaton *)arg;
     node_t		*left = np->left, *right = np->right, *node;
+    series_instance_set_t *set;
     unsigned int	n_series, num_samples, num_instances, i, j, k;
-    pmAtomValue		l_val, r_val;
     pmUnits		l_units = {0}, r_units = {0}, large_units = {0};
     int			l_type, r_type, otype=PM_TYPE_UNKNOWN;
     int			l_sem, r_sem, int_operand, is_int;
@@ -4651,16 +4951,20 @@ series_calculate_star(node_t *np, void *arg)
 	    for (j = 0; j < num_samples; j++) {
 	    	num_instances = node->value_set.series_values[i].series_sample[j].num_instances;
 	    	for (k = 0; k < num_instances; k++) {
-		    data = atof(node->value_set.series_values[i].series_sample[j].series_instance[k].data);
+		    set = &node->value_set.series_values[i].series_sample[j];
 		    if (node->type == N_INTEGER && is_int) {
-			pmsprintf(new_data, sizeof(new_data), "%d", atoi(node->value_set.series_values[i].series_sample[j].series_instance[k].data) * int_operand);
+			data = (int)set->ints[k] * int_operand;
+			pmsprintf(new_data, sizeof(new_data), "%d", (int)data);
 		    } else if (is_int) {
-			pmsprintf(new_data, sizeof(new_data), "%le", data * int_operand);
+			data = set->values[k] * int_operand;
+			pmsprintf(new_data, sizeof(new_data), "%le", data);
 		    } else {
-			pmsprintf(new_data, sizeof(new_data), "%le", data * double_operand);
+			data = set->values[k] * double_operand;
+			pmsprintf(new_data, sizeof(new_data), "%le", data);
 		    }
-		    sdsfree(node->value_set.series_values[i].series_sample[j].series_instance[k].data);
-		    node->value_set.series_values[i].series_sample[j].series_instance[k].data = sdsnew(new_data);
+		    sdsfree(set->series_instance[k].data);
+		    set->series_instance[k].data = sdsnew(new_data);
+		    series_instance_set_double(set, k, data);
 	    	}
 	    }
 	    if (!is_int) {
@@ -4692,13 +4996,11 @@ series_calculate_star(node_t *np, void *arg)
 		    baton->error = -EPROTO;
 		    return;
 		}
-		for (k = 0; k < num_instances; k++) {
-		    series_calculate_order_binary(N_STAR, l_type, r_type, &otype, 
-			&l_val, &r_val, 
-			left->value_set.series_values[i].series_sample[j].series_instance + k,
-			right->value_set.series_values[i].series_sample[j].series_instance + k,
+		series_calculate_binary_row(N_STAR, l_type, r_type, &otype,
+			num_instances,
+			&left->value_set.series_values[i].series_sample[j],
+			&right->value_set.series_values[i].series_sample[j],
 			&l_units, &r_units, &large_units, calculate_star);
-		}
 	    }
 	    /*
 	    * For multiplication, the dimensions of the result are the
@@ -4720,8 +5022,7 @@ series_calculate_slash(node_t *np, void *arg)
 {
     seriesQueryBaton	*baton = (seriesQueryBaton *)arg;
     node_t		*left = np->left, *right = np->right;
-    unsigned int	num_samples, num_instances, j, k;
-    pmAtomValue		l_val, r_val;
+    unsigned int	num_samples, num_instances, j;
     pmUnits		l_units = {0}, r_units = {0}, large_units = {0};
     int			l_type, r_type, otype=PM_TYPE_UNKNOWN;
     int			l_sem, r_sem;
@@ -4747,13 +5048,10 @@ series_calculate_slash(node_t *np, void *arg)
 	    baton->error = -EPROTO;
 	    return;
 	}
-	for (k = 0; k < num_instances; k++) {
-	    series_calculate_order_binary(N_SLASH, l_type, r_type, &otype, 
-		&l_val, &r_val, 
-		left->value_set.series_values[0].series_sample[j].series_instance + k,
-		right->value_set.series_values[0].series_sample[j].series_instance + k,
+	series_calculate_binary_row(N_SLASH, l_type, r_type, &otype, num_instances,
+		&left->value_set.series_values[0].series_sample[j],
+		&right->value_set.series_values[0].series_sample[j],
 		&l_units, &r_units, &large_units, calculate_slash);
-	}
     }
     /*
      * For division, the dimensions of the result are the
@@ -4786,6 +5084,18 @@ series_calculate(node_t *np, int level, void *arg)
 	return sts;
     if ((sts = series_calculate(np->right, level+1, arg)) < 0)
 	return sts;
+    return series_calculate_node(np, arg);
+}
+
+/*
+ * Calculate the values of a single function-type node from the
+ * values of its (already calculated) operands.  Returns the node
+ * type for function nodes, else zero.
+ */
+static int
+series_calculate_node(node_t *np, void *arg)
+{
+    int		sts;
 
     switch ((sts = np->type)) {
     case N_RATE:
@@ -4899,12 +5209,13 @@ series_compatibility_convert(
 	type0 = PM_TYPE_DOUBLE;
 	for (j = 0; j < set0->num_samples; j++) {
 	    for (k = 0; k < set0->series_sample[j].num_instances; k++) {
-		series_extract_value(type0, set0->series_sample[j].series_instance[k].data, &val0);
+		series_instance_value(&set0->series_sample[j], k, type0, &val0);
 		if (pmConvScale(type0, &val0, units0, &val0, large_units) < 0)
 		    memset(large_units, 0, sizeof(*large_units));
 		sdsfree(set0->series_sample[j].series_instance[k].data);
 		str_len = series_pmAtomValue_conv_str(type0, str_val, &val0, sizeof(str_val));
 		set0->series_sample[j].series_instance[k].data = sdsnewlen(str_val, str_len);
+		series_instance_set_atom(&set0->series_sample[j], k, type0, &val0);
 	    }
 	}
 	sdsfree(set0->series_desc.type);
@@ -4918,12 +5229,13 @@ series_compatibility_convert(
 	type1 = PM_TYPE_DOUBLE;
 	for (j = 0; j < set1->num_samples; j++) {
 	    for (k = 0; k < set1->series_sample[j].num_instances; k++) {
-		series_extract_value(type1, set1->series_sample[j].series_instance[k].data, &val1);
+		series_instance_value(&set1->series_sample[j], k, type1, &val1);
 		if (pmConvScale(type1, &val1, units1, &val1, large_units) < 0)
 		    memset(large_units, 0, sizeof(*large_units));
 		sdsfree(set1->series_sample[j].series_instance[k].data);
 		str_len = series_pmAtomValue_conv_str(type1, str_val, &val1, sizeof(str_val));
 		set1->series_sample[j].series_instance[k].data = sdsnewlen(str_val, str_len);
+		series_instance_set_atom(&set1->series_sample[j], k, type1, &val1);
 	    }
 	}
 	sdsfree(set1->series_desc.type);
@@ -5053,20 +5365,10 @@ series_query_report_values(void *arg)
 }
 
 static void
-series_query_funcs_report_values(void *arg)
+series_query_funcs_values(seriesQueryBaton *baton, int has_function)
 {
-    seriesQueryBaton	*baton = (seriesQueryBaton *)arg;
-    int			has_function = 0;
     char		hashbuf[42];
 
-    seriesBatonCheckMagic(baton, MAGIC_QUERY, "series_query_funcs_report_values");
-    seriesBatonCheckCount(baton, "series_query_funcs_report_values");
-
-    seriesBatonReference(baton, "series_query_funcs_report_values");
-
-    /* For function-type nodes, calculate actual values */
-    has_function = series_calculate(baton->query.root, 0, baton->userdata);
-
     /*
      * Store the canonical query to Redis if this query statement has
      * function operation.
@@ -5080,6 +5382,358 @@ series_query_funcs_report_values(void *arg)
     series_query_end_phase(baton);
 }
 
+#if defined(HAVE_LIBUV)
+/*
+ * Function-type nodes can be calculated in libuv worker threads.
+ * Nodes are visited one at a time in the same order as the depth
+ * first series_calculate, and those which calculate each series of
+ * their operand independently are split into tasks over ranges of
+ * (query.batch) series.  Each task has a private copy of the baton
+ * so diagnostics and errors are gathered per-task, then reported in
+ * series order from the main thread when all tasks have completed.
+ */
+typedef struct seriesCalcMessage {
+    pmLogLevel		level;
+    sds			message;
+} seriesCalcMessage;
+
+typedef struct seriesCalcTask {
+    uv_work_t		req;
+    struct seriesCalcState *state;
+    seriesQueryBaton	baton;		/* private baton for this task */
+    node_t		node;		/* function node for this range */
+    node_t		left;		/* operand node for this range */
+    unsigned int	nmessages;
+    seriesCalcMessage	*messages;
+} seriesCalcTask;
+
+typedef struct seriesCalcState {
+    seriesQueryBaton	*baton;
+    int			has_function;
+    unsigned int	batch;		/* series per worker task */
+    unsigned int	nnodes;
+    unsigned int	current;	/* next node to calculate */
+    node_t		**nodes;	/* all nodes, calculation order */
+    unsigned int	ntasks;
+    unsigned int	pending;	/* tasks yet to complete */
+    seriesCalcTask	*tasks;
+} seriesCalcState;
+
+static void series_calculate_next(seriesCalcState *);
+
+static unsigned int
+series_calculate_order(node_t *np, node_t **nodes, unsigned int count)
+{
+    if (np == NULL)
+	return count;
+    count = series_calculate_order(np->left, nodes, count);
+    count = series_calculate_order(np->right, nodes, count);
+    if (nodes)
+	nodes[count] = np;
+    return count + 1;
+}
+
+/*
+ * The in-place functions stop at the first series they cannot
+ * calculate, leaving later series untouched, whereas tasks for
+ * later ranges would carry on.  So check that every series can
+ * be calculated before splitting one of these nodes.
+ */
+static int
+series_calculate_complete(node_t *np)
+{
+    series_sample_set_t	*sp;
+    series_instance_set_t *set;
+    pmAtomValue		ival, oval;
+    pmUnits		units;
+    double		mult;
+    char		*errmsg;
+    int			i, j, k;
+
+    for (i = 0; i < np->left->value_set.num_series; i++) {
+	sp = &np->left->value_set.series_values[i];
+	if (series_extract_type(sp->series_desc.type) == PM_TYPE_UNKNOWN)
+	    return 0;
+	if (np->type == N_RESCALE) {
+	    if (pmParseUnitsStr(sp->series_desc.units, &units, &mult, &errmsg) < 0) {
+		free(errmsg);
+		return 0;
+	    }
+	    if (compare_pmUnits_dim(&units, &np->right->meta.units) != 0)
+		return 0;
+	    ival.d = 1.0;
+	    if (pmConvScale(PM_TYPE_DOUBLE, &ival, &units, &oval, &np->right->meta.units) != 0)
+		return 0;
+	}
+	for (j = 0; j < sp->num_samples; j++) {
+	    set = &sp->series_sample[j];
+	    for (k = 0; k < set->num_instances; k++)
+		if (set->decoded[k] == 0)
+		    return 0;
+	}
+    }
+    return 1;
+}
+
+static int
+series_calculate_splittable(node_t *np)
+{
+    int			i;
+
+    switch (np->type) {
+    case N_RATE:
+	/* reporting this error walks the operands by series index */
+	for (i = 0; i < np->left->value_set.num_series; i++)
+	    if (series_rate_check(np->left->value_set.series_values[i].series_desc) != 0)
+		return 0;
+	return 1;
+    case N_RESCALE:
+    case N_ABS:
+    case N_FLOOR:
+    case N_LOG:
+    case N_SQRT:
+    case N_ROUND:
+	return series_calculate_complete(np);
+    case N_MAX:
+    case N_MAX_INST:
+    case N_MAX_SAMPLE:
+    case N_MIN:
+    case N_MIN_INST:
+    case N_MIN_SAMPLE:
+    case N_AVG:
+    case N_SUM:
+    case N_AVG_INST:
+    case N_SUM_INST:
+    case N_AVG_SAMPLE:
+    case N_SUM_SAMPLE:
+    case N_STDEV_INST:
+    case N_STDEV_SAMPLE:
+    case N_TOPK_INST:
+    case N_TOPK_SAMPLE:
+    case N_NTH_PERCENTILE_INST:
+    case N_NTH_PERCENTILE_SAMPLE:
+	return 1;
+    default:
+	break;
+    }
+    return 0;
+}
+
+/* this function runs in a worker thread */
+static void
+series_calculate_info(pmLogLevel level, sds message, void *arg)
+{
+    seriesCalcTask	*task = (seriesCalcTask *)arg;
+    seriesCalcMessage	*messages;
+    size_t		bytes;
+
+    bytes = (task->nmessages + 1) * sizeof(seriesCalcMessage);
+    if ((messages = (seriesCalcMessage *)realloc(task->messages, bytes)) == NULL)
+	return;
+    messages[task->nmessages].level = level;
+    messages[task->nmessages].message = sdsdup(message);
+    task->messages = messages;
+    task->nmessages++;
+}
+
+/* this function runs in a worker thread */
+static void
+series_calculate_work(uv_work_t *req)
+{
+    seriesCalcTask	*task = (seriesCalcTask *)req->data;
+
+    series_calculate_node(&task->node, &task->baton);
+}
+
+static void
+series_calculate_merge(seriesCalcState *state, node_t *np)
+{
+    seriesQueryBaton	*baton = state->baton;
+    series_sample_set_t	*values = NULL;
+    seriesCalcTask	*task;
+    unsigned int	i, j, count, total = 0;
+    int			inplace;
+
+    task = &state->tasks[0];
+    inplace = (task->node.value_set.series_values == task->left.value_set.series_values);
+    if (!inplace) {
+	for (i = 0; i < state->ntasks; i++)
+	    total += state->tasks[i].node.value_set.num_series;
+	if ((values = (series_sample_set_t *)calloc(total, sizeof(*values))) == NULL)
+	    baton->error = -ENOMEM;
+    }
+
+    for (i = 0, total = 0; i < state->ntasks; i++) {
+	task = &state->tasks[i];
+	for (j = 0; j < task->nmessages; j++)
+	    batoninfo(baton, task->messages[j].level, task->messages[j].message);
+	free(task->messages);
+	if (task->baton.error)
+	    baton->error = task->baton.error;
+	if (inplace)
+	    continue;
+	count = task->node.value_set.num_series;
+	if (values)
+	    memcpy(values + total, task->node.value_set.series_values,
+			count * sizeof(*values));
+	free(task->node.value_set.series_values);
+	total += count;
+    }
+
+    if (inplace) {
+	/* values were calculated in-place, in the operand node */
+	np->value_set = np->left->value_set;
+    } else {
+	np->value_set.num_series = values ? total : 0;
+	np->value_set.series_values = values;
+    }
+
+    free(state->tasks);
+    state->tasks = NULL;
+    state->ntasks = 0;
+}
+
+/* this function runs in the main thread */
+static void
+series_calculate_work_done(uv_work_t *req, int status)
+{
+    seriesCalcTask	*task = (seriesCalcTask *)req->data;
+    seriesCalcState	*state = task->state;
+
+    (void)status;
+    if (--state->pending > 0)
+	return;
+    series_calculate_merge(state, state->nodes[state->current - 1]);
+    series_calculate_next(state);
+}
+
+/*
+ * Queue worker tasks to calculate a function node over ranges of its
+ * operand series, returning zero if queued or negative if the node
+ * is to be calculated directly instead.
+ */
+static int
+series_calculate_queue(seriesCalcState *state, node_t *np)
+{
+    seriesQueryBaton	*baton = state->baton;
+    seriesModuleData	*data = getSeriesModuleData(baton->module);
+    seriesCalcTask	*task;
+    unsigned int	i, first, count, nseries;
+
+    if (np->left == NULL || (nseries = np->left->value_set.num_series) <= state->batch)
+	return -1;
+    if (series_calculate_splittable(np) == 0)
+	return -1;
+
+    state->ntasks = (nseries + state->batch - 1) / state->batch;
+    if ((state->tasks = calloc(state->ntasks, sizeof(seriesCalcTask))) == NULL) {
+	state->ntasks = 0;
+	return -ENOMEM;
+    }
+    state->pending = state->ntasks;
+
+    for (i = first = 0; i < state->ntasks; i++, first += count) {
+	task = &state->tasks[i];
+	count = nseries - first;
+	if (count > state->batch)
+	    count = state->batch;
+	task->state = state;
+	task->baton = *baton;
+	task->baton.info = series_calculate_info;
+	task->baton.userdata = task;
+	task->left = *np->left;
+	task->left.value_set.num_series = count;
+	task->left.value_set.series_values += first;
+	task->node = *np;
+	task->node.left = &task->left;
+	task->node.baton = &task->baton;
+	task->req.data = task;
+	uv_queue_work(data->events, &task->req,
+			series_calculate_work, series_calculate_work_done);
+    }
+    return 0;
+}
+
+static void
+series_calculate_next(seriesCalcState *state)
+{
+    seriesQueryBaton	*baton = state->baton;
+    node_t		*np;
+
+    while (state->current < state->nnodes) {
+	np = state->nodes[state->current++];
+	if (series_calculate_queue(state, np) == 0) {
+	    state->has_function = np->type;	/* all split nodes are functions */
+	    return;
+	}
+	state->has_function = series_calculate_node(np, baton);
+    }
+
+    /* the root node is last in the calculation order */
+    series_query_funcs_values(baton, state->has_function);
+    free(state->nodes);
+    free(state);
+}
+
+static int
+series_calculate_start(seriesQueryBaton *baton)
+{
+    seriesModuleData	*data = getSeriesModuleData(baton->module);
+    seriesCalcState	*state;
+    unsigned int	count;
+    int			batch = DEFAULT_QUERY_BATCH;
+    sds			option;
+
+    if (data == NULL || data->events == NULL)
+	return -ENOTSUP;
+    if (data->config &&
+	(option = pmIniFileLookup(data->config, "pmseries", "query.batch")))
+	batch = atoi(option);
+    if (batch <= 0)	/* calculate directly, in the main thread */
+	return -ENOTSUP;
+
+    if ((state = (seriesCalcState *)calloc(1, sizeof(seriesCalcState))) == NULL)
+	return -ENOMEM;
+    count = series_calculate_order(baton->query.root, NULL, 0);
+    if ((state->nodes = (node_t **)calloc(count, sizeof(node_t *))) == NULL) {
+	free(state);
+	return -ENOMEM;
+    }
+    series_calculate_order(baton->query.root, state->nodes, 0);
+    state->baton = baton;
+    state->batch = batch;
+    state->nnodes = count;
+
+    series_calculate_next(state);
+    return 0;
+}
+#else
+static int
+series_calculate_start(seriesQueryBaton *baton)
+{
+    (void)baton;
+    return -ENOTSUP;
+}
+#endif
+
+static void
+series_query_funcs_report_values(void *arg)
+{
+    seriesQueryBaton	*baton = (seriesQueryBaton *)arg;
+    int			has_function = 0;
+
+    seriesBatonCheckMagic(baton, MAGIC_QUERY, "series_query_funcs_report_values");
+    seriesBatonCheckCount(baton, "series_query_funcs_report_values");
+
+    seriesBatonReference(baton, "series_query_funcs_report_values");
+
+    /* For function-type nodes, calculate actual values */
+    if (series_calculate_start(baton) == 0)
+	return;
+    has_function = series_calculate(baton->query.root, 0, baton);
+    series_query_funcs_values(baton, has_function);
+}
+
 static void
 series_query_funcs(void *arg)
 {
@@ -125,6 +125,15 @@ typedef struct series_instance_set {
     /* Number of series instances */
     int			num_instances;
     pmSeriesValue	*series_instance;
+
+    /*
+     * Values of the instances decoded once, as stored from Redis,
+     * and kept up to date by the functions calculating new values.
+     * These columns share the allocation of series_instance.
+     */
+    double		*values;	/* value as a double */
+    __int64_t		*ints;		/* value as an integer */
+    unsigned char	*decoded;	/* value was numeric */
 } series_instance_set_t;
 
 typedef struct series_sample_set {
@@ -19,6 +19,7 @@
 #include "discover.h"
 #include "util.h"
 #include "sha1.h"
+#include "hot.h"
 
 #define STRINGIFY(s)	#s
 #define TO_STRING(s)	STRINGIFY(s)
@@ -268,7 +269,7 @@ redis_series_source(redisSlots *slots, void *arg)
     cmd = redis_param_sds(cmd, key);
     cmd = redis_param_sha(cmd, context->name.hash);
     sdsfree(key);
-    redisSlotsRequest(slots, cmd, redis_source_context_name, arg);
+    redisSlotsWrite(slots, cmd, redis_source_context_name, arg);
     sdsfree(cmd);
 
     pmwebapi_hash_str(context->hostid, hashbuf, sizeof(hashbuf));
@@ -278,7 +279,7 @@ redis_series_source(redisSlots *slots, void *arg)
     cmd = redis_param_sds(cmd, key);
     cmd = redis_param_sha(cmd, context->name.hash);
     sdsfree(key);
-    redisSlotsRequest(slots, cmd, redis_source_context_name, arg);
+    redisSlotsWrite(slots, cmd, redis_source_context_name, arg);
     sdsfree(cmd);
 
     pmwebapi_hash_str(context->name.hash, hashbuf, sizeof(hashbuf));
@@ -289,7 +290,7 @@ redis_series_source(redisSlots *slots, void *arg)
     cmd = redis_param_sha(cmd, context->name.id);
     cmd = redis_param_sha(cmd, context->hostid);
     sdsfree(key);
-    redisSlotsRequest(slots, cmd, redis_context_name_source, arg);
+    redisSlotsWrite(slots, cmd, redis_context_name_source, arg);
     sdsfree(cmd);
 
     key = sdsnew("pcp:source:location");
@@ -304,7 +305,7 @@ redis_series_source(redisSlots *slots, void *arg)
     sdsfree(val2);
     sdsfree(val);
     sdsfree(key);
-    redisSlotsRequest(slots, cmd, redis_source_location, arg);
+    redisSlotsWrite(slots, cmd, redis_source_location, arg);
     sdsfree(cmd);
 }
 
@@ -372,7 +373,7 @@ redis_series_instance(redisSlots *slots, metric_t *metric, instance_t *instance,
     sdsfree(key);
     for (i = 0; i < metric->numnames; i++)
 	cmd = redis_param_sha(cmd, metric->names[i].hash);
-    redisSlotsRequest(slots, cmd, redis_series_inst_name_callback, arg);
+    redisSlotsWrite(slots, cmd, redis_series_inst_name_callback, arg);
     sdsfree(cmd);
 
     for (i = 0; i < metric->numnames; i++) {
@@ -384,7 +385,7 @@ redis_series_instance(redisSlots *slots, metric_t *metric, instance_t *instance,
 	cmd = redis_param_sds(cmd, key);
 	cmd = redis_param_sha(cmd, instance->name.hash);
 	sdsfree(key);
-	redisSlotsRequest(slots, cmd, redis_instances_series_callback, arg);
+	redisSlotsWrite(slots, cmd, redis_instances_series_callback, arg);
 	sdsfree(cmd);
     }
 
@@ -402,7 +403,7 @@ redis_series_instance(redisSlots *slots, metric_t *metric, instance_t *instance,
     cmd = redis_param_sha(cmd, metric->indom->domain->context->name.hash);
     sdsfree(val);
     sdsfree(key);
-    redisSlotsRequest(slots, cmd, redis_series_inst_callback, arg);
+    redisSlotsWrite(slots, cmd, redis_series_inst_callback, arg);
     sdsfree(cmd);
 }
 
@@ -580,7 +581,7 @@ redis_series_label(redisSlots *slots, metric_t *metric, char *hash,
 	cmd = redis_param_sds(cmd, val);
 	sdsfree(val);
 	sdsfree(key);
-	redisSlotsRequest(slots, cmd,
+	redisSlotsWrite(slots, cmd,
 				redis_series_labelflags_callback, arg);
 	sdsfree(cmd);
     }
@@ -592,7 +593,7 @@ redis_series_label(redisSlots *slots, metric_t *metric, char *hash,
     cmd = redis_param_sha(cmd, list->nameid);
     cmd = redis_param_sha(cmd, list->valueid);
     sdsfree(key);
-    redisSlotsRequest(slots, cmd,
+    redisSlotsWrite(slots, cmd,
 			redis_series_labelvalue_callback, arg);
     sdsfree(cmd);
 
@@ -606,7 +607,7 @@ redis_series_label(redisSlots *slots, metric_t *metric, char *hash,
     cmd = redis_param_sha(cmd, list->valueid);
     cmd = redis_param_sds(cmd, list->value);
     sdsfree(key);
-    redisSlotsRequest(slots, cmd,
+    redisSlotsWrite(slots, cmd,
 			redis_series_maplabelvalue_callback, arg);
     sdsfree(cmd);
 
@@ -618,7 +619,7 @@ redis_series_label(redisSlots *slots, metric_t *metric, char *hash,
     sdsfree(key);
     for (i = 0; i < metric->numnames; i++)
 	cmd = redis_param_sha(cmd, metric->names[i].hash);
-    redisSlotsRequest(slots, cmd,
+    redisSlotsWrite(slots, cmd,
 			redis_series_label_set_callback, arg);
     sdsfree(cmd);
 }
@@ -837,7 +838,7 @@ redis_series_metadata(context_t *context, metric_t *metric, void *arg)
 	cmd = redis_param_sds(cmd, key);
 	cmd = redis_param_sha(cmd, metric->names[i].hash);
 	sdsfree(key);
-	redisSlotsRequest(slots, cmd,
+	redisSlotsWrite(slots, cmd,
 			redis_series_metric_name_callback, arg);
 	sdsfree(cmd);
 
@@ -848,7 +849,7 @@ redis_series_metadata(context_t *context, metric_t *metric, void *arg)
 	cmd = redis_param_sds(cmd, key);
 	cmd = redis_param_sha(cmd, metric->names[i].id);
 	sdsfree(key);
-	redisSlotsRequest(slots, cmd,
+	redisSlotsWrite(slots, cmd,
 			redis_metric_name_series_callback, arg);
 	sdsfree(cmd);
 
@@ -869,7 +870,7 @@ redis_series_metadata(context_t *context, metric_t *metric, void *arg)
 	cmd = redis_param_str(cmd, "units", sizeof("units")-1);
 	cmd = redis_param_str(cmd, units, strlen(units));
 	sdsfree(key);
-	redisSlotsRequest(slots, cmd, redis_desc_series_callback, arg);
+	redisSlotsWrite(slots, cmd, redis_desc_series_callback, arg);
 	sdsfree(cmd);
 
 	if ((baton->flags & PM_SERIES_FLAG_TEXT) && slots->search)
@@ -888,7 +889,7 @@ redis_series_metadata(context_t *context, metric_t *metric, void *arg)
     sdsfree(key);
     for (i = 0; i < metric->numnames; i++)
 	cmd = redis_param_sha(cmd, metric->names[i].hash);
-    redisSlotsRequest(slots, cmd, redis_series_source_callback, arg);
+    redisSlotsWrite(slots, cmd, redis_series_source_callback, arg);
     sdsfree(cmd);
 
 check_instances:
@@ -932,6 +933,7 @@ typedef struct redisStreamBaton {
     redisSlots		*slots;
     sds			stamp;
     char		hash[40+1];
+    redisReply		*sample;	/* hot tier sample, if enabled */
     redisInfoCallBack   info;
     void		*userdata;
     void		*arg;
@@ -945,6 +947,7 @@ initRedisStreamBaton(redisStreamBaton *baton, redisSlots *slots,
     baton->slots = slots;
     baton->stamp = sdsdup(stamp);
     memcpy(baton->hash, hash, sizeof(baton->hash));
+    baton->sample = NULL;
     baton->info = load->info;
     baton->userdata = load->userdata;
     baton->arg = load;
@@ -958,6 +961,8 @@ doneRedisStreamBaton(redisStreamBaton *baton)
     seriesBatonCheckMagic(baton, MAGIC_STREAM, "doneRedisStreamBaton");
     seriesBatonCheckMagic(load, MAGIC_LOAD, "doneRedisStreamBaton");
     sdsfree(baton->stamp);
+    if (baton->sample)
+	freeReplyObject(baton->sample);
     memset(baton, 0, sizeof(*baton));
     free(baton);
 
@@ -1043,6 +1048,11 @@ redis_series_stream_callback(
         checkStreamReplyString(baton->info, baton->userdata, c, reply,
 		baton->stamp, "stream %s status mismatch at time %s",
 		baton->hash, baton->stamp);
+	/* sample is now in Redis, so it can be served from the hot tier */
+	if (baton->sample && reply && reply->type == REDIS_REPLY_STRING) {
+	    seriesHotAppend(baton->hash, baton->sample);
+	    baton->sample = NULL;
+	}
     }
 
     doneRedisStreamBaton(baton);
@@ -1111,6 +1121,10 @@ redis_series_stream(redisSlots *slots, sds stamp, metric_t *metric,
 	sdsfree(name);
     }
 
+    /* keep recent samples of live sources for the hot tier */
+    if ((load->flags & PM_SERIES_FLAG_ACTIVE) && seriesHotEnabled())
+	baton->sample = seriesHotSample(stamp, stream, count - 6);
+
     cmd = redis_command(count);
     cmd = redis_param_str(cmd, XADD, XADD_LEN);
     cmd = redis_param_sds(cmd, key);
@@ -1121,7 +1135,7 @@ redis_series_stream(redisSlots *slots, sds stamp, metric_t *metric,
     cmd = redis_param_raw(cmd, stream);
     sdsfree(key);
     sdsfree(stream);
-    redisSlotsRequest(slots, cmd, redis_series_stream_callback, baton);
+    redisSlotsWrite(slots, cmd, redis_series_stream_callback, baton);
     sdsfree(cmd);
 
     key = sdscatfmt(sdsempty(), "pcp:values:series:%s", hash);
@@ -1130,7 +1144,7 @@ redis_series_stream(redisSlots *slots, sds stamp, metric_t *metric,
     cmd = redis_param_sds(cmd, key);
     cmd = redis_param_sds(cmd, streamexpire);
     sdsfree(key);
-    redisSlotsRequest(slots, cmd, redis_series_timer_callback, load);
+    redisSlotsWrite(slots, cmd, redis_series_timer_callback, load);
     sdsfree(cmd);
 }
 
@@ -1546,6 +1560,8 @@ redisSeriesInit(struct dict *config)
 	else	/* default value: 1 day (without changes) */
 	    streamexpire = DEFAULT_STREAMEXPIRE = sdsnew("86400");
     }
+
+    seriesHotInit(config, atoi(maxstreamlen), atoi(streamexpire));
 }
 
 static void
@@ -1563,6 +1579,8 @@ redisSeriesClose(void)
 	sdsfree(DEFAULT_STREAMEXPIRE);
 	DEFAULT_STREAMEXPIRE = NULL;
     }
+
+    seriesHotClose();
 }
 
 void
@@ -1640,6 +1658,19 @@ pmSeriesSetupMetrics(pmSeriesModule *module)
 	"calls to /series/load",
 	"total RESTAPI calls to /series/load");
 
+    /*
+     * series values served from the in-process hot tier, or not
+     */
+    mmv_stats_add_metric(data->registry, "hot.hits", 10,
+	MMV_TYPE_U64, MMV_SEM_COUNTER, countunits, MMV_INDOM_NULL,
+	"series values served from hot tier",
+	"total series value requests answered from recent samples held in-process");
+
+    mmv_stats_add_metric(data->registry, "hot.misses", 11,
+	MMV_TYPE_U64, MMV_SEM_COUNTER, countunits, MMV_INDOM_NULL,
+	"series values requested from Redis",
+	"total series value requests not covered by the in-process hot tier");
+
     data->map = map = mmv_stats_start(data->registry);
     metrics = data->metrics;
 
@@ -1661,6 +1692,10 @@ pmSeriesSetupMetrics(pmSeriesModule *module)
 						"labelvalues.calls", NULL);
     metrics[SERIES_LOAD_CALLS] = mmv_lookup_value_desc(map,
 						"load.calls", NULL);
+    metrics[SERIES_HOT_HITS] = mmv_lookup_value_desc(map,
+						"hot.hits", NULL);
+    metrics[SERIES_HOT_MISSES] = mmv_lookup_value_desc(map,
+						"hot.misses", NULL);
 }
 
 int
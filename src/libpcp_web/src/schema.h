@@ -121,6 +121,20 @@ extern void redis_series_metric(redisSlots *, metric_t *, sds, int, int, void *)
  */
 #define LOAD_PHASES	6
 
+#define DEFAULT_LOAD_BATCH	256	/* archive records per worker read */
+#define DEFAULT_LOAD_DEPTH	2	/* batches buffered ahead of caching */
+#define DEFAULT_QUERY_BATCH	128	/* series per worker calculation */
+
+typedef struct seriesLoadBatch {
+    struct seriesLoadBatch *next;	/* next batch in read-ahead queue */
+    void		*baton;		/* seriesLoadBaton being loaded */
+    unsigned int	count;		/* number of records read */
+    unsigned int	index;		/* next record to be cached */
+    int			error;		/* PMAPI error code ending the batch */
+    int			*logs;		/* archive index of each record */
+    pmHighResResult	**results;	/* sample data read by the worker */
+} seriesLoadBatch;
+
 typedef struct seriesGetContext {
     seriesBatonMagic	header;		/* MAGIC_CONTEXT */
 
@@ -130,6 +144,19 @@ typedef struct seriesGetContext {
     int			loaded;		/* end of archive data reached */
     int			error;		/* PMAPI error code from fetch */
 
+    int			fetch;		/* read-ahead archive context */
+    unsigned int	batchsize;	/* records read per worker request */
+    unsigned int	depth;		/* maximum batches read but not cached */
+    unsigned int	queued;		/* batches read or being read */
+    unsigned int	reading : 1;	/* worker request is outstanding */
+    unsigned int	waiting : 1;	/* no records ready, awaiting worker */
+    unsigned int	ended : 1;	/* worker has reached end of data */
+    unsigned int	active : 1;	/* record processing loop running */
+    unsigned int	again : 1;	/* next record requested in loop */
+    unsigned int	padding : 27;	/* zero-fill structure padding */
+    seriesLoadBatch	*head;		/* read-ahead queue of fetched batches */
+    seriesLoadBatch	*tail;
+
     redisDoneCallBack	done;
 
     void		*baton;
@@ -176,6 +203,8 @@ enum {
     SERIES_LABELS_CALLS,
     SERIES_LABELVALUES_CALLS,
     SERIES_LOAD_CALLS,
+    SERIES_HOT_HITS,
+    SERIES_HOT_MISSES,
     NUM_SERIES_METRIC
 };
 
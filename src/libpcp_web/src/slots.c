@@ -28,6 +28,10 @@ static int redisClusterLibuvAttach() { return REDIS_OK; }
 
 static char default_server[] = "localhost:6379";
 
+static void redis_write_setup(redisSlots *, dict *);
+static void redis_write_close(redisSlots *);
+static void redis_write_schedule(redisSlots *);
+
 static void
 redis_connect_callback(const redisAsyncContext *redis, int status)
 {
@@ -121,6 +125,31 @@ redisSlotsSetupMetrics(redisSlots *slots)
 	"total bytes received in responses",
 	"Cumulative count of bytes received in Redis responses");
 
+    mmv_stats_add_metric(slots->registry, "requests.coalesced", 10,
+	MMV_TYPE_U64, MMV_SEM_COUNTER, units_count, MMV_INDOM_NULL,
+	"number of coalesced write requests",
+	"Total number of Redis write requests merged into a queued command");
+
+    mmv_stats_add_metric(slots->registry, "requests.queued.total", 11,
+	MMV_TYPE_U64, MMV_SEM_INSTANT, units_count, MMV_INDOM_NULL,
+	"queued write requests",
+	"Number of Redis write commands queued and not yet sent");
+
+    mmv_stats_add_metric(slots->registry, "requests.queued.bytes", 12,
+	MMV_TYPE_U64, MMV_SEM_INSTANT, units_bytes, MMV_INDOM_NULL,
+	"bytes allocated for queued write requests",
+	"Memory currently allocated for queued Redis write commands");
+
+    mmv_stats_add_metric(slots->registry, "requests.flushes", 13,
+	MMV_TYPE_U64, MMV_SEM_COUNTER, units_count, MMV_INDOM_NULL,
+	"number of write queue flushes",
+	"Total number of times queued Redis write commands were sent");
+
+    mmv_stats_add_metric(slots->registry, "requests.deferred", 14,
+	MMV_TYPE_U64, MMV_SEM_COUNTER, units_count, MMV_INDOM_NULL,
+	"number of deferred write queue flushes",
+	"Total number of timed write queue flushes postponed by inflight requests");
+
     slots->map = map = mmv_stats_start(slots->registry);
 
     table = slots->metrics;
@@ -142,6 +171,16 @@ redisSlotsSetupMetrics(redisSlots *slots)
 					"requests.total_bytes", NULL);
     table[SLOT_RESPONSES_TOTAL_BYTES] = mmv_lookup_value_desc(map,
 					"responses.total_bytes", NULL);
+    table[SLOT_REQUESTS_COALESCED] = mmv_lookup_value_desc(map,
+					"requests.coalesced", NULL);
+    table[SLOT_REQUESTS_QUEUED_TOTAL] = mmv_lookup_value_desc(map,
+					"requests.queued.total", NULL);
+    table[SLOT_REQUESTS_QUEUED_BYTES] = mmv_lookup_value_desc(map,
+					"requests.queued.bytes", NULL);
+    table[SLOT_REQUESTS_FLUSHES] = mmv_lookup_value_desc(map,
+					"requests.flushes", NULL);
+    table[SLOT_REQUESTS_DEFERRED] = mmv_lookup_value_desc(map,
+					"requests.deferred", NULL);
 }
 
 int
@@ -181,6 +220,7 @@ redisSlotsInit(dict *config, void *events)
 	free(slots);
 	return NULL;
     }
+    redis_write_setup(slots, config);
 
     servers = pmIniFileLookup(config, "redis", "servers");
     if (servers == NULL)
@@ -391,6 +431,8 @@ redisSlotsConnect(dict *config, redisSlotsFlags flags,
 void
 redisSlotsFree(redisSlots *slots)
 {
+    redisSlotsFlush(slots);
+    redis_write_close(slots);
     redisClusterAsyncDisconnect(slots->acc);
     redisClusterAsyncFree(slots->acc);
     dictRelease(slots->keymap);
@@ -513,6 +555,11 @@ redisSlotsReplyCallback(redisClusterAsyncContext *c, void *r, void *arg)
     }
 
     srd->callback(c, r, srd->arg);
+
+    /* retry a flush of queued writes deferred while requests drain */
+    if (srd->slots->writehead && !srd->slots->writepending)
+	redis_write_schedule(srd->slots);
+
     redisSlotsReplyDataFree(arg);
 }
 
@@ -625,6 +672,336 @@ redisSlotsRequestFirstNode(redisSlots *slots, const sds cmd,
     return REDIS_OK;
 }
 
+/*
+ * Write coalescing - series metadata and values are written using
+ * many small commands, often several to the same key (SADD members,
+ * HMSET fields, EXPIRE of a stream after each XADD).  These writes
+ * are queued for a short time (write.delay msec, by default until
+ * the next event loop iteration) or until write.batch are queued.
+ * Queued SADD/HSET/HMSET commands to the same key are merged into
+ * one command and identical EXPIRE commands are sent just once, the
+ * single reply then being passed to every original requester.  The
+ * flush sends everything queued in order, pipelined per Redis node.
+ */
+typedef struct redisSlotsWriteReply {
+    redisClusterCallbackFn	*callback;	/* actual callback */
+    void			*arg;		/* actual callback args */
+} redisSlotsWriteReply;
+
+struct redisSlotsWriteData {
+    redisSlotsWriteData		*next;		/* next write in issue order */
+    sds				body;		/* command less the *N header */
+    unsigned int		nparams;	/* parameters following the key */
+    unsigned int		nreplies;	/* callbacks merged into this */
+    unsigned int		maxreplies;
+    redisSlotsWriteReply	*replies;
+};
+
+/*
+ * Find the end of the bulk string starting at offset in a formatted
+ * command, returning the offset following it or zero on error.
+ */
+static size_t
+redis_write_bulk(const char *cmd, size_t length, size_t offset)
+{
+    unsigned long	size;
+    char		*end;
+
+    if (offset >= length || cmd[offset] != '$')
+	return 0;
+    size = strtoul(cmd + offset + 1, &end, 10);
+    if (*end != '\r')
+	return 0;
+    offset = (end - cmd) + 2 + size + 2;
+    return offset > length ? 0 : offset;
+}
+
+static void
+redis_write_callback(redisClusterAsyncContext *c, void *r, void *arg)
+{
+    redisSlotsWriteData	*wp = (redisSlotsWriteData *)arg;
+    unsigned int	i;
+
+    for (i = 0; i < wp->nreplies; i++)
+	wp->replies[i].callback(c, r, wp->replies[i].arg);
+    sdsfree(wp->body);
+    free(wp->replies);
+    free(wp);
+}
+
+static int
+redis_write_reply(redisSlotsWriteData *wp, redisClusterCallbackFn *callback, void *arg)
+{
+    redisSlotsWriteReply	*replies;
+    unsigned int		count;
+
+    if (wp->nreplies == wp->maxreplies) {
+	count = wp->maxreplies ? wp->maxreplies * 2 : 2;
+	replies = realloc(wp->replies, count * sizeof(redisSlotsWriteReply));
+	if (replies == NULL)
+	    return -ENOMEM;
+	wp->replies = replies;
+	wp->maxreplies = count;
+    }
+    wp->replies[wp->nreplies].callback = callback;
+    wp->replies[wp->nreplies].arg = arg;
+    wp->nreplies++;
+    return 0;
+}
+
+#if defined(HAVE_LIBUV)
+/* flush timer, and the event loop thread that alone may queue writes */
+typedef struct redisSlotsWriteTimer {
+    uv_timer_t		timer;
+    uv_thread_t		thread;
+} redisSlotsWriteTimer;
+
+static void
+redis_write_timer(uv_timer_t *timer)
+{
+    redisSlots		*slots = (redisSlots *)timer->data;
+    uint64_t		inflight;
+
+    slots->writepending = 0;
+    inflight = redisSlotsInflightRequests(slots);
+    if (slots->writeinflight && inflight > slots->writeinflight) {
+	/* retried as replies arrive, see redisSlotsReplyCallback */
+	mmv_inc(slots->map, slots->metrics[SLOT_REQUESTS_DEFERRED]);
+	return;
+    }
+    redisSlotsFlush(slots);
+}
+
+static void
+redis_write_timer_close(uv_handle_t *handle)
+{
+    free(handle);
+}
+#endif
+
+/*
+ * Archives loaded via the REST API are loaded in worker threads, but
+ * the write queue and its timer belong to the event loop thread.
+ */
+static int
+redis_write_thread(redisSlots *slots)
+{
+#if defined(HAVE_LIBUV)
+    redisSlotsWriteTimer *wtp = (redisSlotsWriteTimer *)slots->writetimer;
+    uv_thread_t		self = uv_thread_self();
+
+    return uv_thread_equal(&self, &wtp->thread);
+#else
+    (void)slots;
+    return 1;
+#endif
+}
+
+static void
+redis_write_schedule(redisSlots *slots)
+{
+#if defined(HAVE_LIBUV)
+    uv_timer_t		*timer = (uv_timer_t *)slots->writetimer;
+
+    slots->writepending = 1;
+    uv_timer_start(timer, redis_write_timer, slots->writedelay, 0);
+#else
+    redisSlotsFlush(slots);
+#endif
+}
+
+static void
+redis_write_setup(redisSlots *slots, dict *config)
+{
+    sds			option;
+
+    slots->writebatch = DEFAULT_WRITE_BATCH;
+    slots->writedelay = DEFAULT_WRITE_DELAY;
+    slots->writeinflight = DEFAULT_WRITE_INFLIGHT;
+
+    if ((option = pmIniFileLookup(config, "redis", "write.batch")))
+	slots->writebatch = atoi(option);
+    if ((option = pmIniFileLookup(config, "redis", "write.delay")))
+	slots->writedelay = atoi(option);
+    if ((option = pmIniFileLookup(config, "redis", "write.inflight")))
+	slots->writeinflight = atoi(option);
+
+#if defined(HAVE_LIBUV)
+    redisSlotsWriteTimer *wtp;
+
+    /* coalescing requires an event loop to flush queued writes */
+    if (slots->writebatch <= 1 || slots->events == NULL)
+	return;
+    if ((slots->writemap = dictCreate(&sdsKeyDictCallBacks, "writemap")) == NULL)
+	return;
+    if ((wtp = (redisSlotsWriteTimer *)calloc(1, sizeof(*wtp))) == NULL) {
+	dictRelease(slots->writemap);
+	slots->writemap = NULL;
+	return;
+    }
+    uv_timer_init(slots->events, &wtp->timer);
+    wtp->timer.data = (void *)slots;
+    wtp->thread = uv_thread_self();
+    slots->writetimer = wtp;
+#endif
+}
+
+static void
+redis_write_close(redisSlots *slots)
+{
+#if defined(HAVE_LIBUV)
+    uv_timer_t		*timer = (uv_timer_t *)slots->writetimer;
+
+    if (timer) {
+	uv_timer_stop(timer);
+	uv_close((uv_handle_t *)timer, redis_write_timer_close);
+	slots->writetimer = NULL;
+    }
+#endif
+    if (slots->writemap) {
+	dictRelease(slots->writemap);
+	slots->writemap = NULL;
+    }
+}
+
+/*
+ * Submit a write request which may be coalesced with others and
+ * sent a short time later - see redisSlotsRequest for the rest.
+ */
+int
+redisSlotsWrite(redisSlots *slots, const sds cmd,
+		redisClusterCallbackFn *callback, void *arg)
+{
+    redisSlotsWriteData	*wp = NULL;
+    unsigned long	count;
+    uint64_t		size;
+    size_t		length = sdslen(cmd), header, verb, key;
+    char		*end;
+    sds			name = NULL;
+    int			merge = 0;
+
+    if (UNLIKELY(slots->state != SLOTS_CONNECTED && slots->state != SLOTS_READY))
+	return -ENOTCONN;
+
+    /* no event loop, disabled via configuration or not the loop thread */
+    if (slots->writetimer == NULL || !redis_write_thread(slots))
+	return redisSlotsRequest(slots, cmd, callback, arg);
+
+    /* *N\r\n $len\r\nverb\r\n $len\r\nkey\r\n params... */
+    if (cmd[0] != '*' ||
+	(count = strtoul(cmd + 1, &end, 10)) < 2 || *end != '\r' ||
+	(verb = redis_write_bulk(cmd, length, header = (end - cmd) + 2)) == 0 ||
+	(key = redis_write_bulk(cmd, length, verb)) == 0)
+	return redisSlotsRequest(slots, cmd, callback, arg);
+
+    if (verb - header == SADD_LEN + 6 &&
+	strncasecmp(cmd + header + 4, SADD, SADD_LEN) == 0)
+	merge = 1;
+    else if (verb - header == HMSET_LEN + 6 &&
+	strncasecmp(cmd + header + 4, HMSET, HMSET_LEN) == 0)
+	merge = 1;
+    else if (verb - header == HSET_LEN + 6 &&
+	strncasecmp(cmd + header + 4, HSET, HSET_LEN) == 0)
+	merge = 1;
+    else if (verb - header == EXPIRE_LEN + 6 &&
+	strncasecmp(cmd + header + 4, EXPIRE, EXPIRE_LEN) == 0)
+	merge = 2;
+
+    /* merge on command and key (adding parameters), or entire command */
+    if (merge == 1)
+	name = sdsnewlen(cmd + header, key - header);
+    else if (merge == 2)
+	name = sdsnewlen(cmd + header, length - header);
+    if (name)
+	wp = (redisSlotsWriteData *)dictFetchValue(slots->writemap, name);
+
+    if (wp != NULL) {
+	if (redis_write_reply(wp, callback, arg) < 0) {
+	    sdsfree(name);
+	    return -ENOMEM;
+	}
+	if (merge == 1) {
+	    size = length - key;
+	    wp->body = sdscatlen(wp->body, cmd + key, size);
+	    wp->nparams += count - 2;
+	    mmv_add(slots->map, slots->metrics[SLOT_REQUESTS_QUEUED_BYTES], &size);
+	}
+	mmv_inc(slots->map, slots->metrics[SLOT_REQUESTS_COALESCED]);
+	sdsfree(name);
+    } else {
+	if ((wp = (redisSlotsWriteData *)calloc(1, sizeof(redisSlotsWriteData))) == NULL ||
+	    redis_write_reply(wp, callback, arg) < 0) {
+	    mmv_inc(slots->map, slots->metrics[SLOT_REQUESTS_ERROR]);
+	    pmNotifyErr(LOG_ERR, "%s: failed to allocate write request\n",
+			"redisSlotsWrite");
+	    free(wp);
+	    sdsfree(name);
+	    return -ENOMEM;
+	}
+	wp->body = sdsnewlen(cmd + header, length - header);
+	wp->nparams = count - 2;
+	if (slots->writetail)
+	    slots->writetail->next = wp;
+	else
+	    slots->writehead = wp;
+	slots->writetail = wp;
+	slots->writequeued++;
+	if (name) {
+	    dictAdd(slots->writemap, name, wp);
+	    sdsfree(name);
+	}
+	size = sdslen(wp->body);
+	mmv_add(slots->map, slots->metrics[SLOT_REQUESTS_QUEUED_BYTES], &size);
+	mmv_inc(slots->map, slots->metrics[SLOT_REQUESTS_QUEUED_TOTAL]);
+    }
+
+    if (slots->writequeued >= slots->writebatch)
+	redisSlotsFlush(slots);
+    else if (!slots->writepending)
+	redis_write_schedule(slots);
+    return REDIS_OK;
+}
+
+/*
+ * Send all queued write requests, in the order first issued.
+ */
+void
+redisSlotsFlush(redisSlots *slots)
+{
+    redisSlotsWriteData	*wp, *next;
+    uint64_t		zero = 0;
+    sds			cmd;
+
+#if defined(HAVE_LIBUV)
+    if (slots->writepending)
+	uv_timer_stop((uv_timer_t *)slots->writetimer);
+#endif
+    slots->writepending = 0;
+
+    if ((wp = slots->writehead) == NULL)
+	return;
+    slots->writehead = slots->writetail = NULL;
+    slots->writequeued = 0;
+    dictEmpty(slots->writemap, NULL);
+
+    mmv_inc(slots->map, slots->metrics[SLOT_REQUESTS_FLUSHES]);
+    mmv_set(slots->map, slots->metrics[SLOT_REQUESTS_QUEUED_TOTAL], &zero);
+    mmv_set(slots->map, slots->metrics[SLOT_REQUESTS_QUEUED_BYTES], &zero);
+
+    for (; wp != NULL; wp = next) {
+	next = wp->next;
+	cmd = redis_command(2 + wp->nparams);
+	cmd = sdscatsds(cmd, wp->body);
+	if (redisSlotsRequest(slots, cmd, redis_write_callback, wp) != REDIS_OK) {
+	    /* as for direct requests, failed submissions get no callback */
+	    sdsfree(wp->body);
+	    free(wp->replies);
+	    free(wp);
+	}
+	sdsfree(cmd);
+    }
+}
+
 int
 redisSlotsProxyConnect(redisSlots *slots, redisInfoCallBack info,
 	redisReader **readerp, const char *buffer, ssize_t nread,
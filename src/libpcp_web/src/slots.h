@@ -45,6 +45,11 @@ enum {
     SLOT_REQUESTS_INFLIGHT_BYTES,
     SLOT_REQUESTS_TOTAL_BYTES,
     SLOT_RESPONSES_TOTAL_BYTES,
+    SLOT_REQUESTS_COALESCED,
+    SLOT_REQUESTS_QUEUED_TOTAL,
+    SLOT_REQUESTS_QUEUED_BYTES,
+    SLOT_REQUESTS_FLUSHES,
+    SLOT_REQUESTS_DEFERRED,
     NUM_SLOT_METRICS
 };
 
@@ -56,6 +61,12 @@ typedef enum redisSlotsState {
     SLOTS_ERR_FATAL	/* fatal error, do not try to reconnect */
 } redisSlotsState;
 
+#define DEFAULT_WRITE_BATCH	1024	/* flush once this many writes queued */
+#define DEFAULT_WRITE_DELAY	0	/* milliseconds before flushing writes */
+#define DEFAULT_WRITE_INFLIGHT	10000	/* defer timed flush above this */
+
+typedef struct redisSlotsWriteData redisSlotsWriteData;
+
 /* note: this struct persists for reconnects */
 typedef struct redisSlots {
     redisClusterAsyncContext *acc;	/* cluster context */
@@ -68,6 +79,17 @@ typedef struct redisSlots {
     mmv_registry_t	*registry;	/* MMV metrics for instrumentation */
     void		*map;		/* MMV mapped metric values handle */
     pmAtomValue		*metrics[NUM_SLOT_METRICS]; /* direct handle lookup */
+
+    dict		*writemap;	/* queued writes by command and key */
+    redisSlotsWriteData	*writehead;	/* queued writes, in issue order */
+    redisSlotsWriteData	*writetail;
+    unsigned int	writequeued;	/* number of queued write commands */
+    unsigned int	writebatch;	/* flush once this many writes queued */
+    unsigned int	writedelay;	/* flush this many msec after queueing */
+    unsigned int	writeinflight;	/* defer timed flush above inflight */
+    unsigned int	writepending : 1;	/* flush timer is running */
+    unsigned int	padding : 31;	/* zero-fill structure padding */
+    void		*writetimer;	/* libuv timer for queued writes */
 } redisSlots;
 
 /* wraps the actual Redis callback and data */
@@ -94,6 +116,8 @@ extern uint64_t redisSlotsInflightRequests(redisSlots *);
 extern int redisSlotsRequest(redisSlots *, sds, redisClusterCallbackFn *, void *);
 extern int redisSlotsRequestFirstNode(redisSlots *slots, const sds cmd,
 		redisClusterCallbackFn *callback, void *arg);
+extern int redisSlotsWrite(redisSlots *, sds, redisClusterCallbackFn *, void *);
+extern void redisSlotsFlush(redisSlots *);
 extern void redisSlotsFree(redisSlots *);
 
 extern int redisSlotsProxyConnect(redisSlots *,
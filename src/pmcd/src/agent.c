@@ -56,6 +56,23 @@ short_delay(int milliseconds)
     (void)nanosleep(&delay, NULL);
 }
 
+/*
+ * A not-ready agent may send an ERROR PDU to indicate it is ready again,
+ * so watch its output descriptor until then.  Called once as an agent
+ * becomes not ready (and again if it moves in a rebuilt agent table);
+ * the registration is dropped when the agent recovers or is cleaned up.
+ */
+void
+WatchNotReadyAgent(AgentInfo *aPtr)
+{
+    if (!aPtr->status.notReady || aPtr->outFd < 0)
+	return;
+    EventsAdd(aPtr->outFd, EV_AGENT, (int)(aPtr - agent));
+    if (pmDebugOptions.appl0)
+	pmNotifyErr(LOG_INFO, "not ready: check %s agent on fd %d\n",
+		     aPtr->pmDomainLabel, aPtr->outFd);
+}
+
 void
 CleanupAgent(AgentInfo* aPtr, int why, int status)
 {
@@ -82,6 +99,7 @@ CleanupAgent(AgentInfo* aPtr, int why, int status)
 	    aPtr->inFd = -1;
 	}
 	if (aPtr->outFd != -1) {
+	    EventsDel(aPtr->outFd);
 	    if (aPtr->ipcType == AGENT_SOCKET)
 	      __pmCloseSocket(aPtr->outFd);
 	    else {
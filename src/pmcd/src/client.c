@@ -20,7 +20,7 @@
 #define MIN_CLIENTS_ALLOC 8
 
 int		maxClientFd = -1;	/* largest fd for a client */
-__pmFdSet	clientFds;		/* for client select() */
+__pmFdSet	clientFds;		/* for client select(), if no epoll */
 
 static int	clientSize;
 
@@ -75,7 +75,7 @@ ClientInfo *
 AcceptNewClient(int reqfd)
 {
     static unsigned int	seq = 0;
-    int			i, fd;
+    int			i, fd, sts;
     __pmSockLen		addrlen;
     struct timeval	now;
 
@@ -108,7 +108,18 @@ AcceptNewClient(int reqfd)
 
     pmcd_openfds_sethi(fd);
 
-    __pmFD_SET(fd, &clientFds);
+    if (EventsActive()) {
+	if ((sts = EventsAdd(fd, EV_CLIENT, i)) < 0) {
+	    /* cannot watch for requests, so drop the client */
+	    pmNotifyErr(LOG_ERR, "AcceptNewClient(%d): cannot add client fd %d: %s\n",
+			    reqfd, fd, pmErrStr(sts));
+	    client[i].fd = fd;
+	    DeleteClient(&client[i]);
+	    return NULL;
+	}
+    }
+    else
+	__pmFD_SET(fd, &clientFds);
     __pmSetVersionIPC(fd, UNKNOWN_VERSION);	/* before negotiation */
     __pmSetSocketIPC(fd);
 
@@ -188,7 +199,10 @@ DeleteClient(ClientInfo *cp)
 	return;
     }
     if (cp->fd != -1) {
-	__pmFD_CLR(cp->fd, &clientFds);
+	if (EventsActive())
+	    EventsDel(cp->fd);
+	else
+	    __pmFD_CLR(cp->fd, &clientFds);
 	__pmCloseSocket(cp->fd);
     }
     if (i == nClients-1) {
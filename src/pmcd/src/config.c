@@ -2171,6 +2171,10 @@ ContactAgents(void)
 	    }
 	}
     }
+
+    /* agents may start not ready, and kept agents may have moved */
+    for (i = 0; i < nAgents; i++)
+	WatchNotReadyAgent(&agent[i]);
 }
 
 int
@@ -16,6 +16,9 @@
 #include "pmapi.h"
 #include "libpcp.h"
 #include "pmcd.h"
+#ifdef HAVE_POLL_H
+#include <poll.h>
+#endif
 
 /* Freq. histogram: pmids for each agent in current fetch request */
 
@@ -361,6 +364,71 @@ ExtractState(void *timestamp)
     return (int)byte;
 }
 
+/*
+ * Wait up to msec milliseconds (forever if negative) for a response from
+ * any busy agent, setting ready[i] for each agent i that has input pending.
+ * Returns the number of ready agents, 0 on timeout, else -1 (errno set).
+ */
+static int
+AgentsReady(int msec, char *ready)
+{
+    int			i, sts;
+#ifdef HAVE_POLL_H
+    static struct pollfd *pfds;
+    static int		*pidx;
+    static int		maxpfds;
+    int			npfds = 0;
+
+    /* poll(2) has no FD_SETSIZE limit on agent descriptor numbers */
+    if (nAgents > maxpfds) {
+	pfds = (struct pollfd *)realloc(pfds, nAgents * sizeof(struct pollfd));
+	pidx = (int *)realloc(pidx, nAgents * sizeof(int));
+	if (pfds == NULL || pidx == NULL) {
+	    pmNoMem("AgentsReady", nAgents * (sizeof(struct pollfd) + sizeof(int)), PM_FATAL_ERR);
+	    /* NOTREACHED */
+	}
+	maxpfds = nAgents;
+    }
+    for (i = 0; i < nAgents; i++) {
+	ready[i] = 0;
+	if (!agent[i].status.busy)
+	    continue;
+	pfds[npfds].fd = agent[i].outFd;
+	pfds[npfds].events = POLLIN;
+	pfds[npfds].revents = 0;
+	pidx[npfds++] = i;
+    }
+    if ((sts = poll(pfds, npfds, msec)) > 0) {
+	for (i = 0; i < npfds; i++)
+	    if (pfds[i].revents != 0)
+		ready[pidx[i]] = 1;
+    }
+#else
+    __pmFdSet		readyFds;
+    struct timeval	timeout;
+    int			maxFd = -1;
+
+    __pmFD_ZERO(&readyFds);
+    for (i = 0; i < nAgents; i++) {
+	ready[i] = 0;
+	if (!agent[i].status.busy)
+	    continue;
+	__pmFD_SET(agent[i].outFd, &readyFds);
+	if (agent[i].outFd > maxFd)
+	    maxFd = agent[i].outFd;
+    }
+    timeout.tv_sec = msec / 1000;
+    timeout.tv_usec = (msec % 1000) * 1000;
+    if ((sts = __pmSelectRead(maxFd+1, &readyFds,
+				msec < 0 ? NULL : &timeout)) > 0) {
+	for (i = 0; i < nAgents; i++)
+	    if (agent[i].status.busy && __pmFD_ISSET(agent[i].outFd, &readyFds))
+		ready[i] = 1;
+    }
+#endif
+    return sts;
+}
+
 /*
  * Handle both the original and high resolution fetch PDU requests.
  * The input handling and PMDA interactions are the same, difference
@@ -382,11 +450,12 @@ HandleFetch(ClientInfo *cip, __pmPDU* pb, int pdutype)
     static int		nDoms;
     static pmResult	**results;	/* array of replies from PMDAs */
     static int		*resIndex;
-    __pmFdSet		waitFds;
-    __pmFdSet		readyFds;
+    static char		*ready;		/* agents with a reply pending */
     int			nWait;
-    int			maxFd;
-    struct timeval	timeout;
+    int			pass;
+    int			msec;
+    struct timeval	now;
+    struct timeval	deadline;
     __pmHashCtl		*hcp;
     __pmHashNode	*hp;
     pmProfile		*profile;
@@ -396,10 +465,13 @@ HandleFetch(ClientInfo *cip, __pmPDU* pb, int pdutype)
 	    free(results);
 	if (resIndex != NULL)
 	    free(resIndex);
+	if (ready != NULL)
+	    free(ready);
 	results = (pmResult **)malloc((nAgents + 1) * sizeof (pmResult *));
 	resIndex = (int *)malloc((nAgents + 1) * sizeof(int));
-	if (results == NULL || resIndex == NULL) {
-	    pmNoMem("DoFetch.results", (nAgents + 1) * sizeof (pmResult *) + (nAgents + 1) * sizeof(int), PM_FATAL_ERR);
+	ready = (char *)malloc(nAgents + 1);
+	if (results == NULL || resIndex == NULL || ready == NULL) {
+	    pmNoMem("DoFetch.results", (nAgents + 1) * (sizeof (pmResult *) + sizeof(int) + 1), PM_FATAL_ERR);
 	    /* NOTREACHED */
 	}
 	nDoms = nAgents;
@@ -443,83 +515,106 @@ HandleFetch(ClientInfo *cip, __pmPDU* pb, int pdutype)
     dList = SplitPmidList(nPmids, pmidList);
 
     /* For each domain in the split pmidList, dispatch the per-domain subset
-     * of pmIDs to the appropriate agent.  For DSO agents, the pmResult will
-     * come back immediately.  If a request cannot be sent to an agent, a
-     * suitable pmResult (containing metric not available values) will be
-     * returned.
+     * of pmIDs to the appropriate agent.  Requests go to all of the daemon
+     * agents first (first pass), so that they are all working concurrently
+     * while the DSO agents are called (second pass) - DSO agents must run
+     * serially on this thread, as the libpcp_pmda state they share is not
+     * thread-safe.  For DSO agents, the pmResult will come back immediately.
+     * If a request cannot be sent to an agent, a suitable pmResult
+     * (containing metric not available values) will be returned.
      */
-    __pmFD_ZERO(&waitFds);
     nWait = 0;
-    maxFd = -1;
-    for (i = 0; dList[i].domain != -1; i++) {
-	j = mapdom[dList[i].domain];
-	results[j] = SendFetch(&dList[i], &agent[j], cip, ctxnum);
-	if (results[j] == NULL) { /* Wait for agent's response */
-	    int fd = agent[j].outFd;
-	    agent[j].status.busy = 1;
-	    __pmFD_SET(fd, &waitFds);
-	    if (fd > maxFd)
-		maxFd = fd;
-	    nWait++;
-	} else {
-	    changes |= ExtractState(&results[j]->timestamp);
+    for (pass = 0; pass < 2; pass++) {
+	for (i = 0; dList[i].domain != -1; i++) {
+	    j = mapdom[dList[i].domain];
+	    if ((agent[j].ipcType == AGENT_DSO) != pass)
+		continue;
+	    results[j] = SendFetch(&dList[i], &agent[j], cip, ctxnum);
+	    if (results[j] == NULL) { /* Wait for agent's response */
+		agent[j].status.busy = 1;
+		nWait++;
+	    } else {
+		changes |= ExtractState(&results[j]->timestamp);
+	    }
 	}
     }
     /* Construct pmResult for bad-pmID list */
     if (dList[i].listSize != 0)
 	results[nAgents] = MakeBadResult(dList[i].listSize, dList[i].list, PM_ERR_NOAGENT);
 
-    /* Wait for results to roll in from agents */
+    /*
+     * Wait for results to roll in from agents, handling each as it arrives.
+     * The timeout applies to the wait as a whole, so that fetch latency is
+     * bounded by the slowest agent rather than the sum over all agents.
+     */
+    pmtimevalNow(&deadline);
+    deadline.tv_sec += pmcd_timeout;
     while (nWait > 0) {
-        __pmFD_COPY(&readyFds, &waitFds);
-	if (nWait > 1) {
-	    timeout.tv_sec = pmcd_timeout;
-	    timeout.tv_usec = 0;
-
-            retry:
+	if (pmcd_timeout == TIMEOUT_NEVER)
+	    msec = -1;
+	else {
+	    pmtimevalNow(&now);
+	    if ((msec = (int)(pmtimevalSub(&deadline, &now) * 1000.0)) < 0)
+		msec = 0;
+	}
+	if (msec == 0)
+	    sts = 0;
+	else if (nWait > 1) {
 	    setoserror(0);
-	    sts = __pmSelectRead(maxFd+1, &readyFds, &timeout);
-
-	    if (sts == 0) {
-		pmNotifyErr(LOG_INFO, "DoFetch: select timeout");
-
-		/* Timeout, terminate agents with undelivered results */
-		for (i = 0; i < nAgents; i++) {
-		    if (agent[i].status.busy) {
-			/* Find entry in dList for this agent */
-			for (j = 0; dList[j].domain != -1; j++)
-			    if (dList[j].domain == agent[i].pmDomainId)
-				break;
-			results[i] = MakeBadResult(dList[j].listSize,
-						   dList[j].list,
-						   PM_ERR_NOAGENT);
-			pmcd_trace(TR_RECV_TIMEOUT, agent[i].outFd, PDU_RESULT, 0);
-			CleanupAgent(&agent[i], AT_COMM, agent[i].inFd);
-		    }
+	    sts = AgentsReady(msec, ready);
+	}
+	else {
+	    /* one agent left, __pmGetPDU below applies the remaining time */
+	    for (i = 0; i < nAgents; i++)
+		ready[i] = agent[i].status.busy;
+	    sts = 1;
+	}
+
+	if (sts == 0) {
+	    /* Deadline passed, terminate agents with undelivered results */
+	    for (i = 0; i < nAgents; i++) {
+		if (agent[i].status.busy) {
+		    pmNotifyErr(LOG_INFO, "DoFetch: \"%s\" agent missed the %d second fetch deadline\n",
+				agent[i].pmDomainLabel, pmcd_timeout);
+		    /* Find entry in dList for this agent */
+		    for (j = 0; dList[j].domain != -1; j++)
+			if (dList[j].domain == agent[i].pmDomainId)
+			    break;
+		    results[i] = MakeBadResult(dList[j].listSize,
+					       dList[j].list,
+					       PM_ERR_NOAGENT);
+		    pmcd_trace(TR_RECV_TIMEOUT, agent[i].outFd, PDU_RESULT, 0);
+		    CleanupAgent(&agent[i], AT_COMM, agent[i].inFd);
 		}
-		break;
-	    }
-	    else if (sts < 0) {
-		if (neterror() == EINTR)
-		    goto retry;
-		/* this is not expected to happen! */
-		pmNotifyErr(LOG_ERR, "DoFetch: fatal select failure: %s\n",
-			netstrerror());
-		Shutdown();
-		exit(1);
 	    }
+	    break;
+	}
+	else if (sts < 0) {
+	    if (neterror() == EINTR)
+		continue;
+	    /* this is not expected to happen! */
+	    pmNotifyErr(LOG_ERR, "DoFetch: fatal failure waiting for agents: %s\n",
+		    netstrerror());
+	    Shutdown();
+	    exit(1);
+	}
+	else if (nWait > 1 && msec > 0) {
+	    /* bound the reads below by the time left after the wait */
+	    pmtimevalNow(&now);
+	    if ((msec = (int)(pmtimevalSub(&deadline, &now) * 1000.0)) <= 0)
+		msec = 1;
 	}
 
 	/* Read results from agents that have them ready */
 	for (i = 0; i < nAgents; i++) {
 	    AgentInfo	*ap = &agent[i];
 	    int		pinpdu;
-	    if (!ap->status.busy || !__pmFD_ISSET(ap->outFd, &readyFds))
+	    if (!ap->status.busy || !ready[i])
 		continue;
 	    ap->status.busy = 0;
-	    __pmFD_CLR(ap->outFd, &waitFds);
 	    nWait--;
-	    pinpdu = sts = __pmGetPDU(ap->outFd, ANY_SIZE, pmcd_timeout, &pb);
+	    pinpdu = sts = __pmGetPDU(ap->outFd, ANY_SIZE,
+				msec < 0 ? TIMEOUT_NEVER : (msec + 999) / 1000, &pb);
 	    if (sts > 0)
 		pmcd_trace(TR_RECV_PDU, ap->outFd, sts, (int)((__psint_t)pb & 0xffffffff));
 	    if (sts == PDU_RESULT) {
@@ -555,6 +650,14 @@ HandleFetch(ClientInfo *cip, __pmPDU* pb, int pdutype)
 	    if (pinpdu > 0)
 		__pmUnpinPDUBuf(pb);
 
+	    if (sts == PM_ERR_TIMEOUT) {
+		/* last agent missed the deadline, as for the wait above */
+		pmNotifyErr(LOG_INFO, "DoFetch: \"%s\" agent missed the %d second fetch deadline\n",
+			    ap->pmDomainLabel, pmcd_timeout);
+		pmcd_trace(TR_RECV_TIMEOUT, ap->outFd, PDU_RESULT, 0);
+		sts = PM_ERR_NOAGENT;
+		CleanupAgent(ap, AT_COMM, ap->outFd);
+	    }
 	    if (sts < 0) {
 		/* Find entry in dList for this agent */
 		for (j = 0; dList[j].domain != -1; j++)
@@ -576,7 +679,7 @@ HandleFetch(ClientInfo *cip, __pmPDU* pb, int pdutype)
 		    fprintf(stderr, "RESULT error from \"%s\" agent : %s\n",
 			    ap->pmDomainLabel, pmErrStr(sts));
 		}
-		if (sts == PM_ERR_IPC || sts == PM_ERR_TIMEOUT)
+		if (sts == PM_ERR_IPC)
 		    CleanupAgent(ap, AT_COMM, ap->outFd);
 	    }
 	}
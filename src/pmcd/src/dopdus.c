@@ -35,6 +35,7 @@ CheckError(AgentInfo *ap, int sts)
 			 ap->status.notReady ? "not ready" : "ready");
 	if (ap->status.notReady == 0) {
 	    ap->status.notReady = 1;
+	    WatchNotReadyAgent(ap);
 	    retSts = PM_ERR_AGAIN;
 	}
 	else
@@ -0,0 +1,196 @@
+/*
+ * Copyright (c) 2026 Red Hat.
+ *
+ * This program is free software; you can redistribute it and/or modify it
+ * under the terms of the GNU General Public License as published by the
+ * Free Software Foundation; either version 2 of the License, or (at your
+ * option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of MERCHANTABILITY
+ * or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU General Public License
+ * for more details.
+ */
+
+/*
+ * Event engine for the pmcd main loop.
+ *
+ * Where the platform provides epoll(7), request ports, client sockets and
+ * not-ready agent descriptors are registered once with the kernel and
+ * EventsWait() returns only the descriptors that are ready, so the cost
+ * of each wakeup is independent of the number of connected clients and
+ * descriptors are not limited by FD_SETSIZE.
+ *
+ * Level-triggered notification is used deliberately: __pmGetPDU() reads
+ * exactly one PDU per call, so a client that has pipelined requests must
+ * continue to be reported ready until its socket has been drained.
+ *
+ * When epoll(7) is not available (or PMCD_SELECT is set in the environment)
+ * all routines here are no-ops and ClientLoop() uses select(2) as before.
+ */
+
+#include "pmcd.h"
+#ifdef HAVE_SYS_EPOLL_H
+#include <sys/epoll.h>
+#endif
+
+#ifdef HAVE_SYS_EPOLL_H
+static int	epollfd = -1;
+
+/*
+ * The epoll_data cookie carries the descriptor (high 32 bits) along
+ * with the event type and table index (low 32 bits), so that stale
+ * events for a recycled client slot can be detected and ignored.
+ */
+#define EV_TYPE_SHIFT	24
+#define EV_INDEX_MASK	((1U << EV_TYPE_SHIFT) - 1)
+
+static __uint64_t
+EventsCookie(int fd, int type, int index)
+{
+    __uint32_t	low;
+
+    low = ((__uint32_t)type << EV_TYPE_SHIFT) | ((__uint32_t)index & EV_INDEX_MASK);
+    return ((__uint64_t)(__uint32_t)fd << 32) | low;
+}
+#endif
+
+/*
+ * Returns 1 if the epoll engine is in use, else 0 (select fallback).
+ */
+int
+EventsInit(void)
+{
+#ifdef HAVE_SYS_EPOLL_H
+    char	*envstr;
+
+    if ((envstr = getenv("PMCD_SELECT")) != NULL && strcmp(envstr, "0") != 0) {
+	fprintf(stderr, "Warning: select(2) event loop from PMCD_SELECT=%s in environment\n", envstr);
+	return 0;
+    }
+    if ((epollfd = epoll_create1(EPOLL_CLOEXEC)) < 0) {
+	pmNotifyErr(LOG_WARNING, "EventsInit: epoll_create1 failed, "
+			"using select: %s\n", osstrerror());
+	epollfd = -1;
+	return 0;
+    }
+    pmcd_openfds_sethi(epollfd);
+    return 1;
+#else
+    return 0;
+#endif
+}
+
+int
+EventsActive(void)
+{
+#ifdef HAVE_SYS_EPOLL_H
+    return epollfd >= 0;
+#else
+    return 0;
+#endif
+}
+
+/*
+ * Register interest in input on fd.  Re-registering a descriptor that
+ * is already being watched updates its type and index.
+ */
+int
+EventsAdd(int fd, int type, int index)
+{
+#ifdef HAVE_SYS_EPOLL_H
+    struct epoll_event	event;
+    int			sts;
+
+    if (epollfd < 0 || fd < 0)
+	return 0;
+    memset(&event, 0, sizeof(event));
+    event.events = EPOLLIN;
+    event.data.u64 = EventsCookie(fd, type, index);
+    if ((sts = epoll_ctl(epollfd, EPOLL_CTL_ADD, fd, &event)) < 0 &&
+	oserror() == EEXIST)
+	sts = epoll_ctl(epollfd, EPOLL_CTL_MOD, fd, &event);
+    if (sts < 0) {
+	sts = -oserror();
+	pmNotifyErr(LOG_ERR, "EventsAdd: fd=%d type=%d index=%d: %s\n",
+			fd, type, index, pmErrStr(sts));
+	return sts;
+    }
+    if (pmDebugOptions.appl0)
+	fprintf(stderr, "EventsAdd: fd=%d type=%d index=%d\n", fd, type, index);
+#else
+    (void)fd; (void)type; (void)index;
+#endif
+    return 0;
+}
+
+/*
+ * Stop watching fd.  Must be called before the descriptor is closed,
+ * as an inherited duplicate would otherwise keep the registration alive.
+ */
+void
+EventsDel(int fd)
+{
+#ifdef HAVE_SYS_EPOLL_H
+    struct epoll_event	event;	/* for pre-2.6.9 kernels */
+
+    if (epollfd < 0 || fd < 0)
+	return;
+    memset(&event, 0, sizeof(event));
+    if (epoll_ctl(epollfd, EPOLL_CTL_DEL, fd, &event) < 0) {
+	if (pmDebugOptions.appl0)
+	    fprintf(stderr, "EventsDel: fd=%d: %s\n", fd, osstrerror());
+    }
+    else if (pmDebugOptions.appl0)
+	fprintf(stderr, "EventsDel: fd=%d\n", fd);
+#else
+    (void)fd;
+#endif
+}
+
+/*
+ * Wait (indefinitely, or until a signal arrives) for input on any of
+ * the registered descriptors, filling in at most maxevents entries.
+ * Returns the number of ready descriptors, 0 on EINTR, else -errno.
+ */
+int
+EventsWait(pmcdEvent *events, int maxevents)
+{
+#ifdef HAVE_SYS_EPOLL_H
+    static struct epoll_event	*ready;
+    static int			nready;
+    __uint32_t			low;
+    int				i, sts;
+
+    if (epollfd < 0)
+	return -EINVAL;
+    if (maxevents > nready) {
+	struct epoll_event	*tmp;
+	size_t			need = maxevents * sizeof(struct epoll_event);
+
+	if ((tmp = (struct epoll_event *)realloc(ready, need)) == NULL) {
+	    pmNoMem("EventsWait", need, PM_RECOV_ERR);
+	    return -ENOMEM;
+	}
+	ready = tmp;
+	nready = maxevents;
+    }
+    if ((sts = epoll_wait(epollfd, ready, maxevents, -1)) < 0) {
+	if (oserror() == EINTR)
+	    return 0;
+	return -oserror();
+    }
+    for (i = 0; i < sts; i++) {
+	low = (__uint32_t)ready[i].data.u64;
+	events[i].fd = (int)(ready[i].data.u64 >> 32);
+	events[i].type = (int)(low >> EV_TYPE_SHIFT);
+	events[i].index = (int)(low & EV_INDEX_MASK);
+	/* hangup or error is reported as input, to be seen by __pmGetPDU */
+	events[i].flags = ready[i].events;
+    }
+    return sts;
+#else
+    (void)events; (void)maxevents;
+    return -EOPNOTSUPP;
+#endif
+}
@@ -287,146 +287,154 @@ ParseOptions(int argc, char *argv[], int *nports)
 }
 
 /*
- * Determine which clients (if any) have sent data to the server and handle it
- * as required.
+ * Read one PDU from the client in slot i and handle it as required.
  */
-void
-HandleClientInput(__pmFdSet *fdsPtr)
+static void
+HandleClientPDU(int i)
 {
     int		sts;
-    int		i;
+    int		pinpdu;
     __pmPDU	*pb;
     __pmPDUHdr	*php;
     ClientInfo	*cp;
 
-    for (i = 0; i < nClients; i++) {
-	int		pinpdu;
+    cp = &client[i];
+    this_client_id = i;
 
-	if (!client[i].status.connected || !__pmFD_ISSET(client[i].fd, fdsPtr))
-	    continue;
+    pinpdu = sts = __pmGetPDU(cp->fd, LIMIT_SIZE, pmcd_timeout, &pb);
+    if (sts > 0) {
+	pmcd_trace(TR_RECV_PDU, cp->fd, sts, (int)((__psint_t)pb & 0xffffffff));
+    } else {
+	CleanupClient(cp, sts);
+	return;
+    }
 
-	cp = &client[i];
-	this_client_id = i;
+    php = (__pmPDUHdr *)pb;
+    if (__pmVersionIPC(cp->fd) == UNKNOWN_VERSION && php->type != PDU_CREDS) {
+	/* old V1 client protocol, no longer supported */
+	sts = PM_ERR_IPC;
+	CleanupClient(cp, sts);
+	__pmUnpinPDUBuf(pb);
+	return;
+    }
 
-	pinpdu = sts = __pmGetPDU(cp->fd, LIMIT_SIZE, pmcd_timeout, &pb);
-	if (sts > 0) {
-	    pmcd_trace(TR_RECV_PDU, cp->fd, sts, (int)((__psint_t)pb & 0xffffffff));
-	} else {
-	    CleanupClient(cp, sts);
-	    continue;
-	}
+    if (pmDebugOptions.appl0)
+	ShowClients(stderr);
 
-	php = (__pmPDUHdr *)pb;
-	if (__pmVersionIPC(cp->fd) == UNKNOWN_VERSION && php->type != PDU_CREDS) {
-	    /* old V1 client protocol, no longer supported */
-	    sts = PM_ERR_IPC;
-	    CleanupClient(cp, sts);
-	    __pmUnpinPDUBuf(pb);
-	    continue;
-	}
+    switch (php->type) {
+	case PDU_PROFILE:
+	    sts = (cp->denyOps & PMCD_OP_FETCH) ?
+		  PM_ERR_PERMISSION : DoProfile(cp, pb);
+	    break;
 
-	if (pmDebugOptions.appl0)
-	    ShowClients(stderr);
+	case PDU_FETCH:
+	    sts = (cp->denyOps & PMCD_OP_FETCH) ?
+		  PM_ERR_PERMISSION : DoFetch(cp, pb);
+	    break;
 
-	switch (php->type) {
-	    case PDU_PROFILE:
-		sts = (cp->denyOps & PMCD_OP_FETCH) ?
-		      PM_ERR_PERMISSION : DoProfile(cp, pb);
-		break;
+	case PDU_HIGHRES_FETCH:
+	    sts = (cp->denyOps & PMCD_OP_FETCH) ?
+		  PM_ERR_PERMISSION : DoHighResFetch(cp, pb);
+	    break;
 
-	    case PDU_FETCH:
-		sts = (cp->denyOps & PMCD_OP_FETCH) ?
-		      PM_ERR_PERMISSION : DoFetch(cp, pb);
-		break;
+	case PDU_INSTANCE_REQ:
+	    sts = (cp->denyOps & PMCD_OP_FETCH) ?
+		  PM_ERR_PERMISSION : DoInstance(cp, pb);
+	    break;
 
-	    case PDU_HIGHRES_FETCH:
-		sts = (cp->denyOps & PMCD_OP_FETCH) ?
-		      PM_ERR_PERMISSION : DoHighResFetch(cp, pb);
-		break;
+	case PDU_LABEL_REQ:
+	    sts = (cp->denyOps & PMCD_OP_FETCH) ?
+		  PM_ERR_PERMISSION : DoLabel(cp, pb);
+	    break;
 
-	    case PDU_INSTANCE_REQ:
-		sts = (cp->denyOps & PMCD_OP_FETCH) ?
-		      PM_ERR_PERMISSION : DoInstance(cp, pb);
-		break;
+	case PDU_DESC_REQ:
+	    sts = (cp->denyOps & PMCD_OP_FETCH) ?
+		  PM_ERR_PERMISSION : DoDesc(cp, pb);
+	    break;
 
-	    case PDU_LABEL_REQ:
-		sts = (cp->denyOps & PMCD_OP_FETCH) ?
-		      PM_ERR_PERMISSION : DoLabel(cp, pb);
-		break;
+	case PDU_DESC_IDS:
+	    sts = (cp->denyOps & PMCD_OP_FETCH) ?
+		  PM_ERR_PERMISSION : DoDescIDs(cp, pb);
+	    break;
 
-	    case PDU_DESC_REQ:
-		sts = (cp->denyOps & PMCD_OP_FETCH) ?
-		      PM_ERR_PERMISSION : DoDesc(cp, pb);
-		break;
+	case PDU_TEXT_REQ:
+	    sts = (cp->denyOps & PMCD_OP_FETCH) ?
+		  PM_ERR_PERMISSION : DoText(cp, pb);
+	    break;
 
-	    case PDU_DESC_IDS:
-		sts = (cp->denyOps & PMCD_OP_FETCH) ?
-		      PM_ERR_PERMISSION : DoDescIDs(cp, pb);
-		break;
+	case PDU_RESULT:
+	    sts = (cp->denyOps & PMCD_OP_STORE) ?
+		  PM_ERR_PERMISSION : DoStore(cp, pb);
+	    break;
 
-	    case PDU_TEXT_REQ:
-		sts = (cp->denyOps & PMCD_OP_FETCH) ?
-		      PM_ERR_PERMISSION : DoText(cp, pb);
-		break;
+	case PDU_PMNS_IDS:
+	    sts = (cp->denyOps & PMCD_OP_FETCH) ?
+		  PM_ERR_PERMISSION : DoPMNSIDs(cp, pb);
+	    break;
 
-	    case PDU_RESULT:
-		sts = (cp->denyOps & PMCD_OP_STORE) ?
-		      PM_ERR_PERMISSION : DoStore(cp, pb);
-		break;
+	case PDU_PMNS_NAMES:
+	    sts = (cp->denyOps & PMCD_OP_FETCH) ?
+		  PM_ERR_PERMISSION : DoPMNSNames(cp, pb);
+	    break;
 
-	    case PDU_PMNS_IDS:
-		sts = (cp->denyOps & PMCD_OP_FETCH) ?
-		      PM_ERR_PERMISSION : DoPMNSIDs(cp, pb);
-		break;
+	case PDU_PMNS_CHILD:
+	    sts = (cp->denyOps & PMCD_OP_FETCH) ?
+		  PM_ERR_PERMISSION : DoPMNSChild(cp, pb);
+	    break;
 
-	    case PDU_PMNS_NAMES:
-		sts = (cp->denyOps & PMCD_OP_FETCH) ?
-		      PM_ERR_PERMISSION : DoPMNSNames(cp, pb);
-		break;
+	case PDU_PMNS_TRAVERSE:
+	    sts = (cp->denyOps & PMCD_OP_FETCH) ?
+		  PM_ERR_PERMISSION : DoPMNSTraverse(cp, pb);
+	    break;
 
-	    case PDU_PMNS_CHILD:
-		sts = (cp->denyOps & PMCD_OP_FETCH) ?
-		      PM_ERR_PERMISSION : DoPMNSChild(cp, pb);
-		break;
+	case PDU_CREDS:
+	    sts = DoCreds(cp, pb);
+	    break;
 
-	    case PDU_PMNS_TRAVERSE:
-		sts = (cp->denyOps & PMCD_OP_FETCH) ?
-		      PM_ERR_PERMISSION : DoPMNSTraverse(cp, pb);
-		break;
+	default:
+	    sts = PM_ERR_IPC;
+    }
+    if (sts < 0) {
+	if (pmDebugOptions.appl0)
+	    fprintf(stderr, "PDU:  %s client[%d]: %s\n",
+		__pmPDUTypeStr(php->type), i, pmErrStr(sts));
+	/* Make sure client still alive before sending. */
+	if (cp->status.connected) {
+	    pmcd_trace(TR_XMIT_PDU, cp->fd, PDU_ERROR, sts);
+	    sts = __pmSendError(cp->fd, FROM_ANON, sts);
+	    if (sts < 0)
+		pmNotifyErr(LOG_ERR, "HandleClientInput: "
+		    "error sending Error PDU to client[%d] %s\n", i, pmErrStr(sts));
+	}
+    }
+    if (pinpdu > 0)
+	__pmUnpinPDUBuf(pb);
 
-	    case PDU_CREDS:
-		sts = DoCreds(cp, pb);
-		break;
+    /*
+     * May need to send connection attributes to interested PMDAs, if
+     * something changed for this client during this PDU exchange.
+     */
+    if (client[i].status.attributes) {
+	if (pmDebugOptions.appl1)
+	    pmNotifyErr(LOG_INFO, "Client idx=%d,seq=%d attrs reset\n",
+			    i, client[i].seq);
+	AgentsAttributes(i);
+    }
+}
 
-	    default:
-		sts = PM_ERR_IPC;
-	}
-	if (sts < 0) {
-	    if (pmDebugOptions.appl0)
-		fprintf(stderr, "PDU:  %s client[%d]: %s\n",
-		    __pmPDUTypeStr(php->type), i, pmErrStr(sts));
-	    /* Make sure client still alive before sending. */
-	    if (cp->status.connected) {
-		pmcd_trace(TR_XMIT_PDU, cp->fd, PDU_ERROR, sts);
-		sts = __pmSendError(cp->fd, FROM_ANON, sts);
-		if (sts < 0)
-		    pmNotifyErr(LOG_ERR, "HandleClientInput: "
-			"error sending Error PDU to client[%d] %s\n", i, pmErrStr(sts));
-	    }
-	}
-	if (pinpdu > 0)
-	    __pmUnpinPDUBuf(pb);
+/*
+ * Determine which clients (if any) have sent data to the server and handle it
+ * as required.
+ */
+void
+HandleClientInput(__pmFdSet *fdsPtr)
+{
+    int		i;
 
-	/*
-	 * May need to send connection attributes to interested PMDAs, if
-	 * something changed for this client during this PDU exchange.
-	 */
-	if (client[i].status.attributes) {
-	    if (pmDebugOptions.appl1)
-		pmNotifyErr(LOG_INFO, "Client idx=%d,seq=%d attrs reset\n",
-				i, client[i].seq);
-	    AgentsAttributes(i);
-	}
+    for (i = 0; i < nClients; i++) {
+	if (!client[i].status.connected || !__pmFD_ISSET(client[i].fd, fdsPtr))
+	    continue;
+	HandleClientPDU(i);
     }
 }
 
@@ -605,70 +613,77 @@ SignalReloadPMNS(void)
     }
 }
 
+/* Process I/O on the file descriptor from an agent that was marked as not
+ * ready to handle PDUs.  Returns 1 if the agent is now ready, else 0.
+ */
+static int
+HandleReadyAgent(AgentInfo *ap)
+{
+    int		s, sts;
+    int		fd;
+    int		reason;
+    int		pinpdu;
+    __pmPDU	*pb;
+
+    fd = ap->outFd;
+    /* Expect an error PDU containing PM_ERR_PMDAREADY */
+    reason = AT_COMM;	/* most errors are protocol failures */
+    pinpdu = sts = __pmGetPDU(ap->outFd, ANY_SIZE, pmcd_timeout, &pb);
+    if (sts > 0)
+	pmcd_trace(TR_RECV_PDU, ap->outFd, sts, (int)((__psint_t)pb & 0xffffffff));
+    if (sts == PDU_ERROR) {
+	s = __pmDecodeError(pb, &sts);
+	if (s < 0) {
+	    sts = s;
+	    pmcd_trace(TR_RECV_ERR, ap->outFd, PDU_ERROR, sts);
+	}
+	else {
+	    /* sts is the status code from the error PDU */
+	    if (pmDebugOptions.appl0)
+		pmNotifyErr(LOG_INFO,
+		     "%s agent (not ready) sent %s status(%d)\n",
+		     ap->pmDomainLabel,
+		     sts == PM_ERR_PMDAREADY ?
+				 "ready" : "unknown", sts);
+	    if (sts == PM_ERR_PMDAREADY) {
+		ap->status.notReady = 0;
+		sts = 1;
+	    }
+	    else {
+		pmcd_trace(TR_RECV_ERR, ap->outFd, PDU_ERROR, sts);
+		sts = PM_ERR_IPC;
+	    }
+	}
+    }
+    else {
+	if (sts < 0)
+	    pmcd_trace(TR_RECV_ERR, ap->outFd, PDU_RESULT, sts);
+	else
+	    pmcd_trace(TR_WRONG_PDU, ap->outFd, PDU_ERROR, sts);
+	sts = PM_ERR_IPC; /* Wrong PDU type */
+    }
+    if (pinpdu > 0)
+	__pmUnpinPDUBuf(pb);
+
+    if (ap->ipcType != AGENT_DSO && sts <= 0)
+	CleanupAgent(ap, reason, fd);
+    return (sts == 1);
+}
+
 /* Process I/O on file descriptors from agents that were marked as not ready
  * to handle PDUs.
  */
 static int
 HandleReadyAgents(__pmFdSet *readyFds)
 {
-    int		i, s, sts;
-    int		fd;
-    int		reason;
+    int		i;
     int		ready = 0;
     AgentInfo	*ap;
-    __pmPDU	*pb;
 
     for (i = 0; i < nAgents; i++) {
 	ap = &agent[i];
-	if (ap->status.notReady) {
-	    fd = ap->outFd;
-	    if (__pmFD_ISSET(fd, readyFds)) {
-		int		pinpdu;
-
-		/* Expect an error PDU containing PM_ERR_PMDAREADY */
-		reason = AT_COMM;	/* most errors are protocol failures */
-		pinpdu = sts = __pmGetPDU(ap->outFd, ANY_SIZE, pmcd_timeout, &pb);
-		if (sts > 0)
-		    pmcd_trace(TR_RECV_PDU, ap->outFd, sts, (int)((__psint_t)pb & 0xffffffff));
-		if (sts == PDU_ERROR) {
-		    s = __pmDecodeError(pb, &sts);
-		    if (s < 0) {
-			sts = s;
-			pmcd_trace(TR_RECV_ERR, ap->outFd, PDU_ERROR, sts);
-		    }
-		    else {
-			/* sts is the status code from the error PDU */
-			if (pmDebugOptions.appl0)
-			    pmNotifyErr(LOG_INFO,
-				 "%s agent (not ready) sent %s status(%d)\n",
-				 ap->pmDomainLabel,
-				 sts == PM_ERR_PMDAREADY ?
-					     "ready" : "unknown", sts);
-			if (sts == PM_ERR_PMDAREADY) {
-			    ap->status.notReady = 0;
-			    sts = 1;
-			    ready++;
-			}
-			else {
-			    pmcd_trace(TR_RECV_ERR, ap->outFd, PDU_ERROR, sts);
-			    sts = PM_ERR_IPC;
-			}
-		    }
-		}
-		else {
-		    if (sts < 0)
-			pmcd_trace(TR_RECV_ERR, ap->outFd, PDU_RESULT, sts);
-		    else
-			pmcd_trace(TR_WRONG_PDU, ap->outFd, PDU_ERROR, sts);
- 		    sts = PM_ERR_IPC; /* Wrong PDU type */
-		}
-		if (pinpdu > 0)
-		    __pmUnpinPDUBuf(pb);
-
-		if (ap->ipcType != AGENT_DSO && sts <= 0)
-		    CleanupAgent(ap, reason, fd);
-	    }
-	}
+	if (ap->status.notReady && __pmFD_ISSET(ap->outFd, readyFds))
+	    ready += HandleReadyAgent(ap);
     }
     return ready;
 }
@@ -756,62 +771,156 @@ CheckNewClient(__pmFdSet * fdset, int rfd, int family)
     }
 }
 
-/* Loop, synchronously processing requests from clients. */
-
-static void
-ClientLoop(void)
+/*
+ * Wait for input using select(2), then process any new connections and
+ * requests, checking every client and not-ready agent descriptor.
+ * Returns -1 on fatal error, else 0.
+ */
+static int
+SelectClientInput(int *reload_namespace)
 {
     int		i, fd, sts;
     int		maxFd;
     int		checkAgents;
-    int		reload_namespace = 0;
-    int		restartAgents = -1;	/* initial state unknown */
     __pmFdSet	readableFds;
 
-    for (;;) {
+    /* Figure out which file descriptors to wait for input on.  Keep
+     * track of the highest numbered descriptor for the select call.
+     */
+    readableFds = clientFds;
+    maxFd = maxClientFd + 1;
 
-	/* Figure out which file descriptors to wait for input on.  Keep
-	 * track of the highest numbered descriptor for the select call.
-	 */
-	readableFds = clientFds;
-	maxFd = maxClientFd + 1;
+    /* If an agent was not ready, it may send an ERROR PDU to indicate it
+     * is now ready.  Add such agents to the list of file descriptors.
+     */
+    checkAgents = 0;
+    for (i = 0; i < nAgents; i++) {
+	AgentInfo	*ap = &agent[i];
 
-	/* If an agent was not ready, it may send an ERROR PDU to indicate it
-	 * is now ready.  Add such agents to the list of file descriptors.
-	 */
-	checkAgents = 0;
-	for (i = 0; i < nAgents; i++) {
-	    AgentInfo	*ap = &agent[i];
-
-	    if (ap->status.notReady) {
-		fd = ap->outFd;
-		__pmFD_SET(fd, &readableFds);
-		if (fd > maxFd)
-		    maxFd = fd + 1;
-		checkAgents = 1;
-		if (pmDebugOptions.appl0)
-		    pmNotifyErr(LOG_INFO,
-				 "not ready: check %s agent on fd %d (max = %d)\n",
-				 ap->pmDomainLabel, fd, maxFd);
-	    }
+	if (ap->status.notReady) {
+	    fd = ap->outFd;
+	    __pmFD_SET(fd, &readableFds);
+	    if (fd > maxFd)
+		maxFd = fd + 1;
+	    checkAgents = 1;
+	    if (pmDebugOptions.appl0)
+		pmNotifyErr(LOG_INFO,
+			     "not ready: check %s agent on fd %d (max = %d)\n",
+			     ap->pmDomainLabel, fd, maxFd);
 	}
+    }
 
-	sts = __pmSelectRead(maxFd, &readableFds, NULL);
-	if (sts > 0) {
-	    if (pmDebugOptions.appl0)
-		for (i = 0; i <= maxClientFd; i++)
-		    if (__pmFD_ISSET(i, &readableFds))
-			fprintf(stderr, "DATA: from %s (fd %d)\n",
-				FdToString(i), i);
-	    __pmServerAddNewClients(&readableFds, CheckNewClient);
-	    if (checkAgents)
-		reload_namespace = HandleReadyAgents(&readableFds);
-	    HandleClientInput(&readableFds);
+    sts = __pmSelectRead(maxFd, &readableFds, NULL);
+    if (sts > 0) {
+	if (pmDebugOptions.appl0)
+	    for (i = 0; i <= maxClientFd; i++)
+		if (__pmFD_ISSET(i, &readableFds))
+		    fprintf(stderr, "DATA: from %s (fd %d)\n",
+			    FdToString(i), i);
+	__pmServerAddNewClients(&readableFds, CheckNewClient);
+	if (checkAgents)
+	    *reload_namespace = HandleReadyAgents(&readableFds);
+	HandleClientInput(&readableFds);
+    }
+    else if (sts == -1 && neterror() != EINTR) {
+	pmNotifyErr(LOG_ERR, "ClientLoop select: %s\n", netstrerror());
+	return -1;
+    }
+    return 0;
+}
+
+/* Register a request port (listening socket) with the event engine */
+static void
+AddRequestPortEvent(__pmFdSet *unused, int fd, int family)
+{
+    (void)unused;
+    EventsAdd(fd, EV_REQUEST_PORT, family);
+}
+
+#define MAXEVENTS	256	/* maximum descriptors handled per wakeup */
+
+/*
+ * Wait for input using the event engine, then process only those request
+ * ports, clients and not-ready agents that have input available.
+ * Returns -1 on fatal error, else 0.
+ */
+static int
+EventClientInput(int *reload_namespace)
+{
+    static pmcdEvent	events[MAXEVENTS];
+    __pmFdSet		portFds;
+    AgentInfo		*ap;
+    int			i, fd, sts, index;
+
+    if ((sts = EventsWait(events, MAXEVENTS)) < 0) {
+	pmNotifyErr(LOG_ERR, "ClientLoop epoll: %s\n", pmErrStr(sts));
+	return -1;
+    }
+
+    for (i = 0; i < sts; i++) {
+	fd = events[i].fd;
+	index = events[i].index;
+	if (pmDebugOptions.appl0)
+	    fprintf(stderr, "DATA: from %s (fd %d)\n", FdToString(fd), fd);
+
+	switch (events[i].type) {
+	    case EV_REQUEST_PORT:
+		/* request ports are opened first, so always < FD_SETSIZE */
+		__pmFD_ZERO(&portFds);
+		__pmFD_SET(fd, &portFds);
+		CheckNewClient(&portFds, fd, index);
+		break;
+
+	    case EV_AGENT:
+		/* agent table may have been rebuilt since the event was queued */
+		if (index >= nAgents || agent[index].outFd != fd)
+		    break;
+		ap = &agent[index];
+		if (!ap->status.notReady)
+		    EventsDel(fd);
+		else if (HandleReadyAgent(ap)) {
+		    EventsDel(fd);
+		    *reload_namespace = 1;
+		}
+		break;
+
+	    case EV_CLIENT:
+		/* client may have gone or its slot been reused in this batch */
+		if (index >= nClients || !client[index].status.connected ||
+		    client[index].fd != fd)
+		    break;
+		HandleClientPDU(index);
+		break;
 	}
-	else if (sts == -1 && neterror() != EINTR) {
-	    pmNotifyErr(LOG_ERR, "ClientLoop select: %s\n", netstrerror());
+    }
+    return 0;
+}
+
+/* Loop, synchronously processing requests from clients. */
+
+static void
+ClientLoop(void)
+{
+    int		i, sts;
+    int		events;
+    int		reload_namespace = 0;
+    int		restartAgents = -1;	/* initial state unknown */
+
+    if ((events = EventsInit()) != 0) {
+	__pmServerAddNewClients(NULL, AddRequestPortEvent);
+	for (i = 0; i < nAgents; i++)
+	    WatchNotReadyAgent(&agent[i]);
+    }
+
+    for (;;) {
+
+	if (events)
+	    sts = EventClientInput(&reload_namespace);
+	else
+	    sts = SelectClientInput(&reload_namespace);
+	if (sts < 0)
 	    break;
-	}
+
 	if (AgentDied) {
 	    if (restartAgents == -1) {
 		char *args;
@@ -147,6 +147,7 @@ extern int		AgentDied;	/* for updating mapdom[] */
 
 PMCD_CALL extern AgentInfo *pmcd_agent(int);
 extern void CleanupAgent(AgentInfo *, int, int);
+extern void WatchNotReadyAgent(AgentInfo *);
 extern int HarvestAgents(unsigned int);
 
 /* pmdaroot file descriptor */
@@ -234,6 +235,26 @@ extern int ClientsAttributes(AgentInfo *);
 extern int AgentsAttributes(int);
 extern int CheckError(AgentInfo *, int);
 
+/*
+ * Main loop event engine (epoll where available, else select)
+ */
+#define EV_REQUEST_PORT	1	/* index is address family */
+#define EV_CLIENT	2	/* index into client[] */
+#define EV_AGENT	3	/* index into agent[] */
+
+typedef struct {
+    int		fd;
+    int		type;		/* EV_* value */
+    int		index;		/* client[] or agent[] index */
+    unsigned int flags;
+} pmcdEvent;
+
+extern int EventsInit(void);
+extern int EventsActive(void);
+extern int EventsAdd(int, int, int);
+extern void EventsDel(int);
+extern int EventsWait(pmcdEvent *, int);
+
 /*
  * Highest known file descriptor used for a Client or an Agent connection.
  * This is reported in the pmcd.openfds metric.
@@ -9700,6 +9700,90 @@ linux_fetchCallBack(pmdaMetric *mdesc, unsigned int inst, pmAtomValue *atom)
     return PMDA_FETCH_STATIC;
 }
 
+/*
+ * Per-CPU and per-node CPU time metrics from /proc/stat, as sums and
+ * differences of cpuacct_t fields (by offset, -1 for none) - so that
+ * the batch callback selects these once per metric, not per instance.
+ */
+typedef struct {
+    unsigned int	cpuitem;	/* kernel.percpu.cpu.* item */
+    unsigned int	nodeitem;	/* kernel.pernode.cpu.* item */
+    int			idle;		/* =1 uses _pm_idletime_size */
+    int			add;		/* field value, */
+    int			add2;		/* plus this field, or */
+    int			sub;		/* less this field */
+} cpuacct_metric_t;
+
+#define ACCT(f)	((int)offsetof(cpuacct_t, f))
+static cpuacct_metric_t cpuacct_metrics[] = {
+    {  0, 62, 0, ACCT(user), -1, -1 },
+    {  1, 63, 0, ACCT(nice), -1, -1 },
+    {  2, 64, 0, ACCT(sys), -1, -1 },
+    {  3, 65, 1, ACCT(idle), -1, -1 },
+    { 30, 69, 0, ACCT(wait), -1, -1 },
+    { 31, 66, 0, ACCT(irq), ACCT(sirq), -1 },
+    { 56, 70, 0, ACCT(sirq), -1, -1 },
+    { 57, 71, 0, ACCT(irq), -1, -1 },
+    { 58, 67, 0, ACCT(steal), -1, -1 },
+    { 61, 68, 0, ACCT(guest), -1, -1 },
+    { 76, 77, 0, ACCT(user), -1, ACCT(guest) },
+    { 83, 85, 0, ACCT(guest_nice), -1, -1 },
+    { 84, 86, 0, ACCT(nice), -1, ACCT(guest_nice) },
+};
+#undef ACCT
+#define ACCT_FIELD(sp, off)	(*(unsigned long long *)((char *)(sp) + (off)))
+
+/*
+ * Batch callback provided to pmdaFetch, for the metrics over the CPU
+ * and NUMA node instance domains - everything else is handled by the
+ * linux_fetchCallBack routine above, one instance at a time.
+ */
+static int
+linux_fetchBatchCallBack(pmdaMetric *mdesc, int numinst,
+		const unsigned int *insts, pmAtomValue *atoms, int *sts)
+{
+    unsigned int	item = pmID_item(mdesc->m_desc.pmid);
+    pmInDom		indom = mdesc->m_desc.indom;
+    cpuacct_metric_t	*mp;
+    cpuacct_t		*sp;
+    double		value;
+    void		*data;
+    int			i, size, pernode = 0;
+
+    if (mdesc->m_user != NULL || pmID_cluster(mdesc->m_desc.pmid) != CLUSTER_STAT)
+	return PM_ERR_NYI;
+
+    for (i = 0; i < sizeof(cpuacct_metrics)/sizeof(cpuacct_metrics[0]); i++) {
+	mp = &cpuacct_metrics[i];
+	if (item == mp->cpuitem)
+	    break;
+	if (item == mp->nodeitem) {
+	    pernode = 1;
+	    break;
+	}
+    }
+    if (i == sizeof(cpuacct_metrics)/sizeof(cpuacct_metrics[0]))
+	return PM_ERR_NYI;
+    size = mp->idle ? _pm_idletime_size : _pm_cputime_size;
+
+    for (i = 0; i < numinst; i++) {
+	if (pmdaCacheLookup(indom, insts[i], NULL, &data) < 0) {
+	    sts[i] = PM_ERR_INST;
+	    continue;
+	}
+	sp = pernode ? &((pernode_t *)data)->stat : &((percpu_t *)data)->stat;
+	if (mp->sub >= 0)
+	    value = (double)(ACCT_FIELD(sp, mp->add) - ACCT_FIELD(sp, mp->sub));
+	else if (mp->add2 >= 0)
+	    value = (double)ACCT_FIELD(sp, mp->add) + (double)ACCT_FIELD(sp, mp->add2);
+	else
+	    value = (double)ACCT_FIELD(sp, mp->add);
+	_pm_assign_utype(size, &atoms[i], 1000 * value / hz);
+	sts[i] = PMDA_FETCH_STATIC;
+    }
+    return 0;
+}
+
 
 static int
 linux_fetch(int numpmid, pmID pmidlist[], pmResult **resp, pmdaExt *pmda)
@@ -10287,6 +10371,7 @@ linux_init(pmdaInterface *dp)
     pmdaSetLabelCallBack(dp, linux_labelCallBack);
     pmdaSetEndContextCallBack(dp, linux_endContextCallBack);
     pmdaSetFetchCallBack(dp, linux_fetchCallBack);
+    pmdaSetFetchBatchCallBack(dp, linux_fetchBatchCallBack);
 
     proc_buddyinfo.indom = &indomtab[BUDDYINFO_INDOM];
 
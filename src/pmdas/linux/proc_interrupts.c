@@ -15,13 +15,35 @@
 #include "linux.h"
 #include "filesys.h"
 #include "proc_interrupts.h"
+#include "proc_reader.h"
 #include <sys/stat.h>
 #include <ctype.h>
 
-static char *iobuf;			/* buffer sized based on CPU count */
-static unsigned int iobufsz;
-
-static online_cpu_t *online_cpumap;	/* maps input columns to CPU info */
+/*
+ * Layout of /proc/interrupts or /proc/softirqs - the header and the
+ * row names - at the last refresh that had to (re)build it, and the
+ * rows themselves.  While the layout is unchanged (the common case),
+ * values are stored via interrupt_t cpus[] without any of the pmdaCache
+ * instance name lookups that otherwise dominate refresh time, with one
+ * instance per CPU per interrupt.
+ */
+typedef struct {
+    proc_reader_t	reader;		/* file contents, by line */
+    unsigned int	nlines;		/* lines of this refresh ... */
+    unsigned int	maxlines;
+    char		**names;	/* ... row names, NULL if not a row */
+    char		**values;	/* ... and the values following */
+    char		*header;	/* layout: header line, */
+    unsigned int	nrows;		/* number of rows, */
+    unsigned int	maxrows;
+    char		**rownames;	/* and row names, */
+    interrupt_t		**rows;		/* for these rows */
+} interrupt_table_t;
+
+static interrupt_table_t interrupts = { .reader = PROC_READER_INIT };
+static interrupt_table_t softirqs = { .reader = PROC_READER_INIT };
+
+static online_cpu_t *online_cpumap;	/* column CPU ids, and per-CPU sums */
 unsigned int irq_err_count;
 unsigned int irq_mis_count;
 
@@ -34,15 +56,9 @@ setup_buffers(void)
     static int setup;
 
     if (!setup) {
-	if ((iobufsz = (_pm_ncpus * 64)) < BUFSIZ)
-	    iobufsz = BUFSIZ;
-	if ((iobuf = malloc(iobufsz)) == NULL)
-	    return;
 	online_cpumap = calloc(_pm_ncpus, sizeof(online_cpu_t));
-	if (!online_cpumap) {
-	    free(iobuf);
+	if (!online_cpumap)
 	    return;
-	}
 	setup = 1;
     }
 }
@@ -59,11 +75,13 @@ map_online_cpus(char *buffer)
     for (s = buffer; i < _pm_ncpus && *s != '\0'; s++) {
 	if (!isdigit((int)*s))
 	    continue;
-	cpuid = (unsigned int)strtoul(s, &end, 10);
+	cpuid = (unsigned int)proc_strtoull(s, &end);
 	if (end == s)
 	    break;
 	online_cpumap[i++].cpuid = cpuid;
 	s = end;
+	if (*s == '\0')
+	    break;
     }
     return i;
 }
@@ -74,14 +92,7 @@ map_online_cpus(char *buffer)
 static int
 column_to_cpuid(int column)
 {
-    int i;
-
-    if (online_cpumap[column].cpuid == column)
-	return column;
-    for (i = 0; i < _pm_ncpus; i++)
-	if (online_cpumap[i].cpuid == column)
-	    return i;
-    return 0;
+    return online_cpumap[column].cpuid;
 }
 
 /*
@@ -119,51 +130,182 @@ extract_interrupt_name(char *buffer, char **suffix)
     prev = end - 1;
     if (*prev == '_' || *prev == ':')	/* overwrite final non-name char */
 	end--;				/* and then move end of name */
-    *end = '\0';			/* mark end of name */
-    *suffix = end + 1;			/* mark values start */
+    if (*end == '\0') {			/* no values at all */
+	*suffix = end;
+    } else {
+	*end = '\0';			/* mark end of name */
+	*suffix = end + 1;		/* mark values start */
+    }
     return s;
 }
 
+/*
+ * Extract a "TAG: count" line value, where the tag is 4 characters
+ */
+static int
+extract_interrupt_count(char *buffer, const char *tag, unsigned int *count)
+{
+    unsigned long long value;
+    char *end;
+
+    if (strncmp(buffer, tag, 4) != 0)
+	return 0;
+    value = proc_strtoull(buffer + 4, &end);
+    if (end == buffer + 4)
+	return 0;
+    *count = (unsigned int)value;
+    return 1;
+}
+
 static int
 extract_interrupt_errors(char *buffer)
 {
-    return (sscanf(buffer, "ERR: %u", &irq_err_count) == 1 ||
-	    sscanf(buffer, "Err: %u", &irq_err_count) == 1  ||
-	    sscanf(buffer, "BAD: %u", &irq_err_count) == 1);
+    return (extract_interrupt_count(buffer, "ERR:", &irq_err_count) ||
+	    extract_interrupt_count(buffer, "Err:", &irq_err_count) ||
+	    extract_interrupt_count(buffer, "BAD:", &irq_err_count));
 }
 
 static int
 extract_interrupt_misses(char *buffer)
 {
-    return sscanf(buffer, "MIS: %u", &irq_mis_count) == 1;
+    return extract_interrupt_count(buffer, "MIS:", &irq_mis_count);
+}
+
+/*
+ * Split each row into name and values (error and miss count lines
+ * are extracted as a side-effect for /proc/interrupts), and return
+ * non-zero if the table layout is unchanged since the last rebuild.
+ */
+static int
+extract_interrupt_rows(interrupt_table_t *tp, int counts)
+{
+    proc_reader_t *rp = &tp->reader;
+    unsigned int i, nlines = rp->nlines - 1;
+    char **lines = rp->lines + 1, *name, *values;
+    int same;
+
+    if (nlines > tp->maxlines) {
+	char **np, **vp;
+
+	if ((np = realloc(tp->names, nlines * sizeof(char *))) == NULL)
+	    return -ENOMEM;
+	tp->names = np;
+	if ((vp = realloc(tp->values, nlines * sizeof(char *))) == NULL)
+	    return -ENOMEM;
+	tp->values = vp;
+	tp->maxlines = nlines;
+    }
+    tp->nlines = nlines;
+
+    same = (tp->header != NULL && tp->nrows == nlines &&
+	    strcmp(tp->header, rp->lines[0]) == 0);
+    for (i = 0; i < nlines; i++) {
+	name = values = NULL;
+	if (counts && (extract_interrupt_errors(lines[i]) ||
+		       extract_interrupt_misses(lines[i])))
+	    ;
+	else if (lines[i][0] != '\0')
+	    name = extract_interrupt_name(lines[i], &values);
+	tp->names[i] = name;
+	tp->values[i] = values;
+	if (same) {
+	    if (name == NULL || tp->rownames[i] == NULL)
+		same = (name == tp->rownames[i]);
+	    else
+		same = (strcmp(name, tp->rownames[i]) == 0);
+	}
+    }
+    return same;
 }
 
+static void
+add_cpu_count(int softirq, unsigned int cpuid, unsigned long value)
+{
+    if (cpuid >= _pm_ncpus)
+	return;
+    if (softirq)
+	online_cpumap[cpuid].sirq_count += value;
+    else
+	online_cpumap[cpuid].intr_count += value;
+}
+
+/*
+ * Fast path refresh, layout unchanged - returns non-zero if any row
+ * now parses differently to the last rebuild, in which case a full
+ * rebuild is needed (after resetting the per-CPU totals).
+ */
 static int
-extract_interrupt_values(char *name, char *buffer, pmInDom intr, pmInDom cpuintr, int ncolumns)
+refresh_interrupt_values(interrupt_table_t *tp, int softirq, int ncolumns)
+{
+    unsigned int r, i;
+    unsigned long value;
+    interrupt_cpu_t *cpuip;
+    interrupt_t *ip;
+    char *s, *end;
+
+    for (r = 0; r < tp->nrows; r++) {
+	if ((ip = tp->rows[r]) == NULL)
+	    continue;
+	if (ip->ncolumns < ncolumns)
+	    return 1;
+	ip->total = 0;
+	for (s = tp->values[r], i = 0; i < ncolumns; i++) {
+	    value = proc_strtoull(s, &end);
+	    if (*end != '\0' && !isspace((int)*end)) {
+		if (ip->cpus[i] != NULL)
+		    return 1;
+		continue;
+	    }
+	    if ((cpuip = ip->cpus[i]) == NULL)
+		return 1;
+	    s = end;
+	    add_cpu_count(softirq, cpuip->cpuid, value);
+	    cpuip->value = value;
+	    ip->total += value;
+	}
+    }
+    return 0;
+}
+
+static int
+extract_interrupt_values(char *name, char *buffer, pmInDom intr, pmInDom cpuintr,
+		int ncolumns, int softirq, interrupt_t **rowp)
 {
     unsigned long i, cpuid, value;
     char *s = buffer, *end = NULL;
     char cpubuf[64];
-    interrupt_cpu_t *cpuip;
+    interrupt_cpu_t *cpuip, **cpus;
     interrupt_t *ip = NULL;
     int sts, changed = 0;
 
+    *rowp = NULL;
     sts = pmdaCacheLookupName(intr, name, NULL, (void **)&ip);
     if (sts < 0 || ip == NULL) {
 	if ((ip = calloc(1, sizeof(interrupt_t))) == NULL)
 	    return 0;
 	changed = 1;
     }
+    if (ip->ncolumns < ncolumns) {
+	if ((cpus = realloc(ip->cpus, ncolumns * sizeof(interrupt_cpu_t *))) == NULL) {
+	    if (changed)
+		free(ip);
+	    return 0;
+	}
+	ip->cpus = cpus;
+	ip->ncolumns = ncolumns;
+    }
+    if (ip->cpus != NULL)
+	memset(ip->cpus, 0, ip->ncolumns * sizeof(interrupt_cpu_t *));
 
     ip->total = 0;
     for (i = 0; i < ncolumns; i++) {
-	value = strtoul(s, &end, 10);
-	if (!isspace(*end))
+	value = proc_strtoull(s, &end);
+	if (*end != '\0' && !isspace((int)*end))
 	    continue;
 	s = end;
 	cpuip = NULL;
 	cpuid = column_to_cpuid(i);
-	online_cpumap[cpuid].intr_count += value;
+	add_cpu_count(softirq, cpuid, value);
 	pmsprintf(cpubuf, sizeof cpubuf, "%s::cpu%lu", name, cpuid);
 	sts = pmdaCacheLookupName(cpuintr, cpubuf, NULL, (void **)&cpuip);
 	if (sts < 0 || cpuip == NULL) {
@@ -174,6 +316,7 @@ extract_interrupt_values(char *name, char *buffer, pmInDom intr, pmInDom cpuintr
 	cpuip->cpuid = cpuid;
 	cpuip->value = value;
 	ip->total += value;
+	ip->cpus[i] = cpuip;
 
 	pmdaCacheStore(cpuintr, PMDA_CACHE_ADD, cpubuf, cpuip);
     }
@@ -182,53 +325,109 @@ extract_interrupt_values(char *name, char *buffer, pmInDom intr, pmInDom cpuintr
     if (ip->label == NULL)
 	ip->label = end ? strdup(label_reformat(end)) : NULL;
 
+    *rowp = ip;
     return changed;
 }
 
-int
-refresh_proc_interrupts(void)
+/*
+ * Forget the current layout, making space for the new one
+ */
+static int
+reset_interrupt_layout(interrupt_table_t *tp)
 {
-    static int setup;
-    FILE *fp;
-    char *name, *values;
-    int i, save, ncolumns;
-    pmInDom intr_indom = INDOM(INTERRUPT_INDOM);
-    pmInDom cpu_intr_indom = INDOM(INTERRUPT_CPU_INDOM);
-
-    if (!setup) {
-	pmdaCacheOp(cpu_intr_indom, PMDA_CACHE_LOAD);
-	pmdaCacheOp(intr_indom, PMDA_CACHE_LOAD);
-	setup = 1;
+    unsigned int i;
+    interrupt_t **rp;
+    char **np;
+
+    for (i = 0; i < tp->nrows; i++)
+	free(tp->rownames[i]);
+    tp->nrows = 0;
+    free(tp->header);
+    tp->header = NULL;
+
+    if (tp->nlines > tp->maxrows) {
+	if ((np = realloc(tp->rownames, tp->nlines * sizeof(char *))) == NULL)
+	    return -ENOMEM;
+	tp->rownames = np;
+	if ((rp = realloc(tp->rows, tp->nlines * sizeof(interrupt_t *))) == NULL)
+	    return -ENOMEM;
+	tp->rows = rp;
+	tp->maxrows = tp->nlines;
     }
-    pmdaCacheOp(cpu_intr_indom, PMDA_CACHE_INACTIVE);
-    pmdaCacheOp(intr_indom, PMDA_CACHE_INACTIVE);
+    return 0;
+}
 
-    setup_buffers();
-    for (i = 0; i < _pm_ncpus; i++)
-	online_cpumap[i].intr_count = 0;
+/*
+ * Remember the layout just rebuilt, for the next refresh
+ */
+static void
+save_interrupt_layout(interrupt_table_t *tp)
+{
+    unsigned int i;
+
+    for (i = 0; i < tp->nlines; i++) {
+	if (tp->names[i] == NULL)
+	    tp->rownames[i] = NULL;
+	else if ((tp->rownames[i] = strdup(tp->names[i])) == NULL)
+	    break;
+    }
+    if (i < tp->nlines) {
+	while (i-- > 0)
+	    free(tp->rownames[i]);
+	return;
+    }
+    tp->nrows = tp->nlines;
+    tp->header = strdup(tp->reader.lines[0]);
+}
 
-    if ((fp = linux_statsfile("/proc/interrupts", iobuf, iobufsz)) == NULL)
-	return -oserror();
+static int
+refresh_interrupt_table(interrupt_table_t *tp, const char *path,
+		pmInDom intr_indom, pmInDom cpu_intr_indom, int softirq)
+{
+    unsigned int i;
+    int sts, save, ncolumns;
+
+    if ((sts = proc_reader_refresh(&tp->reader, path, 1)) < 0 ||
+	tp->reader.nlines < 1) {
+	pmdaCacheOp(cpu_intr_indom, PMDA_CACHE_INACTIVE);
+	pmdaCacheOp(intr_indom, PMDA_CACHE_INACTIVE);
+	return sts < 0 ? sts : -EINVAL;	/* unrecognised file format */
+    }
 
     /* first parse header, which maps online CPU number to column number */
-    if (fgets(iobuf, iobufsz, fp)) {
-	ncolumns = map_online_cpus(iobuf);
-    } else {
-	fclose(fp);
-	return -EINVAL;		/* unrecognised file format */
+    ncolumns = map_online_cpus(tp->reader.lines[0]);
+
+    /* extract interrupt line (or other) and values from each row */
+    if ((sts = extract_interrupt_rows(tp, !softirq)) < 0)
+	return sts;
+    if (sts > 0) {
+	if (refresh_interrupt_values(tp, softirq, ncolumns) == 0)
+	    return 0;
+	for (i = 0; i < _pm_ncpus; i++) {
+	    if (softirq)
+		online_cpumap[i].sirq_count = 0;
+	    else
+		online_cpumap[i].intr_count = 0;
+	}
     }
 
+    /* layout changed, rebuild via the instance domain caches */
+    if (pmDebugOptions.libpmda)
+	fprintf(stderr, "refresh_interrupt_table: %s layout changed, rebuild\n",
+		path);
+    pmdaCacheOp(cpu_intr_indom, PMDA_CACHE_INACTIVE);
+    pmdaCacheOp(intr_indom, PMDA_CACHE_INACTIVE);
+    if ((sts = reset_interrupt_layout(tp)) < 0)
+	return sts;
     save = 0;
-    while (fgets(iobuf, iobufsz, fp) != NULL) {
-	/* extract interrupt line (or other) and values from each row */
-	if (extract_interrupt_errors(iobuf))
-	    continue;
-	if (extract_interrupt_misses(iobuf))
+    for (i = 0; i < tp->nlines; i++) {
+	tp->rows[i] = NULL;
+	if (tp->names[i] == NULL)
 	    continue;
-	name = extract_interrupt_name(iobuf, &values);
-	save |= extract_interrupt_values(name, values, intr_indom, cpu_intr_indom, ncolumns);
+	save |= extract_interrupt_values(tp->names[i], tp->values[i],
+			intr_indom, cpu_intr_indom, ncolumns, softirq, &tp->rows[i]);
     }
-    fclose(fp);
+    save_interrupt_layout(tp);
 
     if (save) {
 	pmdaCacheOp(cpu_intr_indom, PMDA_CACHE_SAVE);
@@ -237,60 +436,33 @@ refresh_proc_interrupts(void)
     return 0;
 }
 
-static int
-extract_softirq_values(char *name, char *buffer, pmInDom sirq, pmInDom cpusirq, int ncolumns)
+int
+refresh_proc_interrupts(void)
 {
-    unsigned long i, cpuid, value;
-    char *s = buffer, *end = NULL;
-    char cpubuf[64];
-    interrupt_cpu_t *cpuip;
-    interrupt_t *ip = NULL;
-    int sts, changed = 0;
-
-    sts = pmdaCacheLookupName(sirq, name, NULL, (void **)&ip);
-    if (sts < 0 || ip == NULL) {
-	if ((ip = calloc(1, sizeof(interrupt_t))) == NULL)
-	    return 0;
-	changed = 1;
-    }
-
-    ip->total = 0;
-    for (i = 0; i < ncolumns; i++) {
-	value = strtoul(s, &end, 10);
-	if (!isspace(*end))
-	    continue;
-	s = end;
-	cpuip = NULL;
-	cpuid = column_to_cpuid(i);
-	online_cpumap[cpuid].sirq_count += value;
-	pmsprintf(cpubuf, sizeof cpubuf, "%s::cpu%lu", name, cpuid);
-	sts = pmdaCacheLookupName(cpusirq, cpubuf, NULL, (void **)&cpuip);
-	if (sts < 0 || cpuip == NULL) {
-	    if ((cpuip = calloc(1, sizeof(interrupt_cpu_t))) == NULL)
-	        continue;
-	    cpuip->row = ip;
-	}
-	cpuip->cpuid = cpuid;
-	cpuip->value = value;
-	ip->total += value;
+    static int setup;
+    int i;
+    pmInDom intr_indom = INDOM(INTERRUPT_INDOM);
+    pmInDom cpu_intr_indom = INDOM(INTERRUPT_CPU_INDOM);
 
-	pmdaCacheStore(cpusirq, PMDA_CACHE_ADD, cpubuf, cpuip);
+    if (!setup) {
+	pmdaCacheOp(cpu_intr_indom, PMDA_CACHE_LOAD);
+	pmdaCacheOp(intr_indom, PMDA_CACHE_LOAD);
+	setup = 1;
     }
-    pmdaCacheStore(sirq, PMDA_CACHE_ADD, name, ip);
 
-    if (ip->label == NULL)
-	ip->label = end ? strdup(label_reformat(end)) : NULL;
+    setup_buffers();
+    for (i = 0; i < _pm_ncpus; i++)
+	online_cpumap[i].intr_count = 0;
 
-    return changed;
+    return refresh_interrupt_table(&interrupts, "/proc/interrupts",
+				   intr_indom, cpu_intr_indom, 0);
 }
 
 int
 refresh_proc_softirqs(void)
 {
     static int setup;
-    FILE *fp;
-    char *name, *values;
-    int i = 0, save, ncolumns;
+    int i;
     pmInDom sirq_indom = INDOM(SOFTIRQ_INDOM);
     pmInDom cpu_sirq_indom = INDOM(SOFTIRQ_CPU_INDOM);
 
@@ -299,37 +471,13 @@ refresh_proc_softirqs(void)
 	pmdaCacheOp(sirq_indom, PMDA_CACHE_LOAD);
 	setup = 1;
     }
-    pmdaCacheOp(cpu_sirq_indom, PMDA_CACHE_INACTIVE);
-    pmdaCacheOp(sirq_indom, PMDA_CACHE_INACTIVE);
 
     setup_buffers();
     for (i = 0; i < _pm_ncpus; i++)
 	online_cpumap[i].sirq_count = 0;
 
-    if ((fp = linux_statsfile("/proc/softirqs", iobuf, iobufsz)) == NULL)
-	return -oserror();
-
-    /* first parse header, which maps online CPU number to column number */
-    if (fgets(iobuf, iobufsz, fp)) {
-	ncolumns = map_online_cpus(iobuf);
-    } else {
-	fclose(fp);
-	return -EINVAL;		/* unrecognised file format */
-    }
-
-    save = 0;
-    while (fgets(iobuf, iobufsz, fp) != NULL) {
-	/* extract values from all subsequent softirqs file lines */
-	name = extract_interrupt_name(iobuf, &values);
-	save |= extract_softirq_values(name, values, sirq_indom, cpu_sirq_indom, ncolumns);
-    }
-    fclose(fp);
-
-    if (save) {
-	pmdaCacheOp(cpu_sirq_indom, PMDA_CACHE_SAVE);
-	pmdaCacheOp(sirq_indom, PMDA_CACHE_SAVE);
-    }
-    return 0;
+    return refresh_interrupt_table(&softirqs, "/proc/softirqs",
+				   sirq_indom, cpu_sirq_indom, 1);
 }
 
 int
@@ -338,7 +486,7 @@ proc_interrupts_fetch(int cluster, int item, unsigned int inst, pmAtomValue *ato
     interrupt_cpu_t *cpuip;
     interrupt_t *ip;
     pmInDom indom;
-    int cpuid, sts;
+    int sts;
 
     switch (cluster) {
     case CLUSTER_INTERRUPTS:
@@ -365,8 +513,7 @@ proc_interrupts_fetch(int cluster, int item, unsigned int inst, pmAtomValue *ato
 	if (item == 4) {	/* kernel.percpu.intr */
 	    if (inst >= _pm_ncpus)
 		return PM_ERR_INST;
-	    cpuid = column_to_cpuid(inst);
-	    atom->ull = online_cpumap[cpuid].intr_count;
+	    atom->ull = online_cpumap[inst].intr_count;
 	    return 1;
 	}
 	break;
@@ -398,8 +545,7 @@ proc_interrupts_fetch(int cluster, int item, unsigned int inst, pmAtomValue *ato
 	if (item == 1) {	/* kernel.percpu.sirq */
 	    if (inst >= _pm_ncpus)
 		return PM_ERR_INST;
-	    cpuid = column_to_cpuid(inst);
-	    atom->ull = online_cpumap[cpuid].sirq_count;
+	    atom->ull = online_cpumap[inst].sirq_count;
 	    return 1;
 	}
 	break;
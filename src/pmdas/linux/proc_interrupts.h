@@ -13,16 +13,20 @@
  * for more details.
  */
 
+typedef struct interrupt_cpu interrupt_cpu_t;
+
 typedef struct {
     char		*label;		/* short interrupt label text */
     unsigned long long	total;		/* aggregation of interrupt counts */
+    unsigned int	ncolumns;	/* number of entries in cpus */
+    interrupt_cpu_t	**cpus;		/* per-column values, NULL if none */
 } interrupt_t;
 
-typedef struct {
+struct interrupt_cpu {
     unsigned int	cpuid;		/* CPU identifier */
     unsigned int	value;		/* individual CPU interrupt value */
     interrupt_t		*row;		/* row data in /proc/interrupts */
-} interrupt_cpu_t;
+};
 
 typedef struct {
     unsigned int	cpuid;		/* CPU identifier */
@@ -21,6 +21,7 @@
 #include <sys/ioctl.h>
 #include "namespaces.h"
 #include "proc_net_dev.h"
+#include "proc_reader.h"
 
 static int
 refresh_inet_socket(linux_container_t *container)
@@ -373,9 +374,9 @@ refresh_proc_net_dev(pmInDom indom, linux_container_t *container)
 {
     static int		setup;		/* first pass through */
     static uint32_t	cache_err;	/* throttle messages */
-    char		buf[1024];
-    FILE		*fp;
+    static proc_reader_t reader = PROC_READER_INIT;
     char		*p, *v;
+    unsigned int	i;
     int			j, sts;
     net_interface_t	*netip;
 
@@ -390,7 +391,8 @@ refresh_proc_net_dev(pmInDom indom, linux_container_t *container)
 
     pmdaCacheOp(indom, PMDA_CACHE_INACTIVE);
 
-    if ((fp = linux_statsfile("/proc/net/dev", buf, sizeof(buf))) == NULL)
+    /* only kept open outside containers, as it is per-network-namespace */
+    if (proc_reader_refresh(&reader, "/proc/net/dev", container == NULL) < 0)
 	return;
 
     /*
@@ -400,11 +402,11 @@ Inter-|   Receive                                                |  Transmit
   eth0:       0  337614    0    0    0     0          0         0        0  267537    0    0    0 27346      62          0
      */
 
-    while (fgets(buf, sizeof(buf), fp) != NULL) {
-	if ((p = v = strchr(buf, ':')) == NULL)
+    for (i = 0; i < reader.nlines; i++) {
+	if ((p = v = strchr(reader.lines[i], ':')) == NULL)
 	    continue;
 	*p = '\0';
-	for (p=buf; *p && isspace((int)*p); p++) {;}
+	for (p=reader.lines[i]; *p && isspace((int)*p); p++) {;}
 
 	sts = pmdaCacheLookupName(indom, p, NULL, (void **)&netip);
 	if (sts == PM_ERR_INST || (sts >= 0 && netip == NULL)) {
@@ -430,16 +432,14 @@ Inter-|   Receive                                                |  Transmit
 	}
 
 	memset(&netip->ioc, 0, sizeof(netip->ioc));
-	for (p=v, j=0; j < PROC_DEV_COUNTERS_PER_LINE; j++) {
-	    for (; !isdigit((int)*p); p++) {;}
-	    sscanf(p, "%llu", (long long unsigned int *)&netip->counters[j]);
-	    for (; !isspace((int)*p); p++) {;}
+	for (p=v+1, j=0; j < PROC_DEV_COUNTERS_PER_LINE; j++) {
+	    for (; *p && !isdigit((int)*p); p++) {;}
+	    if (*p == '\0')
+		break;
+	    netip->counters[j] = proc_strtoull(p, &p);
 	}
     }
 
-    /* success */
-    fclose(fp);
-
     if (!container)
 	pmdaCacheOp(indom, PMDA_CACHE_SAVE);
 }
@@ -0,0 +1,104 @@
+/*
+ * Copyright (c) 2026 Red Hat.
+ *
+ * This program is free software; you can redistribute it and/or modify it
+ * under the terms of the GNU General Public License as published by the
+ * Free Software Foundation; either version 2 of the License, or (at your
+ * option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of MERCHANTABILITY
+ * or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU General Public License
+ * for more details.
+ */
+#include <fcntl.h>
+#include "linux.h"
+#include "proc_reader.h"
+
+void
+proc_reader_close(proc_reader_t *rp)
+{
+    if (rp->fd >= 0) {
+	close(rp->fd);
+	rp->fd = -1;
+    }
+}
+
+/*
+ * Read all of path (relative to linux_statspath) into the reader
+ * buffer and index its lines.  With keepopen, the file descriptor
+ * is kept open and rewound on subsequent refreshes (except in QA
+ * mode, where the file may be replaced between refreshes) - this
+ * must not be used for files whose content depends on the opening
+ * process's namespaces, when refreshing for containers.
+ */
+int
+proc_reader_refresh(proc_reader_t *rp, const char *path, int keepopen)
+{
+    char	buf[MAXPATHLEN];
+    char	*p, *end, **lp;
+    size_t	size;
+    ssize_t	bytes;
+
+    if (linux_test_mode & LINUX_TEST_STATSPATH)
+	keepopen = 0;
+    if (!keepopen)
+	proc_reader_close(rp);
+
+    if (rp->fd >= 0) {
+	if (lseek(rp->fd, 0, SEEK_SET) < 0) {
+	    proc_reader_close(rp);
+	    return -oserror();
+	}
+    } else {
+	pmsprintf(buf, sizeof(buf), "%s%s", linux_statspath, path);
+	if ((rp->fd = open(buf, O_RDONLY)) < 0)
+	    return -oserror();
+    }
+
+    /* read to EOF, growing the buffer as needed (usually just once) */
+    rp->size = 0;
+    for (;;) {
+	if (rp->maxsize - rp->size < 2) {
+	    size = rp->maxsize ? rp->maxsize * 2 : BUFSIZ;
+	    if ((p = (char *)realloc(rp->buf, size)) == NULL) {
+		proc_reader_close(rp);
+		return -ENOMEM;
+	    }
+	    rp->buf = p;
+	    rp->maxsize = size;
+	}
+	bytes = read(rp->fd, rp->buf + rp->size, rp->maxsize - rp->size - 1);
+	if (bytes < 0) {
+	    bytes = -oserror();
+	    proc_reader_close(rp);
+	    return bytes;
+	}
+	if (bytes == 0)
+	    break;
+	rp->size += bytes;
+    }
+    rp->buf[rp->size] = '\0';
+    if (!keepopen)
+	proc_reader_close(rp);
+
+    /* index the lines, terminating each in place */
+    rp->nlines = 0;
+    end = rp->buf + rp->size;
+    for (p = rp->buf; p < end; p++) {
+	if (rp->nlines + 1 >= rp->maxlines) {
+	    size = rp->maxlines ? rp->maxlines * 2 : 64;
+	    if ((lp = (char **)realloc(rp->lines, size * sizeof(char *))) == NULL)
+		return -ENOMEM;
+	    rp->lines = lp;
+	    rp->maxlines = size;
+	}
+	rp->lines[rp->nlines++] = p;
+	if ((p = memchr(p, '\n', end - p)) == NULL)
+	    break;
+	*p = '\0';
+    }
+    if (rp->lines != NULL)
+	rp->lines[rp->nlines] = end;	/* empty sentinel line */
+    return 0;
+}
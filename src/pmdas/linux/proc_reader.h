@@ -0,0 +1,58 @@
+/*
+ * Copyright (c) 2026 Red Hat.
+ *
+ * This program is free software; you can redistribute it and/or modify it
+ * under the terms of the GNU General Public License as published by the
+ * Free Software Foundation; either version 2 of the License, or (at your
+ * option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of MERCHANTABILITY
+ * or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU General Public License
+ * for more details.
+ */
+
+/*
+ * Whole-file reader for the larger, frequently refreshed procfs files.
+ * The contents are read into a buffer that is reused (and only grows)
+ * across refreshes, with newlines replaced by '\0' and the start of
+ * each line indexed, so lines can be parsed in place - no stdio.
+ */
+typedef struct {
+    int			fd;		/* -1 unless kept open */
+    char		*buf;		/* file contents */
+    size_t		size;		/* bytes in buf, excluding final '\0' */
+    size_t		maxsize;	/* bytes allocated for buf */
+    char		**lines;	/* start of each line in buf */
+    unsigned int	nlines;		/* number of lines */
+    unsigned int	maxlines;	/* entries allocated for lines */
+} proc_reader_t;
+
+#define PROC_READER_INIT	{ .fd = -1 }
+
+extern int proc_reader_refresh(proc_reader_t *, const char *, int);
+extern void proc_reader_close(proc_reader_t *);
+
+/*
+ * Decimal strtoull(3) equivalent for procfs values - blanks are
+ * skipped, no sign, no locale.  As with strtoull, *endp is set to
+ * the start of the string if there are no digits.
+ */
+static inline unsigned long long
+proc_strtoull(const char *str, char **endp)
+{
+    const char		*p = str;
+    unsigned long long	value = 0;
+
+    while (*p == ' ' || *p == '\t')
+	p++;
+    if ((unsigned int)(*p - '0') > 9) {
+	*endp = (char *)str;
+	return 0;
+    }
+    do {
+	value = value * 10 + (*p++ - '0');
+    } while ((unsigned int)(*p - '0') <= 9);
+    *endp = (char *)p;
+    return value;
+}
@@ -17,6 +17,7 @@
  */
 #include "linux.h"
 #include "proc_stat.h"
+#include "proc_reader.h"
 #include <sys/stat.h>
 #include <dirent.h>
 #include <ctype.h>
@@ -162,6 +163,31 @@ find_line_format(const char *fmt, int fmtlen, char **bufindex, int nbufindex, in
 
 #define WAITIO_SLOP 100
 
+/*
+ * Extract the CPU time counters following a "cpu" or "cpuN" tag -
+ * fewer fields are reported by older kernels, and like sscanf(3)
+ * we stop at the first missing one.
+ */
+static void
+scan_cpuacct(const char *p, cpuacct_t *acct)
+{
+    unsigned long long	*fields[] = {
+	&acct->user, &acct->nice, &acct->sys, &acct->idle, &acct->wait,
+	&acct->irq, &acct->sirq, &acct->steal, &acct->guest, &acct->guest_nice,
+    };
+    unsigned long long	value;
+    char		*end;
+    int			i;
+
+    for (i = 0; i < sizeof(fields) / sizeof(fields[0]); i++) {
+	value = proc_strtoull(p, &end);
+	if (end == p)
+	    break;
+	*fields[i] = value;
+	p = end;
+    }
+}
+
 /*
  * We use /proc/stat as a single source of truth regarding online/offline
  * state for CPUs (its per-CPU stats are for online CPUs only).
@@ -175,17 +201,12 @@ refresh_proc_stat(proc_stat_t *proc_stat)
     pernode_t	*np;
     percpu_t	*cp;
     pmInDom	cpus, nodes;
-    char	buf[MAXPATHLEN], *name, *sp, **bp;
+    char	*name, *end, **bufindex;
     char	cpuname[32];
-    int		n = 0, i, size;
+    int		n, i, size, sts, nbufindex;
     static unsigned long long	prev_wait;
 
-    static int fd = -1; /* kept open until exit(), unless testing */
-    static char *statbuf;
-    static int maxstatbuf;
-    static char **bufindex;
-    static int nbufindex;
-    static int maxbufindex;
+    static proc_reader_t reader = PROC_READER_INIT; /* kept open until exit() */
 
     cpu_node_setup();
     cpus = INDOM(CPU_INDOM);
@@ -201,67 +222,13 @@ refresh_proc_stat(proc_stat_t *proc_stat)
 	memset(&np->stat, 0, sizeof(np->stat));
     }
 
-    /* in test mode we replace procfs files (keeping fd open thwarts that) */
-    if (fd >= 0 && (linux_test_mode & LINUX_TEST_STATSPATH)) {
-	close(fd);
-	fd = -1;
-    }
-
-    if (fd >= 0) {
-	if (lseek(fd, 0, SEEK_SET) < 0)
-	    return -oserror();
-    } else {
-	pmsprintf(buf, sizeof(buf), "%s/proc/stat", linux_statspath);
-	if ((fd = open(buf, O_RDONLY)) < 0)
-	    return -oserror();
-    }
-
-    for (;;) {
-	while (n >= maxstatbuf) {
-	    size = maxstatbuf + 512;
-	    if ((sp = (char *)realloc(statbuf, size)) == NULL)
-		return -ENOMEM;
-	    statbuf = sp;
-	    maxstatbuf = size;
-	}
-	size = (statbuf + maxstatbuf) - (statbuf + n);
-	if ((i = read(fd, statbuf + n, size)) > 0)
-	    n += i;
-	else
-	    break;
-    }
-    statbuf[n] = '\0';
-
-    if (bufindex == NULL) {
-	size = 16 * sizeof(char *);
-	if ((bufindex = (char **)malloc(size)) == NULL)
-	    return -ENOMEM;
-	maxbufindex = 16;
-    }
-
-    nbufindex = 0;
-    bufindex[nbufindex] = statbuf;
-    for (i = 0; i < n; i++) {
-	if (statbuf[i] == '\n' || statbuf[i] == '\0') {
-	    statbuf[i] = '\0';
-	    if (nbufindex + 1 >= maxbufindex) {
-		size = (maxbufindex + 4) * sizeof(char *);
-		if ((bp = (char **)realloc(bufindex, size)) == NULL)
-		    return -ENOMEM;
-		bufindex = bp;
-	    	maxbufindex += 4;
-	    }
-	    bufindex[++nbufindex] = statbuf + i + 1;
-	}
-    }
+    if ((sts = proc_reader_refresh(&reader, "/proc/stat", 1)) < 0)
+	return sts;
+    bufindex = reader.lines;
+    nbufindex = reader.nlines;
 
-#define ALLCPU_FMT "cpu %llu %llu %llu %llu %llu %llu %llu %llu %llu %llu"
-    n = sscanf((const char *)bufindex[0], ALLCPU_FMT,
-	&proc_stat->all.user, &proc_stat->all.nice,
-	&proc_stat->all.sys, &proc_stat->all.idle,
-	&proc_stat->all.wait, &proc_stat->all.irq,
-	&proc_stat->all.sirq, &proc_stat->all.steal,
-	&proc_stat->all.guest, &proc_stat->all.guest_nice);
+    if (nbufindex > 0 && strncmp(bufindex[0], "cpu ", 4) == 0)
+	scan_cpuacct(bufindex[0] + 3, &proc_stat->all);
     if (proc_stat->all.prev_wait > 0 &&
 	    proc_stat->all.wait < proc_stat->all.prev_wait &&
 	    proc_stat->all.wait > proc_stat->all.prev_wait - WAITIO_SLOP) {
@@ -280,7 +247,6 @@ refresh_proc_stat(proc_stat_t *proc_stat)
     else
 	proc_stat->all.prev_wait = proc_stat->all.wait;
 
-#define PERCPU_FMT "cpu%u %llu %llu %llu %llu %llu %llu %llu %llu %llu %llu"
     /*
      * per-CPU stats
      * e.g. cpu0 95379 4 20053 6502503
@@ -304,7 +270,8 @@ refresh_proc_stat(proc_stat_t *proc_stat)
 		continue;
 	    cp = NULL;
 	    np = NULL;
-	    i = atoi(&bufindex[n][3]);	/* extract CPU identifier */
+	    /* extract CPU identifier */
+	    i = (int)proc_strtoull(&bufindex[n][3], &end);
 	    pmsprintf(cpuname, sizeof(cpuname), "cpu%u", i); /* instance name */
 	    if (pmdaCacheLookupName(cpus, cpuname, &i, (void **)&cp) < 0 || !cp)
 		continue;
@@ -312,11 +279,7 @@ refresh_proc_stat(proc_stat_t *proc_stat)
 	    prev_wait = cp->stat.prev_wait;
 	    memset(&cp->stat, 0, sizeof(cp->stat));
 	    cp->stat.prev_wait = prev_wait;
-	    sscanf(bufindex[n], PERCPU_FMT, &i,
-		    &cp->stat.user, &cp->stat.nice, &cp->stat.sys,
-		    &cp->stat.idle, &cp->stat.wait, &cp->stat.irq,
-		    &cp->stat.sirq, &cp->stat.steal, &cp->stat.guest,
-		    &cp->stat.guest_nice);
+	    scan_cpuacct(end, &cp->stat);
 	    /* see comment above re kernel waitio */
 	    if (cp->stat.prev_wait > 0 &&
 		    cp->stat.wait < cp->stat.prev_wait &&
@@ -358,27 +321,27 @@ refresh_proc_stat(proc_stat_t *proc_stat)
 
 #define INTR_FMT "intr %llu"	/* (export 1st 'total interrupts' value only) */
     if ((i = find_line_format(INTR_FMT, 5, bufindex, nbufindex, i)) >= 0)
-	sscanf((const char *)bufindex[i], INTR_FMT, &proc_stat->intr);
+	proc_stat->intr = proc_strtoull(bufindex[i] + 5, &end);
 
 #define CTXT_FMT "ctxt %llu"
     if ((i = find_line_format(CTXT_FMT, 5, bufindex, nbufindex, i)) >= 0)
-	sscanf((const char *)bufindex[i], CTXT_FMT, &proc_stat->ctxt);
+	proc_stat->ctxt = proc_strtoull(bufindex[i] + 5, &end);
 
 #define BTIME_FMT "btime %lu"
     if ((i = find_line_format(BTIME_FMT, 6, bufindex, nbufindex, i)) >= 0)
-	sscanf((const char *)bufindex[i], BTIME_FMT, &proc_stat->btime);
+	proc_stat->btime = proc_strtoull(bufindex[i] + 6, &end);
 
 #define PROCESSES_FMT "processes %lu"
     if ((i = find_line_format(PROCESSES_FMT, 10, bufindex, nbufindex, i)) >= 0)
-	sscanf((const char *)bufindex[i], PROCESSES_FMT, &proc_stat->processes);
+	proc_stat->processes = proc_strtoull(bufindex[i] + 10, &end);
 
 #define RUNNING_FMT "procs_running %lu"
     if ((i = find_line_format(RUNNING_FMT, 14, bufindex, nbufindex, i)) >= 0)
-	sscanf((const char *)bufindex[i], RUNNING_FMT, &proc_stat->procs_running);
+	proc_stat->procs_running = proc_strtoull(bufindex[i] + 14, &end);
 
 #define BLOCKED_FMT "procs_blocked %lu"
     if ((i = find_line_format(BLOCKED_FMT, 14, bufindex, nbufindex, i)) >= 0)
-	sscanf((const char *)bufindex[i], BLOCKED_FMT, &proc_stat->procs_blocked);
+	proc_stat->procs_blocked = proc_strtoull(bufindex[i] + 14, &end);
 
     /* success */
     return 0;
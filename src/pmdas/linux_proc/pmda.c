@@ -1444,7 +1444,6 @@ proc_refresh(pmdaExt *pmda, int *need_refresh)
 		proc_ctx_threads(pmda->e_context, threads),
 		proc_ctx_cgroups(pmda->e_context, cgroups),
 		container ? cgroup : NULL, cgrouplen);
-
     }
     if (need_refresh[CLUSTER_HOTPROC_PID_STAT] ||
         need_refresh[CLUSTER_HOTPROC_PID_STATM] ||
@@ -1607,6 +1606,309 @@ scheduler_policy_name(int policy)
     return "?";
 }
 
+/*
+ * Extract one proc.psinfo value from a /proc/<pid>/stat entry,
+ * shared by the per-instance and batch fetch callbacks.
+ */
+static int
+proc_pid_stat_value(unsigned int item, proc_pid_entry_t *entry, pmAtomValue *atom)
+{
+    if (!(entry->success & PROC_PID_FLAG_STAT))
+	return 0;
+
+    switch (item) {
+    case 1: /* proc.psinfo.cmd */
+	if ((atom->cp = entry->stat.cmd) == NULL)
+	    return 0;
+	break;
+
+    case 2: /* proc.psinfo.sname */
+	atom->cp = entry->stat.state;
+	break;
+
+    case 3: /* proc.psinfo.ppid */
+	atom->ul = entry->stat.ppid;
+	break;
+
+    case 4: /* proc.psinfo.pgrp */
+	atom->ul = entry->stat.pgrp;
+	break;
+
+    case 5: /* proc.psinfo.session */
+	atom->ul = entry->stat.session;
+	break;
+
+    case 6: /* proc.psinfo.tty */
+	atom->ul = entry->stat.tty;
+	break;
+
+    case 7: /* proc.psinfo.tty_pgrp */
+	if (entry->stat.tty_pgrp < 0)
+	    return 0;
+	atom->ul = entry->stat.tty_pgrp;
+	break;
+
+    case 8: /* proc.psinfo.flags */
+	atom->ul = entry->stat.flags;
+	break;
+
+    case 9: /* proc.psinfo.minflt */
+	atom->ul = entry->stat.minflt;
+	break;
+
+    case 10: /* proc.psinfo.cmin_flt */
+	atom->ul = entry->stat.cminflt;
+	break;
+
+    case 11: /* proc.psinfo.maj_flt */
+	atom->ul = entry->stat.majflt;
+	break;
+
+    case 12: /* proc.psinfo.cmaj_flt */
+	atom->ul = entry->stat.cmajflt;
+	break;
+
+    case 13: /* proc.psinfo.utime */
+	_pm_assign_ulong(atom, entry->stat.utime * 1000 / _pm_hertz);
+	break;
+
+    case 14: /* proc.psinfo.stime */
+	_pm_assign_ulong(atom, entry->stat.stime * 1000 / _pm_hertz);
+	break;
+
+    case 15: /* proc.psinfo.cutime */
+	_pm_assign_ulong(atom, entry->stat.cutime * 1000 / _pm_hertz);
+	break;
+
+    case 16: /* proc.psinfo.cstime */
+	_pm_assign_ulong(atom, entry->stat.cstime * 1000 / _pm_hertz);
+	break;
+
+    case 17: /* proc.psinfo.priority */
+	atom->l = entry->stat.priority;
+	break;
+
+    case 18: /* proc.psinfo.nice */
+	atom->l = entry->stat.nice;
+	break;
+
+    /* case 19: -- threads */
+
+    case 20: /* proc.psinfo.it_real_value */
+	atom->ul = entry->stat.it_real_value;
+	break;
+
+    case 21: /* proc.psinfo.start_time */
+	atom->ull = entry->stat.start_time * 1000 / _pm_hertz;
+	break;
+
+    case 22: /* proc.psinfo.vsize */
+	atom->ull = entry->stat.vsize / 1024;
+	break;
+
+    case 23: /* proc.psinfo.rss */
+	atom->ull = entry->stat.rss * _pm_system_pagesize / 1024;
+	break;
+
+    case 24: /* proc.psinfo.rss_rlim */
+	atom->ull = entry->stat.rss_rlim / 1024;
+	break;
+
+    case 25: /* proc.psinfo.start_code */
+	atom->ul = entry->stat.start_code;
+	break;
+
+    case 26: /* proc.psinfo.end_code */
+	atom->ul = entry->stat.end_code;
+	break;
+
+    case 27: /* proc.psinfo.start_stack */
+	atom->ul = entry->stat.start_stack;
+	break;
+
+    case 28: /* proc.psinfo.esp */
+	atom->ul = entry->stat.esp;
+	break;
+
+    case 29: /* proc.psinfo.eip */
+	atom->ul = entry->stat.eip;
+	break;
+
+    case 30: /* proc.psinfo.signal */
+	atom->ul = entry->stat.signal;
+	break;
+
+    case 31: /* proc.psinfo.blocked */
+	atom->ul = entry->stat.blocked;
+	break;
+
+    case 32: /* proc.psinfo.sigignore */
+	atom->ul = entry->stat.sigignore;
+	break;
+
+    case 33: /* proc.psinfo.sigcatch */
+	atom->ul = entry->stat.sigcatch;
+	break;
+
+    case 34: /* proc.psinfo.wchan */
+	_pm_assign_ulong(atom, entry->stat.wchan);
+	break;
+
+    case 35: /* proc.psinfo.nswap */
+	atom->ul = entry->stat.nswap;
+	break;
+
+    case 36: /* proc.psinfo.cnswap */
+	atom->ul = entry->stat.cnswap;
+	break;
+
+    case 37: /* proc.psinfo.exit_signal */
+	atom->ul = entry->stat.exit_signal;
+	break;
+
+    case 38: /* proc.psinfo.processor */
+	atom->ul = entry->stat.processor;
+	break;
+
+    case 39: /* proc.psinfo.ttyname */
+	if (!entry->stat.tty)
+	    atom->cp = "?";
+	else
+	    atom->cp = get_ttyname_info((dev_t)entry->stat.tty);
+	break;
+
+    case 42: /* proc.psinfo.rt_priority */
+	atom->ul = entry->stat.rtpriority;
+	break;
+
+    case 43: /* proc.psinfo.policy */
+	atom->ul = entry->stat.policy;
+	break;
+
+    case 44: /* proc.psinfo.delayacct_blkio_time */
+	atom->ull = entry->stat.delayacct_blkio_time * 1000 / _pm_hertz;
+	break;
+
+    case 45: /* proc.psinfo.guest_time */
+	atom->ull = entry->stat.guest_time * 1000 / _pm_hertz;
+	break;
+
+    case 46: /* proc.psinfo.cguest_time */
+	atom->ull = entry->stat.cguest_time * 1000 / _pm_hertz;
+	break;
+
+    case 48: /* proc.psinfo.policy_s */
+	atom->cp = scheduler_policy_name(entry->stat.policy);
+	break;
+
+    default:
+	return PM_ERR_PMID;
+    }
+    return PMDA_FETCH_STATIC;
+}
+
+/*
+ * Extract one proc.memory value from a /proc/<pid>/statm entry,
+ * shared by the per-instance and batch fetch callbacks.
+ */
+static int
+proc_pid_statm_value(unsigned int item, proc_pid_entry_t *entry, pmAtomValue *atom)
+{
+    if (!(entry->success & PROC_PID_FLAG_STATM))
+	return 0;
+
+    switch (item) {
+    case 0: /* proc.memory.size */
+	atom->ul = entry->statm.size * _pm_system_pagesize / 1024;
+	break;
+    case 1:	/* proc.memory.rss */
+	atom->ul = entry->statm.rss * _pm_system_pagesize / 1024;
+	break;
+    case 2: /* proc.memory.share */
+	atom->ul = entry->statm.share * _pm_system_pagesize / 1024;
+	break;
+    case 3: /* proc.memory.textrss */
+	atom->ul = entry->statm.textrs * _pm_system_pagesize / 1024;
+	break;
+    case 4: /* proc.memory.librss */
+	atom->ul = entry->statm.librs * _pm_system_pagesize / 1024;
+	break;
+    case 5: /* proc.memory.datrss */
+	atom->ul = entry->statm.datrs * _pm_system_pagesize / 1024;
+	break;
+    case 6: /* proc.memory.dirty */
+	atom->ul = entry->statm.dirty * _pm_system_pagesize / 1024;
+	break;
+    default:
+	return PM_ERR_PMID;
+    }
+    return PMDA_FETCH_STATIC;
+}
+
+/*
+ * Extract one proc.schedstat value from a /proc/<pid>/schedstat entry,
+ * shared by the per-instance and batch fetch callbacks.
+ */
+static int
+proc_pid_schedstat_value(unsigned int item, proc_pid_entry_t *entry, pmAtomValue *atom)
+{
+    if (!(entry->success & PROC_PID_FLAG_SCHEDSTAT))
+	return 0;
+
+    switch (item) {
+    case 0: /* proc.schedstat.cpu_time */
+	atom->ull = entry->schedstat.cputime;
+	break;
+    case 1: /* proc.schedstat.run_delay */
+	atom->ull = entry->schedstat.rundelay;
+	break;
+    case 2: /* proc.schedstat.pcount */
+	_pm_assign_ulong(atom, entry->schedstat.count);
+	break;
+    default:
+	return PM_ERR_PMID;
+    }
+    return PMDA_FETCH_STATIC;
+}
+
+/*
+ * Extract one proc.io value from a /proc/<pid>/io entry,
+ * shared by the per-instance and batch fetch callbacks.
+ */
+static int
+proc_pid_io_value(unsigned int item, proc_pid_entry_t *entry, pmAtomValue *atom)
+{
+    if (!(entry->success & PROC_PID_FLAG_IO))
+	return 0;
+
+    switch (item) {
+    case 0: /* proc.io.rchar */
+	atom->ull = entry->io.rchar;
+	break;
+    case 1: /* proc.io.wchar */
+	atom->ull = entry->io.wchar;
+	break;
+    case 2: /* proc.io.syscr */
+	atom->ull = entry->io.syscr;
+	break;
+    case 3: /* proc.io.syscw */
+	atom->ull = entry->io.syscw;
+	break;
+    case 4: /* proc.io.read_bytes */
+	atom->ull = entry->io.readb;
+	break;
+    case 5: /* proc.io.write_bytes */
+	atom->ull = entry->io.writeb;
+	break;
+    case 6: /* proc.io.cancelled_write_bytes */
+	atom->ull = entry->io.cancel;
+	break;
+    default:
+	return PM_ERR_PMID;
+    }
+    return PMDA_FETCH_STATIC;
+}
+
 /*
  * callback provided to pmdaFetch
  */
@@ -1788,198 +2090,7 @@ proc_fetchCallBack(pmdaMetric *mdesc, unsigned int inst, pmAtomValue *atom)
 
 	if ((entry = fetch_proc_pid_stat(inst, active_proc_pid, &sts)) == NULL)
 	    return sts;
-	if (!(entry->success & PROC_PID_FLAG_STAT))
-	    return 0;
-
-	switch (item) {
-	case 1: /* proc.psinfo.cmd */
-	    if ((atom->cp = entry->stat.cmd) == NULL)
-		return 0;
-	    break;
-
-	case 2: /* proc.psinfo.sname */
-	    atom->cp = entry->stat.state;
-	    break;
-
-	case 3: /* proc.psinfo.ppid */
-	    atom->ul = entry->stat.ppid;
-	    break;
-
-	case 4: /* proc.psinfo.pgrp */
-	    atom->ul = entry->stat.pgrp;
-	    break;
-
-	case 5: /* proc.psinfo.session */
-	    atom->ul = entry->stat.session;
-	    break;
-
-	case 6: /* proc.psinfo.tty */
-	    atom->ul = entry->stat.tty;
-	    break;
-
-	case 7: /* proc.psinfo.tty_pgrp */
-	    if (entry->stat.tty_pgrp < 0)
-		return 0;
-	    atom->ul = entry->stat.tty_pgrp;
-	    break;
-
-	case 8: /* proc.psinfo.flags */
-	    atom->ul = entry->stat.flags;
-	    break;
-
-	case 9: /* proc.psinfo.minflt */
-	    atom->ul = entry->stat.minflt;
-	    break;
-
-	case 10: /* proc.psinfo.cmin_flt */
-	    atom->ul = entry->stat.cminflt;
-	    break;
-
-	case 11: /* proc.psinfo.maj_flt */
-	    atom->ul = entry->stat.majflt;
-	    break;
-
-	case 12: /* proc.psinfo.cmaj_flt */
-	    atom->ul = entry->stat.cmajflt;
-	    break;
-
-	case 13: /* proc.psinfo.utime */
-	    _pm_assign_ulong(atom, entry->stat.utime * 1000 / _pm_hertz);
-	    break;
-
-	case 14: /* proc.psinfo.stime */
-	    _pm_assign_ulong(atom, entry->stat.stime * 1000 / _pm_hertz);
-	    break;
-
-	case 15: /* proc.psinfo.cutime */
-	    _pm_assign_ulong(atom, entry->stat.cutime * 1000 / _pm_hertz);
-	    break;
-
-	case 16: /* proc.psinfo.cstime */
-	    _pm_assign_ulong(atom, entry->stat.cstime * 1000 / _pm_hertz);
-	    break;
-
-	case 17: /* proc.psinfo.priority */
-	    atom->l = entry->stat.priority;
-	    break;
-
-	case 18: /* proc.psinfo.nice */
-	    atom->l = entry->stat.nice;
-	    break;
-
-	/* case 19: -- threads */
-
-	case 20: /* proc.psinfo.it_real_value */
-	    atom->ul = entry->stat.it_real_value;
-	    break;
-
-	case 21: /* proc.psinfo.start_time */
-	    atom->ull = entry->stat.start_time * 1000 / _pm_hertz;
-	    break;
-
-	case 22: /* proc.psinfo.vsize */
-	    atom->ull = entry->stat.vsize / 1024;
-	    break;
-
-	case 23: /* proc.psinfo.rss */
-	    atom->ull = entry->stat.rss * _pm_system_pagesize / 1024;
-	    break;
-
-	case 24: /* proc.psinfo.rss_rlim */
-	    atom->ull = entry->stat.rss_rlim / 1024;
-	    break;
-
-	case 25: /* proc.psinfo.start_code */
-	    atom->ul = entry->stat.start_code;
-	    break;
-
-	case 26: /* proc.psinfo.end_code */
-	    atom->ul = entry->stat.end_code;
-	    break;
-
-	case 27: /* proc.psinfo.start_stack */
-	    atom->ul = entry->stat.start_stack;
-	    break;
-
-	case 28: /* proc.psinfo.esp */
-	    atom->ul = entry->stat.esp;
-	    break;
-
-	case 29: /* proc.psinfo.eip */
-	    atom->ul = entry->stat.eip;
-	    break;
-
-	case 30: /* proc.psinfo.signal */
-	    atom->ul = entry->stat.signal;
-	    break;
-
-	case 31: /* proc.psinfo.blocked */
-	    atom->ul = entry->stat.blocked;
-	    break;
-
-	case 32: /* proc.psinfo.sigignore */
-	    atom->ul = entry->stat.sigignore;
-	    break;
-
-	case 33: /* proc.psinfo.sigcatch */
-	    atom->ul = entry->stat.sigcatch;
-	    break;
-
-	case 34: /* proc.psinfo.wchan */
-	    _pm_assign_ulong(atom, entry->stat.wchan);
-	    break;
-
-	case 35: /* proc.psinfo.nswap */
-	    atom->ul = entry->stat.nswap;
-	    break;
-
-	case 36: /* proc.psinfo.cnswap */
-	    atom->ul = entry->stat.cnswap;
-	    break;
-
-	case 37: /* proc.psinfo.exit_signal */
-	    atom->ul = entry->stat.exit_signal;
-	    break;
-
-	case 38: /* proc.psinfo.processor */
-	    atom->ul = entry->stat.processor;
-	    break;
-
-	case 39: /* proc.psinfo.ttyname */
-	    if (!entry->stat.tty)
-		atom->cp = "?";
-	    else
-		atom->cp = get_ttyname_info((dev_t)entry->stat.tty);
-	    break;
- 
-	case 42: /* proc.psinfo.rt_priority */
-	    atom->ul = entry->stat.rtpriority;
-	    break;
-
-	case 43: /* proc.psinfo.policy */
-	    atom->ul = entry->stat.policy;
-	    break;
-
-	case 44: /* proc.psinfo.delayacct_blkio_time */
-	    atom->ull = entry->stat.delayacct_blkio_time * 1000 / _pm_hertz;
-	    break;
-
-	case 45: /* proc.psinfo.guest_time */
-	    atom->ull = entry->stat.guest_time * 1000 / _pm_hertz;
-	    break;
-
-	case 46: /* proc.psinfo.cguest_time */
-	    atom->ull = entry->stat.cguest_time * 1000 / _pm_hertz;
-	    break;
-
-	case 48: /* proc.psinfo.policy_s */
-	    atom->cp = scheduler_policy_name(entry->stat.policy);
-	    break;
-
-	default:
-	    return PM_ERR_PMID;
-	}
-	break;
+	return proc_pid_stat_value(item, entry, atom);
 
     case CLUSTER_HOTPROC_PID_STATM:
 	active_proc_pid = &hotproc_pid;
@@ -1995,34 +2106,7 @@ proc_fetchCallBack(pmdaMetric *mdesc, unsigned int inst, pmAtomValue *atom)
 	}
 	if ((entry = fetch_proc_pid_statm(inst, active_proc_pid, &sts)) == NULL)
 	    return sts;
-	if (!(entry->success & PROC_PID_FLAG_STATM))
-	    return 0;
-	switch (item) {
-	case 0: /* proc.memory.size */
-	    atom->ul = entry->statm.size * _pm_system_pagesize / 1024;
-	    break;
-	case 1:	/* proc.memory.rss */
-	    atom->ul = entry->statm.rss * _pm_system_pagesize / 1024;
-	    break;
-	case 2: /* proc.memory.share */
-	    atom->ul = entry->statm.share * _pm_system_pagesize / 1024;
-	    break;
-	case 3: /* proc.memory.textrss */
-	    atom->ul = entry->statm.textrs * _pm_system_pagesize / 1024;
-	    break;
-	case 4: /* proc.memory.librss */
-	    atom->ul = entry->statm.librs * _pm_system_pagesize / 1024;
-	    break;
-	case 5: /* proc.memory.datrss */
-	    atom->ul = entry->statm.datrs * _pm_system_pagesize / 1024;
-	    break;
-	case 6: /* proc.memory.dirty */
-	    atom->ul = entry->statm.dirty * _pm_system_pagesize / 1024;
-	    break;
-	default:
-	    return PM_ERR_PMID;
-	}
-    	break;
+	return proc_pid_statm_value(item, entry, atom);
 
     case CLUSTER_HOTPROC_PID_SCHEDSTAT:
 	active_proc_pid = &hotproc_pid;
@@ -2032,23 +2116,7 @@ proc_fetchCallBack(pmdaMetric *mdesc, unsigned int inst, pmAtomValue *atom)
 	    return PM_ERR_PERMISSION;
 	if ((entry = fetch_proc_pid_schedstat(inst, active_proc_pid, &sts)) == NULL)
 	    return sts;
-	if (!(entry->success & PROC_PID_FLAG_SCHEDSTAT))
-	    return 0;
-
-	switch (item) {
-	case 0: /* proc.schedstat.cpu_time */
-	    atom->ull = entry->schedstat.cputime;
-	    break;
-	case 1: /* proc.schedstat.run_delay */
-	    atom->ull = entry->schedstat.rundelay;
-	    break;
-	case 2: /* proc.schedstat.pcount */
-	    _pm_assign_ulong(atom, entry->schedstat.count);
-	    break;
-	default:
-	    return PM_ERR_PMID;
-	}
-    	break;
+	return proc_pid_schedstat_value(item, entry, atom);
 
     case CLUSTER_HOTPROC_PID_IO:
 	active_proc_pid = &hotproc_pid;
@@ -2058,34 +2126,7 @@ proc_fetchCallBack(pmdaMetric *mdesc, unsigned int inst, pmAtomValue *atom)
 	    return PM_ERR_PERMISSION;
 	if ((entry = fetch_proc_pid_io(inst, active_proc_pid, &sts)) == NULL)
 	    return sts;
-	if (!(entry->success & PROC_PID_FLAG_IO))
-	    return 0;
-	switch (item) {
-	case 0: /* proc.io.rchar */
-	    atom->ull = entry->io.rchar;
-	    break;
-	case 1: /* proc.io.wchar */
-	    atom->ull = entry->io.wchar;
-	    break;
-	case 2: /* proc.io.syscr */
-	    atom->ull = entry->io.syscr;
-	    break;
-	case 3: /* proc.io.syscw */
-	    atom->ull = entry->io.syscw;
-	    break;
-	case 4: /* proc.io.read_bytes */
-	    atom->ull = entry->io.readb;
-	    break;
-	case 5: /* proc.io.write_bytes */
-	    atom->ull = entry->io.writeb;
-	    break;
-	case 6: /* proc.io.cancelled_write_bytes */
-	    atom->ull = entry->io.cancel;
-	    break;
-	default:
-	    return PM_ERR_PMID;
-	}
-	break;
+	return proc_pid_io_value(item, entry, atom);
 
     case CLUSTER_HOTPROC_PID_SMAPS:
 	active_proc_pid = &hotproc_pid;
@@ -3428,6 +3469,118 @@ proc_fetchCallBack(pmdaMetric *mdesc, unsigned int inst, pmAtomValue *atom)
     return PMDA_FETCH_STATIC;
 }
 
+/*
+ * Batch callback provided to pmdaFetch - for the per-process counters
+ * the cluster and item are decoded, and the file and field selected,
+ * once per metric rather than once per process.  Everything else goes
+ * through proc_fetchCallBack.
+ */
+static int
+proc_fetchBatchCallBack(pmdaMetric *mdesc, int numinst,
+		const unsigned int *insts, pmAtomValue *atoms, int *sts)
+{
+    unsigned int	cluster = pmID_cluster(mdesc->m_desc.pmid);
+    unsigned int	item = pmID_item(mdesc->m_desc.pmid);
+    proc_pid_t		*active_proc_pid = &proc_pid;
+    proc_pid_entry_t	*entry;
+    proc_pid_entry_t	*(*fetch)(int, proc_pid_t *, int *);
+    int			(*value)(unsigned int, proc_pid_entry_t *, pmAtomValue *);
+    int			i;
+
+    if (mdesc->m_user != NULL)
+	return PM_ERR_NYI;
+
+    switch (cluster) {
+    case CLUSTER_HOTPROC_PID_STAT:
+	active_proc_pid = &hotproc_pid;
+	/*FALLTHROUGH*/
+    case CLUSTER_PID_STAT:
+	/* proc.nprocs, psinfo.{pid,psargs,wchan_s,environ} are special */
+	if (item == 0 || item == 40 || item == 41 || item == 47 || item == 99)
+	    return PM_ERR_NYI;
+	fetch = fetch_proc_pid_stat;
+	value = proc_pid_stat_value;
+	break;
+
+    case CLUSTER_HOTPROC_PID_STATM:
+	active_proc_pid = &hotproc_pid;
+	/*FALLTHROUGH*/
+    case CLUSTER_PID_STATM:
+	if (item == 7) /* proc.memory.maps */
+	    return PM_ERR_NYI;
+	fetch = fetch_proc_pid_statm;
+	value = proc_pid_statm_value;
+	break;
+
+    case CLUSTER_HOTPROC_PID_SCHEDSTAT:
+	active_proc_pid = &hotproc_pid;
+	/*FALLTHROUGH*/
+    case CLUSTER_PID_SCHEDSTAT:
+	fetch = fetch_proc_pid_schedstat;
+	value = proc_pid_schedstat_value;
+	break;
+
+    case CLUSTER_HOTPROC_PID_IO:
+	active_proc_pid = &hotproc_pid;
+	/*FALLTHROUGH*/
+    case CLUSTER_PID_IO:
+	fetch = fetch_proc_pid_io;
+	value = proc_pid_io_value;
+	break;
+
+    default:
+	return PM_ERR_NYI;
+    }
+
+    if (!have_access)
+	return PM_ERR_PERMISSION;
+
+    for (i = 0; i < numinst; i++) {
+	if ((entry = fetch(insts[i], active_proc_pid, &sts[i])) != NULL)
+	    sts[i] = value(item, entry, &atoms[i]);
+    }
+    return 0;
+}
+
+/*
+ * Work out which per-process files this fetch reads from each process
+ * (by metric, so that e.g. proc.nprocs alone reads none of them), and
+ * have them read for all processes in the profile before pmdaFetch.
+ */
+static void
+proc_prefetch(int numpmid, pmID pmidlist[], pmdaExt *pmda)
+{
+    unsigned int	want = 0;
+    unsigned int	item;
+    int			i;
+
+    for (i = 0; i < numpmid; i++) {
+	item = pmID_item(pmidlist[i]);
+	switch (pmID_cluster(pmidlist[i])) {
+	case CLUSTER_PID_STAT:
+	    /* nprocs, pid, wchan_s, psargs and environ are not from stat */
+	    if (item != 99 && item != 0 && item != 40 && item != 41 && item != 47)
+		want |= PROC_PID_FLAG_STAT;
+	    break;
+	case CLUSTER_PID_STATM:
+	    if (item != 7)	/* proc.memory.maps */
+		want |= PROC_PID_FLAG_STATM;
+	    break;
+	case CLUSTER_PID_STATUS:
+	    want |= PROC_PID_FLAG_STATUS;
+	    break;
+	case CLUSTER_PID_SCHEDSTAT:
+	    want |= PROC_PID_FLAG_SCHEDSTAT;
+	    break;
+	case CLUSTER_PID_IO:
+	    want |= PROC_PID_FLAG_IO;
+	    break;
+	}
+    }
+    if (want)
+	prefetch_proc_pid(&proc_pid, want, pmda->e_prof);
+}
+
 static int
 proc_fetch(int numpmid, pmID pmidlist[], pmResult **resp, pmdaExt *pmda)
 {
@@ -3446,8 +3599,11 @@ proc_fetch(int numpmid, pmID pmidlist[], pmResult **resp, pmdaExt *pmda)
 		"proc_fetch", have_access, all_access,
 		proc_ctx_access(pmda->e_context));
 
-    if ((sts = proc_refresh(pmda, need_refresh)) == 0)
+    if ((sts = proc_refresh(pmda, need_refresh)) == 0) {
+	if (have_access)
+	    proc_prefetch(numpmid, pmidlist, pmda);
 	sts = pmdaFetch(numpmid, pmidlist, resp, pmda);
+    }
 
     have_access = all_access || proc_ctx_revert(pmda->e_context);
     if (pmDebugOptions.auth)
@@ -3810,6 +3966,12 @@ proc_init(pmdaInterface *dp)
 	threads = atoi(envpath);
     if ((envpath = getenv("PROC_ACCESS")) != NULL)
 	all_access = atoi(envpath);
+    if ((envpath = getenv("PROC_MAXFDS")) != NULL)
+	proc_pid_maxfds = atoi(envpath);
+    if ((envpath = getenv("PROC_TASKSTATS")) != NULL)
+	proc_pid_taskstats = atoi(envpath);
+    if ((envpath = getenv("PROC_WORKERS")) != NULL)
+	proc_pid_workers = atoi(envpath);
 
     if (_isDSO) {
 	char helppath[MAXPATHLEN];
@@ -3835,6 +3997,7 @@ proc_init(pmdaInterface *dp)
     pmdaSetLabelCallBack(dp, proc_labelCallBack);
     pmdaSetEndContextCallBack(dp, proc_ctx_end);
     pmdaSetFetchCallBack(dp, proc_fetchCallBack);
+    pmdaSetFetchBatchCallBack(dp, proc_fetchBatchCallBack);
 
     /*
      * Initialize the instance domain table.
@@ -3907,13 +4070,15 @@ pmLongOptions	longopts[] = {
     PMDAOPT_LOGFILE,
     { "with-threads", 0, 'L', 0, "include threads in the all-processes instance domain" },
     { "from-cgroup", 1, 'r', "NAME", "restrict monitoring to processes in the named cgroup" },
+    { "with-taskstats", 0, 'T', 0, "gather scheduler statistics via taskstats netlink queries" },
     PMDAOPT_USERNAME,
+    { "workers", 1, 'w', "N", "number of threads refreshing per-process metrics" },
     PMOPT_HELP,
     PMDA_OPTIONS_END
 };
 
 pmdaOptions	opts = {
-    .short_options = "AD:d:l:Lr:U:?",
+    .short_options = "AD:d:l:Lr:TU:w:?",
     .long_options = longopts,
 };
 
@@ -3921,6 +4086,7 @@ int
 main(int argc, char **argv)
 {
     int			c, sep = pmPathSeparator();
+    char		*endnum;
     pmdaInterface	dispatch;
     char		helppath[MAXPATHLEN];
     char		*username = "root";
@@ -3942,6 +4108,17 @@ main(int argc, char **argv)
 	case 'r':
 	    cgroups = opts.optarg;
 	    break;
+	case 'T':
+	    proc_pid_taskstats = 1;
+	    break;
+	case 'w':
+	    proc_pid_workers = (int)strtol(opts.optarg, &endnum, 10);
+	    if (*endnum != '\0' || proc_pid_workers < 1) {
+		pmprintf("%s: -w requires a positive numeric argument\n",
+			pmGetProgname());
+		opts.errors++;
+	    }
+	    break;
 	}
     }
 
@@ -3958,5 +4135,6 @@ main(int argc, char **argv)
     proc_init(&dispatch);
     pmdaConnect(&dispatch);
     pmdaMain(&dispatch);
+    prefetch_shutdown();
     exit(0);
 }
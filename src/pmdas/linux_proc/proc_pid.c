@@ -23,19 +23,56 @@
 #include <dirent.h>
 #include <sys/stat.h>
 #include <sys/types.h>
+#include <sys/resource.h>
+#include <signal.h>
+#if defined(HAVE_PTHREAD_H)
+#include <pthread.h>
+#else
+#error "Need pthread support"
+#endif
 #include <pwd.h>
 #include <grp.h>
 #include "proc_pid.h"
 #include "indom.h"
 #include "cgroups.h"
 #include "hotproc.h"
+#include "taskstats.h"
 
+#ifdef HAVE___THREAD
+/* per-thread, so that refresh workers each read into their own buffer */
+static __thread size_t	procbuflen;
+static __thread char	*procbuf;
+#else
 static size_t	procbuflen;
 static char	*procbuf;
+#endif
+
+/* serialises the descriptor count and strings cache between workers */
+static pthread_mutex_t	proc_pid_mutex = PTHREAD_MUTEX_INITIALIZER;
+
+/*
+ * Descriptors for the small, frequently sampled per-process files
+ * are kept open across samples (up to a limit), then rewound and
+ * re-read on each refresh, avoiding a procfs path lookup and an
+ * open/close per file per process.  Only world-readable files with
+ * any access checks made at read(2) time are eligible, and an open
+ * descriptor is only reused under the credentials that opened it
+ * (a client with different credentials could be denied the open).
+ */
+static const char *proc_pid_fdfiles[PROC_PID_NFDS] = {
+    [PROC_PID_FD_STAT]		= "stat",
+    [PROC_PID_FD_STATM]		= "statm",
+    [PROC_PID_FD_STATUS]	= "status",
+    [PROC_PID_FD_SCHEDSTAT]	= "schedstat",
+};
+int		proc_pid_maxfds = -1;	/* -1: half the RLIMIT_NOFILE limit */
+static int	proc_pid_numfds;	/* number of descriptors kept open */
+int		proc_pid_taskstats;	/* =1 schedstat cluster via netlink */
 
 static proc_pid_list_t procpids; /* previous pids list that the proc pmda uses */
 static void refresh_proc_pidlist(proc_pid_t *, proc_pid_list_t *, proc_runq_t *);
 static int refresh_proc_pid_stat(proc_pid_entry_t *);
+static int refresh_proc_pid_statm(proc_pid_entry_t *);
 static int refresh_proc_pid_status(proc_pid_entry_t *);
 static int refresh_proc_pid_io(proc_pid_entry_t *);
 static int refresh_proc_pid_schedstat(proc_pid_entry_t *);
@@ -115,6 +152,23 @@ compare_pid(const void *pa, const void *pb)
     return a - b;
 }
 
+/*
+ * procfs returns processes in ascending order already, so sorting
+ * is only needed once threads have been interleaved.
+ */
+static void
+sort_pidlist(proc_pid_list_t *pids)
+{
+    int			i;
+
+    for (i = 1; i < pids->count; i++) {
+	if (pids->pids[i-1] > pids->pids[i]) {
+	    qsort(pids->pids, pids->count, sizeof(int), compare_pid);
+	    return;
+	}
+    }
+}
+
 static void
 pidlist_append_pid(int pid, proc_pid_list_t *pids)
 {
@@ -224,7 +278,7 @@ refresh_global_pidlist(int want_threads, proc_pid_list_t *pids)
     }
     closedir(dirp);
 
-    qsort(pids->pids, pids->count, sizeof(int), compare_pid);
+    sort_pidlist(pids);
     return 0;
 }
 
@@ -273,7 +327,7 @@ refresh_hotproc_pidlist(proc_pid_list_t *pids)
     }
     closedir(dirp);
 
-    qsort(pids->pids, pids->count, sizeof(int), compare_pid);
+    sort_pidlist(pids);
     return 0;
 }
 
@@ -762,13 +816,76 @@ refresh_proc_runq(proc_pid_entry_t *ep, proc_runq_t *runq)
     }
 }
 
+static void
+proc_pid_closefd(proc_pid_entry_t *ep, int file)
+{
+    if (ep->fds[file] >= 0) {
+	close(ep->fds[file]);
+	ep->fds[file] = -1;
+	pthread_mutex_lock(&proc_pid_mutex);
+	proc_pid_numfds--;
+	pthread_mutex_unlock(&proc_pid_mutex);
+    }
+    ep->sigs[file] = 0;
+}
+
+static void
+proc_pid_closefds(proc_pid_entry_t *ep)
+{
+    int			file;
+
+    for (file = 0; file < PROC_PID_NFDS; file++)
+	proc_pid_closefd(ep, file);
+}
+
+typedef struct {
+    int			numinst;	/* valid entries */
+    int			harvested;	/* entries deleted */
+} proc_harvest_t;
+
+/*
+ * Hash walk callback counting valid entries, and deleting those for
+ * processes that have exited.
+ */
+static __pmHashWalkState
+harvest_pid(const __pmHashNode *node, void *data)
+{
+    proc_pid_entry_t	*ep = (proc_pid_entry_t *)node->data;
+    proc_harvest_t	*hp = (proc_harvest_t *)data;
+
+    if (ep->fetched & PROC_PID_FLAG_VALID) {
+	hp->numinst++;
+	return PM_HASH_WALK_NEXT;
+    }
+    hp->harvested++;
+
+    // This process has exited.
+    //fprintf(stderr, "DELETED key=%d name=\"%s\"\n", ep->id, ep->name);
+    if (ep->instname != NULL)
+	free(ep->instname);
+    if (ep->name != NULL)
+	free(ep->name);
+    if (ep->stat.cmd != NULL)
+	free(ep->stat.cmd);
+    if (ep->maps_buf != NULL)
+	free(ep->maps_buf);
+    if (ep->wchan_buf != NULL)
+	free(ep->wchan_buf);
+    if (ep->environ_buf != NULL)
+	free(ep->environ_buf);
+    proc_pid_closefds(ep);
+    free(ep);
+    return PM_HASH_WALK_DELETE_NEXT;
+}
+
 static void
 refresh_proc_pidlist(proc_pid_t *proc_pid, proc_pid_list_t *pids, proc_runq_t *runq)
 {
-    int			i, fd, numinst, idx = 0;
+    int			i, fd, added = 0, idx = 0;
     char		*p, buf[MAXPATHLEN];
-    __pmHashNode	*node, *next, *prev;
+    __pmHashNode	*node;
     proc_pid_entry_t	*ep;
+    proc_harvest_t	harvest = { 0 };
     pmdaIndom		*indomp = proc_pid->indom;
 
     /*
@@ -790,12 +907,15 @@ refresh_proc_pidlist(proc_pid_t *proc_pid, proc_pid_list_t *pids, proc_runq_t *r
 	if (node)
 	    ep = (proc_pid_entry_t *)node->data;
 	else {
-	    int k = 0;
+	    int j, k = 0;
 
 	    ep = (proc_pid_entry_t *)malloc(sizeof(proc_pid_entry_t));
 	    memset(ep, 0, sizeof(proc_pid_entry_t));
 
 	    ep->id = pids->pids[i];
+	    for (j = 0; j < PROC_PID_NFDS; j++)
+		ep->fds[j] = -1;
+	    added++;
 
 	    pmsprintf(buf, sizeof(buf), "%s/proc/%d/cmdline", proc_statspath, pids->pids[i]);
 	    if ((fd = open(buf, O_RDONLY)) >= 0) {
@@ -906,43 +1026,7 @@ refresh_proc_pidlist(proc_pid_t *proc_pid, proc_pid_list_t *pids, proc_runq_t *r
     /* 
      * harvest pids that have exit'ed
      */
-    numinst = 0;
-    for (i=0; i < proc_pid->pidhash.hsize; i++) {
-	for (prev=NULL, node=proc_pid->pidhash.hash[i]; node != NULL;) {
-	    next = node->next;
-	    ep = (proc_pid_entry_t *)node->data;
-	    // fprintf(stderr, "CHECKING key=%d node=" PRINTF_P_PFX "%p prev=" PRINTF_P_PFX "%p next=" PRINTF_P_PFX "%p ep=" PRINTF_P_PFX "%p valid=%d\n",
-	    	// ep->id, node, prev, node->next, ep, ep->valid);
-	    if (ep->fetched & PROC_PID_FLAG_VALID) {
-		numinst++;
-	    	prev = node;
-	    }
-	    else {
-		// This process has exited.
-	        //fprintf(stderr, "DELETED key=%d name=\"%s\"\n", ep->id, ep->name);
-		if (ep->instname != NULL)
-		    free(ep->instname);
-		if (ep->name != NULL)
-		    free(ep->name);
-		if (ep->stat.cmd != NULL)
-		    free(ep->stat.cmd);
-		if (ep->maps_buf != NULL)
-		    free(ep->maps_buf);
-		if (ep->wchan_buf != NULL)
-		    free(ep->wchan_buf);
-		if (ep->environ_buf != NULL)
-		    free(ep->environ_buf);
-	    	if (prev == NULL)
-		    proc_pid->pidhash.hash[i] = node->next;
-		else
-		    prev->next = node->next;
-		free(ep);
-		free(node);
-	    }
-	    if ((node = next) == NULL)
-	    	break;
-	}
-    }
+    __pmHashWalkCB(harvest_pid, &harvest, &proc_pid->pidhash);
 
     /* Reset accounting of the runqueue metrics, initially all zeroes */
     if (runq)
@@ -952,14 +1036,23 @@ refresh_proc_pidlist(proc_pid_t *proc_pid, proc_pid_list_t *pids, proc_runq_t *r
      * At this point, the hash table contains only valid pids.  Finally:
      * - refresh the indom table, based on the updated process hash table.
      *   (indom table instance names are shared with the hash table entry,
-     *    so must not be freed).
+     *    so must not be freed).  When no process has started or exited,
+     *   the hash table (and so the indom table) is unchanged.
      * - if runq metrics are being gathered, sample stat files now for all
      *   active processes and accumulate the values - and do this in a way
      *   that sets the FETCHED flag for these files such that they're only
      *   read once for each sample (fetch).
      */
-    indomp->it_numinst = numinst;
-    indomp->it_set = (pmdaInstid *)realloc(indomp->it_set, numinst * sizeof(pmdaInstid));
+    if (added == 0 && harvest.harvested == 0 &&
+	indomp->it_numinst == harvest.numinst) {
+	if (runq == NULL)
+	    return;
+	indomp = NULL;
+    } else {
+	indomp->it_numinst = harvest.numinst;
+	indomp->it_set = (pmdaInstid *)realloc(indomp->it_set,
+				harvest.numinst * sizeof(pmdaInstid));
+    }
     for (i=0; i < proc_pid->pidhash.hsize; i++) {
 	for (node=proc_pid->pidhash.hash[i]; node != NULL; node=node->next) {
 	    ep = (proc_pid_entry_t *)node->data;
@@ -967,7 +1060,8 @@ refresh_proc_pidlist(proc_pid_t *proc_pid, proc_pid_list_t *pids, proc_runq_t *r
 		refresh_proc_pid_stat(ep);
 		refresh_proc_runq(ep, runq);
 	    }
-	    refresh_proc_indom_entry(ep, indomp, idx++);
+	    if (indomp)
+		refresh_proc_indom_entry(ep, indomp, idx++);
 	}
     }
 }
@@ -1169,6 +1263,88 @@ read_proc_entry(int fd, size_t *lenp, char **bufp)
     return sts;
 }
 
+/*
+ * Reserve a slot for a descriptor to be kept open, if within the limit.
+ */
+static int
+proc_pid_keepfd(void)
+{
+    struct rlimit	rlim;
+    int			keep;
+
+    pthread_mutex_lock(&proc_pid_mutex);
+    if (proc_pid_maxfds < 0) {
+	if (getrlimit(RLIMIT_NOFILE, &rlim) < 0)
+	    proc_pid_maxfds = 0;
+	else if (rlim.rlim_cur == RLIM_INFINITY || rlim.rlim_cur > INT_MAX)
+	    proc_pid_maxfds = INT_MAX / 2;
+	else
+	    proc_pid_maxfds = rlim.rlim_cur / 2;
+	if (pmDebugOptions.appl1)
+	    fprintf(stderr, "%s: keeping at most %d descriptors open\n",
+			    "proc_pid_keepfd", proc_pid_maxfds);
+    }
+    if ((keep = (proc_pid_numfds < proc_pid_maxfds)) != 0)
+	proc_pid_numfds++;
+    pthread_mutex_unlock(&proc_pid_mutex);
+    return keep;
+}
+
+/*
+ * Read one of the proc_pid_fdfiles into procbuf, using (and keeping)
+ * an open descriptor where possible.  On success, *changed is set if
+ * the contents differ from those seen the last time, in which case
+ * the caller needs to parse them again.
+ */
+static int
+read_proc_pid_file(int file, proc_pid_entry_t *ep, int *changed)
+{
+    unsigned int	task = procpids.threads ? (1 << file) : 0;
+    unsigned char	*p;
+    uint64_t		sig;
+    uid_t		uid = geteuid();
+    gid_t		gid = getegid();
+    int			fd, sts;
+
+    if (ep->fduid != uid || ep->fdgid != gid) {
+	proc_pid_closefds(ep);
+	ep->fduid = uid;
+	ep->fdgid = gid;
+    }
+    if ((fd = ep->fds[file]) >= 0) {
+	if ((ep->fdtask & (1 << file)) == task &&
+	    lseek(fd, 0, SEEK_SET) == 0 &&
+	    read_proc_entry(fd, &procbuflen, &procbuf) == 0)
+	    goto parse;
+	/* view changed, or the process exited (and pid may be reused) */
+	proc_pid_closefd(ep, file);
+    }
+
+    if ((fd = proc_open(proc_pid_fdfiles[file], ep)) < 0)
+	return maperr();
+    if ((sts = read_proc_entry(fd, &procbuflen, &procbuf)) < 0) {
+	close(fd);
+	return sts;
+    }
+    if (proc_pid_keepfd()) {
+	ep->fds[file] = fd;
+	ep->fdtask = (ep->fdtask & ~(1 << file)) | task;
+    } else {
+	close(fd);
+    }
+
+parse:
+    /* FNV-1a hash of the contents, zero is reserved for "unknown" */
+    sig = 14695981039346656037ULL;
+    for (p = (unsigned char *)procbuf; *p; p++)
+	sig = (sig ^ *p) * 1099511628211ULL;
+    if (sig == 0)
+	sig = 1;
+    *changed = (sig != ep->sigs[file]);
+    ep->sigs[file] = sig;
+    return 0;
+}
+
 static void
 parse_proc_stat(proc_pid_entry_t *ep, size_t buflen, char *buf)
 {
@@ -1237,17 +1413,15 @@ parse_proc_stat(proc_pid_entry_t *ep, size_t buflen, char *buf)
 static int
 refresh_proc_pid_stat(proc_pid_entry_t *ep)
 {
-    int			fd, sts;
+    int			sts, changed;
 
     if (ep->success & PROC_PID_FLAG_STAT)
 	return 0;
-    if ((fd = proc_open("stat", ep)) < 0)
-	return maperr();
-    if ((sts = read_proc_entry(fd, &procbuflen, &procbuf)) >= 0) {
-	parse_proc_stat(ep, procbuflen, procbuf);
+    if ((sts = read_proc_pid_file(PROC_PID_FD_STAT, ep, &changed)) >= 0) {
+	if (changed)
+	    parse_proc_stat(ep, procbuflen, procbuf);
 	ep->success |= PROC_PID_FLAG_STAT;
     }
-    close(fd);
     return sts;
 }
 
@@ -1369,6 +1543,7 @@ static int
 parse_string_value(char **buf, size_t length, int commasep)
 {
     char		*p, *start;
+    int			id;
 
     *buf += length;
     for (p = *buf; *p && isspace(*p); p++);	/* skip initial whitespace */
@@ -1383,7 +1558,10 @@ parse_string_value(char **buf, size_t length, int commasep)
 	    *p = ',';	/* replace whitespace */
 	p++;
     }
-    return proc_strings_insert(start);
+    pthread_mutex_lock(&proc_pid_mutex);
+    id = proc_strings_insert(start);
+    pthread_mutex_unlock(&proc_pid_mutex);
+    return id;
 }
 
 static void
@@ -1568,17 +1746,15 @@ parse_proc_status(proc_pid_entry_t *ep, size_t buflen, char *buf)
 static int
 refresh_proc_pid_status(proc_pid_entry_t *ep)
 {
-    int			fd, sts;
+    int			sts, changed;
 
     if (ep->success & PROC_PID_FLAG_STATUS)
 	return 0;
-    if ((fd = proc_open("status", ep)) < 0)
-	return maperr();
-    if ((sts = read_proc_entry(fd, &procbuflen, &procbuf)) == 0) {
-	parse_proc_status(ep, procbuflen, procbuf);
+    if ((sts = read_proc_pid_file(PROC_PID_FD_STATUS, ep, &changed)) == 0) {
+	if (changed)
+	    parse_proc_status(ep, procbuflen, procbuf);
 	ep->success |= PROC_PID_FLAG_STATUS;
     }
-    close(fd);
     return sts;
 }
 
@@ -1618,17 +1794,15 @@ parse_proc_statm(proc_pid_entry_t *ep, size_t buflen, char *buf)
 static int
 refresh_proc_pid_statm(proc_pid_entry_t *ep)
 {
-    int			fd, sts;
+    int			sts, changed;
 
     if (ep->success & PROC_PID_FLAG_STATM)
 	return 0;
-    if ((fd = proc_open("statm", ep)) < 0)
-	return maperr();
-    if ((sts = read_proc_entry(fd, &procbuflen, &procbuf)) == 0) {
-	parse_proc_statm(ep, procbuflen, procbuf);
+    if ((sts = read_proc_pid_file(PROC_PID_FD_STATM, ep, &changed)) == 0) {
+	if (changed)
+	    parse_proc_statm(ep, procbuflen, procbuf);
 	ep->success |= PROC_PID_FLAG_STATM;
     }
-    close(fd);
     return sts;
 }
 
@@ -1714,17 +1888,15 @@ parse_proc_schedstat(proc_pid_entry_t *ep, size_t buflen, char *buf)
 static int 
 refresh_proc_pid_schedstat(proc_pid_entry_t *ep)
 {
-    int			fd, sts;
+    int			sts, changed;
 
     if (ep->success & PROC_PID_FLAG_SCHEDSTAT)
 	return 0;
-    if ((fd = proc_open("schedstat", ep)) < 0)
-	return maperr();
-    if ((sts = read_proc_entry(fd, &procbuflen, &procbuf)) >= 0) {
-	parse_proc_schedstat(ep, procbuflen, procbuf);
+    if ((sts = read_proc_pid_file(PROC_PID_FD_SCHEDSTAT, ep, &changed)) >= 0) {
+	if (changed)
+	    parse_proc_schedstat(ep, procbuflen, procbuf);
 	ep->success |= PROC_PID_FLAG_SCHEDSTAT;
     }
-    close(fd);
     return sts;
 }
 
@@ -2289,3 +2461,270 @@ fetch_proc_pid_autogroup(int id, proc_pid_t *proc_pid, int *sts)
     }
     return (*sts < 0) ? NULL : ep;
 }
+
+/*
+ * Refreshing ahead of a fetch - the per-process files needed by the
+ * fetch are read for every process in the profile before pmdaFetch
+ * runs, rather than one process at a time from the fetch callback.
+ * Values land in each process's own hash entry either way, so the
+ * fetch result is the same whichever thread (or netlink reply)
+ * provided them.  Only successful refreshes are marked as fetched;
+ * any error is left for the fetch callback to retry and report.
+ */
+int		proc_pid_workers = 1;	/* threads refreshing per-process files */
+
+static const struct {
+    unsigned int	flag;
+    int			(*refresh)(proc_pid_entry_t *);
+} prefetch_files[] = {
+    { PROC_PID_FLAG_STAT,	refresh_proc_pid_stat },
+    { PROC_PID_FLAG_STATM,	refresh_proc_pid_statm },
+    { PROC_PID_FLAG_STATUS,	refresh_proc_pid_status },
+    { PROC_PID_FLAG_SCHEDSTAT,	refresh_proc_pid_schedstat },
+    { PROC_PID_FLAG_IO,		refresh_proc_pid_io },
+};
+
+#define PREFETCH_CHUNK	16	/* entries claimed by a worker at a time */
+
+/*
+ * Work-sharing pool: the calling thread and (proc_pid_workers - 1)
+ * helper threads claim chunks of the entries array until it is
+ * exhausted, then the caller waits for all helpers to finish.
+ * The helpers run until prefetch_shutdown sets stop and joins them.
+ */
+static struct {
+    pthread_mutex_t	lock;
+    pthread_cond_t	start;		/* a new batch of entries is ready */
+    pthread_cond_t	done;		/* all helpers finished the batch */
+    unsigned int	batch;		/* sequence number of current batch */
+    int			helpers;	/* helper threads started */
+    int			stop;		/* helpers are to exit */
+    pthread_t		*tids;		/* helper thread identifiers */
+    int			busy;		/* helpers still working on batch */
+    int			next;		/* index of next entry to be claimed */
+    int			count;		/* number of entries in this batch */
+    unsigned int	want;		/* PROC_PID_FLAG_* files to refresh */
+    proc_pid_entry_t	**entries;
+} pool = {
+    .lock = PTHREAD_MUTEX_INITIALIZER,
+    .start = PTHREAD_COND_INITIALIZER,
+    .done = PTHREAD_COND_INITIALIZER,
+};
+
+static void
+prefetch_entry(proc_pid_entry_t *ep, unsigned int want)
+{
+    unsigned int	flag;
+    int			i;
+
+    for (i = 0; i < sizeof(prefetch_files)/sizeof(prefetch_files[0]); i++) {
+	flag = prefetch_files[i].flag;
+	if (!(want & flag) || (ep->fetched & flag))
+	    continue;
+	prefetch_files[i].refresh(ep);
+	if (ep->success & flag)
+	    ep->fetched |= flag;
+    }
+}
+
+static void
+prefetch_work(void)
+{
+    int			i, first, last;
+
+    for (;;) {
+	pthread_mutex_lock(&pool.lock);
+	first = pool.next;
+	pool.next += PREFETCH_CHUNK;
+	pthread_mutex_unlock(&pool.lock);
+
+	if (first >= pool.count)
+	    break;
+	if ((last = first + PREFETCH_CHUNK) > pool.count)
+	    last = pool.count;
+	for (i = first; i < last; i++)
+	    prefetch_entry(pool.entries[i], pool.want);
+    }
+}
+
+static void *
+prefetch_helper(void *arg)
+{
+    unsigned int	seen = (unsigned int)(uintptr_t)arg;
+
+    for (;;) {
+	pthread_mutex_lock(&pool.lock);
+	while (pool.batch == seen && !pool.stop)
+	    pthread_cond_wait(&pool.start, &pool.lock);
+	if (pool.stop) {
+	    pthread_mutex_unlock(&pool.lock);
+	    break;
+	}
+	seen = pool.batch;
+	pthread_mutex_unlock(&pool.lock);
+
+	prefetch_work();
+
+	pthread_mutex_lock(&pool.lock);
+	if (--pool.busy == 0)
+	    pthread_cond_signal(&pool.done);
+	pthread_mutex_unlock(&pool.lock);
+    }
+    return NULL;
+}
+
+/*
+ * Start any helper threads not yet running, with all signals blocked
+ * so that signal handling remains with the main PMDA thread.
+ */
+static void
+prefetch_helpers(void)
+{
+    sigset_t		set, save;
+    pthread_t		*tids;
+    int			sts;
+
+    if ((tids = realloc(pool.tids, (proc_pid_workers - 1) * sizeof(*tids))) == NULL) {
+	pmNoMem("prefetch_helpers", (proc_pid_workers - 1) * sizeof(*tids), PM_RECOV_ERR);
+	proc_pid_workers = pool.helpers + 1;
+	return;
+    }
+    pool.tids = tids;
+
+    sigfillset(&set);
+    pthread_sigmask(SIG_SETMASK, &set, &save);
+    while (pool.helpers < proc_pid_workers - 1) {
+	if ((sts = pthread_create(&pool.tids[pool.helpers], NULL, prefetch_helper,
+				(void *)(uintptr_t)pool.batch)) != 0) {
+	    pmNotifyErr(LOG_WARNING, "%s: cannot start worker thread: %s\n",
+			"prefetch_helpers", pmErrStr(-sts));
+	    proc_pid_workers = pool.helpers + 1;
+	    break;
+	}
+	pool.helpers++;
+    }
+    pthread_sigmask(SIG_SETMASK, &save, NULL);
+    if (pmDebugOptions.appl1)
+	fprintf(stderr, "%s: %d worker threads\n",
+			"prefetch_helpers", pool.helpers + 1);
+}
+
+static void
+prefetch_parallel(proc_pid_entry_t **entries, int count, unsigned int want)
+{
+    int			i;
+
+    if (pool.helpers < proc_pid_workers - 1)
+	prefetch_helpers();
+    if (pool.helpers == 0 || count <= PREFETCH_CHUNK) {
+	for (i = 0; i < count; i++)
+	    prefetch_entry(entries[i], want);
+	return;
+    }
+
+    pthread_mutex_lock(&pool.lock);
+    pool.entries = entries;
+    pool.count = count;
+    pool.want = want;
+    pool.next = 0;
+    pool.busy = pool.helpers;
+    pool.batch++;
+    pthread_cond_broadcast(&pool.start);
+    pthread_mutex_unlock(&pool.lock);
+
+    prefetch_work();
+
+    pthread_mutex_lock(&pool.lock);
+    while (pool.busy > 0)
+	pthread_cond_wait(&pool.done, &pool.lock);
+    pthread_mutex_unlock(&pool.lock);
+}
+
+/*
+ * Stop and reap the helper threads, from the PMDA teardown path.
+ */
+void
+prefetch_shutdown(void)
+{
+    int			i;
+
+    pthread_mutex_lock(&pool.lock);
+    pool.stop = 1;
+    pthread_cond_broadcast(&pool.start);
+    pthread_mutex_unlock(&pool.lock);
+
+    for (i = 0; i < pool.helpers; i++)
+	pthread_join(pool.tids[i], NULL);
+    free(pool.tids);
+    pool.tids = NULL;
+    pool.helpers = 0;
+    proc_pid_workers = 1;
+}
+
+/*
+ * Gather the schedstat cluster with batched taskstats netlink queries
+ * rather than a procfs open and read per process.  The kernel reports
+ * the same counters either way, but without any per-client access
+ * checks - so this is only done when no client credentials are in
+ * effect, and never for a PROC_STATSPATH test tree.
+ */
+static void
+prefetch_taskstats(proc_pid_entry_t **entries, int count)
+{
+    proc_pid_entry_t	*batch[TASKSTATS_BATCH];
+    int			i, n = 0;
+
+    if (!proc_pid_taskstats || proc_statspath[0] != '\0' || geteuid() != 0)
+	return;
+    if (taskstats_init() < 0)
+	return;
+
+    for (i = 0; i < count; i++) {
+	if (entries[i]->fetched & PROC_PID_FLAG_SCHEDSTAT)
+	    continue;
+	batch[n++] = entries[i];
+	if (n < TASKSTATS_BATCH)
+	    continue;
+	if (refresh_taskstats(batch, n) < 0)
+	    return;
+	n = 0;
+    }
+    if (n > 0)
+	refresh_taskstats(batch, n);
+}
+
+void
+prefetch_proc_pid(proc_pid_t *proc_pid, unsigned int want, const pmProfile *prof)
+{
+    static proc_pid_entry_t **entries;
+    static int		maxentries;
+    proc_pid_entry_t	**tmp;
+    proc_pid_entry_t	*ep;
+    __pmHashNode	*node;
+    pmInDom		indom = proc_pid->indom->it_indom;
+    int			i, count = 0;
+
+    if (proc_pid_workers <= 1)
+	want &= PROC_PID_FLAG_SCHEDSTAT;	/* taskstats only */
+    if (want == 0 || proc_pid->pidhash.nodes == 0)
+	return;
+
+    if (proc_pid->pidhash.nodes > maxentries) {
+	if ((tmp = realloc(entries, proc_pid->pidhash.nodes * sizeof(*tmp))) == NULL)
+	    return;
+	entries = tmp;
+	maxentries = proc_pid->pidhash.nodes;
+    }
+    for (i = 0; i < proc_pid->pidhash.hsize; i++) {
+	for (node = proc_pid->pidhash.hash[i]; node != NULL; node = node->next) {
+	    ep = (proc_pid_entry_t *)node->data;
+	    if (prof == NULL || __pmInProfile(indom, prof, ep->id))
+		entries[count++] = ep;
+	}
+    }
+
+    if (want & PROC_PID_FLAG_SCHEDSTAT)
+	prefetch_taskstats(entries, count);
+    if (proc_pid_workers > 1)
+	prefetch_parallel(entries, count, want);
+}
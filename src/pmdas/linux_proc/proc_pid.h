@@ -222,6 +222,17 @@ enum {
     PROC_PID_FLAG_AUTOGROUP	= 1<<16,
 };
 
+/*
+ * per-process files whose descriptors may be kept open across samples
+ */
+enum {
+    PROC_PID_FD_STAT,
+    PROC_PID_FD_STATM,
+    PROC_PID_FD_STATUS,
+    PROC_PID_FD_SCHEDSTAT,
+    PROC_PID_NFDS
+};
+
 typedef struct {
     int			id;	/* pid, hash key and internal instance id */
     int			pad;
@@ -285,6 +296,14 @@ typedef struct {
     /* /proc/<pid>/autogroup cluster */
     uint32_t		autogroup_id;
     int32_t		autogroup_nice;
+
+    /* descriptors kept open across samples, and who opened them */
+    int			fds[PROC_PID_NFDS];
+    unsigned int	fdtask;	/* bitmap, fds[] opened via task/<pid> */
+    uid_t		fduid;
+    gid_t		fdgid;
+    /* signature of the file contents last parsed, to skip unchanged */
+    uint64_t		sigs[PROC_PID_NFDS];
 } proc_pid_entry_t;
 
 typedef struct {
@@ -299,6 +318,9 @@ typedef struct {
     int			threads;	/* /proc/PID/{xxx,task/PID/xxx} flag */
 } proc_pid_list_t;
 
+/* limit on descriptors kept open across samples, -1 for the default */
+extern int proc_pid_maxfds;
+
 /* lookup a proc hash entry */
 extern proc_pid_entry_t *proc_pid_entry_lookup(int, proc_pid_t *);
 
@@ -347,6 +369,12 @@ extern proc_pid_entry_t *fetch_proc_pid_maps(int, proc_pid_t *, int *);
 /* fetch a proc/<pid>/schedstat entry for pid */
 extern proc_pid_entry_t *fetch_proc_pid_schedstat(int, proc_pid_t *, int *);
 
+/* refresh files for all processes in the profile, ahead of a fetch */
+extern int proc_pid_taskstats;
+extern int proc_pid_workers;
+extern void prefetch_proc_pid(proc_pid_t *, unsigned int, const pmProfile *);
+extern void prefetch_shutdown(void);
+
 /* fetch a proc/<pid>/io entry for pid */
 extern proc_pid_entry_t *fetch_proc_pid_io(int, proc_pid_t *, int *);
 
@@ -0,0 +1,243 @@
+/*
+ * Linux taskstats netlink interface, for per-process scheduler statistics
+ *
+ * Copyright (c) 2026 Red Hat.
+ *
+ * This program is free software; you can redistribute it and/or modify it
+ * under the terms of the GNU General Public License as published by the
+ * Free Software Foundation; either version 2 of the License, or (at your
+ * option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of MERCHANTABILITY
+ * or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU General Public License
+ * for more details.
+ */
+
+#include <sys/socket.h>
+#include <linux/netlink.h>
+#include <linux/genetlink.h>
+#include <linux/taskstats.h>
+#include "pmapi.h"
+#include "libpcp.h"
+#include "pmda.h"
+#include "taskstats.h"
+
+#define GENL_DATA(nlh)	((struct nlattr *)((char *)NLMSG_DATA(nlh) + GENL_HDRLEN))
+#define GENL_LEN(nlh)	((int)(nlh)->nlmsg_len - NLMSG_LENGTH(GENL_HDRLEN))
+#define NLA_DATA(nla)	((void *)((char *)(nla) + NLA_HDRLEN))
+#define NLA_LEN(nla)	((int)(nla)->nla_len - NLA_HDRLEN)
+#define NLA_OK(nla,len)	((len) >= (int)NLA_HDRLEN && \
+			 (nla)->nla_len >= NLA_HDRLEN && (nla)->nla_len <= (len))
+#define NLA_NEXT(nla,len) ((len) -= NLA_ALIGN((nla)->nla_len), \
+			 (struct nlattr *)((char *)(nla) + NLA_ALIGN((nla)->nla_len)))
+
+/* one TASKSTATS_CMD_GET query, for a single pid */
+typedef struct {
+    struct nlmsghdr	n;
+    struct genlmsghdr	g;
+    struct nlattr	a;
+    __u32		pid;
+} taskstats_req_t;
+
+static int	tsfd = -1;	/* generic netlink socket */
+static int	tsfamily;	/* taskstats generic netlink family */
+static __u32	tsseq;		/* sequence number of last query sent */
+static int	tsstate = 1;	/* 1: not yet attempted, 0: ready, <0: error */
+static char	tsbuf[8192];	/* a single reply message */
+
+static void
+taskstats_disable(const char *reason, int sts)
+{
+    pmNotifyErr(LOG_INFO, "taskstats %s, using procfs: %s",
+		reason, pmErrStr(sts));
+    if (tsfd >= 0)
+	close(tsfd);
+    tsfd = -1;
+    tsstate = sts;
+}
+
+/*
+ * Resolve the taskstats family identifier with a CTRL_CMD_GETFAMILY
+ * request to the generic netlink controller.
+ */
+static int
+taskstats_family(void)
+{
+    struct {
+	struct nlmsghdr		n;
+	struct genlmsghdr	g;
+	struct nlattr		a;
+	char			name[NLA_ALIGN(sizeof(TASKSTATS_GENL_NAME))];
+    } req;
+    struct nlmsghdr	*nlh = (struct nlmsghdr *)tsbuf;
+    struct nlattr	*nla;
+    int			bytes, len;
+
+    memset(&req, 0, sizeof(req));
+    req.n.nlmsg_len = sizeof(req);
+    req.n.nlmsg_type = GENL_ID_CTRL;
+    req.n.nlmsg_flags = NLM_F_REQUEST;
+    req.n.nlmsg_seq = ++tsseq;
+    req.g.cmd = CTRL_CMD_GETFAMILY;
+    req.g.version = 1;
+    req.a.nla_type = CTRL_ATTR_FAMILY_NAME;
+    req.a.nla_len = NLA_HDRLEN + sizeof(TASKSTATS_GENL_NAME);
+    strcpy(req.name, TASKSTATS_GENL_NAME);
+
+    if (send(tsfd, &req, sizeof(req), 0) < 0)
+	return -oserror();
+    if ((bytes = recv(tsfd, tsbuf, sizeof(tsbuf), 0)) < 0)
+	return -oserror();
+    if (!NLMSG_OK(nlh, bytes))
+	return PM_ERR_IPC;
+    if (nlh->nlmsg_type == NLMSG_ERROR)
+	return ((struct nlmsgerr *)NLMSG_DATA(nlh))->error;
+
+    len = GENL_LEN(nlh);
+    for (nla = GENL_DATA(nlh); NLA_OK(nla, len); nla = NLA_NEXT(nla, len)) {
+	if (nla->nla_type == CTRL_ATTR_FAMILY_ID)
+	    return *(__u16 *)NLA_DATA(nla);
+    }
+    return -ENOENT;
+}
+
+int
+taskstats_init(void)
+{
+    struct sockaddr_nl	addr = { .nl_family = AF_NETLINK };
+    int			size = TASKSTATS_BATCH * 4 * sizeof(tsbuf);
+    int			sts;
+
+    if (tsstate <= 0)
+	return tsstate;
+
+    if ((tsfd = socket(AF_NETLINK, SOCK_RAW | SOCK_CLOEXEC, NETLINK_GENERIC)) < 0 ||
+	bind(tsfd, (struct sockaddr *)&addr, sizeof(addr)) < 0) {
+	taskstats_disable("socket failed", -oserror());
+	return tsstate;
+    }
+    /* room for all replies to a batch - best effort, else some are lost */
+    setsockopt(tsfd, SOL_SOCKET, SO_RCVBUF, &size, sizeof(size));
+
+    if ((sts = taskstats_family()) < 0) {
+	taskstats_disable("family unavailable", sts);
+	return tsstate;
+    }
+    tsfamily = sts;
+    if (pmDebugOptions.appl1)
+	fprintf(stderr, "%s: taskstats family %d\n", "taskstats_init", tsfamily);
+    return (tsstate = 0);
+}
+
+/*
+ * Extract the pid and statistics from a TASKSTATS_TYPE_AGGR_PID reply;
+ * the structure grows with newer kernels (versioned), so copy only the
+ * part known here - the fields used are present in every version.
+ */
+static int
+taskstats_parse(struct nlmsghdr *nlh, __u32 *pid, struct taskstats *ts)
+{
+    struct nlattr	*nla, *nested;
+    int			len, nlen, found = 0;
+
+    len = GENL_LEN(nlh);
+    for (nla = GENL_DATA(nlh); NLA_OK(nla, len); nla = NLA_NEXT(nla, len)) {
+	if (nla->nla_type != TASKSTATS_TYPE_AGGR_PID)
+	    continue;
+	nlen = NLA_LEN(nla);
+	for (nested = NLA_DATA(nla); NLA_OK(nested, nlen);
+	     nested = NLA_NEXT(nested, nlen)) {
+	    if (nested->nla_type == TASKSTATS_TYPE_PID &&
+		NLA_LEN(nested) >= sizeof(__u32)) {
+		*pid = *(__u32 *)NLA_DATA(nested);
+		found |= 1;
+	    }
+	    else if (nested->nla_type == TASKSTATS_TYPE_STATS) {
+		memset(ts, 0, sizeof(*ts));
+		memcpy(ts, NLA_DATA(nested),
+			NLA_LEN(nested) < sizeof(*ts) ? NLA_LEN(nested) : sizeof(*ts));
+		found |= 2;
+	    }
+	}
+    }
+    return found == 3 ? 0 : -ENOENT;
+}
+
+int
+refresh_taskstats(proc_pid_entry_t **eps, int count)
+{
+    taskstats_req_t	req[TASKSTATS_BATCH];
+    proc_pid_entry_t	*ep;
+    struct nlmsghdr	*nlh;
+    struct nlmsgerr	*err;
+    struct taskstats	ts;
+    __u32		first, pid;
+    unsigned int	i;
+    int			bytes, answered = 0;
+
+    if (tsstate != 0)
+	return tsstate;
+
+    /* all queries go to the kernel in a single message batch */
+    memset(req, 0, count * sizeof(req[0]));
+    first = tsseq + 1;
+    for (i = 0; i < count; i++) {
+	req[i].n.nlmsg_len = sizeof(req[i]);
+	req[i].n.nlmsg_type = tsfamily;
+	req[i].n.nlmsg_flags = NLM_F_REQUEST;
+	req[i].n.nlmsg_seq = ++tsseq;
+	req[i].g.cmd = TASKSTATS_CMD_GET;
+	req[i].g.version = TASKSTATS_GENL_VERSION;
+	req[i].a.nla_type = TASKSTATS_CMD_ATTR_PID;
+	req[i].a.nla_len = NLA_HDRLEN + sizeof(__u32);
+	req[i].pid = eps[i]->id;
+    }
+    if (send(tsfd, req, count * sizeof(req[0]), 0) < 0) {
+	taskstats_disable("send failed", -oserror());
+	return tsstate;
+    }
+
+    /*
+     * The kernel handles the whole batch before send returns, so all
+     * replies are queued now - drain them without blocking.  Replies
+     * dropped for lack of buffer space (ENOBUFS) and per-pid errors
+     * (e.g. ESRCH, the process has exited) leave those entries to be
+     * read from procfs instead.
+     */
+    for (;;) {
+	if ((bytes = recv(tsfd, tsbuf, sizeof(tsbuf), MSG_DONTWAIT)) < 0) {
+	    if (oserror() == EINTR || oserror() == ENOBUFS)
+		continue;
+	    break;
+	}
+	for (nlh = (struct nlmsghdr *)tsbuf; NLMSG_OK(nlh, bytes);
+	     nlh = NLMSG_NEXT(nlh, bytes)) {
+	    if ((i = nlh->nlmsg_seq - first) >= count)
+		continue;
+	    if (nlh->nlmsg_type == NLMSG_ERROR) {
+		err = (struct nlmsgerr *)NLMSG_DATA(nlh);
+		if (err->error == -EPERM) {
+		    /* no CAP_NET_ADMIN - same for every remaining query */
+		    taskstats_disable("not permitted", err->error);
+		    return answered;
+		}
+		continue;
+	    }
+	    if (nlh->nlmsg_type != tsfamily ||
+		taskstats_parse(nlh, &pid, &ts) < 0 || pid != eps[i]->id)
+		continue;
+
+	    ep = eps[i];
+	    ep->schedstat.cputime = ts.cpu_run_virtual_total;
+	    ep->schedstat.rundelay = ts.cpu_delay_total;
+	    ep->schedstat.count = ts.cpu_count;
+	    /* values no longer from procfs, so it must be parsed next time */
+	    ep->sigs[PROC_PID_FD_SCHEDSTAT] = 0;
+	    ep->fetched |= PROC_PID_FLAG_SCHEDSTAT;
+	    ep->success |= PROC_PID_FLAG_SCHEDSTAT;
+	    answered++;
+	}
+    }
+    return answered;
+}
@@ -0,0 +1,34 @@
+/*
+ * Linux taskstats netlink interface, for per-process scheduler statistics
+ *
+ * Copyright (c) 2026 Red Hat.
+ *
+ * This program is free software; you can redistribute it and/or modify it
+ * under the terms of the GNU General Public License as published by the
+ * Free Software Foundation; either version 2 of the License, or (at your
+ * option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of MERCHANTABILITY
+ * or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU General Public License
+ * for more details.
+ */
+#ifndef _TASKSTATS_H
+#define _TASKSTATS_H
+
+#include "proc_pid.h"
+
+/* maximum number of queries sent to the kernel in one message batch */
+#define TASKSTATS_BATCH	64
+
+/* open the netlink socket and resolve the taskstats family, once */
+extern int taskstats_init(void);
+
+/*
+ * Query the schedstat cluster for a batch of (up to TASKSTATS_BATCH)
+ * entries, marking those answered as fetched; returns the number of
+ * entries answered, or a negative error code.
+ */
+extern int refresh_taskstats(proc_pid_entry_t **, int);
+
+#endif /* _TASKSTATS_H */
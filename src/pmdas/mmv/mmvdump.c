@@ -297,10 +297,16 @@ dump_metrics2(void *addr, size_t size, int idx, long base, __uint64_t offset, __
 	buf[sizeof(buf)-1] = '\0';
 
 	printf("  [%u/%"PRIi64"] %s\n", m[i].item, off, buf);
-	printf("       type=%s (0x%x), sem=%s (0x%x), pad=0x%x\n",
+	if (m[i].flags & MMV_METRIC_SHARDED)
+	    printf("       type=%s (0x%x), sem=%s (0x%x), flags=0x%x (sharded)\n",
 		metrictype(m[i].type), m[i].type,
 		metricsem(m[i].semantics), m[i].semantics,
-		m[i].padding);
+		m[i].flags);
+	else
+	    printf("       type=%s (0x%x), sem=%s (0x%x), pad=0x%x\n",
+		metrictype(m[i].type), m[i].type,
+		metricsem(m[i].semantics), m[i].semantics,
+		m[i].flags);
 	printf("       units=%s\n", pmUnitsStr(&m[i].dimension));
 	if (m[i].indom != PM_INDOM_NULL && m[i].indom != 0)
 	    printf("       indom=%d\n", m[i].indom);
@@ -402,6 +408,68 @@ dump_value(void *addr, size_t size, mmv_disk_value_t *vals, int i, int toc, int
     return 0;
 }
 
+static mmv_disk_shards_t *
+lookup_shards(void *addr, size_t size)
+{
+    int i;
+    mmv_disk_header_t *hdr = (mmv_disk_header_t *)addr;
+    mmv_disk_toc_t *toc = (mmv_disk_toc_t *)
+			((char *)addr + sizeof(mmv_disk_header_t));
+    mmv_disk_shards_t *sh;
+
+    for (i = 0; i < hdr->tocs; i++) {
+	if (toc[i].type != MMV_TOC_SHARDS)
+	    continue;
+	if (size < toc[i].offset + sizeof(mmv_disk_shards_t))
+	    return NULL;
+	sh = (mmv_disk_shards_t *)((char *)addr + toc[i].offset);
+	if (size < sh->offset + (__uint64_t)sh->count * sh->stride)
+	    return NULL;
+	return sh;
+    }
+    return NULL;
+}
+
+/*
+ * Replace the value with the sum of its per-CPU slots, as pmdammv would.
+ */
+int
+dump_sharded(void *addr, size_t size, mmv_disk_value_t *vals, int i, int toc, int type)
+{
+    mmv_disk_value_t value = vals[i];
+    mmv_disk_shards_t *sh = lookup_shards(addr, size);
+    __uint64_t sum = 0;
+    unsigned int j;
+
+    if (sh == NULL) {
+	printf(" = ?\n");
+	printf("Bad file: toc[%d] sharded value[%d] without shards\n", toc, i);
+	return 1;
+    }
+    if (value.extra < 0 || value.extra + sizeof(__uint64_t) > sh->stride) {
+	printf(" = ?\n");
+	printf("Bad file: toc[%d] sharded value[%d] extra\n", toc, i);
+	return 1;
+    }
+    for (j = 0; j < sh->count; j++)
+	sum += *(__uint64_t *)((char *)addr + sh->offset +
+				(__uint64_t)j * sh->stride + value.extra);
+    value.value.ull = 0;
+    switch (type) {
+    case MMV_TYPE_I32:
+	value.value.l = (__int32_t)sum;
+	break;
+    case MMV_TYPE_U32:
+	value.value.ul = (__uint32_t)sum;
+	break;
+    default:
+	value.value.ull = sum;
+	break;
+    }
+    printf(" (%u shards)", sh->count);
+    return dump_value(addr, size, &value, 0, toc, type);
+}
+
 int
 dump_values1(void *addr, size_t size, int idx, long base, __uint64_t offset, __int32_t count)
 {
@@ -495,7 +563,10 @@ dump_values2(void *addr, size_t size, int idx, long base, __uint64_t offset, __i
 	    buf[sizeof(buf)-1] = '\0';
 	    printf("[%d or \"%s\"]", instance->internal, buf);
 	}
-	dump_value(addr, size, vals, i, idx, metric->type);
+	if (metric->flags & MMV_METRIC_SHARDED)
+	    dump_sharded(addr, size, vals, i, idx, metric->type);
+	else
+	    dump_value(addr, size, vals, i, idx, metric->type);
     }
     return 0;
 }
@@ -562,6 +633,32 @@ dump_labels(void *addr, size_t size, int idx, long base, __uint64_t offset, __in
     return 0;
 }
 
+int
+dump_shards(void *addr, size_t size, int idx, long base, __uint64_t offset, __int32_t count)
+{
+    int i;
+    mmv_disk_shards_t *sh = (mmv_disk_shards_t *)((char *)addr + offset);
+
+    printf("\nTOC[%d]: offset %ld, shards offset %"PRIu64" (%d entries)\n",
+		idx, base, offset, count);
+
+    for (i = 0; i < count; i++) {
+	__uint64_t off = offset + i * sizeof(mmv_disk_shards_t);
+
+	if (size < off + sizeof(mmv_disk_shards_t)) {
+	    printf("Bad file size: too small for toc[%d] shards[%d]\n", idx, i);
+	    return 1;
+	}
+	printf("  [%u/%"PRIu64"] %u shards, stride %u, starting at offset %"PRIu64"\n",
+		i+1, off, sh[i].count, sh[i].stride, sh[i].offset);
+	if (size < sh[i].offset + (__uint64_t)sh[i].count * sh[i].stride) {
+	    printf("Bad file size: too small for toc[%d] shards[%d] blocks\n", idx, i);
+	    return 1;
+	}
+    }
+    return 0;
+}
+
 static char *
 flagstr(int flags)
 {
@@ -687,6 +784,10 @@ dump(const char *file, void *addr, size_t size)
 	    if (dump_labels(addr, size, i, base, offset, count))
 		sts = 1;
 	    break;    
+	case MMV_TOC_SHARDS:
+	    if (dump_shards(addr, size, i, base, offset, count))
+		sts = 1;
+	    break;
 	default:
 	    printf("Unrecognised TOC[%d] type: 0x%x\n", i, type);
 	    sts = 1;
@@ -67,6 +67,7 @@ typedef struct {
     mmv_disk_metric_t	*metrics1;	/* v1 metric descs in mmap */
     mmv_disk_metric2_t	*metrics2;	/* v2 metric descs in mmap */
     mmv_disk_label_t	*labels; 	/* labels desc in mmap */
+    mmv_disk_shards_t	*shards;	/* v3 sharded values in mmap */
     int			vcnt;		/* number of values */
     int			mcnt1;		/* number of metrics */
     int			mcnt2;		/* number of v2 metrics */
@@ -78,12 +79,28 @@ typedef struct {
     __uint64_t		gen;		/* generation number on open */
 } stats_t;
 
+/*
+ * Index entry mapping (cluster, item, instance) to a value record,
+ * built once per map_stats() so fetch need not scan every metric and
+ * value in the mapping.  Entries keyed with PM_IN_NULL hold the first
+ * value of each metric (the only value, for singular metrics).
+ */
+typedef struct {
+    __uint64_t		key;		/* cluster, item and instance */
+    stats_t		*stats;		/* NULL marks an unused slot */
+    mmv_disk_value_t	*value;		/* value record in mmap */
+    int			metric;		/* index into metrics1/metrics2 */
+    int			singular;	/* metric has no instance domain */
+} value_index_t;
+
 typedef struct {
     pmdaMetric		*metrics;
     pmdaIndom		*indoms;
     pmdaNameSpace	*pmns;
     stats_t		*slist;
     int			scnt;
+    value_index_t	*vindex;	/* (cluster,item,inst) -> value */
+    unsigned int	vimask;		/* number of vindex slots - 1 */
     int			mtot;
     int			intot;
     int			reload;		/* require reload of maps */
@@ -553,6 +570,161 @@ create_indom(pmdaExt *pmda, stats_t *s, __uint64_t offset, __uint32_t count,
     return 0;
 }
 
+#define VINDEX_KEY(c,i,n) \
+	(((__uint64_t)(c) << 42) | ((__uint64_t)(i) << 32) | (__uint32_t)(n))
+
+static unsigned int
+value_index_hash(__uint64_t key)
+{
+    key ^= key >> 33;
+    key *= 0xff51afd7ed558ccdULL;
+    key ^= key >> 33;
+    return (unsigned int)key;
+}
+
+static value_index_t *
+value_index_lookup(agent_t *ap, __uint64_t key)
+{
+    value_index_t	*vp;
+    unsigned int	i;
+
+    if (ap->vindex == NULL)
+	return NULL;
+    for (i = value_index_hash(key) & ap->vimask; ; i = (i + 1) & ap->vimask) {
+	vp = &ap->vindex[i];
+	if (vp->stats == NULL)
+	    return NULL;
+	if (vp->key == key)
+	    return vp;
+    }
+}
+
+/*
+ * Add an entry unless the key is already present - first match wins,
+ * as it did for the original linear scan of the mappings in order.
+ */
+static void
+value_index_add(agent_t *ap, __uint64_t key, stats_t *s,
+	mmv_disk_value_t *v, int metric, int singular)
+{
+    value_index_t	*vp;
+    unsigned int	i;
+
+    for (i = value_index_hash(key) & ap->vimask; ; i = (i + 1) & ap->vimask) {
+	vp = &ap->vindex[i];
+	if (vp->stats == NULL)
+	    break;
+	if (vp->key == key)
+	    return;
+    }
+    vp->key = key;
+    vp->stats = s;
+    vp->value = v;
+    vp->metric = metric;
+    vp->singular = singular;
+}
+
+/*
+ * Index every value record of one mapping, by the cluster and item of
+ * its metric descriptor and the internal identifier of its instance.
+ */
+static void
+value_index_stats(agent_t *ap, stats_t *s)
+{
+    mmv_disk_value_t	*v = s->values;
+    mmv_disk_instance2_t *is;
+    __uint64_t		base, size, offset;
+    __uint32_t		item;
+    __int32_t		indom;
+    int			vi, mi, mcnt, singular;
+
+    if (s->version == MMV_VERSION1) {
+	if (s->metrics1 == NULL)
+	    return;
+	base = (char *)s->metrics1 - (char *)s->addr;
+	size = sizeof(mmv_disk_metric_t);
+	mcnt = s->mcnt1;
+    } else {
+	if (s->metrics2 == NULL)
+	    return;
+	base = (char *)s->metrics2 - (char *)s->addr;
+	size = sizeof(mmv_disk_metric2_t);
+	mcnt = s->mcnt2;
+    }
+
+    for (vi = 0; vi < s->vcnt; vi++) {
+	/* value must refer to a metric descriptor in this mapping */
+	offset = v[vi].metric;
+	if (offset < base || (offset - base) % size != 0 ||
+	    (offset - base) / size >= mcnt)
+	    continue;
+	mi = (offset - base) / size;
+
+	if (s->version == MMV_VERSION1) {
+	    item = s->metrics1[mi].item;
+	    indom = s->metrics1[mi].indom;
+	} else {
+	    item = s->metrics2[mi].item;
+	    indom = s->metrics2[mi].indom;
+	}
+	if (item > MAX_MMV_ITEMS)
+	    continue;
+	singular = (indom == PM_INDOM_NULL || indom == 0);
+
+	if (!singular) {
+	    /* internal identifier is at the same offset in v1 and v2 */
+	    offset = v[vi].instance;
+	    if (offset == 0 || s->len < offset + sizeof(mmv_disk_instance2_t)) {
+		if (pmDebugOptions.appl0)
+		    pmNotifyErr(LOG_ERR, "MMV: %s - "
+				"bad instance offset: %"PRIu64" < %"PRIu64,
+				s->name, s->len, offset);
+		continue;
+	    }
+	    is = (mmv_disk_instance2_t *)((char *)s->addr + offset);
+	    value_index_add(ap, VINDEX_KEY(s->cluster, item, is->internal),
+			    s, &v[vi], mi, singular);
+	}
+	value_index_add(ap, VINDEX_KEY(s->cluster, item, PM_IN_NULL),
+			s, &v[vi], mi, singular);
+    }
+}
+
+static void
+value_index_free(agent_t *ap)
+{
+    free(ap->vindex);
+    ap->vindex = NULL;
+    ap->vimask = 0;
+}
+
+/*
+ * Build the value index over all current mappings, in mapping order;
+ * sized for at most two entries per value at a load factor of 0.5.
+ */
+static void
+value_index_build(agent_t *ap)
+{
+    unsigned int	size = 4;
+    __uint64_t		count = 0;
+    int			i;
+
+    for (i = 0; i < ap->scnt; i++)
+	count += ap->slist[i].vcnt;
+    if (count == 0)
+	return;
+    while (size < count * 4)
+	size <<= 1;
+    if ((ap->vindex = (value_index_t *)calloc(size, sizeof(value_index_t))) == NULL) {
+	pmNotifyErr(LOG_ERR, "%s: failed to allocate value index (%u entries)",
+			pmGetProgname(), size);
+	return;
+    }
+    ap->vimask = size - 1;
+    for (i = 0; i < ap->scnt; i++)
+	value_index_stats(ap, &ap->slist[i]);
+}
+
 static void
 map_stats(pmdaExt *pmda)
 {
@@ -601,6 +773,7 @@ map_stats(pmdaExt *pmda)
 	ap->slist = NULL;
 	ap->scnt = 0;
     }
+    value_index_free(ap);
 
     num = scandir(ap->statsdir, &files, NULL, alphasort);
     for (i = 0; i < num; i++) {
@@ -816,6 +989,34 @@ map_stats(pmdaExt *pmda)
 	    case MMV_TOC_INSTANCES:
 	    case MMV_TOC_STRINGS:
 		break;
+
+	    case MMV_TOC_SHARDS: {
+		mmv_disk_shards_t *sh = (mmv_disk_shards_t *)
+					((char *)s->addr + offset);
+
+		offset += sizeof(mmv_disk_shards_t);
+		if (s->version != MMV_VERSION3 || count != 1 ||
+		    s->len < offset) {
+		    if (pmDebugOptions.appl0) {
+			pmNotifyErr(LOG_ERR, "MMV: %s - "
+					"shards offset: %"PRIu64" < %"PRIu64,
+					s->name, s->len, offset);
+		    }
+		    continue;
+		}
+		if (sh->count < 1 || sh->count > MMV_SHARDMAX ||
+		    sh->stride % sizeof(__uint64_t) != 0 ||
+		    s->len < sh->offset + (__uint64_t)sh->count * sh->stride) {
+		    if (pmDebugOptions.appl0) {
+			pmNotifyErr(LOG_ERR, "MMV: %s - "
+					"bad shards: count %u stride %u",
+					s->name, sh->count, sh->stride);
+		    }
+		    continue;
+		}
+		s->shards = sh;
+		break;
+	    }
 		
 	    case MMV_TOC_LABELS:
 	        if (count > MAX_MMV_LABELS) {
@@ -853,111 +1054,109 @@ map_stats(pmdaExt *pmda)
 	}
     }
 
+    value_index_build(ap);	/* for (cluster,item,inst) -> value lookups */
     pmdaTreeRebuildHash(ap->pmns, ap->mtot); /* for reverse (pmid->name) lookups */
     ap->reload = need_reload;
 }
 
 static int
-mmv_lookup_item1(int item, unsigned int inst,
-	stats_t *s, mmv_disk_value_t **value,
+mmv_lookup_stat_metric(agent_t *agent, pmID pmid, unsigned int inst,
+	stats_t **stats, mmv_disk_value_t **value,
 	__uint64_t *shorttext, __uint64_t *helptext)
 {
-    mmv_disk_metric_t	*m1 = s->metrics1;
-    mmv_disk_value_t	*v = s->values;
-    int			mi, vi, sts = PM_ERR_PMID;
+    value_index_t	*vp = NULL;
+    stats_t		*s;
+    int			sts;
+
+    if (inst != PM_IN_NULL)
+	vp = value_index_lookup(agent, VINDEX_KEY(pmID_cluster(pmid),
+						pmID_item(pmid), inst));
+    if (vp == NULL) {
+	vp = value_index_lookup(agent, VINDEX_KEY(pmID_cluster(pmid),
+						pmID_item(pmid), PM_IN_NULL));
+	if (vp == NULL)
+	    return PM_ERR_PMID;
+	/* singular metrics match any instance, others need an exact match */
+	if (inst != PM_IN_NULL && !vp->singular)
+	    return PM_ERR_INST;
+    }
 
-    for (mi = 0; mi < s->mcnt1; mi++) {
-	if (m1[mi].item != item)
-	    continue;
+    s = vp->stats;
+    if (s->version == MMV_VERSION1) {
+	mmv_disk_metric_t	*m1 = &s->metrics1[vp->metric];
 
-	sts = PM_ERR_INST;
-	for (vi = 0; vi < s->vcnt; vi++) {
-	    mmv_disk_metric_t *mt = (mmv_disk_metric_t *)
-			((char *)s->addr + v[vi].metric);
-	    mmv_disk_instance_t *is = (mmv_disk_instance_t *)
-			((char *)s->addr + v[vi].instance);
-
-	    if ((mt == &m1[mi]) &&
-		(mt->indom == PM_INDOM_NULL || mt->indom == 0 ||
-		inst == PM_IN_NULL || is->internal == inst)) {
-		if (shorttext)
-		    *shorttext = m1[mi].shorttext;
-		if (helptext)
-		    *helptext = m1[mi].helptext;
-		*value = &v[vi];
-		return m1[mi].type;
-	    }
-	}
+	if (shorttext)
+	    *shorttext = m1->shorttext;
+	if (helptext)
+	    *helptext = m1->helptext;
+	sts = m1->type;
+    } else {
+	mmv_disk_metric2_t	*m2 = &s->metrics2[vp->metric];
+
+	if (shorttext)
+	    *shorttext = m2->shorttext;
+	if (helptext)
+	    *helptext = m2->helptext;
+	sts = m2->type;
     }
+    if (sts == MMV_TYPE_NOSUPPORT)
+	return PM_ERR_APPVERSION;
+    *stats = s;
+    *value = vp->value;
     return sts;
 }
 
 static int
-mmv_lookup_item2(int item, unsigned int inst,
-	stats_t *s, mmv_disk_value_t **value,
-	__uint64_t *shorttext, __uint64_t *helptext)
+mmv_lookup_stat_metric_value(agent_t *agent, pmID pmid, unsigned int inst,
+	stats_t **stats, mmv_disk_value_t **value)
 {
-    mmv_disk_metric2_t	*m2 = s->metrics2;
-    mmv_disk_value_t	*v = s->values;
-    int			mi, vi, sts = PM_ERR_PMID;
-
-    for (mi = 0; mi < s->mcnt2; mi++) {
-	if (m2[mi].item != item)
-	    continue;
-
-	sts = PM_ERR_INST;
-	for (vi = 0; vi < s->vcnt; vi++) {
-	    mmv_disk_metric2_t *mt = (mmv_disk_metric2_t *)
-			((char *)s->addr + v[vi].metric);
-	    mmv_disk_instance2_t *is = (mmv_disk_instance2_t *)
-			((char *)s->addr + v[vi].instance);
-
-	    if ((mt == &m2[mi]) &&
-		(mt->indom == PM_INDOM_NULL || mt->indom == 0 ||
-		inst == PM_IN_NULL || is->internal == inst)) {
-		if (shorttext)
-		    *shorttext = m2[mi].shorttext;
-		if (helptext)
-		    *helptext = m2[mi].helptext;
-		*value = &v[vi];
-		return m2[mi].type;
-	    }
-	}
-    }
-    return sts;
+    return mmv_lookup_stat_metric(agent, pmid, inst, stats, value, NULL, NULL);
 }
 
+/*
+ * Sum the per-CPU slots of a sharded value (v3 only), with the
+ * signed types accumulated in two's complement.
+ */
 static int
-mmv_lookup_stat_metric(agent_t *agent, pmID pmid, unsigned int inst,
-	stats_t **stats, mmv_disk_value_t **value,
-	__uint64_t *shorttext, __uint64_t *helptext)
+mmv_shard_sum(stats_t *s, mmv_disk_value_t *v, int type, pmAtomValue *atom)
 {
-    int			si, sts = PM_ERR_PMID;
+    mmv_disk_metric2_t	*m = (mmv_disk_metric2_t *)((char *)s->addr + v->metric);
+    mmv_disk_shards_t	*sh = s->shards;
+    __uint64_t		sum = 0, *slot;
+    char		*block;
+    unsigned int	i;
 
-    for (si = 0; si < agent->scnt; si++) {
-	stats_t *s = &agent->slist[si];
+    if (s->version != MMV_VERSION3 || !(m->flags & MMV_METRIC_SHARDED))
+	return 0;
+    if (sh == NULL || v->extra < 0 ||
+	v->extra + sizeof(__uint64_t) > sh->stride) {
+	if (pmDebugOptions.appl0)
+	    pmNotifyErr(LOG_ERR, "MMV: %s - bad sharded value offset: %"PRIi64,
+			s->name, v->extra);
+	return PM_ERR_VALUE;
+    }
 
-	if (s->cluster != pmID_cluster(pmid))
-	    continue;
+    block = (char *)s->addr + sh->offset + v->extra;
+    for (i = 0; i < sh->count; i++, block += sh->stride) {
+	slot = (__uint64_t *)block;
+	sum += __atomic_load_n(slot, __ATOMIC_RELAXED);
+    }
 
-	sts = (s->version == MMV_VERSION1) ?
-	    mmv_lookup_item1(pmID_item(pmid), inst, s, value, shorttext, helptext):
-	    mmv_lookup_item2(pmID_item(pmid), inst, s, value, shorttext, helptext);
-	if (sts == MMV_TYPE_NOSUPPORT)
-	    sts = PM_ERR_APPVERSION;
-	if (sts >= 0) {
-	    *stats = s;
+    switch (type) {
+	case MMV_TYPE_I32:
+	    atom->l = (__int32_t)sum;
+	    break;
+	case MMV_TYPE_U32:
+	    atom->ul = (__uint32_t)sum;
+	    break;
+	case MMV_TYPE_I64:
+	    atom->ll = (__int64_t)sum;
+	    break;
+	default:
+	    atom->ull = sum;
 	    break;
-	}
     }
-    return sts;
-}
-
-static int
-mmv_lookup_stat_metric_value(agent_t *agent, pmID pmid, unsigned int inst,
-	stats_t **stats, mmv_disk_value_t **value)
-{
-    return mmv_lookup_stat_metric(agent, pmid, inst, stats, value, NULL, NULL);
+    return 1;
 }
 
 /*
@@ -1002,6 +1201,8 @@ mmv_fetchCallBack(pmdaMetric *mdesc, unsigned int inst, pmAtomValue *atom)
 	    case MMV_TYPE_I64:
 	    case MMV_TYPE_U64:
 		memcpy(atom, &v->value, sizeof(pmAtomValue));
+		if ((sts = mmv_shard_sum(s, v, sts, atom)) < 0)
+		    return sts;
 		if ((flags & MMV_FLAG_SENTINEL) &&
 		    (memcmp(atom, &aNaN, sizeof(*atom)) == 0))
 		    return PMDA_FETCH_NOVALUES;
@@ -89,6 +89,14 @@ static pmDesc	desctab[] = {
     { PMDA_PMID(0,25), PM_TYPE_STRING, PM_INDOM_NULL, PM_SEM_INSTANT, PMDA_PMUNITS(0,0,0,0,0,0) },
 /* zoneinfo -- local timezone tzfile identification  -- for pmlogger timezone */
     { PMDA_PMID(0,26), PM_TYPE_STRING, PM_INDOM_NULL, PM_SEM_DISCRETE, PMDA_PMUNITS(0,0,0,0,0,0) },
+/* buf.requests */
+    { PMDA_PMID(0,27), PM_TYPE_U64, PM_INDOM_NULL, PM_SEM_COUNTER, PMDA_PMUNITS(0,0,1,0,0,PM_COUNT_ONE) },
+/* buf.hits */
+    { PMDA_PMID(0,28), PM_TYPE_U64, PM_INDOM_NULL, PM_SEM_COUNTER, PMDA_PMUNITS(0,0,1,0,0,PM_COUNT_ONE) },
+/* buf.large */
+    { PMDA_PMID(0,29), PM_TYPE_U64, PM_INDOM_NULL, PM_SEM_COUNTER, PMDA_PMUNITS(0,0,1,0,0,PM_COUNT_ONE) },
+/* buf.slabs */
+    { PMDA_PMID(0,30), PM_TYPE_U32, PM_INDOM_NULL, PM_SEM_INSTANT, PMDA_PMUNITS(0,0,1,0,0,PM_COUNT_ONE) },
 
 /* pdu_in.error */
     { PMDA_PMID(1,0), PM_TYPE_U32, PM_INDOM_NULL, PM_SEM_COUNTER, PMDA_PMUNITS(0,0,1,0,0,PM_COUNT_ONE) },
@@ -1563,6 +1571,25 @@ pmcd_fetch(int numpmid, pmID pmidlist[], pmResult **resp, pmdaExt *pmda)
 				atom.cp = zoneinfo;
 				break;
 
+			case 27:	/* buf.requests */
+			case 28:	/* buf.hits */
+			case 29:	/* buf.large */
+			case 30:	/* buf.slabs */
+				{
+				    __pmPDUBufStats	bufstats;
+
+				    __pmGetPDUBufStats(&bufstats);
+				    if (item == 27)
+					atom.ull = bufstats.requests;
+				    else if (item == 28)
+					atom.ull = bufstats.hits;
+				    else if (item == 29)
+					atom.ull = bufstats.large;
+				    else
+					atom.ul = bufstats.slabs;
+				}
+				break;
+
 			default:
 				sts = atom.l = PM_ERR_PMID;
 				break;
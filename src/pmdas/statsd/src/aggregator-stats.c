@@ -130,6 +130,28 @@ process_stat(struct agent_config* config, struct pmda_stats_container* s, enum S
     pthread_mutex_unlock(&s->mutex);
 }
 
+/**
+ * Adds stats accumulated locally by an aggregator thread, so that the
+ * mutex is taken once per batch of messages rather than per stat
+ * @arg config
+ * @arg s - Data structure shared with PCP thread containing all PMDA statistics data
+ * @arg delta - Locally accumulated stats, metrics_recorded is ignored
+ *
+ * Synchronized by mutex on pmda_stats_container
+ */
+void
+merge_stats(struct agent_config* config, struct pmda_stats_container* s, struct pmda_stats* delta) {
+    (void)config;
+    pthread_mutex_lock(&s->mutex);
+    s->stats->received += delta->received;
+    s->stats->parsed += delta->parsed;
+    s->stats->dropped += delta->dropped;
+    s->stats->aggregated += delta->aggregated;
+    s->stats->time_spent_parsing += delta->time_spent_parsing;
+    s->stats->time_spent_aggregating += delta->time_spent_aggregating;
+    pthread_mutex_unlock(&s->mutex);
+}
+
 /**
  * Write PMDA stats
  * @arg config - config specifies where to write
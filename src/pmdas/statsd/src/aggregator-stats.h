@@ -80,6 +80,18 @@ reset_stat(struct agent_config* config, struct pmda_stats_container* s, enum STA
 extern void
 process_stat(struct agent_config* config, struct pmda_stats_container* s, enum STAT_TYPE type, void* data);
 
+/**
+ * Adds stats accumulated locally by an aggregator thread, so that the
+ * mutex is taken once per batch of messages rather than per stat
+ * @arg config
+ * @arg s - Data structure shared with PCP thread containing all PMDA statistics data
+ * @arg delta - Locally accumulated stats, metrics_recorded is ignored
+ *
+ * Synchronized by mutex on pmda_stats_container
+ */
+extern void
+merge_stats(struct agent_config* config, struct pmda_stats_container* s, struct pmda_stats* delta);
+
 /**
  * Write PMDA stats
  * @arg config - config specifies where to write
@@ -30,32 +30,38 @@
 #include "aggregator-metrics.h"
 #include "aggregator-stats.h"
 
-/**
- * Mutex guarding aggregator proccesing, so there are no race conditions if we request debug output.
- */
-static pthread_mutex_t g_aggregator_processing_lock;
-
 /**
  * This is shared with a function thats called from signal handler, should debug data be requested
+ * Each aggregator thread registers its arguments (which include its processing lock) here
  */
-static struct aggregator_args* g_aggregator_args = NULL;
+static struct aggregator_args* g_aggregator_args[MAX_STATSD_THREADS];
+static size_t g_aggregator_count = 0;
+static pthread_mutex_t g_aggregator_args_lock = PTHREAD_MUTEX_INITIALIZER;
 
 /**
- * Thread startpoint - passes down given datagram to aggregator to record value it contains (should be used for a single new thread)
+ * Thread startpoint - passes down given datagram to aggregator to record value it contains (should be used for each aggregator thread)
  * @arg args - aggregator_args
  */
 void*
 aggregator_exec(void* args) {
     pthread_setname_np(pthread_self(), "Aggregator");
-    g_aggregator_args = (struct aggregator_args*)args;
-    struct agent_config* config = ((struct aggregator_args*)args)->config;
-    struct pmda_metrics_container* metrics_container = ((struct aggregator_args*)args)->metrics_container;
-    struct pmda_stats_container* stats_container = ((struct aggregator_args*)args)->stats_container;
-    chan_t* parser_to_aggregator = ((struct aggregator_args*)args)->parser_to_aggregator;
+    struct aggregator_args* aggregator_args = (struct aggregator_args*)args;
+    pthread_mutex_lock(&g_aggregator_args_lock);
+    if (g_aggregator_count < MAX_STATSD_THREADS) {
+        g_aggregator_args[g_aggregator_count++] = aggregator_args;
+    }
+    pthread_mutex_unlock(&g_aggregator_args_lock);
+    struct agent_config* config = aggregator_args->config;
+    struct pmda_metrics_container* metrics_container = aggregator_args->metrics_container;
+    struct pmda_stats_container* stats_container = aggregator_args->stats_container;
+    chan_t* parser_to_aggregator = aggregator_args->parser_to_aggregator;
 
     struct parser_to_aggregator_message* message;
     struct timespec t0, t1;
     unsigned long time_spent_aggregating;
+    // stats are accumulated locally and merged in batches, sparing the shared stats mutex
+    struct pmda_stats pending = { 0 };
+    size_t pending_count = 0;
     int should_exit;
     while(1) {
         should_exit = check_exit_flag();
@@ -73,27 +79,36 @@ aggregator_exec(void* args) {
             free_parser_to_aggregator_message(message);
             continue;
         }
-        pthread_mutex_lock(&g_aggregator_processing_lock);
-        process_stat(config, stats_container, STAT_RECEIVED, NULL);
+        pthread_mutex_lock(&aggregator_args->processing_lock);
+        pending.received += 1;
         if (message->type == PARSER_RESULT_PARSED) {
             clock_gettime(CLOCK_MONOTONIC, &t0);
             int status = process_metric(config, metrics_container, (struct statsd_datagram*) message->data);
             clock_gettime(CLOCK_MONOTONIC, &t1);
             time_spent_aggregating = t1.tv_nsec - t0.tv_nsec;
-            process_stat(config, stats_container, STAT_PARSED, NULL);
-            process_stat(config, stats_container, STAT_TIME_SPENT_PARSING, &message->time);
+            pending.parsed += 1;
+            pending.time_spent_parsing += message->time;
             if (status) {
-                process_stat(config, stats_container, STAT_AGGREGATED, NULL);
-                process_stat(config, stats_container, STAT_TIME_SPENT_AGGREGATING, &time_spent_aggregating);
+                pending.aggregated += 1;
+                pending.time_spent_aggregating += time_spent_aggregating;
             } else {
-                process_stat(config, stats_container, STAT_DROPPED, NULL);
+                pending.dropped += 1;
             }
         } else if (message->type == PARSER_RESULT_DROPPED) {
-            process_stat(config, stats_container, STAT_DROPPED, NULL);
-            process_stat(config, stats_container, STAT_TIME_SPENT_PARSING, &message->time);
+            pending.dropped += 1;
+            pending.time_spent_parsing += message->time;
         }
         free_parser_to_aggregator_message(message);
-        pthread_mutex_unlock(&g_aggregator_processing_lock);
+        // merge when caught up, so stats are current whenever the agent is idle
+        if (++pending_count >= AGGREGATOR_STATS_BATCH || chan_size(parser_to_aggregator) == 0) {
+            merge_stats(config, stats_container, &pending);
+            pending = (struct pmda_stats) { 0 };
+            pending_count = 0;
+        }
+        pthread_mutex_unlock(&aggregator_args->processing_lock);
+    }
+    if (pending_count != 0) {
+        merge_stats(config, stats_container, &pending);
     }
     VERBOSE_LOG(2, "Aggregator thread exiting.");
     pthread_exit(NULL);
@@ -104,12 +119,19 @@ aggregator_exec(void* args) {
  */
 void
 aggregator_debug_output() {
-    if (g_aggregator_args != NULL) {
-        pthread_mutex_lock(&g_aggregator_processing_lock);
-        write_metrics_to_file(g_aggregator_args->config, g_aggregator_args->metrics_container);
-        write_stats_to_file(g_aggregator_args->config, g_aggregator_args->stats_container);
-        pthread_mutex_unlock(&g_aggregator_processing_lock);
+    size_t i;
+    pthread_mutex_lock(&g_aggregator_args_lock);
+    if (g_aggregator_count != 0) {
+        for (i = 0; i < g_aggregator_count; i++) {
+            pthread_mutex_lock(&g_aggregator_args[i]->processing_lock);
+        }
+        write_metrics_to_file(g_aggregator_args[0]->config, g_aggregator_args[0]->metrics_container);
+        write_stats_to_file(g_aggregator_args[0]->config, g_aggregator_args[0]->stats_container);
+        for (i = g_aggregator_count; i > 0; i--) {
+            pthread_mutex_unlock(&g_aggregator_args[i - 1]->processing_lock);
+        }
     }
+    pthread_mutex_unlock(&g_aggregator_args_lock);
 }
 
 /**
@@ -148,5 +170,6 @@ create_aggregator_args(
     args->parser_to_aggregator = parser_to_aggregator;
     args->metrics_container = m;
     args->stats_container = s;
+    pthread_mutex_init(&args->processing_lock, NULL);
     return args;
 }
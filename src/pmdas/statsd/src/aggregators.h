@@ -16,6 +16,7 @@
 #define AGGREGATORS_
 
 #include <stddef.h>
+#include <pthread.h>
 #include <pcp/dict.h>
 #include <chan/chan.h>
 
@@ -29,10 +30,16 @@ typedef struct aggregator_args
     chan_t* parser_to_aggregator;
     struct pmda_metrics_container* metrics_container;
     struct pmda_stats_container* stats_container;
+    pthread_mutex_t processing_lock; // guards processing against debug output
 } aggregator_args;
 
 /**
- * Thread startpoint - passes down given datagram to aggregator to record value it contains (should be used for a single new thread)
+ * Stats are merged into the shared stats container at least this often (in messages)
+ */
+#define AGGREGATOR_STATS_BATCH 256
+
+/**
+ * Thread startpoint - passes down given datagram to aggregator to record value it contains (should be used for each aggregator thread)
  * @arg args - aggregator_args
  */
 extern void*
@@ -36,6 +36,9 @@ set_default_config(struct agent_config* config) {
     config->port = 8125;
     config->parser_type = PARSER_TYPE_BASIC;
     config->duration_aggregation_type = DURATION_AGGREGATION_TYPE_HDR_HISTOGRAM;
+    config->listener_threads = 1;
+    config->parser_threads = 1;
+    config->aggregator_threads = 1;
     pmGetUsername(&(config->username));
 }
 
@@ -97,6 +100,21 @@ ini_line_handler(void* user, const char* section, const char* name, const char*
         if (param < UINT32_MAX) {
             dest->duration_aggregation_type = (unsigned int) param;
         }
+    } else if (MATCH("listener_threads")) {
+        long unsigned int param = strtoul(value, NULL, 10);
+        if (param > 0 && param <= MAX_STATSD_THREADS) {
+            dest->listener_threads = (unsigned int) param;
+        }
+    } else if (MATCH("parser_threads")) {
+        long unsigned int param = strtoul(value, NULL, 10);
+        if (param > 0 && param <= MAX_STATSD_THREADS) {
+            dest->parser_threads = (unsigned int) param;
+        }
+    } else if (MATCH("aggregator_threads")) {
+        long unsigned int param = strtoul(value, NULL, 10);
+        if (param > 0 && param <= MAX_STATSD_THREADS) {
+            dest->aggregator_threads = (unsigned int) param;
+        }
     } else {
         return 0;
     }
@@ -140,11 +158,14 @@ read_agent_config_cmd(pmdaInterface* dispatch, struct agent_config* dest, int ar
         { "parser-type", 1, 'r', "PARSER-TYPE", "Parser type to use (ragel = 1, basic = 0)" },
         { "duration-aggregation-type", 1, 'a', "DURATION-AGGREGATION-TYPE", "Aggregation type for duration metric to use (hdr_histogram = 1, basic histogram = 0)" },
         { "max-unprocessed-packets-size:", 1, 'z', "MAX-UNPROCESSED-PACKETS-SIZE", "Maximum count of unprocessed packets." },
+        { "listener-threads", 1, 'L', "LISTENER-THREADS", "Number of listener threads, each with its own socket" },
+        { "parser-threads", 1, 'T', "PARSER-THREADS", "Number of parser threads" },
+        { "aggregator-threads", 1, 'A', "AGGREGATOR-THREADS", "Number of aggregator threads" },
         PMDA_OPTIONS_END
     };
 
     static pmdaOptions opts = {
-        .short_options = "D:d:l:U:v:so:Z:P:r:a:z:?",
+        .short_options = "D:d:l:U:v:so:Z:P:r:a:z:L:T:A:?",
         .long_options = longopts,
     };
     while(1) {
@@ -220,6 +241,36 @@ read_agent_config_cmd(pmdaInterface* dispatch, struct agent_config* dest, int ar
                 }
                 break;
             }
+            case 'L':
+            {
+                long unsigned int param = strtoul(opts.optarg, NULL, 10);
+                if (param > 0 && param <= MAX_STATSD_THREADS) {
+                    dest->listener_threads = (unsigned int) param;
+                } else {
+                    pmNotifyErr(LOG_INFO, "listener_threads option value is out of bounds.");
+                }
+                break;
+            }
+            case 'T':
+            {
+                long unsigned int param = strtoul(opts.optarg, NULL, 10);
+                if (param > 0 && param <= MAX_STATSD_THREADS) {
+                    dest->parser_threads = (unsigned int) param;
+                } else {
+                    pmNotifyErr(LOG_INFO, "parser_threads option value is out of bounds.");
+                }
+                break;
+            }
+            case 'A':
+            {
+                long unsigned int param = strtoul(opts.optarg, NULL, 10);
+                if (param > 0 && param <= MAX_STATSD_THREADS) {
+                    dest->aggregator_threads = (unsigned int) param;
+                } else {
+                    pmNotifyErr(LOG_INFO, "aggregator_threads option value is out of bounds.");
+                }
+                break;
+            }
         }
     }
     if (opts.errors) {
@@ -246,6 +297,8 @@ print_agent_config(struct agent_config* config) {
     pmNotifyErr(LOG_INFO, "parser_type: %s \n", config->parser_type == PARSER_TYPE_BASIC ? "BASIC" : "RAGEL");
     pmNotifyErr(LOG_INFO, "maximum of unprocessed packets: %d \n", config->max_unprocessed_packets);
     pmNotifyErr(LOG_INFO, "maximum udp packet size: %ld \n", config->max_udp_packet_size);
+    pmNotifyErr(LOG_INFO, "threads: %u listener, %u parser, %u aggregator \n",
+        config->listener_threads, config->parser_threads, config->aggregator_threads);
     pmNotifyErr(LOG_INFO, "duration_aggregation_type: %s\n", 
         config->duration_aggregation_type == DURATION_AGGREGATION_TYPE_HDR_HISTOGRAM ? "HDR_HISTOGRAM" : "BASIC");
     pmNotifyErr(LOG_INFO, "</settings>\n");
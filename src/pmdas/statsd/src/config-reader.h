@@ -31,6 +31,11 @@ typedef enum DURATION_AGGREGATION_TYPE {
     DURATION_AGGREGATION_TYPE_HDR_HISTOGRAM = 1
 } DURATION_AGGREGATION_TYPE;
 
+/**
+ * Upper bound for each of the listener, parser and aggregator thread counts
+ */
+#define MAX_STATSD_THREADS 64
+
 typedef struct agent_config {
     enum DURATION_AGGREGATION_TYPE duration_aggregation_type;
     enum PARSER_TYPE parser_type;
@@ -39,6 +44,9 @@ typedef struct agent_config {
     unsigned int show_version;
     unsigned int max_unprocessed_packets;
     unsigned int port;
+    unsigned int listener_threads;
+    unsigned int parser_threads;
+    unsigned int aggregator_threads;
     char* debug_output_filename;
     char* username;
 } agent_config;
@@ -23,6 +23,9 @@
 #include <pthread.h>
 #include <sys/types.h>
 #include <signal.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <sys/socket.h>
 
 #include "network-listener.h"
 #include "parser-basic.h"
@@ -30,20 +33,19 @@
 #include "utils.h"
 #include "config-reader.h"
 
+static char* end_message = "PMDASTATSD_EXIT";
+
 /**
- * Thread entrypoint - listens on address and port specified in config 
- * for UDP/TCP containing StatsD payload and then sends it over to parser thread for parsing
- * @arg args - network_listener_args
+ * Creates UDP socket bound to the port specified in config
+ * When there are multiple listener threads, each binds its own socket with SO_REUSEPORT
+ * and kernel spreads incoming datagrams across them
+ * @arg config - Application config
+ * @return socket file descriptor
  */
-void*
-network_listener_exec(void* args) {
-    pthread_setname_np(pthread_self(), "Net. Listener");
-    static char* end_message = "PMDASTATSD_EXIT"; 
-    struct agent_config* config = ((struct network_listener_args*)args)->config;
-    chan_t* network_listener_to_parser = ((struct network_listener_args*)args)->network_listener_to_parser;
+static int
+create_listener_socket(struct agent_config* config) {
     const char* hostname = 0;
     struct addrinfo hints;
-    fd_set readfds;
     memset(&hints, 0, sizeof(hints));
     hints.ai_family = AF_UNSPEC;
     hints.ai_socktype = SOCK_DGRAM;
@@ -60,48 +62,211 @@ network_listener_exec(void* args) {
     if (fd == -1) {
         DIE("failed creating socket (err=%s)", strerror(errno));
     }
+    if (config->listener_threads > 1) {
+#ifdef SO_REUSEPORT
+        int on = 1;
+        if (setsockopt(fd, SOL_SOCKET, SO_REUSEPORT, &on, sizeof(on)) == -1) {
+            DIE("failed setting SO_REUSEPORT on socket (err=%s)", strerror(errno));
+        }
+#else
+        DIE("multiple listener threads require SO_REUSEPORT support");
+#endif
+    }
     if (bind(fd, res->ai_addr, res->ai_addrlen) == -1) {
         DIE("failed binding socket (err=%s)", strerror(errno));
     }
+    freeaddrinfo(res);
+    fcntl(fd, F_SETFL, O_NONBLOCK);
+    return fd;
+}
+
+/**
+ * Reads datagrams waiting on socket, up to RECV_BATCH_SIZE of them
+ * @arg fd - Socket to read from
+ * @arg buffer - Space for RECV_BATCH_SIZE datagrams, each at most size long
+ * @arg size - Space for single datagram
+ * @arg lengths - Placeholder for lengths of datagrams read
+ * @return number of datagrams read, 0 when there are none
+ */
+static int
+receive_datagrams(int fd, char* buffer, size_t size, size_t* lengths) {
+    int i, count = 0;
+#ifdef HAVE_RECVMMSG
+    struct mmsghdr msgs[RECV_BATCH_SIZE];
+    struct iovec iovecs[RECV_BATCH_SIZE];
+    memset(msgs, 0, sizeof(msgs));
+    for (i = 0; i < RECV_BATCH_SIZE; i++) {
+        iovecs[i].iov_base = buffer + i * size;
+        iovecs[i].iov_len = size;
+        msgs[i].msg_hdr.msg_iov = &iovecs[i];
+        msgs[i].msg_hdr.msg_iovlen = 1;
+    }
+    count = recvmmsg(fd, msgs, RECV_BATCH_SIZE, MSG_DONTWAIT, NULL);
+    if (count == -1) {
+        if (errno == EAGAIN || errno == EWOULDBLOCK || errno == EINTR) {
+            return 0;
+        }
+        DIE("%s", strerror(errno));
+    }
+    for (i = 0; i < count; i++) {
+        lengths[i] = msgs[i].msg_len;
+    }
+#else
+    for (i = 0; i < RECV_BATCH_SIZE; i++) {
+        ssize_t length = recvfrom(fd, buffer + i * size, size, MSG_DONTWAIT, NULL, NULL);
+        if (length == -1) {
+            if (errno == EAGAIN || errno == EWOULDBLOCK || errno == EINTR) {
+                break;
+            }
+            DIE("%s", strerror(errno));
+        }
+        lengths[count++] = length;
+    }
+#endif
+    return count;
+}
+
+/**
+ * Picks parser thread for a single metric line, by the metric name (up to first ',' or ':')
+ * Any one metric is then always parsed by the same thread, so that its updates reach
+ * the aggregators in the order they arrived
+ * @arg line - Metric line
+ * @arg length - Length of line
+ * @arg parser_count - Number of parser threads
+ * @return parser index
+ */
+static unsigned int
+route_to_parser(const char* line, size_t length, unsigned int parser_count) {
+    size_t name_length = 0;
+    if (parser_count == 1) {
+        return 0;
+    }
+    while (name_length < length && line[name_length] != ',' && line[name_length] != ':') {
+        name_length++;
+    }
+    return dictGenCaseHashFunction((const unsigned char*) line, name_length) % parser_count;
+}
+
+/**
+ * Appends metric line to parser's unprocessed datagram, allocating it when first needed
+ * @arg batches - Unprocessed datagrams, one per parser thread
+ * @arg index - Parser index
+ * @arg line - Metric line
+ * @arg length - Length of line
+ * @arg used - Bytes used in each unprocessed datagram so far
+ * @arg size - Space for whole batch
+ */
+static void
+append_to_batch(struct unprocessed_statsd_datagram** batches, unsigned int index, const char* line, size_t length, size_t* used, size_t size) {
+    struct unprocessed_statsd_datagram* datagram = batches[index];
+    if (datagram == NULL) {
+        datagram = (struct unprocessed_statsd_datagram*) malloc(sizeof(struct unprocessed_statsd_datagram));
+        ALLOC_CHECK(datagram, "Unable to assign memory for struct representing unprocessed datagrams.");
+        datagram->value = (char*) malloc(sizeof(char) * size);
+        ALLOC_CHECK(datagram->value, "Unable to assign memory for datagram value.");
+        batches[index] = datagram;
+        used[index] = 0;
+    }
+    memcpy(datagram->value + used[index], line, length);
+    used[index] += length;
+    datagram->value[used[index]++] = '\n';
+}
+
+/**
+ * Splits datagrams read in one batch into metric lines (a datagram may carry several, separated
+ * by newlines), joins them into one unprocessed datagram per parser thread, routed by metric name,
+ * and sends those over to parser threads
+ * @arg config - Application config
+ * @arg channels - Network listener -> Parser, one channel per parser thread
+ * @arg buffer - Datagrams
+ * @arg size - Space for single datagram
+ * @arg lengths - Lengths of datagrams
+ * @arg count - Number of datagrams
+ * @return 1 when end message was received, else 0
+ */
+static int
+forward_datagrams(struct agent_config* config, chan_t** channels, char* buffer, size_t size, size_t* lengths, int count) {
+    struct unprocessed_statsd_datagram* batches[MAX_STATSD_THREADS] = { NULL };
+    size_t used[MAX_STATSD_THREADS];
+    size_t total = 0, end_length = strlen(end_message);
+    unsigned int parser_count = config->parser_threads;
+    unsigned int p;
+    int i, end = 0;
+    for (i = 0; i < count; i++) {
+        total += lengths[i] + 1;
+    }
+    for (i = 0; i < count; i++) {
+        char* payload = buffer + i * size;
+        // since length is not -1
+        if (lengths[i] == size) {
+            VERBOSE_LOG(2, "Datagram too large for buffer: truncated and skipped");
+            continue;
+        }
+        // payload is treated as string, just as when each datagram was sent over on its own
+        size_t payload_length = strnlen(payload, lengths[i]);
+        if (payload_length == end_length && strncmp(payload, end_message, end_length) == 0) {
+            end = 1;
+            break;
+        }
+        size_t start = 0;
+        while (start < payload_length) {
+            char* line = payload + start;
+            char* newline = memchr(line, '\n', payload_length - start);
+            size_t line_length = newline ? (size_t)(newline - line) : payload_length - start;
+            if (line_length > 0) {
+                p = route_to_parser(line, line_length, parser_count);
+                append_to_batch(batches, p, line, line_length, used, total + 1);
+            }
+            start += line_length + 1;
+        }
+    }
+    for (p = 0; p < parser_count; p++) {
+        if (batches[p] != NULL) {
+            batches[p]->value[used[p]] = '\0';
+            chan_send(channels[p], batches[p]);
+        }
+    }
+    return end;
+}
+
+/**
+ * Thread entrypoint - listens on address and port specified in config 
+ * for UDP/TCP containing StatsD payload and then sends it over to parser threads for parsing
+ * @arg args - network_listener_args
+ */
+void*
+network_listener_exec(void* args) {
+    pthread_setname_np(pthread_self(), "Net. Listener");
+    struct agent_config* config = ((struct network_listener_args*)args)->config;
+    chan_t** network_listener_to_parser = ((struct network_listener_args*)args)->network_listener_to_parser;
+    int* listeners_running = ((struct network_listener_args*)args)->listeners_running;
+    fd_set readfds;
+    int fd = create_listener_socket(config);
     VERBOSE_LOG(0, "Socket established.");
     VERBOSE_LOG(0, "Waiting for datagrams.");
-    fcntl(fd, F_SETFL, O_NONBLOCK);
     struct timeval tv;
-    freeaddrinfo(res);
-    int max_udp_packet_size = config->max_udp_packet_size;
-    char *buffer = (char *) malloc(max_udp_packet_size * sizeof(char));
-    struct sockaddr_storage src_addr;
-    socklen_t src_addr_len = sizeof(src_addr);
-    int rv;
-    while(1) {
+    size_t max_udp_packet_size = config->max_udp_packet_size;
+    char *buffer = (char *) malloc(RECV_BATCH_SIZE * max_udp_packet_size * sizeof(char));
+    ALLOC_CHECK(buffer, "Unable to assign memory for datagram buffers.");
+    size_t lengths[RECV_BATCH_SIZE];
+    int rv, count, end = 0;
+    while(!end) {
         FD_ZERO(&readfds);
         FD_SET(fd, &readfds);
         tv.tv_sec = 1;
         tv.tv_usec = 0;
         rv = select(fd + 1, &readfds, NULL, NULL, &tv);
         if (rv == 1) {
-            ssize_t count = recvfrom(fd, buffer, max_udp_packet_size, 0, (struct sockaddr*)&src_addr, &src_addr_len);
-            if (count == -1) {
-                DIE("%s", strerror(errno));
-            } 
-            // since we checked for -1
-            else if ((signed int)count == max_udp_packet_size) { 
-                VERBOSE_LOG(2, "Datagram too large for buffer: truncated and skipped");
-            } else {
-                struct unprocessed_statsd_datagram* datagram = (struct unprocessed_statsd_datagram*) malloc(sizeof(struct unprocessed_statsd_datagram));
-                ALLOC_CHECK(datagram, "Unable to assign memory for struct representing unprocessed datagrams.");
-                datagram->value = (char*) malloc(sizeof(char) * (count + 1));
-                ALLOC_CHECK(datagram->value, "Unable to assign memory for datagram value.");
-                memcpy(datagram->value, buffer, count);
-                datagram->value[count] = '\0';
-                if (strcmp(end_message, datagram->value) == 0) {
-                    free_unprocessed_datagram(datagram);
-                    kill(getpid(), SIGINT);
-                    break;
+            // drain the socket, a batch at a time, before waiting again
+            do {
+                count = receive_datagrams(fd, buffer, max_udp_packet_size, lengths);
+                if (count > 0) {
+                    end = forward_datagrams(config, network_listener_to_parser, buffer, max_udp_packet_size, lengths, count);
                 }
-                chan_send(network_listener_to_parser, datagram);
+            } while (count == RECV_BATCH_SIZE && !end && !check_exit_flag());
+            if (end) {
+                kill(getpid(), SIGINT);
             }
-            memset(buffer, 0, max_udp_packet_size);
             rv = 0;
         } else {
             int exit_flag = check_exit_flag();
@@ -111,13 +276,21 @@ network_listener_exec(void* args) {
         }
     }
     VERBOSE_LOG(2, "Network listener thread exiting.");
-    struct unprocessed_statsd_datagram* datagram = (struct unprocessed_statsd_datagram*) malloc(sizeof(struct unprocessed_statsd_datagram));
-    ALLOC_CHECK(datagram, "Unable to assign memory for struct representing unprocessed datagrams.");
-    size_t length = strlen(end_message) + 1;
-    datagram->value = (char*) malloc(sizeof(char) * length);
-    memcpy(datagram->value, end_message, length);
-    chan_send(network_listener_to_parser, datagram);
+    close(fd);
     free(buffer);
+    // last listener out tells every parser thread to exit
+    if (__sync_sub_and_fetch(listeners_running, 1) == 0) {
+        unsigned int i;
+        for (i = 0; i < config->parser_threads; i++) {
+            struct unprocessed_statsd_datagram* datagram = (struct unprocessed_statsd_datagram*) malloc(sizeof(struct unprocessed_statsd_datagram));
+            ALLOC_CHECK(datagram, "Unable to assign memory for struct representing unprocessed datagrams.");
+            size_t length = strlen(end_message) + 1;
+            datagram->value = (char*) malloc(sizeof(char) * length);
+            ALLOC_CHECK(datagram->value, "Unable to assign memory for datagram value.");
+            memcpy(datagram->value, end_message, length);
+            chan_send(network_listener_to_parser[i], datagram);
+        }
+    }
     pthread_exit(NULL);
 }
 
@@ -138,15 +311,16 @@ free_unprocessed_datagram(struct unprocessed_statsd_datagram* datagram) {
 /**
  * Creates arguments for network listener thread
  * @arg config - Application config
- * @arg unprocessed_channel - Network listener -> Parser
- * @arg stats_sink - Channel for sending stats about PMDA itself
+ * @arg network_listener_to_parser - Network listener -> Parser, one channel per parser thread
+ * @arg listeners_running - Count of running listener threads, shared by all of them
  * @return network_listener_args
  */
 struct network_listener_args*
-create_listener_args(struct agent_config* config, chan_t* network_listener_to_parser) {
+create_listener_args(struct agent_config* config, chan_t** network_listener_to_parser, int* listeners_running) {
     struct network_listener_args* listener_args = (struct network_listener_args*) malloc(sizeof(struct network_listener_args));
     ALLOC_CHECK(listener_args, "Unable to assign memory for listener arguments.");
     listener_args->config = config;
     listener_args->network_listener_to_parser = network_listener_to_parser;
+    listener_args->listeners_running = listeners_running;
     return listener_args;
 }
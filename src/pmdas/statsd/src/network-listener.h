@@ -25,10 +25,16 @@ typedef struct unprocessed_statsd_datagram
     char* value;
 } unprocessed_statsd_datagram;
 
+/**
+ * Maximum number of datagrams read from the socket with one system call
+ */
+#define RECV_BATCH_SIZE 32
+
 typedef struct network_listener_args
 {
     struct agent_config* config;
-    chan_t* network_listener_to_parser;
+    chan_t** network_listener_to_parser; // one channel per parser thread
+    int* listeners_running; // shared by all listeners, last one out notifies parsers
 } network_listener_args;
 
 /**
@@ -49,10 +55,11 @@ free_unprocessed_datagram(struct unprocessed_statsd_datagram* datagram);
 /**
  * Creates arguments for network listener thread
  * @arg config - Application config
- * @arg network_listener_to_parser - Network listener -> Parser
+ * @arg network_listener_to_parser - Network listener -> Parser, one channel per parser thread
+ * @arg listeners_running - Count of running listener threads, shared by all of them
  * @return network_listener_args
  */
 extern struct network_listener_args*
-create_listener_args(struct agent_config* config, chan_t* network_listener_to_parser);
+create_listener_args(struct agent_config* config, chan_t** network_listener_to_parser, int* listeners_running);
 
 #endif
@@ -25,20 +25,38 @@
 #include "aggregators.h"
 #include "parser-basic.h"
 #include "parser-ragel.h"
+#include "dict-callbacks.h"
 #include "utils.h"
 
+/**
+ * Sends message over to aggregator thread
+ * Parsed metrics are spread across aggregators by name, so that any one metric is only ever
+ * updated by one aggregator thread - and as listeners route each metric to a single parser thread
+ * (again by name), in the order its datagrams arrived
+ * @arg args - parser_args
+ * @arg message - Message to be sent
+ */
+static void
+send_to_aggregator(struct parser_args* args, struct parser_to_aggregator_message* message) {
+    size_t index = 0;
+    if (args->aggregator_count > 1 && message->data != NULL) {
+        index = str_hash_callback(message->data->name) % args->aggregator_count;
+    }
+    chan_send(args->parser_to_aggregator[index], message);
+}
+
 /**
  * Thread entrypoint - listens to incoming payload on a unprocessed channel
- * and sends over successfully parsed data over to Aggregator thread via processed channel
+ * and sends over successfully parsed data over to Aggregator threads via processed channels
  * @arg args - parser_args
  */
 void*
 parser_exec(void* args) {
     pthread_setname_np(pthread_self(), "Parser");
     static char* network_end_message = "PMDASTATSD_EXIT";
-    struct agent_config* config = ((struct parser_args*)args)->config;
-    chan_t* network_listener_to_parser = ((struct parser_args*)args)->network_listener_to_parser;
-    chan_t* parser_to_aggregator = ((struct parser_args*)args)->parser_to_aggregator;
+    struct parser_args* parser_args = (struct parser_args*)args;
+    struct agent_config* config = parser_args->config;
+    chan_t* network_listener_to_parser = parser_args->network_listener_to_parser;
     datagram_parse_callback parse_datagram;
     if ((int)config->parser_type == (int)PARSER_TYPE_BASIC) {
         parse_datagram = &basic_parser_parse;
@@ -47,6 +65,7 @@ parser_exec(void* args) {
     }
     struct unprocessed_statsd_datagram* datagram;
     char delim[] = "\n";
+    char* saveptr;
     struct timespec t0, t1;
     unsigned long time_spent_parsing;
     int should_exit;
@@ -68,7 +87,7 @@ parser_exec(void* args) {
             continue;
         }
         struct statsd_datagram* parsed;
-        char* tok = strtok(datagram->value, delim);
+        char* tok = strtok_r(datagram->value, delim, &saveptr);
         while (tok != NULL) {
             clock_gettime(CLOCK_MONOTONIC, &t0);
             int success = parse_datagram(tok, &parsed);
@@ -81,24 +100,29 @@ parser_exec(void* args) {
             if (success) {
                 message->data = parsed;
                 message->type = PARSER_RESULT_PARSED;
-                chan_send(parser_to_aggregator, message);
             } else {
                 message->data = NULL;
                 message->type = PARSER_RESULT_DROPPED;
-                chan_send(parser_to_aggregator, message);
             }
-            tok = strtok(NULL, delim);
+            send_to_aggregator(parser_args, message);
+            tok = strtok_r(NULL, delim, &saveptr);
         }
         free_unprocessed_datagram(datagram);
     }
     VERBOSE_LOG(2, "Parser exiting.");
-    struct parser_to_aggregator_message* message =
-        (struct parser_to_aggregator_message*) malloc(sizeof(struct parser_to_aggregator_message));
-    ALLOC_CHECK(message, "Unable to assign memory for parser to aggregator message.");
-    message->type = PARSER_RESULT_END;
-    message->time = 0;
-    message->data = NULL;
-    chan_send(parser_to_aggregator, message);
+    // last parser out tells every aggregator thread to exit
+    if (__sync_sub_and_fetch(parser_args->parsers_running, 1) == 0) {
+        size_t i;
+        for (i = 0; i < parser_args->aggregator_count; i++) {
+            struct parser_to_aggregator_message* message =
+                (struct parser_to_aggregator_message*) malloc(sizeof(struct parser_to_aggregator_message));
+            ALLOC_CHECK(message, "Unable to assign memory for parser to aggregator message.");
+            message->type = PARSER_RESULT_END;
+            message->time = 0;
+            message->data = NULL;
+            chan_send(parser_args->parser_to_aggregator[i], message);
+        }
+    }
     pthread_exit(NULL);
 }
 
@@ -106,16 +130,24 @@ parser_exec(void* args) {
  * Creates arguments for parser thread
  * @arg config - Application config
  * @arg network_listener_to_parser - Network listener -> Parser
- * @arg parser_to_aggregator - Parser -> Aggregator
+ * @arg parser_to_aggregator - Parser -> Aggregator, one channel per aggregator thread
+ * @arg parsers_running - Count of running parser threads, shared by all of them
  * @return parser_args
  */
 struct parser_args*
-create_parser_args(struct agent_config* config, chan_t* network_listener_to_parser, chan_t* parser_to_aggregator) {
+create_parser_args(
+    struct agent_config* config,
+    chan_t* network_listener_to_parser,
+    chan_t** parser_to_aggregator,
+    int* parsers_running
+) {
     struct parser_args* args = (struct parser_args*) malloc(sizeof(struct parser_args));
     ALLOC_CHECK(args, "Unable to assign memory for parser arguments.");
     args->config = config;
     args->network_listener_to_parser = network_listener_to_parser;
     args->parser_to_aggregator = parser_to_aggregator;
+    args->aggregator_count = config->aggregator_threads;
+    args->parsers_running = parsers_running;
     return args;
 }
 
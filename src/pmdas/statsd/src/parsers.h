@@ -24,7 +24,9 @@ typedef struct parser_args
 {
     struct agent_config* config;
     chan_t* network_listener_to_parser;
-    chan_t* parser_to_aggregator;
+    chan_t** parser_to_aggregator; // one channel per aggregator thread
+    size_t aggregator_count;
+    int* parsers_running; // shared by all parsers, last one out notifies aggregators
 } parser_args;
 
 typedef enum METRIC_TYPE { 
@@ -66,7 +68,7 @@ typedef struct statsd_datagram
 typedef int (*datagram_parse_callback)(char*, struct statsd_datagram**);
 
 /**
- * Thread entrypoint - listens to incoming payload on a unprocessed channel and sends over successfully parsed data over to Aggregator thread via processed channel
+ * Thread entrypoint - listens to incoming payload on a unprocessed channel and sends over successfully parsed data over to Aggregator threads via processed channels
  * @arg args - parser_args
  */
 extern void*
@@ -76,11 +78,17 @@ parser_exec(void* args);
  * Creates arguments for parser thread
  * @arg config - Application config
  * @arg network_listener_to_parser - Network listener -> Parser
- * @arg parser_to_aggregator - Parser -> Aggregator
+ * @arg parser_to_aggregator - Parser -> Aggregator, one channel per aggregator thread
+ * @arg parsers_running - Count of running parser threads, shared by all of them
  * @return parser_args
  */
 extern struct parser_args*
-create_parser_args(struct agent_config* config, chan_t* network_listener_to_parser, chan_t* parser_to_aggregator);
+create_parser_args(
+    struct agent_config* config,
+    chan_t* network_listener_to_parser,
+    chan_t** parser_to_aggregator,
+    int* parsers_running
+);
 
 /**
  * 
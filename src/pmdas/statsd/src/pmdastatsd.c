@@ -254,14 +254,16 @@ main_PDU_loop(pmdaInterface* dispatch) {
 }
 
 static int _isDSO = 1; /* for local contexts */
-static pthread_t network_listener;
-static pthread_t aggregator;
-static pthread_t parser;
-static chan_t* network_listener_to_parser;
-static chan_t* parser_to_aggregator;
-static struct network_listener_args* listener_thread_args;
-static struct aggregator_args* aggregator_thread_args;
-static struct parser_args* parser_thread_args;
+static pthread_t network_listeners[MAX_STATSD_THREADS];
+static pthread_t parsers[MAX_STATSD_THREADS];
+static pthread_t aggregators[MAX_STATSD_THREADS];
+static chan_t* network_listener_to_parser[MAX_STATSD_THREADS];
+static chan_t* parser_to_aggregator[MAX_STATSD_THREADS];
+static struct network_listener_args* listener_thread_args[MAX_STATSD_THREADS];
+static struct aggregator_args* aggregator_thread_args[MAX_STATSD_THREADS];
+static struct parser_args* parser_thread_args[MAX_STATSD_THREADS];
+static int listeners_running;
+static int parsers_running;
 static struct agent_config config;
 static struct pmda_data_extension data = { 0 };
 char help_file_path[MAXPATHLEN];
@@ -273,6 +275,7 @@ statsd_init(pmdaInterface *dispatch)
 {
     struct pmda_metrics_container* metricsp;
     struct pmda_stats_container* statsp;
+    unsigned int i;
     int pthread_errno, sep = pmPathSeparator();
 
     if (_isDSO) {
@@ -294,26 +297,44 @@ statsd_init(pmdaInterface *dispatch)
     statsp = init_pmda_stats(&config);
     init_data_ext(&data, &config, metricsp, statsp);
 
-    network_listener_to_parser = chan_init(config.max_unprocessed_packets);
-    if (network_listener_to_parser == NULL) {
-	    DIE("Unable to create channel network listener -> parser.");
+    for (i = 0; i < config.parser_threads; i++) {
+        network_listener_to_parser[i] = chan_init(config.max_unprocessed_packets);
+        if (network_listener_to_parser[i] == NULL) {
+            DIE("Unable to create channel network listener -> parser.");
+        }
     }
-    parser_to_aggregator = chan_init(config.max_unprocessed_packets);
-    if (parser_to_aggregator == NULL) {
-	    DIE("Unable to create channel parser -> aggregator.");
+    for (i = 0; i < config.aggregator_threads; i++) {
+        parser_to_aggregator[i] = chan_init(config.max_unprocessed_packets);
+        if (parser_to_aggregator[i] == NULL) {
+            DIE("Unable to create channel parser -> aggregator.");
+        }
     }
 
-    listener_thread_args = create_listener_args(&config, network_listener_to_parser);
-    parser_thread_args = create_parser_args(&config, network_listener_to_parser, parser_to_aggregator);
-    aggregator_thread_args = create_aggregator_args(&config, parser_to_aggregator, metricsp, statsp);
+    listeners_running = config.listener_threads;
+    parsers_running = config.parser_threads;
+    for (i = 0; i < config.listener_threads; i++) {
+        listener_thread_args[i] = create_listener_args(&config, network_listener_to_parser, &listeners_running);
+    }
+    for (i = 0; i < config.parser_threads; i++) {
+        parser_thread_args[i] = create_parser_args(&config, network_listener_to_parser[i], parser_to_aggregator, &parsers_running);
+    }
+    for (i = 0; i < config.aggregator_threads; i++) {
+        aggregator_thread_args[i] = create_aggregator_args(&config, parser_to_aggregator[i], metricsp, statsp);
+    }
 
     pthread_errno = 0; 
-    pthread_errno = pthread_create(&network_listener, NULL, network_listener_exec, listener_thread_args);
-    PTHREAD_CHECK(pthread_errno);
-    pthread_errno = pthread_create(&parser, NULL, parser_exec, parser_thread_args);
-    PTHREAD_CHECK(pthread_errno);
-    pthread_errno = pthread_create(&aggregator, NULL, aggregator_exec, aggregator_thread_args);
-    PTHREAD_CHECK(pthread_errno);
+    for (i = 0; i < config.listener_threads; i++) {
+        pthread_errno = pthread_create(&network_listeners[i], NULL, network_listener_exec, listener_thread_args[i]);
+        PTHREAD_CHECK(pthread_errno);
+    }
+    for (i = 0; i < config.parser_threads; i++) {
+        pthread_errno = pthread_create(&parsers[i], NULL, parser_exec, parser_thread_args[i]);
+        PTHREAD_CHECK(pthread_errno);
+    }
+    for (i = 0; i < config.aggregator_threads; i++) {
+        pthread_errno = pthread_create(&aggregators[i], NULL, aggregator_exec, aggregator_thread_args[i]);
+        PTHREAD_CHECK(pthread_errno);
+    }
 
     if (dispatch->status != 0) {
         pthread_exit(NULL);
@@ -343,31 +364,49 @@ statsd_init(pmdaInterface *dispatch)
 
 static void
 statsd_done(void) {    
-    if (pthread_join(network_listener, NULL) != 0) {
-        DIE("Error joining network network listener thread.");
-    } else {
-        VERBOSE_LOG(2, "Network listener thread joined.");
+    unsigned int i;
+    for (i = 0; i < config.listener_threads; i++) {
+        if (pthread_join(network_listeners[i], NULL) != 0) {
+            DIE("Error joining network network listener thread.");
+        } else {
+            VERBOSE_LOG(2, "Network listener thread joined.");
+        }
     }
-    if (pthread_join(parser, NULL) != 0) {
-        DIE("Error joining datagram parser thread.");
-    } else {
-        VERBOSE_LOG(2, "Parser thread joined.");
+    for (i = 0; i < config.parser_threads; i++) {
+        if (pthread_join(parsers[i], NULL) != 0) {
+            DIE("Error joining datagram parser thread.");
+        } else {
+            VERBOSE_LOG(2, "Parser thread joined.");
+        }
     }
-    if (pthread_join(aggregator, NULL) != 0) {    
-        DIE("Error joining datagram aggregator thread.");
-    } else {
-        VERBOSE_LOG(2, "Aggregator thread joined.");
+    for (i = 0; i < config.aggregator_threads; i++) {
+        if (pthread_join(aggregators[i], NULL) != 0) {    
+            DIE("Error joining datagram aggregator thread.");
+        } else {
+            VERBOSE_LOG(2, "Aggregator thread joined.");
+        }
     }
 
     free_shared_data(&config, &data);
-    free(listener_thread_args);
-    free(parser_thread_args);
-    free(aggregator_thread_args);
+    for (i = 0; i < config.listener_threads; i++) {
+        free(listener_thread_args[i]);
+    }
+    for (i = 0; i < config.parser_threads; i++) {
+        free(parser_thread_args[i]);
+    }
+    for (i = 0; i < config.aggregator_threads; i++) {
+        pthread_mutex_destroy(&aggregator_thread_args[i]->processing_lock);
+        free(aggregator_thread_args[i]);
+    }
     
-    chan_close(network_listener_to_parser);
-    chan_close(parser_to_aggregator);
-    chan_dispose(network_listener_to_parser);
-    chan_dispose(parser_to_aggregator);
+    for (i = 0; i < config.parser_threads; i++) {
+        chan_close(network_listener_to_parser[i]);
+        chan_dispose(network_listener_to_parser[i]);
+    }
+    for (i = 0; i < config.aggregator_threads; i++) {
+        chan_close(parser_to_aggregator[i]);
+        chan_dispose(parser_to_aggregator[i]);
+    }
 }
 
 int
@@ -0,0 +1,276 @@
+/*
+ * Copyright (c) 2026 Red Hat.
+ *
+ * This program is free software; you can redistribute it and/or modify it
+ * under the terms of the GNU General Public License as published by the
+ * Free Software Foundation; either version 2 of the License, or (at your
+ * option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of MERCHANTABILITY
+ * or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU General Public License
+ * for more details.
+ */
+
+/*
+ * Compress PCP archive files into the zstd "seekable format" - a
+ * sequence of independent zstd frames, each holding a fixed amount
+ * of uncompressed data, followed by a skippable frame with a seek
+ * table, so libpcp can decompress just the frames it needs.
+ */
+
+#include <sys/stat.h>
+#include <sys/time.h>
+#include <zstd.h>
+#include "pmapi.h"
+#include "libpcp.h"
+
+#define SEEKTABLE_SKIPPABLE_MAGIC	0x184D2A5EU
+#define SEEKTABLE_MAGIC			0x8F92EAB1U
+#define SEEKTABLE_FOOTER_SIZE		9
+#define SEEKTABLE_ENTRY_SIZE		8	/* no per-frame checksums */
+
+static pmLongOptions longopts[] = {
+    PMAPI_OPTIONS_HEADER("Options"),
+    { "frame-size", 1, 'b', "SIZE", "uncompressed bytes per frame [default 1m]" },
+    PMOPT_DEBUG,
+    { "keep", 0, 'k', 0, "keep (do not remove) the input files" },
+    { "level", 1, 'l', "N", "zstd compression level [default 3]" },
+    { "verbose", 0, 'v', 0, "report compressed sizes" },
+    PMOPT_HELP,
+    PMAPI_OPTIONS_END
+};
+
+static pmOptions opts = {
+    .short_options = "b:D:kl:v?",
+    .long_options = longopts,
+    .short_usage = "[options] file ...",
+};
+
+static size_t	framesize = 1024 * 1024;
+static int	level = 3;
+static int	kflag;
+static int	vflag;
+
+static void
+put_le32(unsigned char *p, __uint32_t v)
+{
+    p[0] = v & 0xff;
+    p[1] = (v >> 8) & 0xff;
+    p[2] = (v >> 16) & 0xff;
+    p[3] = (v >> 24) & 0xff;
+}
+
+static int
+parse_size(const char *arg, size_t *sizep)
+{
+    char		*end;
+    unsigned long long	size = strtoull(arg, &end, 10);
+
+    if (end == arg)
+	return -1;
+    switch (*end) {
+    case 'k': case 'K':
+	size *= 1024; end++;
+	break;
+    case 'm': case 'M':
+	size *= 1024 * 1024; end++;
+	break;
+    }
+    if (*end != '\0' || size == 0 || size > 0x40000000)
+	return -1;
+    *sizep = size;
+    return 0;
+}
+
+/*
+ * Compress one file (name) into name.zst, returns 0 on success
+ */
+static int
+compress_file(const char *name, ZSTD_CCtx *cctx, char *src, char *dst, size_t dstsize)
+{
+    FILE		*in, *out;
+    char		outname[MAXPATHLEN];
+    unsigned char	*table = NULL, *tp;
+    unsigned char	buf[SEEKTABLE_FOOTER_SIZE];
+    struct stat		sbuf;
+    struct timeval	times[2];
+    size_t		n, csize, tablesize;
+    __uint64_t		ibytes = 0, obytes = 0;
+    __uint32_t		nframes = 0, maxframes = 0;
+
+    if ((in = fopen(name, "r")) == NULL) {
+	fprintf(stderr, "%s: cannot open %s: %s\n",
+			pmGetProgname(), name, strerror(errno));
+	return -1;
+    }
+    if (fstat(fileno(in), &sbuf) < 0) {
+	fprintf(stderr, "%s: cannot stat %s: %s\n",
+			pmGetProgname(), name, strerror(errno));
+	fclose(in);
+	return -1;
+    }
+    pmsprintf(outname, sizeof(outname), "%s.zst", name);
+    if ((out = fopen(outname, "wx")) == NULL) {
+	fprintf(stderr, "%s: cannot create %s: %s\n",
+			pmGetProgname(), outname, strerror(errno));
+	fclose(in);
+	return -1;
+    }
+
+    while ((n = fread(src, 1, framesize, in)) > 0) {
+	csize = ZSTD_compress2(cctx, dst, dstsize, src, n);
+	if (ZSTD_isError(csize)) {
+	    fprintf(stderr, "%s: %s: %s\n",
+			pmGetProgname(), name, ZSTD_getErrorName(csize));
+	    goto fail;
+	}
+	if (fwrite(dst, 1, csize, out) != csize)
+	    goto writefail;
+	if (nframes == maxframes) {
+	    maxframes = maxframes ? maxframes * 2 : 64;
+	    if ((tp = realloc(table, maxframes * SEEKTABLE_ENTRY_SIZE)) == NULL) {
+		pmNoMem("seek table", maxframes * SEEKTABLE_ENTRY_SIZE, PM_FATAL_ERR);
+		/*NOTREACHED*/
+	    }
+	    table = tp;
+	}
+	tp = &table[nframes++ * SEEKTABLE_ENTRY_SIZE];
+	put_le32(tp, csize);
+	put_le32(tp + 4, n);
+	ibytes += n;
+	obytes += csize;
+    }
+    if (ferror(in)) {
+	fprintf(stderr, "%s: read error on %s: %s\n",
+			pmGetProgname(), name, strerror(errno));
+	goto fail;
+    }
+
+    /* seek table, as a skippable frame */
+    tablesize = nframes * SEEKTABLE_ENTRY_SIZE + SEEKTABLE_FOOTER_SIZE;
+    put_le32(buf, SEEKTABLE_SKIPPABLE_MAGIC);
+    put_le32(buf + 4, tablesize);
+    if (fwrite(buf, 1, 8, out) != 8)
+	goto writefail;
+    if (nframes && fwrite(table, SEEKTABLE_ENTRY_SIZE, nframes, out) != nframes)
+	goto writefail;
+    put_le32(buf, nframes);
+    buf[4] = 0;		/* descriptor: no checksums */
+    put_le32(buf + 5, SEEKTABLE_MAGIC);
+    if (fwrite(buf, 1, SEEKTABLE_FOOTER_SIZE, out) != SEEKTABLE_FOOTER_SIZE)
+	goto writefail;
+    obytes += tablesize + 8;
+    if (fflush(out) != 0 || fsync(fileno(out)) < 0)
+	goto writefail;
+
+    /* like xz(1) and friends, preserve permissions and times */
+    fchmod(fileno(out), sbuf.st_mode & 07777);
+    times[0].tv_sec = sbuf.st_atime;
+    times[0].tv_usec = 0;
+    times[1].tv_sec = sbuf.st_mtime;
+    times[1].tv_usec = 0;
+    fclose(out);
+    utimes(outname, times);
+    fclose(in);
+    free(table);
+
+    if (vflag)
+	printf("%s: %llu -> %llu bytes, %u frames\n", name,
+		(unsigned long long)ibytes, (unsigned long long)obytes, nframes);
+    if (!kflag && unlink(name) < 0) {
+	fprintf(stderr, "%s: cannot remove %s: %s\n",
+			pmGetProgname(), name, strerror(errno));
+	return -1;
+    }
+    return 0;
+
+writefail:
+    fprintf(stderr, "%s: write error on %s: %s\n",
+			pmGetProgname(), outname, strerror(errno));
+fail:
+    fclose(out);
+    fclose(in);
+    unlink(outname);
+    free(table);
+    return -1;
+}
+
+int
+main(int argc, char **argv)
+{
+    int		c;
+    int		sts = 0;
+    char	*src, *dst;
+    char	*endnum;
+    size_t	dstsize;
+    ZSTD_CCtx	*cctx;
+
+    while ((c = pmGetOptions(argc, argv, &opts)) != EOF) {
+	switch (c) {
+
+	case 'b':	/* uncompressed frame size */
+	    if (parse_size(opts.optarg, &framesize) < 0) {
+		pmprintf("%s: -b requires a size argument (1 to 1g bytes)\n",
+			pmGetProgname());
+		opts.errors++;
+	    }
+	    break;
+
+	case 'k':	/* keep input files */
+	    kflag = 1;
+	    break;
+
+	case 'l':	/* compression level */
+	    level = (int)strtol(opts.optarg, &endnum, 10);
+	    if (*endnum != '\0' ||
+		level < ZSTD_minCLevel() || level > ZSTD_maxCLevel()) {
+		pmprintf("%s: -l requires a compression level (%d to %d)\n",
+			pmGetProgname(), ZSTD_minCLevel(), ZSTD_maxCLevel());
+		opts.errors++;
+	    }
+	    break;
+
+	case 'v':	/* verbose */
+	    vflag = 1;
+	    break;
+
+	default:
+	    opts.errors++;
+	    break;
+	}
+    }
+
+    if (opts.errors || opts.optind >= argc) {
+	pmUsageMessage(&opts);
+	exit(1);
+    }
+
+    if ((cctx = ZSTD_createCCtx()) == NULL) {
+	fprintf(stderr, "%s: cannot create zstd context\n", pmGetProgname());
+	exit(1);
+    }
+    ZSTD_CCtx_setParameter(cctx, ZSTD_c_compressionLevel, level);
+    ZSTD_CCtx_setParameter(cctx, ZSTD_c_checksumFlag, 1);
+    ZSTD_CCtx_setParameter(cctx, ZSTD_c_contentSizeFlag, 1);
+
+    dstsize = ZSTD_compressBound(framesize);
+    if ((src = malloc(framesize)) == NULL) {
+	pmNoMem("frame", framesize, PM_FATAL_ERR);
+	/*NOTREACHED*/
+    }
+    if ((dst = malloc(dstsize)) == NULL) {
+	pmNoMem("compressed frame", dstsize, PM_FATAL_ERR);
+	/*NOTREACHED*/
+    }
+
+    for (c = opts.optind; c < argc; c++) {
+	if (compress_file(argv[c], cctx, src, dst, dstsize) < 0)
+	    sts = 1;
+    }
+
+    ZSTD_freeCCtx(cctx);
+    free(src);
+    free(dst);
+    exit(sts);
+}
@@ -2471,7 +2471,9 @@ checkwinend(__pmTimestamp *tsp)
 		    fputc('\n', stderr);
 		}
 		if (iap->_result != iap->_Nresult) {
-		    free(iap->_Nresult);
+		    /* pmValueSets belong to _result */
+		    iap->_Nresult->numpmid = 0;
+		    __pmFreeResult(iap->_Nresult);
 		}
 		if (iap->_result != NULL) {
 		    __pmFreeResult(iap->_result);
@@ -3262,7 +3264,8 @@ main(int argc, char **argv)
 			}
 		    }
 		}
-		free(iap->_Nresult);
+		iap->_Nresult->numpmid = 0;
+		__pmFreeResult(iap->_Nresult);
 	    }
 	    if (iap->_result != NULL) {
 		__pmFreeResult(iap->_result);
@@ -16,6 +16,7 @@
 #include "logger.h"
 
 int	last_log_offset;
+off_t	index_interval = 100000;
 
 #define IS_DERIVED_LOGGED(x) (pmID_domain(x) == DYNAMIC_PMID && (pmID_cluster(x) & 2048) == 2048 && pmID_item(x) != 0)
 #define SET_DERIVED_LOGGED(x) pmID_build(pmID_domain(x), 2048 | pmID_cluster(x), pmID_item(x))
@@ -604,7 +605,7 @@ do_work(task_t *tp)
     int			changed;
     int			needindom;
     int			needti;
-    static off_t	flushsize = 100000;
+    static off_t	flushsize = -1;
     long		old_meta_offset;
     long		label_offset;
     long		new_offset;
@@ -625,6 +626,10 @@ do_work(task_t *tp)
 	/* ignore callbacks until all of the config file has been parsed */
 	return;
 
+    if (flushsize < 0)
+	/* first temporal index entry after $PMLOGGER_INDEX_INTERVAL bytes */
+	flushsize = index_interval;
+
     /* find AFctl_t for this afid */
     for (acp = achead; acp != (AFctl_t *)0; acp = acp->ac_next) {
 	if (acp->ac_afid == tp->t_afid)
@@ -1059,7 +1064,7 @@ do_work(task_t *tp)
 	     */
 	    __pmFseek(archctl.ac_mfp, new_offset, SEEK_SET);
 	    __pmFseek(logctl.mdfp, new_meta_offset, SEEK_SET);
-	    flushsize = __pmFtell(archctl.ac_mfp) + 100000;
+	    flushsize = __pmFtell(archctl.ac_mfp) + index_interval;
 	}
 
 	last_stamp = resp->timestamp;	/* struct assignment */
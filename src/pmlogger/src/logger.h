@@ -123,6 +123,9 @@ extern __pmTimestamp	epoch;
 /* offset to start of last written result */
 extern int	last_log_offset;
 
+/* data volume bytes between temporal index entries, 0 for every result */
+extern off_t	index_interval;
+
 /* yylex() gets input from here ... */
 extern FILE		*fconfig;
 extern FILE		*yyin;
@@ -1189,6 +1189,24 @@ main(int argc, char **argv)
 	exit(1);
     }
 
+    /* temporal index density, in bytes of data volume between entries */
+    if ((endnum = getenv("PMLOGGER_INDEX_INTERVAL")) != NULL) {
+	long	bytes = strtol(endnum, &p, 10);
+
+	if (*p != '\0' || bytes < 0)
+	    fprintf(stderr, "%s: Warning: bad $PMLOGGER_INDEX_INTERVAL: \"%s\" ignored\n",
+		    pmGetProgname(), endnum);
+	else
+	    index_interval = bytes;
+    }
+
+    /* compress data volumes as they are written */
+    if ((endnum = getenv("PMLOGGER_COMPRESS")) != NULL && *endnum != '\0') {
+	if ((sts = __pmLogSetCompression(endnum)) < 0)
+	    fprintf(stderr, "%s: Warning: $PMLOGGER_COMPRESS: \"%s\" ignored: %s\n",
+		    pmGetProgname(), endnum, pmErrStr(sts));
+    }
+
     if (getenv("PMLOGGER_REEXEC") != NULL) {
 	/*
 	 * We have been re-exec'd. See run_done(). This flag indicates
@@ -130,7 +130,7 @@ rewrite(__pmResult *rp)
 	 * to be written because it looks like a "mark" record with
 	 * numpmid == 0
 	 */
-	free(orp);
+	__pmFreeResult(orp);
 	orp = NULL;
     }
 
@@ -176,6 +176,7 @@ rewrite_free(void)
 	free(vsp);
     }
 
-    free(orp);
+    orp->numpmid = 0;
+    __pmFreeResult(orp);
     orp = NULL;
 }
@@ -102,8 +102,7 @@ cleanup(int all)
 	    /* free hash table for instance values */
 	    __pmHashWalkCB(hash_cb, metricp, &metricp->values);
 	    /* free hash table */
-	    if (metricp->values.hash != NULL)
-		free(metricp->values.hash);
+	    __pmHashClear(&metricp->values);
 	    /* reset hash table */
 	    __pmHashInit(&metricp->values);
 	}
@@ -0,0 +1,104 @@
+/*
+ * Compile a PCP PMNS for fast loading
+ *
+ * Copyright (c) 2026 Red Hat.
+ * 
+ * This program is free software; you can redistribute it and/or modify it
+ * under the terms of the GNU General Public License as published by the
+ * Free Software Foundation; either version 2 of the License, or (at your
+ * option) any later version.
+ * 
+ * This program is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of MERCHANTABILITY
+ * or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU General Public License
+ * for more details.
+ */
+
+#include "pmapi.h"
+#include "libpcp.h"
+
+static pmLongOptions longopts[] = {
+    PMAPI_OPTIONS_HEADER("Options"),
+    PMOPT_DEBUG,
+    PMOPT_NAMESPACE,
+    PMOPT_HELP,
+    PMAPI_OPTIONS_END
+};
+
+static pmOptions opts = {
+    .short_options = "D:n:?",
+    .long_options = longopts,
+    .short_usage = "[options] [outfile]",
+};
+
+int
+main(int argc, char **argv)
+{
+    int		sep = pmPathSeparator();
+    int		sts;
+    int		c;
+    char	*p;
+    char	pmnsfile[MAXPATHLEN];
+    char	outfname[MAXPATHLEN];
+
+    /* no derived or anon metrics, please */
+    __pmSetInternalState(PM_STATE_PMCS);
+
+    if ((p = getenv("PMNS_DEFAULT")) != NULL) {
+	pmstrncpy(pmnsfile, sizeof(pmnsfile), p);
+    } else {
+	pmsprintf(pmnsfile, sizeof(pmnsfile), "%s%c" "pmns" "%c" "root",
+		pmGetConfig("PCP_VAR_DIR"), sep, sep);
+    }
+
+    while ((c = pmgetopt_r(argc, argv, &opts)) != EOF) {
+	switch (c) {
+
+	case 'D':	/* debug options */
+	    if ((sts = pmSetDebug(opts.optarg)) < 0) {
+		fprintf(stderr, "%s: unrecognized debug options specification (%s)\n",
+			pmGetProgname(), opts.optarg);
+		opts.errors++;
+	    }
+	    break;
+
+	case 'n':	/* alternative name space file */
+	    pmstrncpy(pmnsfile, sizeof(pmnsfile), opts.optarg);
+	    break;
+
+	case '?':
+	default:
+	    opts.errors++;
+	    break;
+	}
+    }
+
+    if (opts.errors || opts.optind < argc - 1) {
+	pmUsageMessage(&opts);
+	exit(1);
+    }
+
+    /* default output is alongside the PMNS, where pmLoadNameSpace looks */
+    if (opts.optind < argc)
+	pmstrncpy(outfname, sizeof(outfname), argv[opts.optind]);
+    else
+	pmsprintf(outfname, sizeof(outfname), "%s.bin", pmnsfile);
+
+    /*
+     * parsed exactly as pmLoadNameSpace would (no cpp), as that is
+     * when the compiled PMNS is used in place of pmnsfile
+     */
+    if ((sts = pmLoadNameSpace(pmnsfile)) < 0) {
+	fprintf(stderr, "%s: Error: pmLoadNameSpace(%s): %s\n",
+		pmGetProgname(), pmnsfile, pmErrStr(sts));
+	exit(1);
+    }
+
+    if ((sts = __pmCompilePMNS(__pmExportPMNS(), pmnsfile, outfname)) < 0) {
+	fprintf(stderr, "%s: Error: cannot create %s: %s\n",
+		pmGetProgname(), outfname, pmErrStr(sts));
+	exit(1);
+    }
+
+    exit(0);
+}
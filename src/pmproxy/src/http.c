@@ -17,10 +17,27 @@
 #include "encoding.h"
 #include "dict.h"
 #include "util.h"
+#ifdef HAVE_ZLIB
+#include <zlib.h>
+#endif
+#ifdef HAVE_ZSTD
+#include <zstd.h>
+#endif
 
 static int chunked_transfer_size; /* pmproxy.chunksize, pagesize by default */
 static int smallest_buffer_size = 128;
 
+static int compression;		/* pmproxy.compression, enabled by default */
+static int compression_level;	/* pmproxy.compression.level */
+static int compression_minsize;	/* pmproxy.compression.minsize (bytes) */
+
+static const char * const encoding_names[] = {
+    [HTTP_ENCODING_IDENTITY]	= "identity",
+    [HTTP_ENCODING_DEFLATE]	= "deflate",
+    [HTTP_ENCODING_GZIP]	= "gzip",
+    [HTTP_ENCODING_ZSTD]	= "zstd",
+};
+
 /* https://tools.ietf.org/html/rfc7230#section-3.1.1 */
 #define MAX_URL_SIZE	8192
 #define MAX_PARAMS_SIZE 8000
@@ -221,6 +238,10 @@ http_response_header(struct client *client, unsigned int length, http_code_t sts
 
     header = sdscatfmt(header, "Content-Type: %s%s\r\n",
 		http_content_type(flags), http_content_encoding(flags));
+    if (flags & HTTP_FLAG_COMPRESS)
+	header = sdscatfmt(header, "Content-Encoding: %s\r\n"
+				   "Vary: Accept-Encoding\r\n",
+			encoding_names[client->u.http.encoding]);
     header = sdscatfmt(header, "Date: %s\r\n\r\n",
 		http_date_string(time(NULL), date, sizeof(date)));
 
@@ -375,17 +396,269 @@ http_response_access(struct client *client, http_code_t sts, http_options_t opti
     return header;
 }
 
+static int
+http_encoding_supported(http_encoding_t encoding)
+{
+    switch (encoding) {
+#ifdef HAVE_ZLIB
+    case HTTP_ENCODING_DEFLATE:
+    case HTTP_ENCODING_GZIP:
+	return 1;
+#endif
+#ifdef HAVE_ZSTD
+    case HTTP_ENCODING_ZSTD:
+	return 1;
+#endif
+    default:
+	break;
+    }
+    return 0;
+}
+
+/*
+ * Choose the response Content-Encoding from an Accept-Encoding request
+ * header (RFC 7231 section 5.3.4) - the supported coding with highest
+ * q-value, ties broken by our own preference (zstd, gzip, deflate).
+ * Codings not mentioned take the "*" q-value, q=0 means unacceptable.
+ */
+static http_encoding_t
+http_accept_encoding(const char *value)
+{
+    http_encoding_t	encoding, best = HTTP_ENCODING_IDENTITY;
+    double		qvalues[HTTP_ENCODING_ZSTD + 1], qstar = 0.0, q, bestq = 0.0;
+    const char		*p = value, *name;
+    char		*endnum;
+    size_t		length;
+
+    for (encoding = 0; encoding <= HTTP_ENCODING_ZSTD; encoding++)
+	qvalues[encoding] = -1.0;	/* not mentioned */
+
+    while (*p != '\0') {
+	while (*p == ',' || isspace((int)*p))
+	    p++;
+	if (*p == '\0')
+	    break;
+	for (name = p; *p != '\0' && *p != ',' && *p != ';' && !isspace((int)*p); p++)
+	    ;
+	length = p - name;
+
+	/* optional parameters - only the q-value is of interest */
+	q = 1.0;
+	while (*p != '\0' && *p != ',') {
+	    if (*p++ != ';')
+		continue;
+	    while (isspace((int)*p))
+		p++;
+	    if ((*p == 'q' || *p == 'Q') && p[1] == '=') {
+		q = strtod(p + 2, &endnum);
+		p = endnum;
+	    }
+	}
+
+	if (length == 1 && *name == '*')
+	    qstar = q;
+	else if (length == 4 && strncasecmp(name, "zstd", 4) == 0)
+	    qvalues[HTTP_ENCODING_ZSTD] = q;
+	else if ((length == 4 && strncasecmp(name, "gzip", 4) == 0) ||
+		 (length == 6 && strncasecmp(name, "x-gzip", 6) == 0))
+	    qvalues[HTTP_ENCODING_GZIP] = q;
+	else if (length == 7 && strncasecmp(name, "deflate", 7) == 0)
+	    qvalues[HTTP_ENCODING_DEFLATE] = q;
+    }
+
+    for (encoding = HTTP_ENCODING_ZSTD; encoding > HTTP_ENCODING_IDENTITY; encoding--) {
+	if (!http_encoding_supported(encoding))
+	    continue;
+	q = qvalues[encoding] < 0.0 ? qstar : qvalues[encoding];
+	if (q > bestq) {
+	    bestq = q;
+	    best = encoding;
+	}
+    }
+    return best;
+}
+
+static void
+http_encoder_release(struct client *client)
+{
+    void		*encoder = client->u.http.encoder;
+
+    if (encoder == NULL)
+	return;
+    switch (client->u.http.encoding) {
+#ifdef HAVE_ZLIB
+    case HTTP_ENCODING_DEFLATE:
+    case HTTP_ENCODING_GZIP:
+	deflateEnd((z_stream *)encoder);
+	free(encoder);
+	break;
+#endif
+#ifdef HAVE_ZSTD
+    case HTTP_ENCODING_ZSTD:
+	ZSTD_freeCCtx((ZSTD_CCtx *)encoder);
+	break;
+#endif
+    default:
+	break;
+    }
+    client->u.http.encoder = NULL;
+}
+
+#ifdef HAVE_ZLIB
+static sds
+http_compress_zlib(struct client *client, const char *input, size_t length,
+		int finish, sds output)
+{
+    z_stream		*stream = (z_stream *)client->u.http.encoder;
+    char		buffer[16384];
+    int			bits, sts;
+    int			level = compression_level;
+
+    if (stream == NULL) {
+	if ((stream = calloc(1, sizeof(z_stream))) == NULL)
+	    goto fail;
+	if (level > Z_BEST_COMPRESSION)
+	    level = Z_BEST_COMPRESSION;
+	/* +16 selects the gzip (rather than zlib) wrapper for deflate */
+	bits = (client->u.http.encoding == HTTP_ENCODING_GZIP) ? 15 + 16 : 15;
+	if (deflateInit2(stream, level, Z_DEFLATED,
+			bits, 8, Z_DEFAULT_STRATEGY) != Z_OK) {
+	    free(stream);
+	    goto fail;
+	}
+	client->u.http.encoder = stream;
+    }
+
+    stream->next_in = (Bytef *)input;
+    stream->avail_in = length;
+    do {
+	stream->next_out = (Bytef *)buffer;
+	stream->avail_out = sizeof(buffer);
+	if ((sts = deflate(stream, finish ? Z_FINISH : Z_SYNC_FLUSH)) == Z_STREAM_ERROR)
+	    goto fail;
+	output = sdscatlen(output, buffer, sizeof(buffer) - stream->avail_out);
+    } while (stream->avail_out == 0);
+    return output;
+
+fail:
+    sdsfree(output);
+    return NULL;
+}
+#endif
+
+#ifdef HAVE_ZSTD
+static sds
+http_compress_zstd(struct client *client, const char *input, size_t length,
+		int finish, sds output)
+{
+    ZSTD_CCtx		*cctx = (ZSTD_CCtx *)client->u.http.encoder;
+    ZSTD_inBuffer	in = { input, length, 0 };
+    ZSTD_outBuffer	out;
+    char		buffer[16384];
+    size_t		remaining;
+
+    if (cctx == NULL) {
+	if ((cctx = ZSTD_createCCtx()) == NULL)
+	    goto fail;
+	ZSTD_CCtx_setParameter(cctx, ZSTD_c_compressionLevel, compression_level);
+	client->u.http.encoder = cctx;
+    }
+
+    do {
+	out.dst = buffer;
+	out.size = sizeof(buffer);
+	out.pos = 0;
+	remaining = ZSTD_compressStream2(cctx, &out, &in,
+				finish ? ZSTD_e_end : ZSTD_e_flush);
+	if (ZSTD_isError(remaining))
+	    goto fail;
+	output = sdscatlen(output, buffer, out.pos);
+    } while (remaining != 0);
+    return output;
+
+fail:
+    sdsfree(output);
+    return NULL;
+}
+#endif
+
+/*
+ * Encode (more of) a response body using the negotiated Content-Encoding,
+ * returning a new buffer with the encoded bytes, or NULL on failure.  The
+ * output is flushed on each call so that every chunk of a streamed reply
+ * can be decoded by the client as soon as it arrives.  The encoder state
+ * is released once the final call (finish set) has been made.
+ */
+static sds
+http_compress(struct client *client, const char *input, size_t length, int finish)
+{
+    sds			output = sdsempty();
+
+    switch (client->u.http.encoding) {
+#ifdef HAVE_ZLIB
+    case HTTP_ENCODING_DEFLATE:
+    case HTTP_ENCODING_GZIP:
+	output = http_compress_zlib(client, input, length, finish, output);
+	break;
+#endif
+#ifdef HAVE_ZSTD
+    case HTTP_ENCODING_ZSTD:
+	output = http_compress_zstd(client, input, length, finish, output);
+	break;
+#endif
+    default:
+	sdsfree(output);
+	output = NULL;
+	break;
+    }
+
+    if (output == NULL || finish)
+	http_encoder_release(client);
+    if (output == NULL)
+	fprintf(stderr, "%s: %s compression failed for client %p\n",
+		"http_compress", encoding_names[client->u.http.encoding], client);
+    return output;
+}
+
+/* prepend a chunked transfer encoding message length (hex), append CRLF */
+static sds
+http_chunk(sds buffer, const char *content, size_t length)
+{
+    buffer = sdscatprintf(buffer, "%lX\r\n", (unsigned long)length);
+    buffer = sdscatlen(buffer, content, length);
+    return sdscatlen(buffer, "\r\n", 2);
+}
+
 void
 http_reply(struct client *client, sds message,
 		http_code_t sts, http_flags_t type, http_options_t options)
 {
     enum http_flags	flags = client->u.http.flags;
     char		length[32]; /* hex length */
-    sds			buffer, suffix;
+    sds			buffer, suffix, encoded;
 
     if (flags & HTTP_FLAG_STREAMING) {
 	buffer = sdsempty();
-	if (client->buffer == NULL) {	/* no data currently accumulated */
+	if (flags & HTTP_FLAG_COMPRESS) {
+	    /* encode any remaining content and end the compressed stream */
+	    if ((suffix = client->buffer) == NULL)
+		suffix = sdsempty();
+	    if (message != NULL)
+		suffix = sdscatsds(suffix, message);
+	    client->buffer = NULL;
+	    encoded = http_compress(client, suffix, sdslen(suffix), 1);
+	    sdsfree(suffix);
+	    if (encoded == NULL) {
+		/* cannot recover mid-stream - truncate the response */
+		sdsfree(message);
+		sdsfree(buffer);
+		client->u.http.flags &= ~(HTTP_FLAG_STREAMING | HTTP_FLAG_COMPRESS);
+		client_close(client);
+		return;
+	    }
+	    buffer = http_chunk(buffer, encoded, sdslen(encoded));
+	    sdsfree(encoded);
+	} else if (client->buffer == NULL) {	/* no data currently accumulated */
 	    pmsprintf(length, sizeof(length), "%lX", (unsigned long)sdslen(message));
 	    buffer = sdscatfmt(buffer, "%s\r\n%S\r\n", length, message);
 	} else if (message != NULL) {
@@ -400,7 +673,8 @@ http_reply(struct client *client, sds message,
 	client->buffer = NULL;
 
 	suffix = sdsnewlen("0\r\n\r\n", 5);		/* chunked suffix */
-	client->u.http.flags &= ~HTTP_FLAG_STREAMING;	/* end of stream! */
+	/* end of stream! */
+	client->u.http.flags &= ~(HTTP_FLAG_STREAMING | HTTP_FLAG_COMPRESS);
 
     } else if (flags & HTTP_FLAG_NO_BODY) {
 	if (client->u.http.parser.method == HTTP_OPTIONS)
@@ -420,6 +694,13 @@ http_reply(struct client *client, sds message,
 	} else {
 	    suffix = sdsempty();
 	}
+	if (client->u.http.encoding != HTTP_ENCODING_IDENTITY &&
+	    sdslen(suffix) >= compression_minsize &&
+	    (encoded = http_compress(client, suffix, sdslen(suffix), 1)) != NULL) {
+	    sdsfree(suffix);
+	    suffix = encoded;
+	    type |= HTTP_FLAG_COMPRESS;
+	}
 	buffer = http_response_header(client, sdslen(suffix), sts, type);
     }
 
@@ -475,25 +756,45 @@ http_transfer(struct client *client)
     /* If the client buffer length is now beyond a set maximum size,
      * send it using chunked transfer encoding.  Once buffer pointer
      * is copied into the uv_buf_t, clear it in the client, and then
-     * return control to caller.
+     * return control to caller.  With a negotiated Content-Encoding
+     * each chunk is compressed (and flushed) as it is sent.
      */
     if (sdslen(client->buffer) >= chunked_transfer_size) {
 	if (parser->http_major == 1 && parser->http_minor > 0) {
 	    if (!(flags & HTTP_FLAG_STREAMING)) {
 		/* send headers (no content length) and initial content */
 		flags |= HTTP_FLAG_STREAMING;
+		if (client->u.http.encoding != HTTP_ENCODING_IDENTITY)
+		    flags |= HTTP_FLAG_COMPRESS;
 		buffer = http_response_header(client, 0, HTTP_STATUS_OK, flags);
 		client->u.http.flags = flags;
 	    } else {
 		/* headers already sent, send the next chunk of content */
 		buffer = sdsempty();
 	    }
-	    /* prepend a chunked transfer encoding message length (hex) */
-	    buffer = sdscatprintf(buffer, "%lX\r\n",
+	    if (flags & HTTP_FLAG_COMPRESS) {
+		suffix = http_compress(client, client->buffer,
+					sdslen(client->buffer), 0);
+		sdsfree(client->buffer);
+		client->buffer = NULL;
+		if (suffix == NULL) {
+		    /* cannot recover mid-stream - truncate the response */
+		    sdsfree(buffer);
+		    client->u.http.flags &= ~(HTTP_FLAG_STREAMING | HTTP_FLAG_COMPRESS);
+		    client_close(client);
+		    return;
+		}
+		buffer = sdscatprintf(buffer, "%lX\r\n",
+				 (unsigned long)sdslen(suffix));
+		suffix = sdscatfmt(suffix, "\r\n");
+	    } else {
+		/* prepend a chunked transfer encoding message length (hex) */
+		buffer = sdscatprintf(buffer, "%lX\r\n",
 				 (unsigned long)sdslen(client->buffer));
-	    suffix = sdscatfmt(client->buffer, "\r\n");
-	    /* reset for next call - original released on I/O completion */
-	    client->buffer = NULL;	/* safe, as now held in 'suffix' */
+		suffix = sdscatfmt(client->buffer, "\r\n");
+		/* reset for next call - original released on I/O completion */
+		client->buffer = NULL;	/* safe, as now held in 'suffix' */
+	    }
 
 	    if (pmDebugOptions.http) {
 		method = http_method_str(client->u.http.parser.method);
@@ -524,6 +825,9 @@ http_client_release(struct client *client)
     client->u.http.servlet = NULL;
     client->u.http.flags = 0;
 
+    http_encoder_release(client);
+    client->u.http.encoding = HTTP_ENCODING_IDENTITY;
+
     if (client->u.http.headers) {
 	dictRelease(client->u.http.headers);
 	client->u.http.headers = NULL;
@@ -786,6 +1090,10 @@ on_header_value(http_parser *request, const char *offset, size_t length)
     dictSetVal(client->u.http.headers, entry, value);
     field = (sds)dictGetKey(entry);
 
+    /* HTTP response compression for all servlets */
+    if (compression && strcasecmp(field, "Accept-Encoding") == 0)
+	client->u.http.encoding = http_accept_encoding(value);
+
     /* HTTP Basic Auth for all servlets */
     if (strncmp(field, "Authorization", 14) == 0 &&
 	strncmp(value, "Basic ", 6) == 0) {
@@ -984,6 +1292,21 @@ setup_http_module(struct proxy *proxy)
     if (chunked_transfer_size < smallest_buffer_size)
 	chunked_transfer_size = smallest_buffer_size;
 
+    if ((option = pmIniFileLookup(config, "pmproxy", "compression")) != NULL)
+	compression = (strcmp(option, "true") == 0);
+    else
+	compression = 1;
+    if ((option = pmIniFileLookup(config, "pmproxy", "compression.level")) != NULL)
+	compression_level = atoi(option);
+    else
+	compression_level = 1;	/* fastest, yet effective for JSON and text */
+    if (compression_level < 1)
+	compression_level = 1;
+    if ((option = pmIniFileLookup(config, "pmproxy", "compression.minsize")) != NULL)
+	compression_minsize = atoi(option);
+    else
+	compression_minsize = 1024;
+
     HEADER_ACCESS_CONTROL_REQUEST_HEADERS = sdsnew("Access-Control-Request-Headers");
     HEADER_ACCESS_CONTROL_REQUEST_METHOD = sdsnew("Access-Control-Request-Method");
     HEADER_ACCESS_CONTROL_ALLOW_METHODS = sdsnew("Access-Control-Allow-Methods");
@@ -42,6 +42,15 @@ typedef enum http_flags {
     /* maximum 16 for server.h */
 } http_flags_t;
 
+/* response Content-Encoding, in increasing order of preference */
+typedef enum http_encoding {
+    HTTP_ENCODING_IDENTITY	= 0,
+    HTTP_ENCODING_DEFLATE	= 1,
+    HTTP_ENCODING_GZIP		= 2,
+    HTTP_ENCODING_ZSTD		= 3,
+    /* maximum 256 for server.h */
+} http_encoding_t;
+
 typedef enum http_options {
     HTTP_OPT_GET	= (1 << HTTP_GET),
     HTTP_OPT_PUT	= (1 << HTTP_PUT),
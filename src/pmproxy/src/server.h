@@ -91,8 +91,11 @@ typedef struct http_client {
     sds			realm;		/* optional Basic Auth realm */
     void		*privdata;	/* private HTTP parsing state */
     void		*data;		/* opaque servlet information */
+    void		*encoder;	/* response compression state */
     unsigned int	type : 16;	/* HTTP response content type */
     unsigned int	flags : 16;	/* request status flags field */
+    unsigned int	encoding : 8;	/* negotiated Content-Encoding */
+    unsigned int	pad : 24;
 } http_client_t;
 
 typedef struct pcp_client {